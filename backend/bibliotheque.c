@@ -1,33 +1,292 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
 
 #include "bibliotheque.h"
 
+// Comparaison sans casse, sans allouer de copie "pliee" du titre
+static int comparer_ci(const char *a, const char *b){
+    while (*a && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+        a++;
+        b++;
+    }
+    return tolower((unsigned char) *a) - tolower((unsigned char) *b);
+}
+
+static int cmp_annee(const Livre *a, const Livre *b){
+    if (a->annee != b->annee)
+        return (a->annee < b->annee) ? -1 : 1;
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+static int cmp_titre(const Livre *a, const Livre *b){
+    int c = comparer_ci(a->titre, b->titre);
+    if (c != 0)
+        return c;
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+// Decennie d'une annee, arrondie vers le bas (-5 -> -10)
+static int decennie_de(int annee){
+    return (annee >= 0) ? (annee / 10) * 10 : -(((-annee) + 9) / 10) * 10;
+}
+
+static IndexCategorie *categorie_trouver(const Bibliotheque *bibli, const char *nom){
+    for (size_t i = 0; i < bibli->nb_categories; i++) {
+        if (comparer_ci(bibli->categories[i].nom, nom) == 0)
+            return &bibli->categories[i];
+    }
+    return NULL;
+}
+
+static IndexCategorie *categorie_obtenir(Bibliotheque *bibli, const char *nom){
+    IndexCategorie *cat = categorie_trouver(bibli, nom);
+    if (cat != NULL)
+        return cat;
+    if (bibli->nb_categories == bibli->cap_categories) {
+        size_t cap = bibli->cap_categories ? bibli->cap_categories * 2 : 8;
+        IndexCategorie *tmp = realloc(bibli->categories, cap * sizeof(IndexCategorie));
+        if (tmp == NULL)
+            return NULL;
+        bibli->categories = tmp;
+        bibli->cap_categories = cap;
+    }
+    cat = &bibli->categories[bibli->nb_categories++];
+    strncpy(cat->nom, nom, sizeof(cat->nom) - 1);
+    cat->nom[sizeof(cat->nom) - 1] = '\0';
+    bitmap_init(&cat->livres);
+    return cat;
+}
+
+static IndexDecennie *decennie_trouver(const Bibliotheque *bibli, int decennie){
+    for (size_t i = 0; i < bibli->nb_decennies; i++) {
+        if (bibli->decennies[i].decennie == decennie)
+            return &bibli->decennies[i];
+    }
+    return NULL;
+}
+
+static IndexDecennie *decennie_obtenir(Bibliotheque *bibli, int decennie){
+    IndexDecennie *dec = decennie_trouver(bibli, decennie);
+    if (dec != NULL)
+        return dec;
+    if (bibli->nb_decennies == bibli->cap_decennies) {
+        size_t cap = bibli->cap_decennies ? bibli->cap_decennies * 2 : 16;
+        IndexDecennie *tmp = realloc(bibli->decennies, cap * sizeof(IndexDecennie));
+        if (tmp == NULL)
+            return NULL;
+        bibli->decennies = tmp;
+        bibli->cap_decennies = cap;
+    }
+    dec = &bibli->decennies[bibli->nb_decennies++];
+    dec->decennie = decennie;
+    bitmap_init(&dec->livres);
+    return dec;
+}
+
+static Bool index_id_reserver(Bibliotheque *bibli, int id){
+    if (id <= 0 || id > BIBLIO_ID_MAX)
+        return FAUX;
+    if ((size_t) id < bibli->cap_id)
+        return VRAI;
+    size_t cap = bibli->cap_id ? bibli->cap_id : 64;
+    while (cap <= (size_t) id) cap *= 2;
+    if (cap > (size_t) BIBLIO_ID_MAX + 1)
+        cap = (size_t) BIBLIO_ID_MAX + 1;
+    Livre **tmp = realloc(bibli->par_id, cap * sizeof(Livre *));
+    if (tmp == NULL)
+        return FAUX;
+    memset(tmp + bibli->cap_id, 0, (cap - bibli->cap_id) * sizeof(Livre *));
+    bibli->par_id = tmp;
+    bibli->cap_id = cap;
+    return VRAI;
+}
+
+// En lot, le livre attend biblio_lot_fin pour entrer dans les skiplists
+static Bool lot_retenir(Bibliotheque *bibli, Livre *livre){
+    if (bibli->nb_lot == bibli->cap_lot) {
+        size_t cap = bibli->cap_lot ? bibli->cap_lot * 2 : 1024;
+        Livre **tmp = realloc(bibli->lot, cap * sizeof(Livre *));
+        if (tmp == NULL)
+            return FAUX;
+        bibli->lot = tmp;
+        bibli->cap_lot = cap;
+    }
+    bibli->lot[bibli->nb_lot++] = livre;
+    return VRAI;
+}
+
+// FAUX sans rien toucher si par_id ne peut pas recevoir cet id
+static Bool index_ajouter(Bibliotheque *bibli, Livre *livre){
+    if (!index_id_reserver(bibli, livre->id))
+        return FAUX;
+    if (!bibli->en_lot || !lot_retenir(bibli, livre)) {
+        skiplist_insert(&bibli->index_annee, livre);
+        skiplist_insert(&bibli->index_titre, livre);
+    }
+
+    uint32_t id = (uint32_t) livre->id;
+    bibli->par_id[id] = livre;
+    bitmap_add(&bibli->tous, id);
+    bitmap_add(livre->est_emprunte ? &bibli->empruntes : &bibli->disponibles, id);
+    IndexCategorie *cat = categorie_obtenir(bibli, livre->categorie);
+    if (cat != NULL)
+        bitmap_add(&cat->livres, id);
+    IndexDecennie *dec = decennie_obtenir(bibli, decennie_de(livre->annee));
+    if (dec != NULL)
+        bitmap_add(&dec->livres, id);
+    return VRAI;
+}
+
+static void index_retirer(Bibliotheque *bibli, const Livre *livre){
+    skiplist_remove(&bibli->index_annee, livre);
+    skiplist_remove(&bibli->index_titre, livre);
+
+    uint32_t id = (uint32_t) livre->id;
+    if ((size_t) livre->id < bibli->cap_id)
+        bibli->par_id[id] = NULL;
+    bitmap_remove(&bibli->tous, id);
+    bitmap_remove(&bibli->disponibles, id);
+    bitmap_remove(&bibli->empruntes, id);
+    IndexCategorie *cat = categorie_trouver(bibli, livre->categorie);
+    if (cat != NULL)
+        bitmap_remove(&cat->livres, id);
+    IndexDecennie *dec = decennie_trouver(bibli, decennie_de(livre->annee));
+    if (dec != NULL)
+        bitmap_remove(&dec->livres, id);
+}
+
 void biblio_init(Bibliotheque *bibli){
     if (bibli == NULL)
         return;
     hash_init(&bibli->table);
+    skiplist_init(&bibli->index_annee, cmp_annee);
+    skiplist_init(&bibli->index_titre, cmp_titre);
+    bibli->par_id = NULL;
+    bibli->cap_id = 0;
+    bitmap_init_dense(&bibli->tous);
+    bitmap_init_dense(&bibli->disponibles);
+    bitmap_init_dense(&bibli->empruntes);
+    bibli->categories = NULL;
+    bibli->nb_categories = 0;
+    bibli->cap_categories = 0;
+    bibli->decennies = NULL;
+    bibli->nb_decennies = 0;
+    bibli->cap_decennies = 0;
     bibli->nb_livres = 0;
     bibli->next_id = 1;
+    bibli->muet = FAUX;
+    bibli->en_lot = FAUX;
+    bibli->lot = NULL;
+    bibli->nb_lot = 0;
+    bibli->cap_lot = 0;
 }
 
 void biblio_free(Bibliotheque *bibli){
     if (bibli == NULL)
     return;
+    skiplist_free(&bibli->index_annee);
+    skiplist_free(&bibli->index_titre);
+    free(bibli->par_id);
+    bibli->par_id = NULL;
+    bibli->cap_id = 0;
+    bitmap_free(&bibli->tous);
+    bitmap_free(&bibli->disponibles);
+    bitmap_free(&bibli->empruntes);
+    for (size_t i = 0; i < bibli->nb_categories; i++) {
+        bitmap_free(&bibli->categories[i].livres);
+    }
+    free(bibli->categories);
+    bibli->categories = NULL;
+    bibli->nb_categories = 0;
+    bibli->cap_categories = 0;
+    for (size_t i = 0; i < bibli->nb_decennies; i++) {
+        bitmap_free(&bibli->decennies[i].livres);
+    }
+    free(bibli->decennies);
+    bibli->decennies = NULL;
+    bibli->nb_decennies = 0;
+    bibli->cap_decennies = 0;
     hash_free(&bibli->table);
+    free(bibli->lot);
+    bibli->lot = NULL;
+    bibli->nb_lot = 0;
+    bibli->cap_lot = 0;
+    bibli->en_lot = FAUX;
     bibli->nb_livres = 0;
     bibli->next_id = 1;
 }
 
-void biblio_add(Bibliotheque *bibli, const Livre *livre){
-    if (bibli == NULL || livre == NULL) return;
-    hash_insert(&bibli->table, livre);
+Bool biblio_add(Bibliotheque *bibli, const Livre *livre){
+    if (bibli == NULL || livre == NULL) return FAUX;
+    // L'index par id exige des ids positifs, uniques et au plus BIBLIO_ID_MAX
+    Livre copie;
+    if (livre->id <= 0 || livre->id > BIBLIO_ID_MAX || biblio_find_by_id(bibli, livre->id) != NULL) {
+        copie = *livre;
+        copie.id = bibli->next_id;
+        livre = &copie;
+    }
+    if (!index_id_reserver(bibli, livre->id)) {
+        printf("Livre '%s' refuse : id %d hors de l'index.\n", livre->titre, livre->id);
+        return FAUX;
+    }
+    Livre *insere = hash_insert(&bibli->table, livre);
+    if (insere == NULL) return FAUX;
+    index_ajouter(bibli, insere);  // id deja reserve
     bibli->nb_livres++;
     if (livre->id >= bibli->next_id) {
         bibli->next_id = livre->id + 1;
     }
-    printf("Le livre '%s' a ete ajoute a la bibliotheque.\n", livre->titre);
+    if (!bibli->muet && !bibli->en_lot)
+        printf("Le livre '%s' a ete ajoute a la bibliotheque.\n", livre->titre);
+    return VRAI;
+}
+
+/* Ajouts en masse (chargement de livres.dat, import) : jusqu'a
+   biblio_lot_fin, biblio_add ne touche pas aux skiplists ni a la console.
+   Les deux index tries sont alors fusionnes en un passage chacun, au lieu
+   d'une insertion par livre. Seuls des ajouts sont permis entre les deux. */
+void biblio_lot_debut(Bibliotheque *bibli){
+    if (bibli == NULL)
+        return;
+    bibli->en_lot = VRAI;
+    bibli->nb_lot = 0;
+}
+
+void biblio_lot_fin(Bibliotheque *bibli){
+    if (bibli == NULL || !bibli->en_lot)
+        return;
+    skiplist_fusionner(&bibli->index_annee, bibli->lot, bibli->nb_lot);
+    skiplist_fusionner(&bibli->index_titre, bibli->lot, bibli->nb_lot);
+    if (!bibli->muet && bibli->nb_lot > 0)
+        printf("%lu livres ajoutes a la bibliotheque.\n", (unsigned long) bibli->nb_lot);
+    free(bibli->lot);
+    bibli->lot = NULL;
+    bibli->nb_lot = 0;
+    bibli->cap_lot = 0;
+    bibli->en_lot = FAUX;
+}
+
+Livre *biblio_find_by_id(const Bibliotheque *bibli, int id){
+    if (bibli == NULL || id <= 0 || (size_t) id >= bibli->cap_id)
+        return NULL;
+    return bibli->par_id[id];
+}
+
+// Bascule l'etat d'emprunt et le bitmap des disponibles en O(1)
+void biblio_marquer_emprunte(Bibliotheque *bibli, Livre *livre, Bool emprunte){
+    if (bibli == NULL || livre == NULL)
+        return;
+    livre->est_emprunte = emprunte;
+    if (emprunte) {
+        bitmap_remove(&bibli->disponibles, (uint32_t) livre->id);
+        bitmap_add(&bibli->empruntes, (uint32_t) livre->id);
+    } else {
+        bitmap_remove(&bibli->empruntes, (uint32_t) livre->id);
+        bitmap_add(&bibli->disponibles, (uint32_t) livre->id);
+    }
 }
 
 Livre *biblio_search(Bibliotheque *bibli, const char *titre){
@@ -36,34 +295,58 @@ Livre *biblio_search(Bibliotheque *bibli, const char *titre){
     return hash_search_value(&bibli->table, titre);
 }
 
+Livre *biblio_search_etat(Bibliotheque *bibli, const char *titre, Bool emprunte){
+    if (bibli == NULL || titre == NULL)
+        return NULL;
+    Livre *premier = NULL;
+    for (NoeudLivre *n = hash_get_bucket(&bibli->table, titre)->head; n != NULL; n = n->noeudnext){
+        if (strcmp(n->data.titre, titre) != 0)
+            continue;
+        if (n->data.est_emprunte == emprunte)
+            return &n->data;
+        if (premier == NULL)
+            premier = &n->data;
+    }
+    return premier;
+}
+
 Bool biblio_emprunter(Bibliotheque *bibli, const char *titre){
-    
+    if (bibli == NULL)
+        return FAUX;
     Livre *emprunt = biblio_search(bibli, titre);
     if (emprunt == NULL){
-        printf("Livre non trouver : %s\n", titre);
+        if (!bibli->muet)
+            printf("Livre non trouver : %s\n", titre);
         return FAUX;
     }
     if (emprunt->est_emprunte == VRAI){
-        printf("Livre deja emprunter : %s\n", titre);
+        if (!bibli->muet)
+            printf("Livre deja emprunter : %s\n", titre);
         return FAUX;
     }
-    emprunt->est_emprunte = VRAI;
-    printf("Vous venez d'emprunter le livre : %s. Bonne lecture !!\n",titre);
+    biblio_marquer_emprunte(bibli, emprunt, VRAI);
+    if (!bibli->muet)
+        printf("Vous venez d'emprunter le livre : %s. Bonne lecture !!\n",titre);
     return VRAI;
 }
 
 Bool biblio_retour(Bibliotheque *bibli, const char *titre){
+    if (bibli == NULL)
+        return FAUX;
     Livre *retourne = biblio_search(bibli, titre);
     if (retourne == NULL){
-        printf("Livre non trouver : %s\n", titre);
+        if (!bibli->muet)
+            printf("Livre non trouver : %s\n", titre);
         return FAUX;
     }
     if (retourne->est_emprunte == FAUX){
-        printf("Vous n'avez pas emprunter de livre : %s\n", titre);
+        if (!bibli->muet)
+            printf("Vous n'avez pas emprunter de livre : %s\n", titre);
         return FAUX;
     }
-    retourne->est_emprunte = FAUX;
-    printf("Merci d'avoir retourner le livre : %s!\n", titre);
+    biblio_marquer_emprunte(bibli, retourne, FAUX);
+    if (!bibli->muet)
+        printf("Merci d'avoir retourner le livre : %s!\n", titre);
     return VRAI;
 }
 
@@ -120,13 +403,53 @@ void biblio_remove(Bibliotheque *bibli, const char *titre){
         return;
     Livre *livre = biblio_search(bibli, titre);
     if (livre == NULL){
-        printf("Livre non trouver : %s\n",titre);
+        if (!bibli->muet)
+            printf("Livre non trouver : %s\n",titre);
         return;
     }
-    hash_remove(&bibli->table, titre);
+    biblio_remove_livre(bibli, livre);
+}
+
+// Retire ce livre precis : les titres ne sont pas uniques (import, lots)
+void biblio_remove_livre(Bibliotheque *bibli, Livre *livre){
+    if (bibli == NULL || livre == NULL)
+        return;
+    char titre[sizeof(livre->titre)];
+    memcpy(titre, livre->titre, sizeof(titre));
+    // Hors de la table d'abord : un livre absent ne touche pas aux index
+    NoeudLivre *noeud = hash_detacher_livre(&bibli->table, livre);
+    if (noeud == NULL)
+        return;
+    index_retirer(bibli, livre);
+    free(noeud);
     bibli->nb_livres--;
 
-    printf("Le livre '%s' a ete supprime de la bibliotheque.\n", titre);
+    if (!bibli->muet)
+        printf("Le livre '%s' a ete supprime de la bibliotheque.\n", titre);
+}
+
+// Remplace les donnees d'un livre en gardant les index a jour
+void biblio_update(Bibliotheque *bibli, Livre *existant, const Livre *nouveau){
+    if (bibli == NULL || existant == NULL || nouveau == NULL)
+        return;
+    if (!index_id_reserver(bibli, nouveau->id))
+        return;
+    if (strcmp(existant->titre, nouveau->titre) != 0) {
+        NoeudLivre *noeud = hash_detacher_livre(&bibli->table, existant);
+        if (noeud == NULL)
+            return;
+        index_retirer(bibli, existant);
+        free(noeud);
+        existant = hash_insert(&bibli->table, nouveau);
+        if (existant == NULL) {
+            bibli->nb_livres--;
+            return;
+        }
+    } else {
+        index_retirer(bibli, existant);
+        *existant = *nouveau;
+    }
+    index_ajouter(bibli, existant);
 }
 void biblio_save(const Bibliotheque *bibli, const char *nom_fichier){
     if (bibli == NULL || nom_fichier == NULL)
@@ -257,3 +580,287 @@ int biblio_next_id(Bibliotheque *bibli){
     if (bibli == NULL) return 1;
     return bibli->next_id;
 }
+
+void biblio_criteres_init(CriteresLivres *crit){
+    if (crit == NULL) return;
+    crit->nb_categories = 0;
+    crit->nb_decennies = 0;
+    crit->disponible = -1;
+    crit->annee_min = INT_MIN;
+    crit->annee_max = INT_MAX;
+    crit->tri = TRI_AUCUN;
+}
+
+/* Construit dans res (initialise ici) les ids qui satisfont les filtres
+   categorie / disponibilite / decennie, par ET et OU sur les bitmaps. */
+Bool biblio_filtrer(const Bibliotheque *bibli, const CriteresLivres *crit, Bitmap *res){
+    if (bibli == NULL || crit == NULL || res == NULL)
+        return FAUX;
+    if (!bitmap_copy(res, &bibli->tous))
+        return FAUX;
+
+    if (crit->nb_categories > 0) {
+        Bitmap union_cat;
+        bitmap_init(&union_cat);
+        for (size_t i = 0; i < crit->nb_categories; i++) {
+            IndexCategorie *cat = categorie_trouver(bibli, crit->categories[i]);
+            if (cat != NULL && !bitmap_or_inplace(&union_cat, &cat->livres)) {
+                bitmap_free(&union_cat);
+                bitmap_free(res);
+                return FAUX;
+            }
+        }
+        Bool ok = bitmap_and_inplace(res, &union_cat);
+        bitmap_free(&union_cat);
+        if (!ok)
+            return FAUX;
+    }
+
+    if (crit->nb_decennies > 0) {
+        Bitmap union_dec;
+        bitmap_init(&union_dec);
+        for (size_t i = 0; i < crit->nb_decennies; i++) {
+            IndexDecennie *dec = decennie_trouver(bibli, decennie_de(crit->decennies[i]));
+            if (dec != NULL && !bitmap_or_inplace(&union_dec, &dec->livres)) {
+                bitmap_free(&union_dec);
+                bitmap_free(res);
+                return FAUX;
+            }
+        }
+        Bool ok = bitmap_and_inplace(res, &union_dec);
+        bitmap_free(&union_dec);
+        if (!ok)
+            return FAUX;
+    }
+
+    if (crit->disponible == 1) {
+        if (!bitmap_and_inplace(res, &bibli->disponibles))
+            return FAUX;
+    } else if (crit->disponible == 0) {
+        if (!bitmap_and_inplace(res, &bibli->empruntes))
+            return FAUX;
+    }
+    return VRAI;
+}
+
+static int cmp_ptr_titre(const void *a, const void *b){
+    return cmp_titre(*(Livre *const *) a, *(Livre *const *) b);
+}
+
+/* Selection ordonnee des livres :
+   - filtres categorie/disponibilite/decennie : bitmap calcule par biblio_filtrer
+   - plage d'annees ou tri par annee : parcours de index_annee depuis annee_min, O(log n + k)
+   - tri par titre seul : parcours de index_titre
+   - plage d'annees + tri par titre : plage lue sur index_annee puis tri des k resultats
+   - sinon : ids du bitmap dans l'ordre croissant
+   Si resultat n'est pas NULL, il recoit le bitmap des livres selectionnes
+   (pour le comptage des facettes) et doit etre libere par l'appelant. */
+Livre **biblio_selection(const Bibliotheque *bibli, const CriteresLivres *crit, size_t *nb, Bitmap *resultat){
+    if (bibli == NULL || crit == NULL || nb == NULL)
+        return NULL;
+    *nb = 0;
+    Bitmap filtre;
+    if (!biblio_filtrer(bibli, crit, &filtre))
+        return NULL;
+    Livre **res = malloc((bitmap_cardinal(&filtre) + 1) * sizeof(Livre *));
+    if (res == NULL) {
+        bitmap_free(&filtre);
+        return NULL;
+    }
+
+    Bool plage = (crit->annee_min != INT_MIN || crit->annee_max != INT_MAX) ? VRAI : FAUX;
+
+    if (plage || crit->tri == TRI_ANNEE) {
+        Livre cle;
+        cle.annee = crit->annee_min;
+        cle.id = INT_MIN;
+        NoeudSkip *actuel = skiplist_lower_bound(&bibli->index_annee, &cle);
+        while (actuel != NULL && actuel->livre->annee <= crit->annee_max) {
+            if (bitmap_contains(&filtre, (uint32_t) actuel->livre->id))
+                res[(*nb)++] = actuel->livre;
+            actuel = actuel->suivant[0];
+        }
+        if (crit->tri == TRI_TITRE)
+            qsort(res, *nb, sizeof(Livre *), cmp_ptr_titre);
+        if (resultat != NULL) {
+            // La plage d'annees restreint le filtre : on garde seulement les k retenus
+            bitmap_free(&filtre);
+            bitmap_init(&filtre);
+            for (size_t i = 0; i < *nb; i++) {
+                bitmap_add(&filtre, (uint32_t) res[i]->id);
+            }
+        }
+    } else {
+        uint32_t *ids = malloc((bitmap_cardinal(&filtre) + 1) * sizeof(uint32_t));
+        if (ids == NULL) {
+            free(res);
+            bitmap_free(&filtre);
+            return NULL;
+        }
+        size_t n = bitmap_to_array(&filtre, ids);
+        for (size_t i = 0; i < n; i++) {
+            Livre *livre = biblio_find_by_id(bibli, (int) ids[i]);
+            if (livre != NULL)
+                res[(*nb)++] = livre;
+        }
+        free(ids);
+        if (crit->tri == TRI_TITRE) {
+            // Peu de resultats : tri des k livres ; sinon l'index est deja dans l'ordre
+            if (*nb * 8 < bibli->nb_livres) {
+                qsort(res, *nb, sizeof(Livre *), cmp_ptr_titre);
+            } else {
+                *nb = 0;
+                for (NoeudSkip *actuel = skiplist_first(&bibli->index_titre); actuel != NULL;
+                     actuel = actuel->suivant[0]) {
+                    if (bitmap_contains(&filtre, (uint32_t) actuel->livre->id))
+                        res[(*nb)++] = actuel->livre;
+                }
+            }
+        }
+    }
+    if (resultat != NULL)
+        *resultat = filtre;
+    else
+        bitmap_free(&filtre);
+    return res;
+}
+
+char *biblio_selection_to_json(Livre *const *livres, size_t nb){
+    // 2048 octets couvrent les champs de taille fixe d'un Livre + le gabarit
+    size_t taille_max = (nb * 2048) + 16;
+    char *json = malloc(taille_max);
+    if (json == NULL)
+        return NULL;
+
+    size_t len = 0;
+    len += snprintf(json + len, taille_max - len, "[\n");
+    for (size_t i = 0; i < nb; i++){
+        const Livre *l = livres[i];
+        len += snprintf(json + len, taille_max - len,
+  "%s  {\n"
+  "    \"id\": %d,\n"
+  "    \"titre\": \"%s\",\n"
+  "    \"auteur\": \"%s\",\n"
+  "    \"annee\": %d,\n"
+  "    \"categorie\": \"%s\",\n"
+  "    \"fichier\": \"%s\",\n"
+  "    \"est_emprunte\": %s,\n"
+  "    \"description\": \"%s\",\n"
+  "    \"couverture\": \"%s\"\n"
+  "  }",
+  (i > 0) ? ",\n" : "",
+  l->id,
+  l->titre,
+  l->auteur,
+  l->annee,
+  l->categorie,
+  l->fichier,
+  l->est_emprunte ? "true" : "false",
+  l->description,
+  l->couverture);
+    }
+    snprintf(json + len, taille_max - len, "\n]");
+    return json;
+}
+
+static Bool tampon_ajouter(char **buf, size_t *cap, size_t *len, const char *s){
+    size_t add = strlen(s);
+    if (*len + add + 1 > *cap) {
+        size_t new_cap = (*cap) * 2;
+        while (new_cap < *len + add + 1) new_cap *= 2;
+        char *tmp = realloc(*buf, new_cap);
+        if (tmp == NULL) return FAUX;
+        *buf = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, s, add + 1);
+    *len += add;
+    return VRAI;
+}
+
+// Meme echappement que json_append_escaped (server.c) : guillemets et antislashs
+static Bool tampon_ajouter_echappe(char **buf, size_t *cap, size_t *len, const char *s){
+    for (const char *p = s; *p; p++) {
+        char tmp[3] = {'\\', *p, '\0'};
+        if (!tampon_ajouter(buf, cap, len, (*p == '"' || *p == '\\') ? tmp : tmp + 1)) return FAUX;
+    }
+    return VRAI;
+}
+
+static int cmp_decennie(const void *a, const void *b){
+    int x = (*(IndexDecennie *const *) a)->decennie;
+    int y = (*(IndexDecennie *const *) b)->decennie;
+    return (x > y) - (x < y);
+}
+
+/* Comptes par categorie, disponibilite et decennie pour un ensemble de resultats.
+   Chaque compte est un |resultat & index| calcule sur les bitmaps, sans relire les livres. */
+char *biblio_facettes_to_json(const Bibliotheque *bibli, const Bitmap *resultat){
+    if (bibli == NULL || resultat == NULL)
+        return NULL;
+    // Copie en bitset : chaque facette se compte par tests de bits, sans fusion de tableaux
+    Bitmap pivot;
+    if (!bitmap_copy(&pivot, resultat))
+        return NULL;
+    if (!bitmap_densify(&pivot)) {
+        bitmap_free(&pivot);
+        return NULL;
+    }
+    resultat = &pivot;
+    size_t cap = 1024, len = 0;
+    char *json = malloc(cap);
+    if (json == NULL) {
+        bitmap_free(&pivot);
+        return NULL;
+    }
+    json[0] = '\0';
+    char ligne[160];
+    Bool ok = tampon_ajouter(&json, &cap, &len, "{\n    \"categories\": {");
+
+    Bool premier = VRAI;
+    for (size_t i = 0; ok && i < bibli->nb_categories; i++) {
+        size_t n = bitmap_and_cardinal(resultat, &bibli->categories[i].livres);
+        if (n == 0) continue;
+        snprintf(ligne, sizeof(ligne), "\": %zu", n);
+        ok = tampon_ajouter(&json, &cap, &len, premier ? "\"" : ", \"") &&
+             tampon_ajouter_echappe(&json, &cap, &len, bibli->categories[i].nom) &&
+             tampon_ajouter(&json, &cap, &len, ligne);
+        premier = FAUX;
+    }
+
+    size_t total = bitmap_cardinal(resultat);
+    size_t dispo = bitmap_and_cardinal(resultat, &bibli->disponibles);
+    snprintf(ligne, sizeof(ligne),
+             "},\n    \"disponibilite\": {\"disponibles\": %zu, \"empruntes\": %zu},\n"
+             "    \"decennies\": {", dispo, total - dispo);
+    ok = ok && tampon_ajouter(&json, &cap, &len, ligne);
+
+    // Decennies presentees dans l'ordre chronologique
+    IndexDecennie **tri = malloc((bibli->nb_decennies + 1) * sizeof(IndexDecennie *));
+    if (tri == NULL) {
+        bitmap_free(&pivot);
+        free(json);
+        return NULL;
+    }
+    for (size_t i = 0; i < bibli->nb_decennies; i++) {
+        tri[i] = &bibli->decennies[i];
+    }
+    qsort(tri, bibli->nb_decennies, sizeof(IndexDecennie *), cmp_decennie);
+    premier = VRAI;
+    for (size_t i = 0; ok && i < bibli->nb_decennies; i++) {
+        size_t n = bitmap_and_cardinal(resultat, &tri[i]->livres);
+        if (n == 0) continue;
+        snprintf(ligne, sizeof(ligne), "%s\"%d\": %zu", premier ? "" : ", ", tri[i]->decennie, n);
+        ok = tampon_ajouter(&json, &cap, &len, ligne);
+        premier = FAUX;
+    }
+    free(tri);
+    bitmap_free(&pivot);
+
+    ok = ok && tampon_ajouter(&json, &cap, &len, "}\n  }");
+    if (!ok) {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
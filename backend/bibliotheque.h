@@ -1,29 +1,97 @@
 #pragma once 
 
 #include "hash_table.h"
+#include "skiplist.h"
+#include "bitmap.h"
 #include "model.h"
 #include <stddef.h>
 
+#define CRITERES_MAX_VALEURS 16
+#define BIBLIO_ID_MAX (8 * 1024 * 1024)  // par_id est indexe par id : au-dela, refuse
+
+typedef struct IndexCategorie {
+    char nom[64];
+    Bitmap livres;
+} IndexCategorie;
+
+typedef struct IndexDecennie {
+    int decennie;
+    Bitmap livres;
+} IndexDecennie;
+
 typedef struct Bibliotheque {
     HashTable table;
     size_t nb_livres;
     int next_id;
+    SkipList index_annee;   // tri par (annee, id)
+    SkipList index_titre;   // tri par (titre sans casse, id)
+
+    Livre **par_id;         // acces direct par id
+    size_t cap_id;
+    Bitmap tous;            // ids presents (dense)
+    Bitmap disponibles;     // ids non empruntes (dense : bascule en O(1))
+    Bitmap empruntes;       // ids empruntes (dense)
+    IndexCategorie *categories;
+    size_t nb_categories;
+    size_t cap_categories;
+    IndexDecennie *decennies;
+    size_t nb_decennies;
+    size_t cap_decennies;
+    Bool muet;              // pas de messages console (copie miroir du catalogue)
+    Bool en_lot;            // biblio_lot_debut : skiplists fusionnees a la fin
+    Livre **lot;            // livres ajoutes depuis, pas encore dans les skiplists
+    size_t nb_lot;
+    size_t cap_lot;
 }Bibliotheque;
 
+typedef enum {
+    TRI_AUCUN = 0,
+    TRI_TITRE,
+    TRI_ANNEE
+} TriLivres;
+
+/* Criteres de selection pour /api/livres (annee_min/annee_max inclusifs).
+   Plusieurs categories ou decennies se combinent en OU, les familles en ET. */
+typedef struct CriteresLivres {
+    const char *categories[CRITERES_MAX_VALEURS];
+    size_t nb_categories;
+    int decennies[CRITERES_MAX_VALEURS];
+    size_t nb_decennies;
+    int disponible;         // -1 : indifferent, 1 : disponibles, 0 : empruntes
+    int annee_min;
+    int annee_max;
+    TriLivres tri;
+} CriteresLivres;
+
 // --- FONCTIONS À IMPLÉMENTER ---
 
 void biblio_init(Bibliotheque *bibli);
 void biblio_free(Bibliotheque *bibli);
 
-void biblio_add(Bibliotheque *bibli, const Livre *livre);
+Bool biblio_add(Bibliotheque *bibli, const Livre *livre);
+void biblio_lot_debut(Bibliotheque *bibli);
+void biblio_lot_fin(Bibliotheque *bibli);
 int biblio_next_id(Bibliotheque *bibli);
 Livre *biblio_search(Bibliotheque *bibli, const char *titre);
+// Parmi les livres de ce titre, le premier dans l'etat voulu, sinon le premier tout court
+Livre *biblio_search_etat(Bibliotheque *bibli, const char *titre, Bool emprunte);
+Livre *biblio_find_by_id(const Bibliotheque *bibli, int id);
+void biblio_marquer_emprunte(Bibliotheque *bibli, Livre *livre, Bool emprunte);
 Bool biblio_emprunter(Bibliotheque *bibli, const char *titre);
 Bool biblio_retour(Bibliotheque *bibli, const char *titre);
 size_t biblio_count(const Bibliotheque *bibli);
 void biblio_display(const Bibliotheque *bibli);
 void biblio_display_categorie(const Bibliotheque *bibli, const char *categ_search);
 void biblio_remove(Bibliotheque *bibli, const char *titre);
+void biblio_remove_livre(Bibliotheque *bibli, Livre *livre);
+void biblio_update(Bibliotheque *bibli, Livre *existant, const Livre *nouveau);
 void biblio_save(const Bibliotheque *bibli, const char *nom_fichier);
 void biblio_load(Bibliotheque *bibli, const char *nom_fichier);
 char *biblio_to_json(const Bibliotheque *bibli);
+
+void biblio_criteres_init(CriteresLivres *crit);
+Bool biblio_filtrer(const Bibliotheque *bibli, const CriteresLivres *crit, Bitmap *res);
+Livre **biblio_selection(const Bibliotheque *bibli, const CriteresLivres *crit, size_t *nb, Bitmap *resultat);
+char *biblio_selection_to_json(Livre *const *livres, size_t nb);
+char *biblio_facettes_to_json(const Bibliotheque *bibli, const Bitmap *resultat);
+
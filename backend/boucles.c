@@ -0,0 +1,175 @@
+#include "boucles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef SO_REUSEPORT
+/* Socket d'ecoute TCP avec SO_REUSEPORT, posee avant bind : chaque boucle a
+   la sienne sur le meme port. -1 en cas d'echec. */
+static int ouvrir_socket_partagee(const char *url) {
+  struct mg_addr adresse;
+  memset(&adresse, 0, sizeof(adresse));
+  if (!mg_aton(mg_url_host(url), &adresse)) return -1;
+  unsigned short port = mg_url_port(url);
+
+  struct sockaddr_storage ss;
+  socklen_t longueur;
+  memset(&ss, 0, sizeof(ss));
+  if (adresse.is_ip6) {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &ss;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    memcpy(&sin6->sin6_addr, adresse.ip, 16);
+    longueur = sizeof(*sin6);
+  } else {
+    struct sockaddr_in *sin = (struct sockaddr_in *) &ss;
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    memcpy(&sin->sin_addr, adresse.ip, 4);
+    longueur = sizeof(*sin);
+  }
+
+  int fd = socket(ss.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return -1;
+  int on = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      bind(fd, (struct sockaddr *) &ss, longueur) != 0 ||
+      listen(fd, MG_SOCK_LISTEN_BACKLOG_SIZE) != 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+/* Mongoose ne pose que SO_REUSEADDR et n'offre pas de crochet avant bind :
+   on ouvre un listener HTTP sur un port ephemere (il porte le protocole
+   HTTP, herite par les connexions acceptees) et on remplace sa socket. */
+static struct mg_connection *ecouter_partage(Boucle *boucle, const char *url, mg_event_handler_t fn) {
+  int fd = ouvrir_socket_partagee(url);
+  if (fd < 0) return NULL;
+  struct mg_connection *c = mg_http_listen(&boucle->mgr, "http://127.0.0.1:0", fn, boucle);
+  if (c == NULL) {
+    close(fd);
+    return NULL;
+  }
+  close((int) (size_t) c->fd);  // la fermeture la retire aussi d'epoll
+  c->fd = (void *) (size_t) fd;
+  c->loc.port = mg_htons(mg_url_port(url));
+  MG_EPOLL_ADD(c);
+  return c;
+}
+#endif
+
+/* nb = 0 : une boucle par coeur. Sans SO_REUSEPORT, une seule boucle.
+   plafonds (ou NULL) : debit maximal par IP, commun a toutes les boucles. */
+Bool boucles_init(Boucles *b, size_t nb, const char *url, mg_event_handler_t fn, atomic_int *arret,
+                  PlafondsIP *plafonds) {
+  if (b == NULL) return FAUX;
+  memset(b, 0, sizeof(Boucles));
+#ifdef SO_REUSEPORT
+  if (nb == 0) {
+    long coeurs = sysconf(_SC_NPROCESSORS_ONLN);
+    nb = coeurs > 0 ? (size_t) coeurs : 1;
+  }
+  if (nb > BOUCLES_MAX) nb = BOUCLES_MAX;
+#else
+  nb = 1;
+#endif
+
+  b->boucles = calloc(nb, sizeof(Boucle));
+  if (b->boucles == NULL) return FAUX;
+  b->reveil = VRAI;
+  for (size_t i = 0; i < nb; i++) {
+    Boucle *boucle = &b->boucles[i];
+    boucle->indice = i;
+    boucle->arret = arret;
+    mg_mgr_init(&boucle->mgr);
+    ordonnanceur_init(&boucle->ordonnanceur, ORDONNANCEUR_BUDGET_TOUR, plafonds);
+    boucle->mgr.userdata = &boucle->ordonnanceur;
+    retours_init(&boucle->retours, &boucle->mgr);
+    b->nb++;
+    struct mg_connection *c = NULL;
+#ifdef SO_REUSEPORT
+    if (nb > 1) c = ecouter_partage(boucle, url, fn);
+    else
+#endif
+    c = mg_http_listen(&boucle->mgr, url, fn, boucle);
+    if (c == NULL) return FAUX;
+    boucle->ecoute = boucle->retours.ecoute = c->id;
+    if (!mg_wakeup_init(&boucle->mgr)) b->reveil = FAUX;
+  }
+  return VRAI;
+}
+
+static void *executer_boucle(void *arg) {
+  Boucle *boucle = (Boucle *) arg;
+  while (atomic_load(boucle->arret) == 0) {
+    int attente = ordonnanceur_attente(&boucle->ordonnanceur, 1000);
+    ordonnanceur_tour(&boucle->ordonnanceur);
+    mg_mgr_poll(&boucle->mgr, attente);
+  }
+  return NULL;
+}
+
+// Lance les boucles 1..nb-1, fait tourner la boucle 0 ici, rend la main a l'arret
+void boucles_executer(Boucles *b) {
+  if (b == NULL || b->nb == 0) return;
+  for (size_t i = 1; i < b->nb; i++) {
+    Boucle *boucle = &b->boucles[i];
+    boucle->lancee = pthread_create(&boucle->thread, NULL, executer_boucle, boucle) == 0;
+  }
+  executer_boucle(&b->boucles[0]);
+  for (size_t i = 1; i < b->nb; i++) {
+    if (b->boucles[i].lancee) pthread_join(b->boucles[i].thread, NULL);
+    b->boucles[i].lancee = FAUX;
+  }
+}
+
+// Apres boucles_executer et l'arret du pool (plus de mg_wakeup possible)
+void boucles_free(Boucles *b) {
+  if (b == NULL || b->boucles == NULL) return;
+  for (size_t i = 0; i < b->nb; i++) {
+    mg_mgr_free(&b->boucles[i].mgr);
+    retours_free(&b->boucles[i].retours);  // travaux des connexions qui viennent d'etre fermees
+  }
+  free(b->boucles);
+  b->boucles = NULL;
+  b->nb = 0;
+}
+
+// A appeler depuis le gestionnaire d'evenements : fn_data est la boucle
+void boucle_compter(struct mg_connection *c, int ev) {
+  Boucle *boucle = (Boucle *) c->fn_data;
+  if (boucle == NULL) return;
+  if (ev == MG_EV_ACCEPT) {
+    atomic_fetch_add(&boucle->connexions, 1);
+  } else if (ev == MG_EV_HTTP_MSG) {
+    atomic_fetch_add(&boucle->requetes, 1);
+  }
+}
+
+char *boucles_stats_json(const Boucles *b) {
+  if (b == NULL) return NULL;
+  size_t cap = (b->nb + 1) * 160 + 32;
+  char *json = malloc(cap);
+  if (json == NULL) return NULL;
+  size_t len = 0;
+  len += snprintf(json + len, cap - len, "{ \"boucles\": [");
+  for (size_t i = 0; i < b->nb; i++) {
+    const Boucle *boucle = &b->boucles[i];
+    len += snprintf(json + len, cap - len,
+                    "%s{ \"connexions\": %lu, \"requetes\": %lu, \"octets_masse\": %lu, \"retenues\": %lu }",
+                    i == 0 ? "" : ", ", atomic_load(&boucle->connexions), atomic_load(&boucle->requetes),
+                    atomic_load(&boucle->ordonnanceur.octets), atomic_load(&boucle->ordonnanceur.retenues));
+  }
+  snprintf(json + len, cap - len, "] }");
+  return json;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "mongoose.h"
+#include "model.h"
+#include "ordonnanceur.h"
+#include "travailleurs.h"
+
+#define BOUCLES_MAX 64
+
+/* Une boucle d'evenements : son mg_mgr, sa socket d'ecoute, son thread.
+   Seul ce thread touche a ses connexions ; les travailleurs lui rendent
+   leurs reponses dans retours. Son ordonnanceur partage la
+   bande passante entre ses transferts de masse (mgr.userdata). */
+typedef struct Boucle {
+    struct mg_mgr mgr;
+    pthread_t thread;
+    size_t indice;
+    Bool lancee;                // thread cree (la boucle 0 tourne dans main)
+    atomic_int *arret;          // non nul : sortir de mg_mgr_poll
+    unsigned long ecoute;       // id de la socket d'ecoute : cible des mg_wakeup sans connexion
+    atomic_ulong connexions;    // acceptees par cette boucle
+    atomic_ulong requetes;
+    Ordonnanceur ordonnanceur;
+    RetoursTravaux retours;
+} Boucle;
+
+/* Plusieurs boucles ecoutent le meme port avec SO_REUSEPORT : le noyau
+   repartit les connexions entrantes entre elles. Avec une seule boucle (ou
+   sans SO_REUSEPORT), ecoute classique de Mongoose. */
+typedef struct Boucles {
+    Boucle *boucles;
+    size_t nb;
+    Bool reveil;                // mg_wakeup_init reussi sur toutes les boucles
+} Boucles;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool boucles_init(Boucles *b, size_t nb, const char *url, mg_event_handler_t fn, atomic_int *arret,
+                  PlafondsIP *plafonds);
+void boucles_executer(Boucles *b);
+void boucles_free(Boucles *b);
+void boucle_compter(struct mg_connection *c, int ev);
+char *boucles_stats_json(const Boucles *b);
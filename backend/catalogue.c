@@ -0,0 +1,237 @@
+#include "catalogue.h"
+#include "fichiers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+// Chaque thread garde la meme case de compteur pour toutes ses lectures
+static _Thread_local int t_indice = -1;
+static atomic_int s_prochain_indice;
+
+static int indice_du_thread(void){
+    if (t_indice < 0)
+        t_indice = atomic_fetch_add(&s_prochain_indice, 1) % CATALOGUE_CASES;
+    return t_indice;
+}
+
+static void ceder(void){
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static void attendre_lecteurs(CompteurLecteurs *compteurs){
+    for (int i = 0; i < CATALOGUE_CASES; i++) {
+        while (atomic_load(&compteurs[i].n) != 0)
+            ceder();
+    }
+}
+
+/* Les nouveaux lecteurs passent sur l'autre jeu de compteurs, puis on attend
+   que l'ancien jeu se vide : plus personne ne lit la copie desactivee. */
+static void basculer_version(Catalogue *cat){
+    int v = atomic_load(&cat->version);
+    attendre_lecteurs(cat->lecteurs[1 - v]);
+    atomic_store(&cat->version, 1 - v);
+    attendre_lecteurs(cat->lecteurs[v]);
+}
+
+Bool catalogue_init(Catalogue *cat){
+    if (cat == NULL)
+        return FAUX;
+    memset(cat, 0, sizeof(Catalogue));
+    for (int i = 0; i < 2; i++) {
+        cat->copies[i] = malloc(sizeof(Bibliotheque));
+        if (cat->copies[i] == NULL) {
+            catalogue_free(cat);
+            return FAUX;
+        }
+        biblio_init(cat->copies[i]);
+    }
+    cat->copies[1]->muet = VRAI;
+    atomic_init(&cat->active, 0);
+    atomic_init(&cat->version, 0);
+    atomic_init(&cat->generation, 0);
+    pthread_mutex_init(&cat->ecrivain, NULL);
+    return VRAI;
+}
+
+void catalogue_free(Catalogue *cat){
+    if (cat == NULL)
+        return;
+    for (int i = 0; i < CATALOGUE_ETATS_PAGES; i++) {
+        free(atomic_load(&cat->etats[i]));
+        atomic_store(&cat->etats[i], NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (cat->copies[i] != NULL) {
+            biblio_free(cat->copies[i]);
+            free(cat->copies[i]);
+            cat->copies[i] = NULL;
+        }
+    }
+}
+
+// Les pointeurs obtenus ne sont valables que jusqu'a catalogue_lire_fin
+Bibliotheque *catalogue_lire_debut(Catalogue *cat, LectureCatalogue *lecture){
+    lecture->indice = indice_du_thread();
+    lecture->version = atomic_load(&cat->version);
+    atomic_fetch_add(&cat->lecteurs[lecture->version][lecture->indice].n, 1);
+    return cat->copies[atomic_load(&cat->active)];
+}
+
+void catalogue_lire_fin(Catalogue *cat, const LectureCatalogue *lecture){
+    atomic_fetch_sub(&cat->lecteurs[lecture->version][lecture->indice].n, 1);
+}
+
+/* Un seul ecrivain a la fois. Ne pas appeler depuis une section de lecture
+   du meme thread : l'ecrivain attendrait ce lecteur indefiniment. */
+int catalogue_ecrire(Catalogue *cat, OperationCatalogue op, void *arg){
+    pthread_mutex_lock(&cat->ecrivain);
+    int actif = atomic_load(&cat->active);
+    int resultat = op(cat->copies[1 - actif], arg);
+    atomic_store(&cat->active, 1 - actif);
+    atomic_fetch_add(&cat->generation, 1);
+    basculer_version(cat);
+    op(cat->copies[actif], arg);
+    pthread_mutex_unlock(&cat->ecrivain);
+    return resultat;
+}
+
+/* Mot d'etat du livre id, NULL si l'id est hors de la table. Une page
+   manquante est allouee ; si deux threads la creent ensemble, un seul
+   pointeur est publie et l'autre page est liberee. */
+static atomic_uchar *etat_du_livre(Catalogue *cat, int id){
+    if (id <= 0 || id >= CATALOGUE_ETATS_PAGE * CATALOGUE_ETATS_PAGES)
+        return NULL;
+    _Atomic(atomic_uchar *) *emplacement = &cat->etats[id / CATALOGUE_ETATS_PAGE];
+    atomic_uchar *page = atomic_load(emplacement);
+    if (page == NULL) {
+        atomic_uchar *nouvelle = calloc(CATALOGUE_ETATS_PAGE, sizeof(atomic_uchar));
+        if (nouvelle == NULL)
+            return NULL;
+        if (atomic_compare_exchange_strong(emplacement, &page, nouvelle))
+            page = nouvelle;
+        else
+            free(nouvelle);
+    }
+    return &page[id % CATALOGUE_ETATS_PAGE];
+}
+
+/* Passe le livre de l'etat de a vers, sans verrou. Un seul thread gagne une
+   transition donnee. Un id non suivi laisse passer : l'operation appliquee
+   ensuite sous le mutex de l'ecrivain tranche. */
+Bool catalogue_transition(Catalogue *cat, int id, int de, int vers){
+    atomic_uchar *etat = etat_du_livre(cat, id);
+    if (etat == NULL)
+        return VRAI;
+    unsigned char attendu = (unsigned char) de;
+    return atomic_compare_exchange_strong(etat, &attendu, (unsigned char) vers) ? VRAI : FAUX;
+}
+
+// Pour les ecritures qui imposent l'etat (ajout, modification, chargement)
+void catalogue_fixer_etat(Catalogue *cat, int id, int etat){
+    atomic_uchar *mot = etat_du_livre(cat, id);
+    if (mot != NULL)
+        atomic_store(mot, (unsigned char) etat);
+}
+
+/* Sous le mutex de l'ecrivain, avant que bibli soit visible : chaque mot
+   prend son etat d'apres bibli en une seule ecriture, sans passer par
+   DISPONIBLE pour un livre emprunte. */
+static void synchroniser_etats(Catalogue *cat, const Bibliotheque *bibli){
+    for (int i = 0; i < CATALOGUE_ETATS_PAGES; i++) {
+        atomic_uchar *page = atomic_load(&cat->etats[i]);
+        if (page == NULL)
+            continue;
+        for (int j = 0; j < CATALOGUE_ETATS_PAGE; j++) {
+            uint32_t id = (uint32_t) (i * CATALOGUE_ETATS_PAGE + j);
+            atomic_store(&page[j], bitmap_contains(&bibli->empruntes, id) ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+        }
+    }
+    // Pages encore absentes : celles des livres empruntes sont creees
+    size_t nb = bitmap_cardinal(&bibli->empruntes);
+    uint32_t *ids = malloc((nb + 1) * sizeof(uint32_t));
+    if (ids != NULL) {
+        nb = bitmap_to_array(&bibli->empruntes, ids);
+        for (size_t i = 0; i < nb; i++)
+            catalogue_fixer_etat(cat, (int) ids[i], LIVRE_EMPRUNTE);
+        free(ids);
+    }
+}
+
+static Bibliotheque *construire_copie(const char *path, const char *journal, Bool muet){
+    Bibliotheque *bibli = malloc(sizeof(Bibliotheque));
+    if (bibli == NULL)
+        return NULL;
+    biblio_init(bibli);
+    bibli->muet = muet;
+    Bool charge = fichiers_charger(bibli, path);
+    if (fichiers_rejouer(bibli, journal) == 0 && !charge) {
+        biblio_free(bibli);
+        free(bibli);
+        return NULL;
+    }
+    return bibli;
+}
+
+static long ecart_ns(const struct timespec *debut, const struct timespec *fin){
+    return (long) (fin->tv_sec - debut->tv_sec) * 1000000000L + (fin->tv_nsec - debut->tv_nsec);
+}
+
+/* Remplace les deux copies par celles construites depuis le fichier. Le
+   mutex de l'ecrivain est tenu de la construction a l'echange : aucune
+   ecriture ne peut s'appliquer aux anciennes copies puis disparaitre avec
+   elles, les ecrivains attendent le rechargement. Les lecteurs continuent
+   sans verrou sur l'ancien catalogue ; leur seule pause est l'echange des
+   pointeurs (rendue dans pause_ns si non NULL). Les mots d'etat sont
+   recalcules avant que les nouvelles copies soient visibles, et les
+   anciennes sont liberees quand plus aucun lecteur ne les voit. En cas
+   d'echec le catalogue courant reste en place. Le journal des lots (NULL :
+   aucun) est rejoue apres le fichier. */
+Bool catalogue_charger(Catalogue *cat, const char *path, const char *journal, long *pause_ns){
+    if (cat == NULL || path == NULL)
+        return FAUX;
+    pthread_mutex_lock(&cat->ecrivain);
+    Bibliotheque *neuves[2] = { construire_copie(path, journal, FAUX),
+                               construire_copie(path, journal, VRAI) };
+    if (neuves[0] == NULL || neuves[1] == NULL) {
+        pthread_mutex_unlock(&cat->ecrivain);
+        for (int i = 0; i < 2; i++) {
+            if (neuves[i] != NULL) {
+                biblio_free(neuves[i]);
+                free(neuves[i]);
+            }
+        }
+        return FAUX;
+    }
+    synchroniser_etats(cat, neuves[0]);
+
+    struct timespec debut, fin;
+    clock_gettime(CLOCK_MONOTONIC, &debut);
+    int actif = atomic_load(&cat->active);
+    Bibliotheque *anciennes[2] = { cat->copies[0], cat->copies[1] };
+    cat->copies[1 - actif] = neuves[1 - actif];  // personne ne lit la copie inactive
+    atomic_store(&cat->active, 1 - actif);
+    atomic_fetch_add(&cat->generation, 1);
+    basculer_version(cat);
+    cat->copies[actif] = neuves[actif];
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    pthread_mutex_unlock(&cat->ecrivain);
+    if (pause_ns != NULL)
+        *pause_ns = ecart_ns(&debut, &fin);
+
+    for (int i = 0; i < 2; i++) {
+        biblio_free(anciennes[i]);
+        free(anciennes[i]);
+    }
+    return VRAI;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bibliotheque.h"
+#include "model.h"
+
+#define CATALOGUE_CASES 64      // compteurs de lecteurs, un par ligne de cache
+#define CATALOGUE_ETATS_PAGE 4096
+#define CATALOGUE_ETATS_PAGES 1024  // ids suivis : 1 .. 4 194 303
+
+/* Etat de pret d'un livre : DISPONIBLE -> EMPRUNTE -> EN_RETOUR -> DISPONIBLE.
+   EN_RETOUR couvre la mise a jour des copies pendant un retour : un emprunt
+   ne peut pas passer avant que le retour y soit applique. */
+enum { LIVRE_DISPONIBLE = 0, LIVRE_EMPRUNTE, LIVRE_EN_RETOUR };
+
+typedef struct CompteurLecteurs {
+    atomic_long n;
+    char marge[64 - sizeof(atomic_long)];
+} CompteurLecteurs;
+
+/* Catalogue partage entre threads, en "gauche-droite" : deux copies
+   identiques de la Bibliotheque. Les lecteurs ne prennent aucun verrou :
+   ils s'annoncent sur un compteur (le leur, sur sa propre ligne de cache)
+   puis lisent la copie active. L'unique ecrivain modifie la copie inactive,
+   la rend active, attend que les lecteurs aient quitte l'ancienne, puis y
+   rejoue la meme operation. Cout : deux fois la memoire du catalogue.
+   L'etat de pret de chaque livre est en plus un mot atomique partage par les
+   deux copies (pages allouees a la demande, jamais deplacees) : un emprunt se
+   gagne par compare-and-swap avant de passer par l'ecrivain. */
+typedef struct Catalogue {
+    Bibliotheque *copies[2];
+    atomic_int active;                              // copie servie aux lecteurs
+    atomic_int version;                             // compteurs ou s'annoncer
+    atomic_ulong generation;                        // +1 a chaque ecriture ou rechargement
+    CompteurLecteurs lecteurs[2][CATALOGUE_CASES];
+    pthread_mutex_t ecrivain;
+    _Atomic(atomic_uchar *) etats[CATALOGUE_ETATS_PAGES];
+} Catalogue;
+
+typedef struct LectureCatalogue {
+    int version;
+    int indice;
+} LectureCatalogue;
+
+/* Operation d'ecriture, appliquee une fois a chaque copie : elle doit etre
+   deterministe (meme resultat sur deux copies identiques). */
+typedef int (*OperationCatalogue)(Bibliotheque *bibli, void *arg);
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool catalogue_init(Catalogue *cat);
+void catalogue_free(Catalogue *cat);
+Bibliotheque *catalogue_lire_debut(Catalogue *cat, LectureCatalogue *lecture);
+void catalogue_lire_fin(Catalogue *cat, const LectureCatalogue *lecture);
+int catalogue_ecrire(Catalogue *cat, OperationCatalogue op, void *arg);
+Bool catalogue_charger(Catalogue *cat, const char *path, const char *journal, long *pause_ns);
+Bool catalogue_transition(Catalogue *cat, int id, int de, int vers);
+void catalogue_fixer_etat(Catalogue *cat, int id, int etat);
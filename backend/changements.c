@@ -0,0 +1,504 @@
+#include "changements.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fichiers.h"
+
+#define PREFIXE_SEQ "{\"seq\": "
+
+static unsigned long long seq_de(const char *ligne) {
+  if (strncmp(ligne, PREFIXE_SEQ, sizeof(PREFIXE_SEQ) - 1) != 0) return 0;
+  return strtoull(ligne + sizeof(PREFIXE_SEQ) - 1, NULL, 10);
+}
+
+static Bool ajouter_repere(Changements *ch, unsigned long long seq, long position, unsigned int fichier) {
+  if (ch->nb_reperes == ch->cap_reperes) {
+    size_t cap = ch->cap_reperes == 0 ? 64 : ch->cap_reperes * 2;
+    RepereJournal *reperes = realloc(ch->reperes, cap * sizeof(RepereJournal));
+    if (reperes == NULL) return FAUX;
+    ch->reperes = reperes;
+    ch->cap_reperes = cap;
+  }
+  ch->reperes[ch->nb_reperes++] = (RepereJournal) {seq, position, fichier};
+  return VRAI;
+}
+
+static void chemin_journal(const Changements *ch, unsigned int fichier, char *chemin, size_t taille) {
+  if (fichier == ch->fichier) snprintf(chemin, taille, "%s", ch->chemin);
+  else snprintf(chemin, taille, "%s.1", ch->chemin);
+}
+
+/* Un repere toutes les CHANGEMENTS_DEVERSEMENT lignes, comme si le journal
+   avait ete ecrit par deversements pleins ; renvoie le dernier seq lu. */
+static unsigned long long relire_journal(Changements *ch, unsigned int fichier, long *taille) {
+  char chemin[sizeof(ch->chemin) + 4];
+  chemin_journal(ch, fichier, chemin, sizeof(chemin));
+  *taille = 0;
+  FILE *f = fopen(chemin, "rb");
+  char *ligne = malloc(CHANGEMENTS_LIGNE_MAX);
+  unsigned long long dernier = 0;
+  if (f != NULL && ligne != NULL) {
+    size_t lues = 0;
+    long position = 0;
+    while (fgets(ligne, CHANGEMENTS_LIGNE_MAX, f) != NULL) {
+      Bool entiere = strchr(ligne, '\n') != NULL;
+      unsigned long long seq = entiere ? seq_de(ligne) : 0;
+      if (seq > dernier) {
+        if (lues++ % CHANGEMENTS_DEVERSEMENT == 0) ajouter_repere(ch, seq, position, fichier);
+        dernier = seq;
+      }
+      while (!entiere && fgets(ligne, CHANGEMENTS_LIGNE_MAX, f) != NULL) entiere = strchr(ligne, '\n') != NULL;
+      position = ftell(f);
+    }
+    *taille = position;
+  }
+  if (f != NULL) fclose(f);
+  free(ligne);
+  return dernier;
+}
+
+/* Sous le verrou : ecrit en un ajout les changements de l'anneau pas
+   encore dans le journal. Au-dela de CHANGEMENTS_JOURNAL_MAX, le journal
+   devient le precedent (l'ancien precedent est perdu). */
+static void deverser(Changements *ch) {
+  unsigned long long dernier = atomic_load(&ch->dernier);
+  unsigned long long debut = ch->deverse + 1 > ch->premier ? ch->deverse + 1 : ch->premier;
+  if (debut > dernier) return;
+  size_t total = 0;
+  for (unsigned long long s = debut; s <= dernier; s++) total += ch->anneau[s % CHANGEMENTS_ANNEAU].longueur + 1;
+  char *lignes = malloc(total);
+  Bool ok = lignes != NULL;
+  long taille = ch->taille;
+  if (ok) {
+    size_t n = 0;
+    for (unsigned long long s = debut; s <= dernier; s++) {
+      const Changement *x = &ch->anneau[s % CHANGEMENTS_ANNEAU];
+      memcpy(lignes + n, x->json, x->longueur);
+      lignes[n + x->longueur] = '\n';
+      n += x->longueur + 1;
+    }
+    ok = fichiers_journal_ajouter(ch->chemin, lignes, total, &taille);
+    free(lignes);
+  }
+  if (ok) ok = ajouter_repere(ch, debut, ch->taille, ch->fichier);
+  if (!ok) {
+    // Trou dans le journal : ce qui precede n'est plus lisible d'un seul tenant
+    MG_ERROR(("Journal des changements %s : ecriture impossible, seq %llu a %llu perdus", ch->chemin, debut,
+              dernier));
+    ch->nb_reperes = 0;
+  }
+  if (taille > 0) ch->taille = taille;
+  ch->deverse = dernier;
+
+  if (ch->taille > CHANGEMENTS_JOURNAL_MAX) {
+    char precedent[sizeof(ch->chemin) + 4];
+    snprintf(precedent, sizeof(precedent), "%s.1", ch->chemin);
+    if (rename(ch->chemin, precedent) == 0) {
+      size_t garde = 0;
+      for (size_t i = 0; i < ch->nb_reperes; i++) {
+        if (ch->reperes[i].fichier == ch->fichier) ch->reperes[garde++] = ch->reperes[i];
+      }
+      ch->nb_reperes = garde;
+      ch->taille_precedent = ch->taille;
+      ch->taille = 0;
+      ch->fichier++;
+    }
+  }
+}
+
+Bool changements_init(Changements *ch, const char *chemin, size_t nb_boucles) {
+  memset(ch, 0, sizeof(Changements));
+  pthread_mutex_init(&ch->verrou, NULL);
+  ch->anneau = calloc(CHANGEMENTS_ANNEAU, sizeof(Changement));
+  ch->boucles = calloc(nb_boucles > 0 ? nb_boucles : 1, sizeof(BoucleChangements));
+  if (ch->anneau == NULL || ch->boucles == NULL) return FAUX;
+  ch->nb_boucles = nb_boucles;
+  for (size_t i = 0; i < nb_boucles; i++) {
+    atomic_init(&ch->boucles[i].abonnes, 0);
+    atomic_init(&ch->boucles[i].reveil, 0);
+  }
+  snprintf(ch->chemin, sizeof(ch->chemin), "%s", chemin);
+  ch->fichier = 1;
+  unsigned long long precedent = relire_journal(ch, 0, &ch->taille_precedent);
+  unsigned long long courant = relire_journal(ch, 1, &ch->taille);
+  unsigned long long dernier = courant > precedent ? courant : precedent;
+  ch->deverse = dernier;
+  atomic_init(&ch->lus_anneau, 0);
+  atomic_init(&ch->lus_journal, 0);
+  atomic_init(&ch->trop_anciens, 0);
+
+  /* Les changements d'un anneau perdu (arret brutal) ont pu etre vus : on
+     saute leurs numeros. Le saut est ecrit tout de suite, sous la forme
+     d'un changement "demarrage" : apres un second arret brutal, la
+     numerotation repart au-dela de lui. */
+  unsigned long long seq = dernier > 0 ? dernier + CHANGEMENTS_DEVERSEMENT : 1;
+  char *json = mg_mprintf(PREFIXE_SEQ "%llu, \"type\": \"demarrage\"}", seq);
+  if (json == NULL) return FAUX;
+  ch->anneau[seq % CHANGEMENTS_ANNEAU] = (Changement) {seq, json, strlen(json)};
+  ch->premier = seq;
+  atomic_init(&ch->dernier, seq);
+  deverser(ch);
+  return VRAI;
+}
+
+void changements_boucle(Changements *ch, size_t indice, struct mg_mgr *mgr, unsigned long ecoute) {
+  if (indice >= ch->nb_boucles) return;
+  ch->boucles[indice].mgr = mgr;
+  ch->boucles[indice].ecoute = ecoute;
+}
+
+void changements_free(Changements *ch) {
+  if (ch->anneau != NULL) {
+    pthread_mutex_lock(&ch->verrou);
+    deverser(ch);
+    pthread_mutex_unlock(&ch->verrou);
+    unsigned long long dernier = atomic_load(&ch->dernier);
+    for (unsigned long long s = ch->premier; s <= dernier; s++) free(ch->anneau[s % CHANGEMENTS_ANNEAU].json);
+  }
+  free(ch->anneau);
+  free(ch->reperes);
+  free(ch->boucles);
+  pthread_mutex_destroy(&ch->verrou);
+  memset(ch, 0, sizeof(Changements));
+}
+
+unsigned long long changements_ajouter(Changements *ch, const char *corps, char **ligne) {
+  if (ligne != NULL) *ligne = NULL;
+  size_t n = strlen(corps);
+  if (ch->anneau == NULL || n < 2 || corps[0] != '{') return 0;
+  char *json = malloc(n + 32);
+  if (json == NULL) return 0;
+
+  pthread_mutex_lock(&ch->verrou);
+  unsigned long long seq = atomic_load(&ch->dernier) + 1;
+  size_t entete = (size_t) snprintf(json, 32, PREFIXE_SEQ "%llu%s", seq, corps[1] == '}' ? "" : ", ");
+  memcpy(json + entete, corps + 1, n);  // '\0' compris
+  if (seq - ch->premier >= CHANGEMENTS_ANNEAU) {
+    if (ch->deverse < ch->premier) deverser(ch);
+    free(ch->anneau[ch->premier % CHANGEMENTS_ANNEAU].json);
+    ch->premier++;
+  }
+  ch->anneau[seq % CHANGEMENTS_ANNEAU] = (Changement) {seq, json, entete + n - 1};
+  atomic_store(&ch->dernier, seq);
+  unsigned long long deverse = ch->deverse > ch->premier - 1 ? ch->deverse : ch->premier - 1;
+  if (seq - deverse >= CHANGEMENTS_DEVERSEMENT) deverser(ch);
+  if (ligne != NULL && (*ligne = malloc(entete + n)) != NULL) memcpy(*ligne, json, entete + n);
+  pthread_mutex_unlock(&ch->verrou);
+
+  for (size_t i = 0; i < ch->nb_boucles; i++) {
+    BoucleChangements *b = &ch->boucles[i];
+    if (b->mgr == NULL || atomic_load(&b->abonnes) == 0) continue;
+    if (atomic_exchange(&b->reveil, 1) == 0) mg_wakeup(b->mgr, b->ecoute, "", 0);
+  }
+  return seq;
+}
+
+// --- Lecture ---
+
+/* Lignes de f entre position et fin, de seq > *depuis, tant que *n < limite.
+   FAUX si la lecture a echoue. Chaque lecteur a son propre FILE* : le
+   fseek puis les fread suivants ne croisent personne. */
+static Bool lire_fichier(FILE *f, long position, long fin, unsigned long long *depuis, size_t limite, long *n,
+                         EcrireChangement ecrire, void *ctx) {
+  char *tampon = malloc(CHANGEMENTS_LIGNE_MAX);
+  if (tampon == NULL) return FAUX;
+  size_t garde = 0;
+  Bool ok = fseek(f, position, SEEK_SET) == 0;
+  while (ok && position < fin && (size_t) *n < limite) {
+    size_t voulu = CHANGEMENTS_LIGNE_MAX - garde;
+    if ((long) voulu > fin - position) voulu = (size_t) (fin - position);
+    size_t lu = fread(tampon + garde, 1, voulu, f);
+    if (lu == 0) {
+      ok = FAUX;
+      break;
+    }
+    position += (long) lu;
+    garde += lu;
+    char *debut = tampon, *bout = tampon + garde, *nl;
+    while ((size_t) *n < limite && (nl = memchr(debut, '\n', (size_t) (bout - debut))) != NULL) {
+      *nl = '\0';
+      Changement x = {seq_de(debut), debut, (size_t) (nl - debut)};
+      if (x.seq > *depuis) {
+        ecrire(ctx, &x);
+        *depuis = x.seq;
+        (*n)++;
+      }
+      debut = nl + 1;
+    }
+    garde = (size_t) (bout - debut);
+    if (garde == CHANGEMENTS_LIGNE_MAX) garde = 0;  // ligne trop longue : ignoree
+    memmove(tampon, debut, garde);
+  }
+  free(tampon);
+  return ok;
+}
+
+// Sous le verrou : ouvre les journaux a partir du repere qui precede depuis + 1
+static long lire_journal(Changements *ch, unsigned long long *depuis, size_t limite, EcrireChangement ecrire,
+                         void *ctx) {
+  size_t bas = 0, haut = ch->nb_reperes;
+  while (bas < haut) {  // premier repere de seq > depuis + 1
+    size_t milieu = (bas + haut) / 2;
+    if (ch->reperes[milieu].seq <= *depuis + 1) bas = milieu + 1;
+    else haut = milieu;
+  }
+  if (bas == 0) return -1;
+  RepereJournal depart = ch->reperes[bas - 1];
+  Bool dans_precedent = depart.fichier != ch->fichier;
+  long fin_precedent = ch->taille_precedent, fin_courant = ch->taille;
+  char chemin[sizeof(ch->chemin) + 4];
+  FILE *precedent = NULL;
+  if (dans_precedent) {
+    chemin_journal(ch, depart.fichier, chemin, sizeof(chemin));
+    precedent = fopen(chemin, "rb");
+  }
+  FILE *courant = fopen(ch->chemin, "rb");
+  pthread_mutex_unlock(&ch->verrou);
+
+  // Les fichiers ouverts restent les bons meme si le journal tourne entre-temps
+  long n = 0;
+  Bool ok = VRAI;
+  if (dans_precedent) {
+    ok = precedent != NULL && lire_fichier(precedent, depart.position, fin_precedent, depuis, limite, &n, ecrire, ctx);
+    depart.position = 0;
+  }
+  if (ok) ok = courant != NULL && lire_fichier(courant, depart.position, fin_courant, depuis, limite, &n, ecrire, ctx);
+  if (precedent != NULL) fclose(precedent);
+  if (courant != NULL) fclose(courant);
+  atomic_fetch_add(&ch->lus_journal, (unsigned long) n);
+
+  pthread_mutex_lock(&ch->verrou);
+  return ok ? n : -1;
+}
+
+long changements_lire(Changements *ch, unsigned long long depuis, size_t limite, EcrireChangement ecrire,
+                      void *ctx) {
+  long n = 0;
+  pthread_mutex_lock(&ch->verrou);
+  unsigned long long dernier = atomic_load(&ch->dernier);
+  if (depuis > dernier) {
+    pthread_mutex_unlock(&ch->verrou);
+    return -2;
+  }
+  // Sorti de l'anneau mais deverse : le journal d'abord (les numeros sautes au demarrage n'y sont pas)
+  if (depuis + 1 < ch->premier && ch->deverse > depuis) {
+    unsigned long long deverse = ch->deverse;
+    n = lire_journal(ch, &depuis, limite, ecrire, ctx);
+    if (n < 0) atomic_fetch_add(&ch->trop_anciens, 1);
+    if (n < 0 || (size_t) n >= limite) {
+      pthread_mutex_unlock(&ch->verrou);
+      return n;
+    }
+    if (depuis < deverse) depuis = deverse;
+    // Deverse et sorti de l'anneau pendant la lecture : la suite au prochain appel
+    if (depuis + 1 < ch->premier && ch->deverse > depuis) {
+      pthread_mutex_unlock(&ch->verrou);
+      return n;
+    }
+  }
+  dernier = atomic_load(&ch->dernier);
+  long lus_journal = n;
+  for (unsigned long long s = depuis + 1 > ch->premier ? depuis + 1 : ch->premier; s <= dernier && (size_t) n < limite;
+       s++, n++) {
+    ecrire(ctx, &ch->anneau[s % CHANGEMENTS_ANNEAU]);
+  }
+  pthread_mutex_unlock(&ch->verrou);
+  atomic_fetch_add(&ch->lus_anneau, (unsigned long) (n - lus_journal));
+  return n;
+}
+
+// --- Abonnes de /api/changes ---
+
+/* Flux en cours d'une connexion, range dans c->pfn_data comme le fait
+   exportation.c ; le gestionnaire HTTP est rendu a la fin. */
+typedef struct AbonneChangements {
+  Changements *ch;
+  BoucleChangements *boucle;
+  struct mg_connection *c;
+  unsigned long long curseur;   // dernier seq envoye
+  Bool sse;
+  size_t limite;
+  uint64_t echeance;            // attente longue : reponse vide ; SSE : prochain battement
+  struct mg_iobuf corps;        // attente longue : changements de la reponse
+  mg_event_handler_t pfn;
+  void *pfn_data;
+} AbonneChangements;
+
+static void ecrire_sse(void *ctx, const Changement *x) {
+  AbonneChangements *a = (AbonneChangements *) ctx;
+  mg_printf(a->c, "id: %llu\ndata: ", x->seq);
+  mg_send(a->c, x->json, x->longueur);
+  mg_send(a->c, "\n\n", 2);
+  a->curseur = x->seq;
+}
+
+static void ecrire_json(void *ctx, const Changement *x) {
+  AbonneChangements *a = (AbonneChangements *) ctx;
+  if (a->corps.len > 0) mg_iobuf_add(&a->corps, a->corps.len, ",\n", 2);
+  mg_iobuf_add(&a->corps, a->corps.len, x->json, x->longueur);
+  a->curseur = x->seq;
+}
+
+static void ignorer(void *ctx, const Changement *x) {
+  (void) ctx;
+  (void) x;
+}
+
+static void repondre_trop_ancien(Changements *ch, struct mg_connection *c, long etat) {
+  unsigned long long plus_ancien = 0;
+  pthread_mutex_lock(&ch->verrou);
+  plus_ancien = ch->nb_reperes > 0 ? ch->reperes[0].seq : ch->premier;
+  pthread_mutex_unlock(&ch->verrou);
+  mg_http_reply(c, 410, "Content-Type: application/json\r\n",
+                "{\"error\": \"%s\", \"plus_ancien\": %llu, \"dernier\": %llu, \"instantane\": \"/api/export\"}\n",
+                etat == -2 ? "Curseur inconnu (posterieur au dernier changement)"
+                           : "Curseur trop ancien : repartir d'un instantane",
+                plus_ancien, atomic_load(&ch->dernier));
+}
+
+static void repondre_json(AbonneChangements *a, unsigned long long depuis) {
+  mg_http_reply(a->c, 200, "Content-Type: application/json\r\nCache-Control: no-store\r\n",
+                "{\"depuis\": %llu, \"suivant\": %llu, \"dernier\": %llu, \"changements\": [%.*s]}\n", depuis,
+                a->curseur, atomic_load(&a->ch->dernier), (int) a->corps.len,
+                a->corps.buf != NULL ? (char *) a->corps.buf : "");
+  mg_iobuf_free(&a->corps);
+}
+
+static void rendre(struct mg_connection *c, AbonneChangements *a) {
+  c->pfn = a->pfn;
+  c->pfn_data = a->pfn_data;
+  atomic_fetch_sub(&a->boucle->abonnes, 1);
+  mg_iobuf_free(&a->corps);
+  free(a);
+}
+
+// Envoie ce qui est arrive depuis le curseur ; l'attente longue se termine au premier lot
+static void avancer(struct mg_connection *c, AbonneChangements *a, uint64_t maintenant) {
+  Changements *ch = a->ch;
+  if (a->sse) {
+    while (c->send.len < 256 * 1024 && a->curseur < atomic_load(&ch->dernier)) {
+      long n = changements_lire(ch, a->curseur, a->limite, ecrire_sse, a);
+      if (n < 0) {
+        mg_printf(c, "event: trop_ancien\ndata: {\"curseur\": %llu}\n\n", a->curseur);
+        c->is_draining = 1;
+        rendre(c, a);
+        return;
+      }
+      if (n == 0) break;
+    }
+    if (maintenant >= a->echeance) {
+      mg_send(c, ":\n\n", 3);
+      a->echeance = maintenant + CHANGEMENTS_BATTEMENT_MS;
+    }
+    return;
+  }
+  unsigned long long depuis = a->curseur;
+  long n = a->curseur < atomic_load(&ch->dernier) ? changements_lire(ch, a->curseur, a->limite, ecrire_json, a) : 0;
+  if (n < 0) {
+    repondre_trop_ancien(ch, c, n);
+  } else if (n > 0 || maintenant >= a->echeance) {
+    repondre_json(a, depuis);
+  } else {
+    return;
+  }
+  rendre(c, a);
+  if (c->recv.len > 0) c->pfn(c, MG_EV_READ, NULL);  // requete suivante deja recue
+}
+
+static void abonne_cb(struct mg_connection *c, int ev, void *ev_data) {
+  AbonneChangements *a = (AbonneChangements *) c->pfn_data;
+  if (ev == MG_EV_CLOSE) {
+    rendre(c, a);
+  } else if (ev == MG_EV_POLL) {
+    avancer(c, a, *(uint64_t *) ev_data);
+  } else if (ev == MG_EV_WRITE && a->sse) {
+    avancer(c, a, mg_millis());
+  }
+}
+
+static BoucleChangements *boucle_de(Changements *ch, const struct mg_mgr *mgr) {
+  for (size_t i = 0; i < ch->nb_boucles; i++) {
+    if (ch->boucles[i].mgr == mgr) return &ch->boucles[i];
+  }
+  return NULL;
+}
+
+void changements_servir(Changements *ch, struct mg_connection *c, unsigned long long depuis, Bool sse,
+                        unsigned long attente_ms, size_t limite) {
+  if (limite == 0 || limite > CHANGEMENTS_LOT) limite = CHANGEMENTS_LOT;
+  AbonneChangements tout_de_suite = {.ch = ch, .c = c, .curseur = depuis, .limite = limite};
+  tout_de_suite.corps.align = 4096;
+  BoucleChangements *boucle = boucle_de(ch, c->mgr);
+  if (!sse) {
+    // Deja des changements (ou pas d'attente) : reponse immediate, sans abonnement
+    long n = changements_lire(ch, depuis, limite, ecrire_json, &tout_de_suite);
+    if (n < 0) {
+      mg_iobuf_free(&tout_de_suite.corps);
+      repondre_trop_ancien(ch, c, n);
+      return;
+    }
+    if (n > 0 || attente_ms == 0 || boucle == NULL) {
+      repondre_json(&tout_de_suite, depuis);
+      return;
+    }
+  } else {
+    long n = changements_lire(ch, depuis, 1, ignorer, NULL);  // curseur encore lisible ?
+    if (n < 0) {
+      repondre_trop_ancien(ch, c, n);
+      return;
+    }
+  }
+  if (boucle == NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Flux indisponible\"}\n");
+    return;
+  }
+  AbonneChangements *a = calloc(1, sizeof(AbonneChangements));
+  if (a == NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Memoire insuffisante\"}\n");
+    return;
+  }
+  *a = tout_de_suite;
+  a->boucle = boucle;
+  a->sse = sse;
+  a->echeance = mg_millis() + (sse ? CHANGEMENTS_BATTEMENT_MS : attente_ms);
+  atomic_fetch_add(&boucle->abonnes, 1);
+  if (sse) {
+    mg_printf(c,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: text/event-stream\r\n"
+              "Cache-Control: no-store\r\n\r\n"
+              "retry: 5000\n\n");
+  }
+  a->pfn = c->pfn;
+  a->pfn_data = c->pfn_data;
+  c->pfn = abonne_cb;
+  c->pfn_data = a;
+  if (sse) avancer(c, a, mg_millis());
+}
+
+void changements_livrer(Changements *ch, struct mg_connection *ecoute) {
+  BoucleChangements *b = boucle_de(ch, ecoute->mgr);
+  if (b == NULL || !atomic_exchange(&b->reveil, 0)) return;
+  uint64_t maintenant = mg_millis();
+  for (struct mg_connection *c = ecoute->mgr->conns; c != NULL; c = c->next) {
+    if (c->pfn == abonne_cb && !c->is_closing && !c->is_draining) {
+      avancer(c, (AbonneChangements *) c->pfn_data, maintenant);
+    }
+  }
+}
+
+char *changements_stats_json(Changements *ch) {
+  pthread_mutex_lock(&ch->verrou);
+  unsigned long long premier = ch->premier, deverse = ch->deverse;
+  unsigned long long plus_ancien = ch->nb_reperes > 0 ? ch->reperes[0].seq : premier;
+  long taille = ch->taille + ch->taille_precedent;
+  pthread_mutex_unlock(&ch->verrou);
+  unsigned long abonnes = 0;
+  for (size_t i = 0; i < ch->nb_boucles; i++) abonnes += atomic_load(&ch->boucles[i].abonnes);
+  return mg_mprintf("{ \"dernier\": %llu, \"premier_anneau\": %llu, \"plus_ancien\": %llu, \"deverse\": %llu, "
+                    "\"journal_octets\": %ld, \"abonnes\": %lu, \"lus_anneau\": %lu, \"lus_journal\": %lu, "
+                    "\"trop_anciens\": %lu }",
+                    atomic_load(&ch->dernier), premier, plus_ancien, deverse, taille, abonnes,
+                    atomic_load(&ch->lus_anneau), atomic_load(&ch->lus_journal), atomic_load(&ch->trop_anciens));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define CHANGEMENTS_ANNEAU 16384                     // derniers changements gardes en memoire (puissance de 2)
+#define CHANGEMENTS_DEVERSEMENT 1024                 // changements accumules avant un ajout au journal
+#define CHANGEMENTS_JOURNAL_MAX (64L * 1024 * 1024)  // au-dela, le journal devient <journal>.1
+#define CHANGEMENTS_LIGNE_MAX (64 * 1024)            // une ligne du journal
+#define CHANGEMENTS_LOT 1000                         // changements par reponse, au plus
+#define CHANGEMENTS_BATTEMENT_MS 15000               // commentaire SSE pour garder la connexion
+
+// Un changement numerote : l'objet JSON complet, seq en tete
+typedef struct Changement {
+    unsigned long long seq;
+    char *json;
+    size_t longueur;
+} Changement;
+
+// Debut d'un deversement dans un journal : on y reprend la lecture d'un seq plus ancien
+typedef struct RepereJournal {
+    unsigned long long seq;
+    long position;
+    unsigned int fichier;       // numero du journal (le courant ou le precedent)
+} RepereJournal;
+
+// Connexions d'une boucle qui suivent le flux (SSE ou attente longue)
+typedef struct BoucleChangements {
+    struct mg_mgr *mgr;
+    unsigned long ecoute;       // id de la connexion qui recoit les reveils
+    atomic_ulong abonnes;
+    atomic_int reveil;          // mg_wakeup deja envoye, pas encore traite
+} BoucleChangements;
+
+/* Chaque ecriture du catalogue ou des prets recoit un numero croissant
+   (seq) a sa premiere application. Les CHANGEMENTS_ANNEAU derniers restent
+   en memoire ; ils partent dans le journal par paquets de
+   CHANGEMENTS_DEVERSEMENT, avant d'etre ecrases. Un client reprend apres le
+   dernier seq recu, depuis l'anneau ou le journal ; s'il est plus ancien
+   que les deux, il doit repartir d'un instantane (/api/export).
+   Chaque demarrage ecrit un changement "demarrage" CHANGEMENTS_DEVERSEMENT
+   apres le dernier seq du journal : apres un arret brutal, les changements
+   perdus avec l'anneau ne sont jamais renumerotes. */
+typedef struct Changements {
+    pthread_mutex_t verrou;
+    Changement *anneau;                 // indice : seq % CHANGEMENTS_ANNEAU
+    unsigned long long premier;         // plus ancien seq de l'anneau
+    atomic_ullong dernier;              // dernier seq attribue (0 : aucun)
+    unsigned long long deverse;         // dernier seq ecrit dans le journal
+    char chemin[256];                   // journal courant ; le precedent est chemin.1
+    long taille;                        // du journal courant
+    long taille_precedent;
+    unsigned int fichier;               // numero du journal courant
+    RepereJournal *reperes;
+    size_t nb_reperes;
+    size_t cap_reperes;
+    BoucleChangements *boucles;
+    size_t nb_boucles;
+    atomic_ulong lus_anneau;
+    atomic_ulong lus_journal;
+    atomic_ulong trop_anciens;
+} Changements;
+
+typedef void (*EcrireChangement)(void *ctx, const Changement *ch);
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+// Relit les journaux de chemin (reperes, dernier seq) ; FAUX faute de memoire
+Bool changements_init(Changements *ch, const char *chemin, size_t nb_boucles);
+void changements_boucle(Changements *ch, size_t indice, struct mg_mgr *mgr, unsigned long ecoute);
+// Apres l'arret des boucles : deverse l'anneau dans le journal
+void changements_free(Changements *ch);
+
+/* N'importe quel thread, dans l'ordre des ecritures : corps est un objet
+   JSON ("{...}") qui recoit "seq" en tete. Retourne le seq attribue (0 en
+   cas d'echec) ; *ligne, si non nul, recoit une copie de l'objet complet. */
+unsigned long long changements_ajouter(Changements *ch, const char *corps, char **ligne);
+
+/* Appelle ecrire pour les changements de seq > depuis, dans l'ordre, au
+   plus limite. Retourne le nombre lu, -1 si depuis est sorti de l'anneau
+   et des journaux, -2 si depuis depasse le dernier seq. */
+long changements_lire(Changements *ch, unsigned long long depuis, size_t limite, EcrireChangement ecrire,
+                      void *ctx);
+
+/* Boucle : /api/changes. sse : flux text/event-stream sans fin ; sinon
+   reponse JSON des que des changements existent apres depuis, ou vide au
+   bout de attente_ms. 410 si depuis est trop ancien. */
+void changements_servir(Changements *ch, struct mg_connection *c, unsigned long long depuis, Bool sse,
+                        unsigned long attente_ms, size_t limite);
+// MG_EV_WAKEUP de la socket d'ecoute d'une boucle
+void changements_livrer(Changements *ch, struct mg_connection *ecoute);
+
+char *changements_stats_json(Changements *ch);
@@ -0,0 +1,275 @@
+#include "depot.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "empreinte.h"
+
+static int chiffre_hex(char c) {
+  return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+Bool depot_nom_valide(const char *nom) {
+  if (nom == NULL) return FAUX;
+  for (size_t i = 0; i < 64; i++) {
+    if (chiffre_hex(nom[i]) < 0) return FAUX;  // minuscules seulement : un seul nom par contenu
+  }
+  size_t ext = strlen(nom + 64);
+  if (nom[64] != '.' || ext < 2 || ext > DEPOT_EXTENSION + 1) return FAUX;
+  for (const char *p = nom + 65; *p; p++) {
+    if (!islower((unsigned char) *p) && !isdigit((unsigned char) *p)) return FAUX;
+  }
+  return VRAI;
+}
+
+void depot_extension(const char *nom, char extension[DEPOT_EXTENSION + 1]) {
+  const char *point = nom != NULL ? strrchr(nom, '.') : NULL;
+  size_t n = 0;
+  if (point != NULL && strlen(point + 1) <= DEPOT_EXTENSION) {
+    for (const char *p = point + 1; *p && isalnum((unsigned char) *p); p++) {
+      extension[n++] = (char) tolower((unsigned char) *p);
+    }
+    if (point[1 + n] != '\0') n = 0;
+  }
+  if (n == 0) memcpy(extension, "bin", n = 3);
+  extension[n] = '\0';
+}
+
+static uint32_t hachage_nom(const char *nom) {
+  uint32_t h = 0;
+  for (size_t i = 0; i < 8; i++) h = (h << 4) | (uint32_t) chiffre_hex(nom[i]);
+  return h;
+}
+
+// --- Table des blobs (sous d->verrou) ---
+
+static Blob *blob_chercher(Depot *d, const char *nom, uint32_t hachage) {
+  for (Blob *b = d->alveoles[hachage & (DEPOT_ALVEOLES - 1)]; b != NULL; b = b->suivant) {
+    if (b->hachage == hachage && strcmp(b->nom, nom) == 0) return b;
+  }
+  return NULL;
+}
+
+static Blob *blob_ajouter(Depot *d, const char *nom, uint64_t taille) {
+  Blob *b = calloc(1, sizeof(Blob));
+  if (b == NULL) return NULL;
+  snprintf(b->nom, sizeof(b->nom), "%s", nom);
+  b->hachage = hachage_nom(nom);
+  b->taille = taille;
+  b->libre_depuis = mg_millis();
+  Blob **alveole = &d->alveoles[b->hachage & (DEPOT_ALVEOLES - 1)];
+  b->suivant = *alveole;
+  *alveole = b;
+  d->nb_blobs++;
+  d->octets += taille;
+  return b;
+}
+
+static void chemin_blob(const Depot *d, const char *nom, char *chemin, size_t taille) {
+  snprintf(chemin, taille, "%s/%s", d->repertoire, nom);
+}
+
+// Un blob existant au demarrage ; restes de televersements interrompus effaces
+static void inventorier(const char *nom, void *arg) {
+  Depot *d = (Depot *) arg;
+  char chemin[MG_PATH_MAX];
+  chemin_blob(d, nom, chemin, sizeof(chemin));
+  size_t taille = 0;
+  if (nom[0] == '.' && strlen(nom) == 1 + 16 + 5 && strcmp(nom + 17, ".part") == 0) {
+    remove(chemin);
+  } else if (depot_nom_valide(nom) && mg_fs_posix.st(chemin, &taille, NULL) != 0) {
+    blob_ajouter(d, nom, taille);
+  }
+}
+
+Bool depot_init(Depot *d, const char *repertoire, CacheFichiers *cache, Inventaire *inventaire) {
+  memset(d, 0, sizeof(Depot));
+  pthread_mutex_init(&d->verrou, NULL);
+  snprintf(d->repertoire, sizeof(d->repertoire), "%s", repertoire);
+  d->cache = cache;
+  d->inventaire = inventaire;
+  mg_fs_posix.ls(repertoire, inventorier, d);  // une seule lecture du repertoire
+  return mg_fs_posix.st(repertoire, NULL, NULL) & MG_FS_DIR;
+}
+
+void depot_free(Depot *d) {
+  for (size_t i = 0; i < DEPOT_ALVEOLES; i++) {
+    while (d->alveoles[i] != NULL) {
+      Blob *b = d->alveoles[i];
+      d->alveoles[i] = b->suivant;
+      free(b);
+    }
+  }
+  pthread_mutex_destroy(&d->verrou);
+}
+
+static void nommer(const char *sha256, const char *extension, char nom[DEPOT_NOM]) {
+  size_t i = 0;
+  for (; i < 64 && sha256[i]; i++) nom[i] = (char) tolower((unsigned char) sha256[i]);
+  snprintf(nom + i, DEPOT_NOM - i, ".%s", extension);
+}
+
+Bool depot_trouver(Depot *d, const char *sha256, const char *extension, char nom[DEPOT_NOM]) {
+  nommer(sha256, extension, nom);
+  if (!depot_nom_valide(nom)) return FAUX;
+  pthread_mutex_lock(&d->verrou);
+  Blob *b = blob_chercher(d, nom, hachage_nom(nom));
+  if (b != NULL) {
+    b->libre_depuis = mg_millis();
+    atomic_fetch_add(&d->doublons, 1);
+    atomic_fetch_add(&d->octets_evites, (unsigned long) b->taille);
+  }
+  pthread_mutex_unlock(&d->verrou);
+  return b != NULL;
+}
+
+Bool depot_publier(Depot *d, const char *temporaire, const char *sha256, const char *extension,
+                   uint64_t taille, char nom[DEPOT_NOM], Bool *doublon) {
+  char chemin[MG_PATH_MAX];
+  nommer(sha256, extension, nom);
+  chemin_blob(d, nom, chemin, sizeof(chemin));
+  Bool ok = VRAI;
+
+  // Sous le verrou : deux publications du meme contenu ne renomment qu'une fois
+  pthread_mutex_lock(&d->verrou);
+  Blob *b = blob_chercher(d, nom, hachage_nom(nom));
+  *doublon = b != NULL;
+  if (b != NULL) {
+    remove(temporaire);
+    b->libre_depuis = mg_millis();
+    atomic_fetch_add(&d->doublons, 1);
+    atomic_fetch_add(&d->octets_evites, (unsigned long) taille);
+  } else if (rename(temporaire, chemin) != 0) {
+    remove(temporaire);
+    ok = FAUX;
+  } else {
+    blob_ajouter(d, nom, taille);
+    atomic_fetch_add(&d->publies, 1);
+    inventaire_actualiser(d->inventaire, nom);  // sans attendre inotify
+  }
+  const char *barre = strrchr(temporaire, '/');
+  inventaire_actualiser(d->inventaire, barre != NULL ? barre + 1 : temporaire);  // ancien nom, a l'import
+  pthread_mutex_unlock(&d->verrou);
+  return ok;
+}
+
+Bool depot_importer(Depot *d, const char *chemin, const char *extension, char nom[DEPOT_NOM]) {
+  FILE *fp = fopen(chemin, "rb");
+  unsigned char *tampon = malloc(64 * 1024);
+  if (fp == NULL || tampon == NULL) {
+    if (fp != NULL) fclose(fp);
+    free(tampon);
+    return FAUX;
+  }
+  Empreinte e;
+  uint64_t taille = 0;
+  size_t n;
+  empreinte_init(&e);
+  while ((n = fread(tampon, 1, 64 * 1024, fp)) > 0) {
+    empreinte_ajouter(&e, tampon, n);
+    taille += n;
+  }
+  Bool lu = !ferror(fp);
+  fclose(fp);
+  free(tampon);
+  if (!lu) return FAUX;
+
+  unsigned char brut[32];
+  char sha256[65];
+  Bool doublon;
+  empreinte_finir(&e, brut);
+  for (size_t i = 0; i < 32; i++) snprintf(sha256 + 2 * i, 3, "%02x", brut[i]);
+  return depot_publier(d, chemin, sha256, extension, taille, nom, &doublon);
+}
+
+void depot_referencer(Depot *d, const char *nom, int delta) {
+  if (!depot_nom_valide(nom)) return;
+  pthread_mutex_lock(&d->verrou);
+  Blob *b = blob_chercher(d, nom, hachage_nom(nom));
+  if (b != NULL) {
+    b->references += delta;
+    if (b->references <= 0) {
+      b->references = 0;
+      b->libre_depuis = mg_millis();
+    }
+  }
+  pthread_mutex_unlock(&d->verrou);
+}
+
+void depot_oublier_references(Depot *d) {
+  uint64_t maintenant = mg_millis();
+  pthread_mutex_lock(&d->verrou);
+  for (size_t i = 0; i < DEPOT_ALVEOLES; i++) {
+    for (Blob *b = d->alveoles[i]; b != NULL; b = b->suivant) {
+      if (b->references > 0) b->libre_depuis = maintenant;
+      b->references = 0;
+    }
+  }
+  pthread_mutex_unlock(&d->verrou);
+}
+
+Bool depot_servir(Depot *d, const char *nom) {
+  pthread_mutex_lock(&d->verrou);
+  Bool present = blob_chercher(d, nom, hachage_nom(nom)) != NULL;
+  pthread_mutex_unlock(&d->verrou);
+  atomic_fetch_add(present ? &d->servis : &d->absents, 1);
+  return present;
+}
+
+size_t depot_collecter(Depot *d, uint64_t delai_ms) {
+  uint64_t maintenant = mg_millis();
+  size_t nb = 0;
+  char chemin[MG_PATH_MAX];
+  pthread_mutex_lock(&d->verrou);
+  for (size_t i = 0; i < DEPOT_ALVEOLES; i++) {
+    for (Blob **p = &d->alveoles[i]; *p != NULL;) {
+      Blob *b = *p;
+      if (b->references > 0 || maintenant - b->libre_depuis < delai_ms) {
+        p = &b->suivant;
+        continue;
+      }
+      chemin_blob(d, b->nom, chemin, sizeof(chemin));
+      remove(chemin);
+      cache_fichiers_invalider(d->cache, chemin);
+      inventaire_actualiser(d->inventaire, b->nom);
+      *p = b->suivant;
+      d->nb_blobs--;
+      d->octets -= b->taille;
+      atomic_fetch_add(&d->octets_liberes, (unsigned long) b->taille);
+      free(b);
+      nb++;
+    }
+  }
+  pthread_mutex_unlock(&d->verrou);
+  atomic_fetch_add(&d->collectes, nb);
+  return nb;
+}
+
+char *depot_stats_json(Depot *d) {
+  size_t orphelins = 0;
+  unsigned long references = 0;
+  pthread_mutex_lock(&d->verrou);
+  for (size_t i = 0; i < DEPOT_ALVEOLES; i++) {
+    for (Blob *b = d->alveoles[i]; b != NULL; b = b->suivant) {
+      orphelins += b->references == 0;
+      references += (unsigned long) b->references;
+    }
+  }
+  size_t nb = d->nb_blobs;
+  uint64_t octets = d->octets;
+  pthread_mutex_unlock(&d->verrou);
+
+  unsigned long servis = atomic_load(&d->servis), absents = atomic_load(&d->absents);
+  unsigned long publies = atomic_load(&d->publies), doublons = atomic_load(&d->doublons);
+  return mg_mprintf("{ \"blobs\": %lu, \"octets\": %llu, \"references\": %lu, \"orphelins\": %lu, "
+                    "\"servis\": %lu, \"absents\": %lu, \"taux_succes\": %.3f, "
+                    "\"publies\": %lu, \"doublons\": %lu, \"taux_doublons\": %.3f, \"octets_evites\": %lu, "
+                    "\"collectes\": %lu, \"octets_liberes\": %lu }",
+                    (unsigned long) nb, (unsigned long long) octets, references, (unsigned long) orphelins,
+                    servis, absents, servis + absents > 0 ? (double) servis / (double) (servis + absents) : 0.0,
+                    publies, doublons,
+                    publies + doublons > 0 ? (double) doublons / (double) (publies + doublons) : 0.0,
+                    atomic_load(&d->octets_evites), atomic_load(&d->collectes),
+                    atomic_load(&d->octets_liberes));
+}
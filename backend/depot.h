@@ -0,0 +1,78 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+#include "envoi.h"
+#include "inventaire.h"
+
+#define DEPOT_EXTENSION 8                     // caracteres, sans le point
+#define DEPOT_NOM (64 + 1 + DEPOT_EXTENSION + 1)
+#define DEPOT_ALVEOLES 4096                   // puissance de 2
+#define DEPOT_DELAI_MS (60 * 60 * 1000)       // blob sans reference : garde une heure
+#define DEPOT_COLLECTE_MS (10 * 60 * 1000)    // periode du ramasse-miettes
+
+/* Un fichier du depot, nomme "<sha256>.<extension>" : son nom decrit son
+   contenu, qui ne change donc jamais. */
+typedef struct Blob {
+    char nom[DEPOT_NOM];
+    uint32_t hachage;           // 8 premiers chiffres de l'empreinte
+    uint64_t taille;
+    int references;             // livres du catalogue qui le designent
+    uint64_t libre_depuis;      // mg_millis : sans reference (ou redemande) depuis
+    struct Blob *suivant;
+} Blob;
+
+/* Stockage adresse par le contenu d'un repertoire (pdf ou couvertures) :
+   deux televersements identiques donnent un seul fichier. Les references
+   viennent des champs fichier / couverture des livres ; un blob qui n'en a
+   plus depuis le delai de grace est efface par depot_collecter. Les
+   fichiers au nom libre (anciens uploads) ne sont ni comptes ni effaces. */
+typedef struct Depot {
+    pthread_mutex_t verrou;
+    char repertoire[MG_PATH_MAX / 2];
+    CacheFichiers *cache;       // descripteurs a oublier quand un blob part
+    Inventaire *inventaire;     // liste du repertoire a tenir a jour, ou NULL
+    Blob *alveoles[DEPOT_ALVEOLES];
+    size_t nb_blobs;
+    uint64_t octets;            // taille totale des blobs
+    atomic_ulong servis;        // requetes pour un blob present
+    atomic_ulong absents;       // requetes pour un nom de blob inconnu
+    atomic_ulong publies;       // contenus nouveaux
+    atomic_ulong doublons;      // contenus deja presents (transfert ou copie evites)
+    atomic_ulong octets_evites;
+    atomic_ulong collectes;
+    atomic_ulong octets_liberes;
+} Depot;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool depot_init(Depot *d, const char *repertoire, CacheFichiers *cache, Inventaire *inventaire);
+void depot_free(Depot *d);
+
+Bool depot_nom_valide(const char *nom);
+void depot_extension(const char *nom, char extension[DEPOT_EXTENSION + 1]);
+
+/* Blob deja present pour cette empreinte (hexadecimal) : son nom dans nom,
+   et le delai de grace repart (un livre va le designer). */
+Bool depot_trouver(Depot *d, const char *sha256, const char *extension, char nom[DEPOT_NOM]);
+
+/* Range le fichier temporaire (meme repertoire) sous son nom de blob, ou
+   l'efface si ce contenu est deja la. Renvoie FAUX si rename echoue. */
+Bool depot_publier(Depot *d, const char *temporaire, const char *sha256, const char *extension,
+                   uint64_t taille, char nom[DEPOT_NOM], Bool *doublon);
+
+// Hache un fichier existant du repertoire et le renomme en blob
+Bool depot_importer(Depot *d, const char *chemin, const char *extension, char nom[DEPOT_NOM]);
+
+void depot_referencer(Depot *d, const char *nom, int delta);
+void depot_oublier_references(Depot *d);
+
+// Compte le succes ou l'echec ; VRAI si le blob est present
+Bool depot_servir(Depot *d, const char *nom);
+
+// Efface les blobs sans reference depuis delai_ms ; renvoie leur nombre
+size_t depot_collecter(Depot *d, uint64_t delai_ms);
+char *depot_stats_json(Depot *d);
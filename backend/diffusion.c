@@ -0,0 +1,182 @@
+#include "diffusion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Bool diffusion_init(Diffusion *d, size_t nb_boucles) {
+  memset(d, 0, sizeof(Diffusion));
+  d->files = calloc(nb_boucles > 0 ? nb_boucles : 1, sizeof(FileDiffusion));
+  if (d->files == NULL) return FAUX;
+  d->nb_files = nb_boucles;
+  for (size_t i = 0; i < nb_boucles; i++) {
+    pthread_mutex_init(&d->files[i].verrou, NULL);
+    atomic_init(&d->files[i].abonnes, 0);
+  }
+  atomic_init(&d->abonnes, 0);
+  atomic_init(&d->publies, 0);
+  atomic_init(&d->envois, 0);
+  atomic_init(&d->octets, 0);
+  atomic_init(&d->decroches, 0);
+  return VRAI;
+}
+
+void diffusion_boucle(Diffusion *d, size_t indice, struct mg_mgr *mgr, unsigned long ecoute) {
+  if (indice >= d->nb_files) return;
+  d->files[indice].mgr = mgr;
+  d->files[indice].ecoute = ecoute;
+}
+
+static void trame_relacher(TrameDiffusion *t) {
+  if (atomic_fetch_sub(&t->references, 1) == 1) free(t);
+}
+
+void diffusion_free(Diffusion *d) {
+  for (size_t i = 0; i < d->nb_files; i++) {
+    FileDiffusion *f = &d->files[i];
+    for (size_t k = 0; k < f->nb; k++) trame_relacher(f->trames[k]);
+    free(f->trames);
+    pthread_mutex_destroy(&f->verrou);
+  }
+  free(d->files);
+  d->files = NULL;
+  d->nb_files = 0;
+}
+
+static FileDiffusion *file_de(Diffusion *d, const struct mg_mgr *mgr) {
+  for (size_t i = 0; i < d->nb_files; i++) {
+    if (d->files[i].mgr == mgr) return &d->files[i];
+  }
+  return NULL;
+}
+
+// --- Boucle ---
+
+Bool diffusion_abonner(Diffusion *d, struct mg_connection *c, struct mg_http_message *hm) {
+  FileDiffusion *f = file_de(d, c->mgr);
+  if (f == NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Diffusion indisponible\"}\n");
+    return FAUX;
+  }
+  mg_ws_upgrade(c, hm, NULL);
+  if (!c->is_websocket) return FAUX;  // 426 deja repondu
+  atomic_fetch_add(&f->abonnes, 1);
+  atomic_fetch_add(&d->abonnes, 1);
+  return VRAI;
+}
+
+void diffusion_quitter(Diffusion *d, struct mg_connection *c) {
+  if (!c->is_websocket) return;
+  FileDiffusion *f = file_de(d, c->mgr);
+  if (f == NULL) return;
+  atomic_fetch_sub(&f->abonnes, 1);
+  atomic_fetch_sub(&d->abonnes, 1);
+}
+
+void diffusion_livrer(Diffusion *d, struct mg_connection *ecoute) {
+  FileDiffusion *f = file_de(d, ecoute->mgr);
+  if (f == NULL) return;
+  pthread_mutex_lock(&f->verrou);
+  TrameDiffusion **trames = f->trames;
+  size_t nb = f->nb;
+  f->trames = NULL;
+  f->nb = f->cap = 0;
+  pthread_mutex_unlock(&f->verrou);
+  if (nb == 0) return;
+
+  unsigned long envois = 0, octets = 0, decroches = 0;
+  for (struct mg_connection *c = ecoute->mgr->conns; c != NULL; c = c->next) {
+    if (!c->is_websocket || c->is_closing || c->is_draining) continue;
+    for (size_t k = 0; k < nb; k++) {
+      if (c->send.len > DIFFUSION_RETARD_MAX) {
+        c->is_closing = 1;  // ne lit plus : il se reabonnera et recevra l'etat complet
+        decroches++;
+        break;
+      }
+      mg_send(c, trames[k]->octets, trames[k]->longueur);
+      envois++;
+      octets += trames[k]->longueur;
+    }
+  }
+  for (size_t k = 0; k < nb; k++) trame_relacher(trames[k]);
+  free(trames);
+  atomic_fetch_add(&d->envois, envois);
+  atomic_fetch_add(&d->octets, octets);
+  atomic_fetch_add(&d->decroches, decroches);
+}
+
+// --- Publieurs ---
+
+Bool diffusion_active(Diffusion *d) {
+  return d->files != NULL && atomic_load(&d->abonnes) > 0;
+}
+
+// En-tete d'une trame texte du serveur (FIN, sans masque), RFC 6455 5.2
+static size_t entete_trame(unsigned char *e, size_t longueur) {
+  e[0] = 0x81;
+  if (longueur < 126) {
+    e[1] = (unsigned char) longueur;
+    return 2;
+  }
+  if (longueur < 65536) {
+    e[1] = 126;
+    e[2] = (unsigned char) (longueur >> 8);
+    e[3] = (unsigned char) longueur;
+    return 4;
+  }
+  e[1] = 127;
+  for (int i = 0; i < 8; i++) e[2 + i] = (unsigned char) ((uint64_t) longueur >> (56 - 8 * i));
+  return 10;
+}
+
+void diffusion_publier(Diffusion *d, const char *fmt, ...) {
+  if (!diffusion_active(d)) return;
+  va_list ap;
+  va_start(ap, fmt);
+  char *message = mg_vmprintf(fmt, &ap);
+  va_end(ap);
+  if (message == NULL) return;
+  diffusion_publier_texte(d, message, strlen(message));
+  free(message);
+}
+
+void diffusion_publier_texte(Diffusion *d, const char *message, size_t longueur) {
+  if (!diffusion_active(d)) return;
+  TrameDiffusion *t = malloc(sizeof(TrameDiffusion) + longueur + 10);
+  if (t == NULL) return;
+  size_t entete = entete_trame(t->octets, longueur);
+  memcpy(t->octets + entete, message, longueur);
+  t->longueur = entete + longueur;
+  atomic_fetch_add(&d->publies, 1);
+
+  // Une reference par boucle visee, plus celle de la publication
+  atomic_init(&t->references, 1);
+  for (size_t i = 0; i < d->nb_files; i++) {
+    FileDiffusion *f = &d->files[i];
+    if (f->mgr == NULL || atomic_load(&f->abonnes) == 0) continue;
+    atomic_fetch_add(&t->references, 1);
+    pthread_mutex_lock(&f->verrou);
+    Bool ajoutee = VRAI, reveil = f->nb == 0;
+    if (f->nb == f->cap) {
+      size_t cap = f->cap == 0 ? 16 : f->cap * 2;
+      TrameDiffusion **trames = realloc(f->trames, cap * sizeof(TrameDiffusion *));
+      if (trames != NULL) {
+        f->trames = trames;
+        f->cap = cap;
+      } else {
+        ajoutee = FAUX;
+      }
+    }
+    if (ajoutee) f->trames[f->nb++] = t;
+    pthread_mutex_unlock(&f->verrou);
+    if (!ajoutee) trame_relacher(t);
+    else if (reveil) mg_wakeup(f->mgr, f->ecoute, "", 0);
+  }
+  trame_relacher(t);
+}
+
+char *diffusion_stats_json(Diffusion *d) {
+  return mg_mprintf("{ \"abonnes\": %lu, \"publies\": %lu, \"envois\": %lu, \"octets\": %lu, \"decroches\": %lu }",
+                    atomic_load(&d->abonnes), atomic_load(&d->publies), atomic_load(&d->envois),
+                    atomic_load(&d->octets), atomic_load(&d->decroches));
+}
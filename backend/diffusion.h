@@ -0,0 +1,65 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define DIFFUSION_RETARD_MAX (1024 * 1024)  // tampon d'envoi d'un abonne au-dela duquel il est deconnecte
+
+/* Un message deja mis en trame WebSocket (texte, non masque : la meme
+   pour tous les abonnes), partage par les boucles qui doivent l'envoyer. */
+typedef struct TrameDiffusion {
+    atomic_int references;      // boucles qui ne l'ont pas encore envoyee
+    size_t longueur;
+    unsigned char octets[];     // en-tete WebSocket puis message JSON
+} TrameDiffusion;
+
+/* Trames en attente pour une boucle. Elles sont ajoutees par n'importe
+   quel thread ; la boucle est reveillee (mg_wakeup vers sa socket
+   d'ecoute) seulement quand sa file etait vide. */
+typedef struct FileDiffusion {
+    pthread_mutex_t verrou;
+    TrameDiffusion **trames;
+    size_t nb;
+    size_t cap;
+    struct mg_mgr *mgr;
+    unsigned long ecoute;       // id de la connexion qui recoit les reveils
+    atomic_ulong abonnes;       // ecrit par la boucle, lu par les publieurs
+} FileDiffusion;
+
+/* Abonnes WebSocket de /ws, repartis sur les boucles. Un evenement est
+   serialise et mis en trame une seule fois (diffusion_publier), puis
+   chaque boucle copie la meme trame dans le tampon d'envoi de ses
+   abonnes. Sans abonne, publier ne coute qu'une lecture atomique. */
+typedef struct Diffusion {
+    FileDiffusion *files;
+    size_t nb_files;
+    atomic_ulong abonnes;       // toutes boucles confondues
+    atomic_ulong publies;       // evenements mis en trame
+    atomic_ulong envois;        // copies dans un tampon d'abonne
+    atomic_ulong octets;
+    atomic_ulong decroches;     // abonnes deconnectes car trop en retard
+} Diffusion;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool diffusion_init(Diffusion *d, size_t nb_boucles);
+// Avant le lancement des boucles : mgr de la boucle indice et id de sa socket d'ecoute
+void diffusion_boucle(Diffusion *d, size_t indice, struct mg_mgr *mgr, unsigned long ecoute);
+void diffusion_free(Diffusion *d);
+
+// Boucle : passe c en WebSocket et le compte comme abonne (FAUX sans en-tetes WebSocket)
+Bool diffusion_abonner(Diffusion *d, struct mg_connection *c, struct mg_http_message *hm);
+// MG_EV_CLOSE de n'importe quelle connexion
+void diffusion_quitter(Diffusion *d, struct mg_connection *c);
+// MG_EV_WAKEUP ou MG_EV_POLL de la socket d'ecoute : envoie les trames en attente
+void diffusion_livrer(Diffusion *d, struct mg_connection *ecoute);
+
+Bool diffusion_active(Diffusion *d);
+// N'importe quel thread : message JSON (format de mg_mprintf) pour tous les abonnes
+void diffusion_publier(Diffusion *d, const char *fmt, ...);
+// Meme chose pour un message deja serialise
+void diffusion_publier_texte(Diffusion *d, const char *message, size_t longueur);
+char *diffusion_stats_json(Diffusion *d);
@@ -0,0 +1,130 @@
+#include "empreinte.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#include <stdatomic.h>
+
+static const uint32_t s_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static atomic_int s_sha_ni = -1;  // -1 : pas encore teste
+
+static Bool sha_ni_disponible(void) {
+  int oui = atomic_load_explicit(&s_sha_ni, memory_order_relaxed);
+  if (oui < 0) {
+    unsigned int a, b, c, d;
+    int ssse3_sse41 = __get_cpuid(1, &a, &b, &c, &d) && (c & (1u << 9)) && (c & (1u << 19));
+    int sha = __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29));
+    oui = ssse3_sse41 && sha;  // meme resultat quel que soit le thread qui teste
+    atomic_store_explicit(&s_sha_ni, oui, memory_order_relaxed);
+  }
+  return oui == 1;
+}
+
+/* nb blocs de 64 octets. L'etat est range ABEF / CDGH le temps de l'appel ;
+   les 16 groupes de 4 mots du message sont calcules d'abord, puis les 64
+   tours (deux par sha256rnds2). Optimisee meme si le reste est compile
+   sans -O : sinon chaque intrinseque repasse par la pile. */
+__attribute__((target("sha,sse4.1,ssse3"), optimize("O2")))
+static void compresser(uint32_t etat[8], const unsigned char *data, size_t nb) {
+  const __m128i masque = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &etat[0]), 0xB1);   // CDAB
+  __m128i etat1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &etat[4]), 0x1B);  // EFGH
+  __m128i etat0 = _mm_alignr_epi8(tmp, etat1, 8);                                      // ABEF
+  etat1 = _mm_blend_epi16(etat1, tmp, 0xF0);                                           // CDGH
+
+  for (; nb > 0; nb--, data += 64) {
+    __m128i w[16];
+    for (int i = 0; i < 4; i++) {
+      w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16 * i)), masque);
+    }
+    for (int i = 4; i < 16; i++) {
+      __m128i m = _mm_add_epi32(_mm_sha256msg1_epu32(w[i - 4], w[i - 3]), _mm_alignr_epi8(w[i - 1], w[i - 2], 4));
+      w[i] = _mm_sha256msg2_epu32(m, w[i - 1]);
+    }
+    __m128i abef = etat0, cdgh = etat1;
+    for (int i = 0; i < 16; i++) {
+      __m128i m = _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i *) &s_k[4 * i]));
+      etat1 = _mm_sha256rnds2_epu32(etat1, etat0, m);
+      etat0 = _mm_sha256rnds2_epu32(etat0, etat1, _mm_shuffle_epi32(m, 0x0E));
+    }
+    etat0 = _mm_add_epi32(etat0, abef);
+    etat1 = _mm_add_epi32(etat1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(etat0, 0x1B);     // FEBA
+  etat1 = _mm_shuffle_epi32(etat1, 0xB1);   // DCHG
+  _mm_storeu_si128((__m128i *) &etat[0], _mm_blend_epi16(tmp, etat1, 0xF0));  // DCBA
+  _mm_storeu_si128((__m128i *) &etat[4], _mm_alignr_epi8(etat1, tmp, 8));     // HGFE
+}
+
+#else
+
+static Bool sha_ni_disponible(void) {
+  return FAUX;
+}
+
+static void compresser(uint32_t etat[8], const unsigned char *data, size_t nb) {
+  (void) etat, (void) data, (void) nb;
+}
+
+#endif
+
+void empreinte_init(Empreinte *e) {
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memset(e, 0, sizeof(Empreinte));
+  if (sha_ni_disponible()) {
+    memcpy(e->etat, initial, sizeof(initial));
+  } else {
+    mg_sha256_init(&e->mg);
+  }
+}
+
+void empreinte_ajouter(Empreinte *e, const unsigned char *data, size_t len) {
+  if (!sha_ni_disponible()) {
+    mg_sha256_update(&e->mg, data, len);
+    return;
+  }
+  e->longueur += len;
+  if (e->dans_bloc > 0) {
+    size_t n = 64 - e->dans_bloc < len ? 64 - e->dans_bloc : len;
+    memcpy(e->bloc + e->dans_bloc, data, n);
+    e->dans_bloc += n, data += n, len -= n;
+    if (e->dans_bloc < 64) return;
+    compresser(e->etat, e->bloc, 1);
+    e->dans_bloc = 0;
+  }
+  compresser(e->etat, data, len / 64);
+  memcpy(e->bloc, data + len - len % 64, len % 64);
+  e->dans_bloc = len % 64;
+}
+
+void empreinte_finir(Empreinte *e, unsigned char sortie[32]) {
+  if (!sha_ni_disponible()) {
+    mg_sha256_final(sortie, &e->mg);
+    return;
+  }
+  uint64_t bits = e->longueur * 8;
+  unsigned char fin[72] = {0x80};
+  size_t bourrage = (e->dans_bloc < 56 ? 56 : 120) - e->dans_bloc;
+  for (int i = 0; i < 8; i++) fin[bourrage + (size_t) i] = (unsigned char) (bits >> (56 - 8 * i));
+  empreinte_ajouter(e, fin, bourrage + 8);
+  for (int i = 0; i < 8; i++) {
+    sortie[4 * i] = (unsigned char) (e->etat[i] >> 24);
+    sortie[4 * i + 1] = (unsigned char) (e->etat[i] >> 16);
+    sortie[4 * i + 2] = (unsigned char) (e->etat[i] >> 8);
+    sortie[4 * i + 3] = (unsigned char) e->etat[i];
+  }
+}
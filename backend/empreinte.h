@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+
+/* SHA-256 incremental. Sur x86 avec les extensions SHA (SHA-NI), les blocs
+   passent par les instructions dediees, plus de dix fois plus vite que
+   mg_sha256 ; ailleurs, c'est mg_sha256. Le choix est fait a l'execution. */
+typedef struct Empreinte {
+    mg_sha256_ctx mg;           // sans SHA-NI
+    uint32_t etat[8];           // avec SHA-NI : etat et bloc en cours
+    unsigned char bloc[64];
+    size_t dans_bloc;
+    uint64_t longueur;
+} Empreinte;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void empreinte_init(Empreinte *e);
+void empreinte_ajouter(Empreinte *e, const unsigned char *data, size_t len);
+void empreinte_finir(Empreinte *e, unsigned char sortie[32]);
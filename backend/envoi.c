@@ -0,0 +1,500 @@
+#include "envoi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- Cache des descripteurs (tout sous cache->verrou) ---
+
+static uint32_t fnv1a(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; s++) {
+    h ^= (unsigned char) *s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static EntreeFichier **alveole_de(CacheFichiers *cache, uint32_t hachage) {
+  return &cache->alveoles[hachage & (CACHE_FICHIERS_ALVEOLES - 1)];
+}
+
+static EntreeFichier *cache_chercher(CacheFichiers *cache, const char *chemin, uint32_t hachage) {
+  for (EntreeFichier *e = *alveole_de(cache, hachage); e != NULL; e = e->suivant_alveole) {
+    if (e->hachage == hachage && strcmp(e->chemin, chemin) == 0) return e;
+  }
+  return NULL;
+}
+
+static void lru_detacher(CacheFichiers *cache, EntreeFichier *e) {
+  if (e->plus_recent != NULL) e->plus_recent->moins_recent = e->moins_recent;
+  else cache->plus_recente = e->moins_recent;
+  if (e->moins_recent != NULL) e->moins_recent->plus_recent = e->plus_recent;
+  else cache->moins_recente = e->plus_recent;
+  e->plus_recent = e->moins_recent = NULL;
+}
+
+static void lru_en_tete(CacheFichiers *cache, EntreeFichier *e) {
+  e->moins_recent = cache->plus_recente;
+  if (cache->plus_recente != NULL) cache->plus_recente->plus_recent = e;
+  cache->plus_recente = e;
+  if (cache->moins_recente == NULL) cache->moins_recente = e;
+}
+
+static void entree_relacher(EntreeFichier *e) {
+  if (--e->references == 0) {
+    close(e->fd);
+    free(e);
+  }
+}
+
+static void cache_retirer(CacheFichiers *cache, EntreeFichier *e) {
+  EntreeFichier **p = alveole_de(cache, e->hachage);
+  while (*p != e) p = &(*p)->suivant_alveole;
+  *p = e->suivant_alveole;
+  lru_detacher(cache, e);
+  cache->nb--;
+  entree_relacher(e);  // reference du cache ; les envois en cours gardent la leur
+}
+
+static void cache_vider(CacheFichiers *cache) {
+  while (cache->moins_recente != NULL) cache_retirer(cache, cache->moins_recente);
+}
+
+/* Entree du fichier avec une reference pour l'appelant (a rendre par
+   cache_relacher), NULL si le fichier n'est pas un fichier lisible. */
+static EntreeFichier *cache_acquerir(CacheFichiers *cache, const char *chemin) {
+  uint32_t hachage = fnv1a(chemin);
+  pthread_mutex_lock(&cache->verrou);
+  EntreeFichier *e = cache_chercher(cache, chemin, hachage);
+  if (e != NULL) {
+    e->references++;
+    lru_detacher(cache, e);
+    lru_en_tete(cache, e);
+    pthread_mutex_unlock(&cache->verrou);
+    atomic_fetch_add(&cache->succes, 1);
+    return e;
+  }
+  pthread_mutex_unlock(&cache->verrou);
+  atomic_fetch_add(&cache->echecs, 1);
+
+  // Ouverture hors verrou : les autres boucles continuent a servir
+  int fd = open(chemin, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (e = calloc(1, sizeof(EntreeFichier))) == NULL) {
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  e->fd = fd;
+  e->taille = (long long) st.st_size;
+  e->hachage = hachage;
+  e->references = 1;
+  mg_snprintf(e->etag, sizeof(e->etag), "\"%lld.%lld\"", (long long) st.st_mtime, e->taille);
+  if (strlen(chemin) >= sizeof(e->chemin) || cache->capacite == 0) return e;  // servi sans cache
+  memcpy(e->chemin, chemin, strlen(chemin) + 1);
+
+  pthread_mutex_lock(&cache->verrou);
+  EntreeFichier *deja = cache_chercher(cache, chemin, hachage);
+  if (deja != NULL) {
+    // Ouvert en meme temps par une autre boucle : on garde le sien
+    deja->references++;
+    pthread_mutex_unlock(&cache->verrou);
+    close(fd);
+    free(e);
+    return deja;
+  }
+  e->references++;
+  EntreeFichier **alveole = alveole_de(cache, hachage);
+  e->suivant_alveole = *alveole;
+  *alveole = e;
+  lru_en_tete(cache, e);
+  cache->nb++;
+  while (cache->nb > cache->capacite) cache_retirer(cache, cache->moins_recente);
+  pthread_mutex_unlock(&cache->verrou);
+  return e;
+}
+
+static void cache_relacher(CacheFichiers *cache, EntreeFichier *e) {
+  pthread_mutex_lock(&cache->verrou);
+  entree_relacher(e);
+  pthread_mutex_unlock(&cache->verrou);
+}
+
+void cache_fichiers_init(CacheFichiers *cache, size_t capacite) {
+  memset(cache, 0, sizeof(CacheFichiers));
+  pthread_mutex_init(&cache->verrou, NULL);
+  cache->capacite = capacite;
+  cache->inotify = -1;
+}
+
+void cache_fichiers_invalider(CacheFichiers *cache, const char *chemin) {
+  if (cache == NULL || chemin == NULL) return;
+  uint32_t hachage = fnv1a(chemin);
+  pthread_mutex_lock(&cache->verrou);
+  EntreeFichier *e = cache_chercher(cache, chemin, hachage);
+  if (e != NULL) {
+    cache_retirer(cache, e);
+    atomic_fetch_add(&cache->invalidations, 1);
+  }
+  pthread_mutex_unlock(&cache->verrou);
+}
+
+static void invalider_evenement(CacheFichiers *cache, const struct inotify_event *ev) {
+  char chemin[sizeof(((EntreeFichier *) 0)->chemin)], repertoire[sizeof(cache->repertoires[0])];
+  chemin[0] = '\0';
+  pthread_mutex_lock(&cache->verrou);
+  for (size_t i = 0; i < cache->nb_repertoires; i++) {
+    if (cache->surveilles[i] != ev->wd) continue;
+    snprintf(chemin, sizeof(chemin), "%s/%s", cache->repertoires[i], ev->name);
+    memcpy(repertoire, cache->repertoires[i], sizeof(repertoire));
+  }
+  pthread_mutex_unlock(&cache->verrou);
+  if (chemin[0] == '\0') return;
+  cache_fichiers_invalider(cache, chemin);
+  if (cache->ecouteur != NULL) cache->ecouteur(cache->ecouteur_arg, repertoire, ev->name);
+}
+
+// Evenements perdus : chaque repertoire est a relire
+static void evenements_perdus(CacheFichiers *cache) {
+  char repertoires[CACHE_FICHIERS_REPERTOIRES][sizeof(cache->repertoires[0])];
+  if (cache->ecouteur == NULL) return;
+  pthread_mutex_lock(&cache->verrou);
+  size_t nb = cache->nb_repertoires;
+  memcpy(repertoires, cache->repertoires, sizeof(repertoires));
+  pthread_mutex_unlock(&cache->verrou);
+  for (size_t i = 0; i < nb; i++) cache->ecouteur(cache->ecouteur_arg, repertoires[i], NULL);
+}
+
+static void *surveiller_repertoires(void *arg) {
+  CacheFichiers *cache = (CacheFichiers *) arg;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd pfd = {cache->inotify, POLLIN, 0};
+  while (atomic_load(&cache->arret) == 0) {
+    if (poll(&pfd, 1, 500) <= 0) continue;
+    ssize_t n = read(cache->inotify, buf, sizeof(buf));
+    for (char *p = buf; n > 0 && p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *) p;
+      if (ev->mask & IN_Q_OVERFLOW) {
+        pthread_mutex_lock(&cache->verrou);
+        cache_vider(cache);  // evenements perdus : on ne sait plus quoi garder
+        pthread_mutex_unlock(&cache->verrou);
+        evenements_perdus(cache);
+      } else if (ev->len > 0) {
+        invalider_evenement(cache, ev);
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+  return NULL;
+}
+
+void cache_fichiers_ecouter(CacheFichiers *cache, EcouteurRepertoire ecouteur, void *arg) {
+  cache->ecouteur = ecouteur;
+  cache->ecouteur_arg = arg;
+}
+
+/* Toute ecriture, creation, suppression ou renommage dans le repertoire
+   retire l'entree correspondante. FAUX si inotify est indisponible : seuls
+   les uploads invalident alors le cache. */
+Bool cache_fichiers_surveiller(CacheFichiers *cache, const char *repertoire) {
+  if (cache == NULL || repertoire == NULL || strlen(repertoire) >= sizeof(cache->repertoires[0])) return FAUX;
+  pthread_mutex_lock(&cache->verrou);
+  Bool ok = FAUX;
+  if (cache->inotify < 0) cache->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cache->inotify >= 0 && cache->nb_repertoires < CACHE_FICHIERS_REPERTOIRES) {
+    int wd = inotify_add_watch(cache->inotify, repertoire,
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM |
+                               IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (wd >= 0) {
+      cache->surveilles[cache->nb_repertoires] = wd;
+      snprintf(cache->repertoires[cache->nb_repertoires], sizeof(cache->repertoires[0]), "%s", repertoire);
+      cache->nb_repertoires++;
+      ok = VRAI;
+    }
+  }
+  Bool lancer = ok && !cache->surveillant_lance;
+  if (lancer) cache->surveillant_lance = VRAI;
+  pthread_mutex_unlock(&cache->verrou);
+  if (lancer && pthread_create(&cache->surveillant, NULL, surveiller_repertoires, cache) != 0) {
+    cache->surveillant_lance = FAUX;
+  }
+  return ok;
+}
+
+// Apres l'arret des boucles : plus aucun envoi ne tient d'entree
+void cache_fichiers_free(CacheFichiers *cache) {
+  if (cache == NULL) return;
+  atomic_store(&cache->arret, 1);
+  if (cache->surveillant_lance) pthread_join(cache->surveillant, NULL);
+  cache->surveillant_lance = FAUX;
+  if (cache->inotify >= 0) close(cache->inotify);
+  cache->inotify = -1;
+  pthread_mutex_lock(&cache->verrou);
+  cache_vider(cache);
+  pthread_mutex_unlock(&cache->verrou);
+}
+
+char *cache_fichiers_stats_json(CacheFichiers *cache) {
+  if (cache == NULL) return NULL;
+  pthread_mutex_lock(&cache->verrou);
+  size_t nb = cache->nb, nb_repertoires = cache->nb_repertoires;
+  pthread_mutex_unlock(&cache->verrou);
+  return mg_mprintf("{ \"entrees\": %lu, \"capacite\": %lu, \"succes\": %lu, \"echecs\": %lu, "
+                    "\"invalidations\": %lu, \"repertoires_surveilles\": %lu }",
+                    (unsigned long) nb, (unsigned long) cache->capacite, atomic_load(&cache->succes),
+                    atomic_load(&cache->echecs), atomic_load(&cache->invalidations),
+                    (unsigned long) nb_repertoires);
+}
+
+// --- Envoi par sendfile ---
+
+/* Corps en cours d'envoi, range dans c->pfn_data comme le fait
+   mg_http_serve_file ; pfn d'origine (HTTP) restaure a la fin. */
+typedef struct EnvoiFichier {
+  CacheFichiers *cache;
+  EntreeFichier *entree;
+  Ordonnanceur *ordonnanceur;   // celui de la boucle (mgr->userdata), ou NULL
+  Flux flux;
+  int fd;
+  off_t position;
+  off_t fin;                    // exclue
+  mg_event_handler_t pfn;
+  void *pfn_data;
+} EnvoiFichier;
+
+static void envoi_terminer(struct mg_connection *c, EnvoiFichier *e) {
+  ordonnanceur_retirer(e->ordonnanceur, &e->flux);
+  cache_relacher(e->cache, e->entree);
+  c->pfn = e->pfn;
+  c->pfn_data = e->pfn_data;
+  c->is_resp = 0;  // Mongoose peut passer a la requete suivante
+  free(e);
+}
+
+/* Mongoose ne surveille l'ecriture que si le tampon d'envoi n'est pas vide :
+   quand la socket est pleine (ou la tranche epuisee), on y met l'octet
+   suivant du fichier pour etre reveille des qu'elle peut reprendre. */
+static void envoi_amorcer(struct mg_connection *c, EnvoiFichier *e) {
+  unsigned char octet;
+  if (pread(e->fd, &octet, 1, e->position) == 1) {
+    mg_send(c, &octet, 1);
+    e->position++;
+  } else {
+    c->is_closing = 1;
+  }
+}
+
+static void envoi_cb(struct mg_connection *c, int ev, void *ev_data) {
+  EnvoiFichier *e = (EnvoiFichier *) c->pfn_data;
+  if (ev == MG_EV_CLOSE) {
+    envoi_terminer(c, e);
+  } else if ((ev == MG_EV_WRITE || ev == MG_EV_POLL) && c->send.len == 0) {
+    size_t envoye = 0;
+    Bool retenu = FAUX;
+    while (e->position < e->fin && envoye < ENVOI_TRANCHE) {
+      size_t reste = (size_t) (e->fin - e->position);
+      size_t voulu = reste < ENVOI_TRANCHE - envoye ? reste : ENVOI_TRANCHE - envoye;
+      size_t permis = ordonnanceur_autoriser(e->ordonnanceur, &e->flux, voulu);
+      if (permis == 0) {
+        retenu = VRAI;  // quantum ou plafond epuise : MG_EV_POLL d'un prochain tour
+        break;
+      }
+      ssize_t n = sendfile((int) (size_t) c->fd, e->fd, &e->position, permis);
+      if (n > 0) {
+        envoye += (size_t) n;
+        ordonnanceur_consommer(e->ordonnanceur, &e->flux, (size_t) n);
+        if (permis < voulu && (size_t) n == permis && e->position < e->fin) {
+          retenu = VRAI;  // part du tour prise : la suite a un prochain tour, sans sommeil
+          break;
+        }
+      } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        break;
+      } else {
+        c->is_closing = 1;  // client parti ou fichier tronque
+        return;
+      }
+    }
+    if (e->position >= e->fin) {
+      envoi_terminer(c, e);
+    } else if (!retenu) {
+      envoi_amorcer(c, e);
+    }
+  }
+  (void) ev_data;
+}
+
+/* "bytes=a-b", "bytes=a-" ou "bytes=-n" (les n derniers octets). Renvoie
+   FAUX si l'en-tete ne suit pas ces formes : on sert alors tout le fichier. */
+static Bool lire_plage(const struct mg_str *h, off_t taille, off_t *debut, off_t *fin, Bool *valide) {
+  char buf[64];
+  if (h->len < 7 || h->len >= sizeof(buf) || strncmp(h->buf, "bytes=", 6) != 0) return FAUX;
+  memcpy(buf, h->buf + 6, h->len - 6);
+  buf[h->len - 6] = '\0';
+  char *tiret = strchr(buf, '-');
+  if (tiret == NULL || strchr(buf, ',') != NULL) return FAUX;
+  *tiret = '\0';
+  char *f1 = NULL, *f2 = NULL;
+  long long a = strtoll(buf, &f1, 10), b = strtoll(tiret + 1, &f2, 10);
+  Bool a_vide = buf[0] == '\0', b_vide = tiret[1] == '\0';
+  if ((!a_vide && *f1 != '\0') || (!b_vide && *f2 != '\0') || (a_vide && b_vide)) return FAUX;
+  if (a_vide) {
+    a = b >= taille ? 0 : taille - b;
+    b = taille - 1;
+  } else if (b_vide || b >= taille) {
+    b = taille - 1;
+  }
+  *valide = a >= 0 && a <= b && a < taille;
+  *debut = (off_t) a;
+  *fin = (off_t) b + 1;
+  return VRAI;
+}
+
+// Type d'apres la liste "ext=type,..." de opts->mime_types
+static struct mg_str type_mime(const char *path, const char *types) {
+  const char *point = strrchr(path, '.');
+  struct mg_str k, v, s = mg_str(types != NULL ? types : "");
+  if (point != NULL) {
+    struct mg_str ext = mg_str(point + 1);
+    while (mg_span(s, &k, &s, ',')) {
+      if (mg_span(k, &k, &v, '=') && k.len == ext.len && mg_ncasecmp(k.buf, ext.buf, k.len) == 0) return v;
+    }
+  }
+  return mg_str("application/octet-stream");
+}
+
+static const char *statut_texte(int status) {
+  switch (status) {
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 416: return "Range Not Satisfiable";
+    default: return "OK";
+  }
+}
+
+void envoi_fichier(CacheFichiers *cache, struct mg_connection *c, struct mg_http_message *hm,
+                   const char *path, const struct mg_http_serve_opts *opts) {
+  if (c->is_tls || opts->fs != NULL) {
+    mg_http_serve_file(c, hm, path, opts);
+    return;
+  }
+  const char *extra = opts->extra_headers != NULL ? opts->extra_headers : "";
+  EntreeFichier *entree = cache_acquerir(cache, path);
+  if (entree == NULL) {
+    mg_http_reply(c, 404, extra, "Not found\n");
+    return;
+  }
+
+  struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+  if (inm != NULL && mg_vcasecmp(inm, entree->etag) == 0) {
+    cache_relacher(cache, entree);
+    mg_http_reply(c, 304, extra, "");
+    return;
+  }
+
+  int status = 200;
+  char plage[100] = "";
+  off_t taille = (off_t) entree->taille, debut = 0, fin = taille;
+  Bool valide = VRAI;
+  struct mg_str *rh = mg_http_get_header(hm, "Range");
+  if (rh != NULL && lire_plage(rh, taille, &debut, &fin, &valide)) {
+    if (!valide) {
+      status = 416;
+      debut = fin = 0;
+      mg_snprintf(plage, sizeof(plage), "Content-Range: bytes */%lld\r\n", (long long) taille);
+    } else {
+      status = 206;
+      mg_snprintf(plage, sizeof(plage), "Content-Range: bytes %lld-%lld/%lld\r\n",
+                  (long long) debut, (long long) fin - 1, (long long) taille);
+    }
+  }
+
+  struct mg_str mime = type_mime(path, opts->mime_types);
+  mg_printf(c,
+            "HTTP/1.1 %d %s\r\n"
+            "Content-Type: %.*s\r\n"
+            "Etag: %s\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Content-Length: %lld\r\n"
+            "%s%s\r\n",
+            status, statut_texte(status), (int) mime.len, mime.buf, entree->etag,
+            (long long) (fin - debut), plage, extra);
+
+  EnvoiFichier *e = NULL;
+  if (fin > debut && mg_vcasecmp(&hm->method, "HEAD") != 0) {
+    e = calloc(1, sizeof(EnvoiFichier));
+    if (e == NULL) c->is_draining = 1;  // en-tetes partis, corps impossible
+  }
+  if (e == NULL) {
+    cache_relacher(cache, entree);
+    c->is_resp = 0;
+    return;
+  }
+  /* Lecture sequentielle deja annoncee a l'ouverture ; pour les gros corps
+     (pdf), on demande en plus les premiers Mo tout de suite. */
+  if (fin - debut > ENVOI_TRANCHE) {
+    posix_fadvise(entree->fd, debut, ENVOI_LECTURE_AVANCE, POSIX_FADV_WILLNEED);
+  }
+  e->cache = cache;
+  e->entree = entree;
+  e->ordonnanceur = (Ordonnanceur *) c->mgr->userdata;
+  ordonnanceur_inscrire(e->ordonnanceur, &e->flux, &c->rem);
+  e->fd = entree->fd;
+  e->position = debut;
+  e->fin = fin;
+  e->pfn = c->pfn;
+  e->pfn_data = c->pfn_data;
+  c->pfn = envoi_cb;
+  c->pfn_data = e;
+  c->is_resp = 1;  // requetes suivantes en attente jusqu'a la fin du corps
+}
+
+#else
+
+// Sans sendfile, mg_http_serve_file rouvre le fichier a chaque fois : pas de cache
+void cache_fichiers_init(CacheFichiers *cache, size_t capacite) {
+  memset(cache, 0, sizeof(CacheFichiers));
+  pthread_mutex_init(&cache->verrou, NULL);
+  cache->capacite = capacite;
+  cache->inotify = -1;
+}
+
+Bool cache_fichiers_surveiller(CacheFichiers *cache, const char *repertoire) {
+  (void) cache, (void) repertoire;
+  return FAUX;
+}
+
+void cache_fichiers_invalider(CacheFichiers *cache, const char *chemin) {
+  (void) cache, (void) chemin;
+}
+
+void cache_fichiers_ecouter(CacheFichiers *cache, EcouteurRepertoire ecouteur, void *arg) {
+  cache->ecouteur = ecouteur;
+  cache->ecouteur_arg = arg;
+}
+
+void cache_fichiers_free(CacheFichiers *cache) {
+  (void) cache;
+}
+
+char *cache_fichiers_stats_json(CacheFichiers *cache) {
+  (void) cache;
+  return mg_mprintf("{ \"entrees\": 0 }");
+}
+
+void envoi_fichier(CacheFichiers *cache, struct mg_connection *c, struct mg_http_message *hm,
+                   const char *path, const struct mg_http_serve_opts *opts) {
+  (void) cache;
+  mg_http_serve_file(c, hm, path, opts);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+#include "ordonnanceur.h"
+
+#define ENVOI_TRANCHE (512 * 1024)        // octets par appel a sendfile
+#define ENVOI_LECTURE_AVANCE (2 * 1024 * 1024)
+
+#define CACHE_FICHIERS_CAPACITE 128
+#define CACHE_FICHIERS_ALVEOLES 256       // puissance de 2
+#define CACHE_FICHIERS_REPERTOIRES 4
+
+/* Fichier ouvert et ses en-tetes precalcules. Le descripteur est partage
+   par les envois en cours : sendfile et pread lisent a une position
+   explicite, sans toucher a celle du fichier. */
+typedef struct EntreeFichier {
+    char chemin[256];
+    uint32_t hachage;
+    int fd;
+    long long taille;
+    char etag[48];
+    int references;             // le cache + chaque envoi en cours
+    struct EntreeFichier *suivant_alveole;
+    struct EntreeFichier *plus_recent;
+    struct EntreeFichier *moins_recent;
+} EntreeFichier;
+
+/* Prevenu par le surveillant de chaque evenement inotify d'un repertoire
+   surveille (nom NULL : evenements perdus, tout le repertoire a relire). */
+typedef void (*EcouteurRepertoire)(void *arg, const char *repertoire, const char *nom);
+
+/* Cache LRU borne des pdf et couvertures servis : un succes ne coute aucun
+   appel systeme en dehors de l'envoi lui-meme. Une entree sort du cache sur
+   notification inotify de son repertoire, a chaque morceau d'upload, ou
+   quand elle est la moins recente ; son descripteur est ferme au depart du
+   dernier envoi qui l'utilise. */
+typedef struct CacheFichiers {
+    pthread_mutex_t verrou;
+    EntreeFichier *alveoles[CACHE_FICHIERS_ALVEOLES];
+    EntreeFichier *plus_recente;
+    EntreeFichier *moins_recente;
+    size_t nb;
+    size_t capacite;
+    int inotify;                // -1 : pas encore de surveillance
+    int surveilles[CACHE_FICHIERS_REPERTOIRES];
+    char repertoires[CACHE_FICHIERS_REPERTOIRES][128];
+    size_t nb_repertoires;
+    pthread_t surveillant;
+    Bool surveillant_lance;
+    EcouteurRepertoire ecouteur;  // fixe avant la surveillance, ou NULL
+    void *ecouteur_arg;
+    atomic_int arret;
+    atomic_ulong succes;
+    atomic_ulong echecs;
+    atomic_ulong invalidations;
+} CacheFichiers;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void cache_fichiers_init(CacheFichiers *cache, size_t capacite);
+Bool cache_fichiers_surveiller(CacheFichiers *cache, const char *repertoire);
+void cache_fichiers_invalider(CacheFichiers *cache, const char *chemin);
+void cache_fichiers_ecouter(CacheFichiers *cache, EcouteurRepertoire ecouteur, void *arg);
+void cache_fichiers_free(CacheFichiers *cache);
+char *cache_fichiers_stats_json(CacheFichiers *cache);
+
+/* Meme contrat que mg_http_serve_file (ETag / If-None-Match, Range, HEAD,
+   extra_headers, mime_types), mais sous Linux le corps part par sendfile :
+   du cache de pages a la socket, sans passer par le tampon d'envoi de la
+   connexion. Ailleurs (ou en TLS, ou avec opts->fs) : mg_http_serve_file.
+   Le corps est un flux de masse pour l'Ordonnanceur range dans
+   c->mgr->userdata (voir boucles.c), s'il y en a un. */
+void envoi_fichier(CacheFichiers *cache, struct mg_connection *c, struct mg_http_message *hm,
+                   const char *path, const struct mg_http_serve_opts *opts);
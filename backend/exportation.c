@@ -0,0 +1,312 @@
+#include "exportation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+Bool exportation_type(const char *nom, TypeExport *type) {
+  static const char *const noms[] = {"livres", "emprunts"};
+  for (size_t i = 0; i < sizeof(noms) / sizeof(noms[0]); i++) {
+    if (strcmp(nom, noms[i]) == 0) {
+      *type = (TypeExport) i;
+      return VRAI;
+    }
+  }
+  return FAUX;
+}
+
+// --- Fichier temporaire : ecrit par le producteur, relu a mesure par la boucle ---
+
+#ifndef _WIN32
+
+static Bool fichier_ouvrir(Exportation *x, const char *repertoire) {
+  char chemin[256];
+  snprintf(chemin, sizeof(chemin), "%s/.export-XXXXXX", repertoire);
+  x->fd = mkstemp(chemin);
+  if (x->fd < 0) return FAUX;
+  unlink(chemin);  // disparait avec le dernier descripteur
+  return VRAI;
+}
+
+static void fichier_fermer(Exportation *x) {
+  close(x->fd);
+}
+
+static Bool fichier_ecrire(Exportation *x, const char *donnees, size_t n) {
+  size_t ecrit = 0;
+  while (ecrit < n) {
+    ssize_t k = write(x->fd, donnees + ecrit, n - ecrit);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) return FAUX;
+    ecrit += (size_t) k;
+  }
+  return VRAI;
+}
+
+static long long fichier_lire(Exportation *x, char *dest, size_t n, long long position) {
+  return (long long) pread(x->fd, dest, n, (off_t) position);
+}
+
+#else
+
+// Nom unique dans le processus : l'adresse de l'export, vivant jusqu'a la suppression
+static Bool fichier_ouvrir(Exportation *x, const char *repertoire) {
+  snprintf(x->chemin, sizeof(x->chemin), "%s/.export-%p", repertoire, (void *) x);
+  x->ecriture = fopen(x->chemin, "wb");
+  x->lecture = x->ecriture != NULL ? fopen(x->chemin, "rb") : NULL;
+  if (x->lecture != NULL) return VRAI;
+  if (x->ecriture != NULL) {
+    fclose(x->ecriture);
+    remove(x->chemin);
+  }
+  return FAUX;
+}
+
+static void fichier_fermer(Exportation *x) {
+  fclose(x->ecriture);
+  fclose(x->lecture);
+  remove(x->chemin);
+}
+
+// fflush : les octets doivent etre dans le fichier avant la publication de produit
+static Bool fichier_ecrire(Exportation *x, const char *donnees, size_t n) {
+  return fwrite(donnees, 1, n, x->ecriture) == n && fflush(x->ecriture) == 0;
+}
+
+// Le fseek vide le tampon de lecture : fread voit ce qui a ete ecrit depuis
+static long long fichier_lire(Exportation *x, char *dest, size_t n, long long position) {
+  if (_fseeki64(x->lecture, position, SEEK_SET) != 0) return -1;
+  return (long long) fread(dest, 1, n, x->lecture);
+}
+
+#endif
+
+Exportation *exportation_creer(TypeExport type, long long apres, const char *repertoire) {
+  Exportation *x = calloc(1, sizeof(Exportation));
+  if (x == NULL) return NULL;
+  x->tampon = malloc(EXPORT_TAMPON);
+  if (x->tampon == NULL || !fichier_ouvrir(x, repertoire)) {
+    free(x->tampon);
+    free(x);
+    return NULL;
+  }
+  x->type = type;
+  x->apres = apres;
+  atomic_init(&x->produit, 0);
+  atomic_init(&x->fini, 0);
+  atomic_init(&x->annule, 0);
+  atomic_init(&x->attente, 0);
+  atomic_init(&x->references, 2);
+  return x;
+}
+
+void exportation_relacher(Exportation *x) {
+  if (atomic_fetch_sub(&x->references, 1) != 1) return;
+  fichier_fermer(x);
+  free(x->tampon);
+  free(x);
+}
+
+// --- Producteur ---
+
+// Reveille la boucle si elle a tout envoye (apres publication de produit ou fini)
+static void reveiller(Exportation *x) {
+  if (x->mgr != NULL && atomic_exchange(&x->attente, 0)) mg_wakeup(x->mgr, x->conn_id, "", 0);
+}
+
+static Bool vider(Exportation *x) {
+  if (!fichier_ecrire(x, x->tampon, x->utilise)) return FAUX;
+  atomic_fetch_add(&x->produit, (long long) x->utilise);
+  x->utilise = 0;
+  reveiller(x);
+  return VRAI;
+}
+
+static void ajouter(Exportation *x, const char *s, size_t n) {
+  memcpy(x->tampon + x->utilise, s, n);
+  x->utilise += n;
+}
+
+#define AJOUTER(x, s) ajouter((x), (s), sizeof(s) - 1)
+
+// Chaine JSON ; n : longueur lue au plus (fin de champ .dat), la chaine s'arrete aussi a '\0'
+static void ajouter_texte(Exportation *x, const char *s, size_t n) {
+  static const char hex[] = "0123456789abcdef";
+  char *d = x->tampon + x->utilise;
+  *d++ = '"';
+  for (size_t i = 0; i < n && s[i] != '\0'; i++) {
+    unsigned char o = (unsigned char) s[i];
+    if (o == '"' || o == '\\') {
+      *d++ = '\\';
+      *d++ = (char) o;
+    } else if (o < 0x20) {
+      memcpy(d, "\\u00", 4);
+      d[4] = hex[o >> 4];
+      d[5] = hex[o & 15];
+      d += 6;
+    } else {
+      *d++ = (char) o;
+    }
+  }
+  *d++ = '"';
+  x->utilise = (size_t) (d - x->tampon);
+}
+
+static void ajouter_entier(Exportation *x, long long v) {
+  x->utilise += (size_t) snprintf(x->tampon + x->utilise, 24, "%lld", v);
+}
+
+// Place pour une ligne de plus, sinon le tampon part dans le fichier
+static Bool reserver(Exportation *x) {
+  if (atomic_load_explicit(&x->annule, memory_order_relaxed)) return FAUX;
+  return x->utilise + EXPORT_LIGNE_MAX <= EXPORT_TAMPON || vider(x);
+}
+
+Bool exportation_livre(Exportation *x, const Livre *l) {
+  if (!reserver(x)) return FAUX;
+  AJOUTER(x, "{\"id\": ");
+  ajouter_entier(x, l->id);
+  AJOUTER(x, ", \"titre\": ");
+  ajouter_texte(x, l->titre, sizeof(l->titre));
+  AJOUTER(x, ", \"auteur\": ");
+  ajouter_texte(x, l->auteur, sizeof(l->auteur));
+  AJOUTER(x, ", \"annee\": ");
+  ajouter_entier(x, l->annee);
+  AJOUTER(x, ", \"categorie\": ");
+  ajouter_texte(x, l->categorie, sizeof(l->categorie));
+  AJOUTER(x, ", \"fichier\": ");
+  ajouter_texte(x, l->fichier, sizeof(l->fichier));
+  if (l->est_emprunte) AJOUTER(x, ", \"est_emprunte\": true, \"description\": ");
+  else AJOUTER(x, ", \"est_emprunte\": false, \"description\": ");
+  ajouter_texte(x, l->description, sizeof(l->description));
+  AJOUTER(x, ", \"couverture\": ");
+  ajouter_texte(x, l->couverture, sizeof(l->couverture));
+  AJOUTER(x, "}\n");
+  x->lignes++;
+  return VRAI;
+}
+
+// emprunts.dat : email|id|titre|date|lien|couverture (les deux derniers parfois absents)
+Bool exportation_ligne_dat(Exportation *x, const char *ligne, long long rang) {
+  const char *champs[6];
+  size_t longueurs[6], nb = 0;
+  size_t total = strcspn(ligne, "\r\n");
+  if (total == 0) return VRAI;  // ligne vide : rien a exporter
+  if (total > (EXPORT_LIGNE_MAX - 256) / 6) total = (EXPORT_LIGNE_MAX - 256) / 6;
+  for (const char *p = ligne, *fin = ligne + total; nb < 6; nb++) {
+    const char *barre = memchr(p, '|', (size_t) (fin - p));
+    champs[nb] = p;
+    longueurs[nb] = (size_t) ((barre != NULL ? barre : fin) - p);
+    if (barre == NULL) {
+      nb++;
+      break;
+    }
+    p = barre + 1;
+  }
+  for (size_t i = nb; i < 6; i++) champs[i] = "", longueurs[i] = 0;
+  if (!reserver(x)) return FAUX;
+  AJOUTER(x, "{\"id\": ");
+  ajouter_entier(x, rang);
+  AJOUTER(x, ", \"email\": ");
+  ajouter_texte(x, champs[0], longueurs[0]);
+  AJOUTER(x, ", \"livre\": ");
+  ajouter_entier(x, strtoll(champs[1], NULL, 10));
+  AJOUTER(x, ", \"titre\": ");
+  ajouter_texte(x, champs[2], longueurs[2]);
+  AJOUTER(x, ", \"date\": ");
+  ajouter_entier(x, strtoll(champs[3], NULL, 10));
+  AJOUTER(x, ", \"lien\": ");
+  ajouter_texte(x, champs[4], longueurs[4]);
+  AJOUTER(x, ", \"couverture\": ");
+  ajouter_texte(x, champs[5], longueurs[5]);
+  AJOUTER(x, "}\n");
+  x->lignes++;
+  return VRAI;
+}
+
+void exportation_terminer(Exportation *x, Bool ok) {
+  if (ok) ok = vider(x);
+  atomic_store(&x->fini, ok ? 1 : -1);
+  reveiller(x);
+  exportation_relacher(x);
+}
+
+// --- Envoi par la boucle ---
+
+static void rendre(struct mg_connection *c, Exportation *x) {
+  c->pfn = x->pfn;
+  c->pfn_data = x->pfn_data;
+  atomic_store(&x->annule, 1);
+  exportation_relacher(x);
+}
+
+/* Remplit le tampon d'envoi jusqu'a EXPORT_MORCEAU : chaque morceau est lu
+   du fichier directement derriere son en-tete de taille, ecrit sur 8
+   chiffres hexadecimaux (zeros en tete permis) avant de connaitre la
+   longueur lue. */
+static void pousser(struct mg_connection *c, Exportation *x) {
+  while (c->send.len < EXPORT_MORCEAU) {
+    long long produit = atomic_load(&x->produit);
+    if (x->position >= produit) {
+      int fini = atomic_load(&x->fini);
+      if (fini == 0) {
+        atomic_store(&x->attente, 1);
+        if (atomic_load(&x->produit) > x->position) continue;  // publie entre-temps
+        return;  // reveil par mg_wakeup
+      }
+      if (atomic_load(&x->produit) > x->position) continue;  // dernier morceau publie avant fini
+      if (fini > 0) mg_send(c, "0\r\n\r\n", 5);
+      else c->is_draining = 1;  // flux tronque : le client voit l'erreur
+      rendre(c, x);
+      c->is_resp = 0;
+      if (!c->is_draining && c->recv.len > 0) c->pfn(c, MG_EV_READ, NULL);  // requete suivante deja recue
+      return;
+    }
+    size_t voulu = (size_t) (produit - x->position);
+    if (voulu > EXPORT_MORCEAU) voulu = EXPORT_MORCEAU;
+    size_t debut = c->send.len;
+    if (c->send.size < debut + voulu + 12 && !mg_iobuf_resize(&c->send, debut + voulu + 12)) {
+      c->is_closing = 1;
+      return;
+    }
+    long long n = fichier_lire(x, (char *) c->send.buf + debut + 10, voulu, x->position);
+    if (n <= 0) {
+      c->is_closing = 1;
+      return;
+    }
+    char entete[24];
+    snprintf(entete, sizeof(entete), "%08lx\r\n", (unsigned long) n);
+    memcpy(c->send.buf + debut, entete, 10);
+    memcpy(c->send.buf + debut + 10 + n, "\r\n", 2);
+    c->send.len = debut + 12 + (size_t) n;
+    x->position += n;
+  }
+}
+
+static void exportation_cb(struct mg_connection *c, int ev, void *ev_data) {
+  Exportation *x = (Exportation *) c->pfn_data;
+  if (ev == MG_EV_CLOSE) {
+    rendre(c, x);
+  } else if (ev == MG_EV_WRITE || ev == MG_EV_POLL || ev == MG_EV_WAKEUP) {
+    pousser(c, x);
+  }
+  (void) ev_data;
+}
+
+void exportation_envoyer(Exportation *x, struct mg_connection *c) {
+  mg_printf(c,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/x-ndjson\r\n"
+            "Cache-Control: no-store\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n");
+  x->pfn = c->pfn;
+  x->pfn_data = c->pfn_data;
+  c->pfn = exportation_cb;
+  c->pfn_data = x;
+  pousser(c, x);
+}
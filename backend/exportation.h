@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define EXPORT_TAMPON (256 * 1024)        // lignes accumulees avant chaque write
+#define EXPORT_LIGNE_MAX (32 * 1024)      // une ligne, echappements compris
+#define EXPORT_MORCEAU (256 * 1024)       // morceau chunked, et tampon d'envoi vise
+
+/* Pas d'export des utilisateurs : les routes ne sont pas authentifiees,
+   et noms et emails n'ont pas a en sortir. */
+typedef enum { EXPORT_LIVRES = 0, EXPORT_EMPRUNTS } TypeExport;
+
+/* Export NDJSON d'un instantane. Un producteur (thread du pool) ecrit les
+   lignes dans un fichier temporaire deja supprime de son repertoire ; la
+   boucle de la connexion les envoie en chunked a mesure, sans attendre la
+   fin. L'instantane est pris d'un seul tenant (lecture du catalogue ou
+   verrou des .dat) et ne depend pas de la vitesse du client : la memoire
+   reste bornee par les deux tampons, le reste est sur disque. Sous Windows
+   (ni pread ni suppression d'un fichier ouvert), deux FILE* sur le meme
+   fichier, un par cote, et le fichier est supprime a la liberation. */
+typedef struct Exportation {
+    TypeExport type;
+    long long apres;            // reprise : seulement les id superieurs
+#ifndef _WIN32
+    int fd;
+#else
+    FILE *ecriture;             // producteur
+    FILE *lecture;              // boucle
+    char chemin[256];
+#endif
+    char *tampon;               // producteur seulement
+    size_t utilise;
+    size_t lignes;
+    atomic_llong produit;       // octets du fichier lisibles par la boucle
+    atomic_int fini;            // 0 : en cours, 1 : complet, -1 : erreur
+    atomic_int annule;          // client parti : le producteur s'arrete
+    atomic_int attente;         // la boucle a tout envoye et attend un reveil
+    atomic_int references;      // producteur + connexion
+    struct mg_mgr *mgr;
+    unsigned long conn_id;
+    long long position;         // boucle seulement
+    mg_event_handler_t pfn;
+    void *pfn_data;
+} Exportation;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+// "livres" ou "emprunts"
+Bool exportation_type(const char *nom, TypeExport *type);
+
+// Fichier temporaire dans repertoire (le disque des donnees, pas /tmp), NULL en cas d'echec
+Exportation *exportation_creer(TypeExport type, long long apres, const char *repertoire);
+
+/* Producteur. Chaque ajout renvoie FAUX si l'export doit s'arreter (client
+   parti, disque plein) ; exportation_terminer publie la fin et rend la
+   reference du producteur. Les lignes .dat sont celles de emprunts.dat,
+   rang : leur numero (1 : premiere). */
+Bool exportation_livre(Exportation *x, const Livre *livre);
+Bool exportation_ligne_dat(Exportation *x, const char *ligne, long long rang);
+void exportation_terminer(Exportation *x, Bool ok);
+
+/* Boucle : envoie les en-tetes puis le fichier a mesure qu'il se remplit.
+   La connexion garde sa reference jusqu'a la fin de l'envoi ou sa fermeture. */
+void exportation_envoyer(Exportation *x, struct mg_connection *c);
+
+// Sans envoi (erreur avant exportation_envoyer) : rend la reference de la connexion
+void exportation_relacher(Exportation *x);
@@ -0,0 +1,440 @@
+#include "externe.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXTERNE_ENTETES "Content-Type: application/json\r\nCache-Control: no-cache\r\n"
+
+// Minuscules, espaces de debut et de fin retires, suites d'espaces reduites
+static void normaliser(const char *recherche, char cle[EXTERNE_RECHERCHE]) {
+  size_t n = 0;
+  for (const char *p = recherche; *p != '\0' && n + 1 < EXTERNE_RECHERCHE; p++) {
+    if (isspace((unsigned char) *p)) {
+      if (n > 0 && cle[n - 1] != ' ') cle[n++] = ' ';
+    } else {
+      cle[n++] = (char) tolower((unsigned char) *p);
+    }
+  }
+  if (n > 0 && cle[n - 1] == ' ') n--;
+  cle[n] = '\0';
+}
+
+// --- Livres de l'amont ---
+
+static int hex4(const char *p) {
+  int v = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = tolower((unsigned char) p[i]);
+    if (!isxdigit(c)) return -1;
+    v = v * 16 + (isdigit(c) ? c - '0' : c - 'a' + 10);
+  }
+  return v;
+}
+
+static size_t utf8(unsigned long cp, char *sortie) {
+  if (cp < 0x80) return sortie[0] = (char) cp, 1;
+  if (cp < 0x800) return sortie[0] = (char) (0xC0 | (cp >> 6)), sortie[1] = (char) (0x80 | (cp & 0x3F)), 2;
+  if (cp < 0x10000) {
+    sortie[0] = (char) (0xE0 | (cp >> 12));
+    sortie[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    sortie[2] = (char) (0x80 | (cp & 0x3F));
+    return 3;
+  }
+  sortie[0] = (char) (0xF0 | (cp >> 18));
+  sortie[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+  sortie[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+  sortie[3] = (char) (0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/* Chaine JSON decodee (malloc), NULL si absente ou d'un autre type.
+   mg_json_get_str ne garde que l'octet bas des \uXXXX : les titres
+   accentues echappes par l'amont deviendraient de l'UTF-8 invalide. */
+static char *chaine(struct mg_str json, const char *chemin) {
+  struct mg_str tok = mg_json_get_tok(json, chemin);
+  if (tok.buf == NULL || tok.len < 2 || tok.buf[0] != '"') return NULL;
+  const char *p = tok.buf + 1, *fin = tok.buf + tok.len - 1;
+  char *s = malloc(tok.len), *q = s;  // un echappement n'allonge jamais
+  if (s == NULL) return NULL;
+  while (p < fin) {
+    if (*p != '\\' || p + 1 >= fin) {
+      *q++ = *p++;
+      continue;
+    }
+    char c = p[1];
+    p += 2;
+    if (c == 'u' && p + 4 <= fin && hex4(p) >= 0) {
+      unsigned long cp = (unsigned long) hex4(p);
+      p += 4;
+      if (cp >= 0xD800 && cp < 0xDC00 && p + 6 <= fin && p[0] == '\\' && p[1] == 'u' && hex4(p + 2) >= 0xDC00 &&
+          hex4(p + 2) < 0xE000) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + ((unsigned long) hex4(p + 2) - 0xDC00);
+        p += 6;
+      }
+      q += utf8(cp, q);
+    } else {
+      *q++ = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+    }
+  }
+  *q = '\0';
+  return s;
+}
+
+// Premier format dont le type commence par prefixe (cles entre guillemets)
+static char *format(struct mg_str formats, const char *prefixe) {
+  struct mg_str cle, valeur;
+  size_t ofs = 0, n = strlen(prefixe);
+  while ((ofs = mg_json_next(formats, ofs, &cle, &valeur)) > 0) {
+    if (cle.len > n + 1 && strncmp(cle.buf + 1, prefixe, n) == 0) return chaine(valeur, "$");
+  }
+  return NULL;
+}
+
+static char *premier(char *a, char *b, char *c) {
+  char *choix = a != NULL ? a : b != NULL ? b : c;
+  if (a != choix) free(a);
+  if (b != choix) free(b);
+  if (c != choix) free(c);
+  return choix;
+}
+
+/* Meme normalisation que normalizeGutendex (frontend) : premiere etagere ou
+   premier sujet pour la categorie, resume ou trois sujets pour la
+   description, pdf puis html puis epub pour le lien. */
+static Bool livre_lire(struct mg_str obj, LivreExterne *l) {
+  struct mg_str formats = mg_json_get_tok(obj, "$.formats");
+  char *titre = chaine(obj, "$.title"), *auteur = chaine(obj, "$.authors[0].name");
+  char *categorie = premier(chaine(obj, "$.bookshelves[0]"), chaine(obj, "$.subjects[0]"), NULL);
+  char *description = chaine(obj, "$.summaries[0]");
+  if (description == NULL) {
+    char *sujets[3] = {chaine(obj, "$.subjects[0]"), chaine(obj, "$.subjects[1]"), chaine(obj, "$.subjects[2]")};
+    if (sujets[0] != NULL) {
+      description = mg_mprintf("%s%s%s%s%s", sujets[0], sujets[1] ? ", " : "", sujets[1] ? sujets[1] : "",
+                               sujets[1] && sujets[2] ? ", " : "", sujets[1] && sujets[2] ? sujets[2] : "");
+    }
+    for (int i = 0; i < 3; i++) free(sujets[i]);
+  }
+  char *couverture = premier(format(formats, "image/jpeg"), format(formats, "image/png"), NULL);
+  char *pdf = format(formats, "application/pdf"), *html = format(formats, "text/html");
+  char *epub = format(formats, "application/epub+zip");
+  const char *type = pdf != NULL ? "pdf" : html != NULL ? "html" : epub != NULL ? "epub" : "";
+  char *lien = premier(pdf, html, epub);
+
+  l->titre = titre != NULL ? titre : mg_mprintf("Sans titre");
+  l->auteur = auteur != NULL ? auteur : mg_mprintf("Auteur inconnu");
+  l->json = mg_mprintf("{ \"id\": %ld, \"titre\": %m, \"auteur\": %m, \"annee\": \"\", \"categorie\": %m, "
+                       "\"description\": %m, \"couverture\": %m, \"est_emprunte\": false, \"lien\": %m, "
+                       "\"format\": \"%s\", \"source\": \"api\" }",
+                       mg_json_get_long(obj, "$.id", 0), MG_ESC(l->titre), MG_ESC(l->auteur),
+                       MG_ESC(categorie != NULL ? categorie : "Sans categorie"),
+                       MG_ESC(description != NULL ? description : "Description indisponible"),
+                       MG_ESC(couverture != NULL ? couverture : ""), MG_ESC(lien != NULL ? lien : ""), type);
+  free(categorie);
+  free(description);
+  free(couverture);
+  free(lien);
+  return l->titre != NULL && l->auteur != NULL && l->json != NULL;
+}
+
+static void resultat_free(ResultatExterne *r) {
+  for (size_t i = 0; i < r->nb; i++) {
+    free(r->livres[i].titre);
+    free(r->livres[i].auteur);
+    free(r->livres[i].json);
+  }
+  free(r);
+}
+
+// Les EXTERNE_RESULTATS premiers livres de la page ; NULL si ce n'est pas une reponse Gutendex
+static ResultatExterne *resultat_lire(struct mg_str corps) {
+  struct mg_str resultats = mg_json_get_tok(corps, "$.results");
+  if (resultats.buf == NULL || resultats.buf[0] != '[') return NULL;
+  ResultatExterne *r = calloc(1, sizeof(ResultatExterne));
+  if (r == NULL) return NULL;
+  struct mg_str obj;
+  size_t ofs = 0;
+  while (r->nb < EXTERNE_RESULTATS && (ofs = mg_json_next(resultats, ofs, NULL, &obj)) > 0) {
+    if (obj.len == 0 || obj.buf[0] != '{') continue;
+    if (!livre_lire(obj, &r->livres[r->nb])) {
+      r->nb++;  // libere avec les autres
+      resultat_free(r);
+      return NULL;
+    }
+    r->nb++;
+  }
+  r->references = 1;
+  return r;
+}
+
+// --- Cache par recherche (tout sous e->verrou) ---
+
+static uint32_t fnv1a(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; s++) {
+    h ^= (unsigned char) *s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static EntreeExterne **alveole_de(Externe *e, uint32_t hachage) {
+  return &e->alveoles[hachage & (EXTERNE_ALVEOLES - 1)];
+}
+
+static EntreeExterne *cache_chercher(Externe *e, const char *cle, uint32_t hachage) {
+  for (EntreeExterne *en = *alveole_de(e, hachage); en != NULL; en = en->suivant_alveole) {
+    if (en->hachage == hachage && strcmp(en->cle, cle) == 0) return en;
+  }
+  return NULL;
+}
+
+static void lru_detacher(Externe *e, EntreeExterne *en) {
+  if (en->plus_recent != NULL) en->plus_recent->moins_recent = en->moins_recent;
+  else e->plus_recente = en->moins_recent;
+  if (en->moins_recent != NULL) en->moins_recent->plus_recent = en->plus_recent;
+  else e->moins_recente = en->plus_recent;
+  en->plus_recent = en->moins_recent = NULL;
+}
+
+static void lru_en_tete(Externe *e, EntreeExterne *en) {
+  en->moins_recent = e->plus_recente;
+  if (e->plus_recente != NULL) e->plus_recente->plus_recent = en;
+  e->plus_recente = en;
+  if (e->moins_recente == NULL) e->moins_recente = en;
+}
+
+static void resultat_relacher(ResultatExterne *r) {
+  if (r != NULL && --r->references == 0) resultat_free(r);
+}
+
+static void cache_retirer(Externe *e, EntreeExterne *en) {
+  EntreeExterne **p = alveole_de(e, en->hachage);
+  while (*p != en) p = &(*p)->suivant_alveole;
+  *p = en->suivant_alveole;
+  lru_detacher(e, en);
+  e->nb--;
+  resultat_relacher(en->resultat);
+  free(en->attente);
+  free(en);
+}
+
+// Les recherches en vol restent : leurs requetes attendent l'entree
+static void cache_reduire(Externe *e) {
+  for (EntreeExterne *en = e->moins_recente; en != NULL && e->nb > e->capacite;) {
+    EntreeExterne *suivante = en->plus_recent;
+    if (!en->en_vol) cache_retirer(e, en);
+    en = suivante;
+  }
+}
+
+static EntreeExterne *cache_creer(Externe *e, const char *cle, uint32_t hachage) {
+  EntreeExterne *en = calloc(1, sizeof(EntreeExterne));
+  if (en == NULL) return NULL;
+  snprintf(en->cle, sizeof(en->cle), "%s", cle);
+  en->hachage = hachage;
+  EntreeExterne **alveole = alveole_de(e, hachage);
+  en->suivant_alveole = *alveole;
+  *alveole = en;
+  lru_en_tete(e, en);
+  e->nb++;
+  cache_reduire(e);
+  return en;
+}
+
+static Bool attente_ajouter(EntreeExterne *en, Travail *t) {
+  if (en->nb_attente == en->cap_attente) {
+    size_t cap = en->cap_attente == 0 ? 4 : en->cap_attente * 2;
+    Travail **attente = realloc(en->attente, cap * sizeof(Travail *));
+    if (attente == NULL) return FAUX;
+    en->attente = attente;
+    en->cap_attente = cap;
+  }
+  en->attente[en->nb_attente++] = t;
+  return VRAI;
+}
+
+// --- Appel a l'amont (dans la boucle qui l'a lance) ---
+
+typedef struct AppelAmont {
+  Externe *externe;
+  char cle[EXTERNE_RECHERCHE];
+  uint64_t limite;            // mg_millis
+  Bool fini;
+} AppelAmont;
+
+/* Fin d'un appel, reussi (neuf) ou non : la reponse est composee une fois
+   pour toutes les requetes qui l'attendaient, avec l'ancien resultat s'il
+   y en a un quand l'amont a echoue. */
+static void terminer(AppelAmont *a, ResultatExterne *neuf) {
+  Externe *e = a->externe;
+  a->fini = VRAI;
+  if (neuf == NULL) atomic_fetch_add(&e->erreurs, 1);
+
+  pthread_mutex_lock(&e->verrou);
+  EntreeExterne *en = cache_chercher(e, a->cle, fnv1a(a->cle));
+  Travail **attente = en->attente;
+  size_t nb = en->nb_attente;
+  en->attente = NULL;
+  en->nb_attente = en->cap_attente = 0;
+  en->en_vol = FAUX;
+  if (neuf != NULL) {
+    resultat_relacher(en->resultat);
+    en->resultat = neuf;
+    en->expire = mg_millis() + EXTERNE_TTL_MS;
+  }
+  ResultatExterne *r = en->resultat;
+  if (r != NULL) r->references++;
+  cache_reduire(e);
+  pthread_mutex_unlock(&e->verrou);
+
+  if (neuf == NULL && r != NULL) atomic_fetch_add(&e->perimes, nb);
+  size_t longueur = 0;
+  char *corps = e->composer(a->cle, r, neuf != NULL ? "amont" : r != NULL ? "perime" : "indisponible", &longueur);
+  for (size_t i = 0; i < nb; i++) {
+    char *copie = corps != NULL ? malloc(longueur) : NULL;
+    if (copie != NULL) memcpy(copie, corps, longueur);
+    travail_repondre_corps(attente[i], 200, EXTERNE_ENTETES, copie, longueur);  // sans copie : 500
+    travail_terminer(attente[i]);
+  }
+  free(corps);
+  free(attente);
+
+  pthread_mutex_lock(&e->verrou);
+  resultat_relacher(r);
+  pthread_mutex_unlock(&e->verrou);
+}
+
+static void amont_envoyer(struct mg_connection *c, const AppelAmont *a) {
+  const char *url = a->externe->amont;
+  struct mg_str hote = mg_url_host(url);
+  char recherche[3 * EXTERNE_RECHERCHE];
+  if (mg_url_is_ssl(url)) {
+    struct mg_tls_opts opts = {.name = hote};
+    mg_tls_init(c, &opts);
+  }
+  mg_url_encode(a->cle, strlen(a->cle), recherche, sizeof(recherche));
+  mg_printf(c,
+            "GET %s?mime_type=application%%2Fpdf%s%s HTTP/1.1\r\nHost: %.*s\r\n"
+            "Accept: application/json\r\nConnection: close\r\n\r\n",
+            mg_url_uri(url), a->cle[0] != '\0' ? "&search=" : "", recherche, (int) hote.len, hote.buf);
+}
+
+static void amont_evenement(struct mg_connection *c, int ev, void *ev_data) {
+  AppelAmont *a = (AppelAmont *) c->fn_data;
+  if (ev == MG_EV_CONNECT) {
+    amont_envoyer(c, a);
+  } else if (ev == MG_EV_POLL) {
+    if (!a->fini && mg_millis() > a->limite) mg_error(c, "amont : delai depasse");
+  } else if (ev == MG_EV_HTTP_MSG) {
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    terminer(a, mg_http_status(hm) == 200 ? resultat_lire(hm->body) : NULL);
+    c->is_draining = 1;
+  } else if (ev == MG_EV_CLOSE) {
+    if (!a->fini) terminer(a, NULL);  // erreur reseau, TLS, delai
+    free(a);
+  }
+}
+
+static void appeler(Externe *e, struct mg_mgr *mgr, const char *cle) {
+  AppelAmont echec, *a = calloc(1, sizeof(AppelAmont));
+  if (a == NULL) a = &echec;
+  memset(a, 0, sizeof(AppelAmont));
+  a->externe = e;
+  snprintf(a->cle, sizeof(a->cle), "%s", cle);
+  a->limite = mg_millis() + EXTERNE_DELAI_MS;
+  atomic_fetch_add(&e->appels, 1);
+  if (a != &echec && mg_http_connect(mgr, e->amont, amont_evenement, a) != NULL) return;
+  terminer(a, NULL);
+  if (a != &echec) free(a);
+}
+
+// --- Requetes ---
+
+static void envoyer(struct mg_connection *c, char *corps, size_t longueur) {
+  if (corps == NULL) {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+    return;
+  }
+  mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %lu\r\n\r\n", EXTERNE_ENTETES, (unsigned long) longueur);
+  mg_send(c, corps, longueur);
+  c->is_resp = 0;  // reponse complete, comme apres mg_http_reply
+  free(corps);
+}
+
+void externe_repondre(Externe *e, struct mg_connection *c, const char *recherche) {
+  char cle[EXTERNE_RECHERCHE];
+  normaliser(recherche, cle);
+  uint32_t hachage = fnv1a(cle);
+  size_t longueur = 0;
+
+  pthread_mutex_lock(&e->verrou);
+  EntreeExterne *en = cache_chercher(e, cle, hachage);
+  if (en != NULL) {
+    lru_detacher(e, en);
+    lru_en_tete(e, en);
+  }
+  if (en != NULL && en->resultat != NULL && mg_millis() < en->expire) {
+    ResultatExterne *r = en->resultat;
+    r->references++;
+    pthread_mutex_unlock(&e->verrou);
+    atomic_fetch_add(&e->succes, 1);
+    char *corps = e->composer(cle, r, "frais", &longueur);
+    pthread_mutex_lock(&e->verrou);
+    resultat_relacher(r);
+    pthread_mutex_unlock(&e->verrou);
+    envoyer(c, corps, longueur);
+    return;
+  }
+
+  // Absente ou perimee : la requete attend l'appel en cours, ou en lance un
+  Travail *t = travail_suspendre(c);
+  if (t == NULL || (en == NULL && (en = cache_creer(e, cle, hachage)) == NULL) || !attente_ajouter(en, t)) {
+    pthread_mutex_unlock(&e->verrou);
+    if (t == NULL) {
+      mg_http_reply(c, 503, "", "{\"error\": \"Requete precedente en cours\"}\n");
+    } else {
+      travail_repondre(t, 503, "", "{\"error\": \"Memoire insuffisante\"}\n");
+      travail_terminer(t);
+    }
+    return;
+  }
+  Bool lancer = !en->en_vol;
+  en->en_vol = VRAI;
+  pthread_mutex_unlock(&e->verrou);
+  atomic_fetch_add(lancer ? &e->echecs : &e->partages, 1);
+  if (lancer) appeler(e, c->mgr, cle);
+}
+
+// --- Cycle de vie et compteurs ---
+
+void externe_init(Externe *e, const char *amont, size_t capacite, ComposerExterne composer) {
+  memset(e, 0, sizeof(Externe));
+  pthread_mutex_init(&e->verrou, NULL);
+  snprintf(e->amont, sizeof(e->amont), "%s", amont);
+  e->capacite = capacite;
+  e->composer = composer;
+}
+
+// Apres l'arret des boucles : plus aucun appel en vol
+void externe_free(Externe *e) {
+  while (e->moins_recente != NULL) cache_retirer(e, e->moins_recente);
+  pthread_mutex_destroy(&e->verrou);
+}
+
+char *externe_stats_json(Externe *e) {
+  pthread_mutex_lock(&e->verrou);
+  size_t nb = e->nb, en_vol = 0;
+  for (EntreeExterne *en = e->plus_recente; en != NULL; en = en->moins_recent) en_vol += en->en_vol;
+  pthread_mutex_unlock(&e->verrou);
+  unsigned long succes = atomic_load(&e->succes), echecs = atomic_load(&e->echecs);
+  unsigned long partages = atomic_load(&e->partages);
+  return mg_mprintf("{ \"amont\": %m, \"recherches\": %lu, \"capacite\": %lu, \"en_vol\": %lu, "
+                    "\"succes\": %lu, \"echecs\": %lu, \"partages\": %lu, \"taux_succes\": %.3f, "
+                    "\"appels\": %lu, \"erreurs\": %lu, \"perimes\": %lu }",
+                    MG_ESC(e->amont), (unsigned long) nb, (unsigned long) e->capacite, (unsigned long) en_vol,
+                    succes, echecs, partages,
+                    succes + echecs + partages > 0 ? (double) succes / (double) (succes + echecs + partages) : 0.0,
+                    atomic_load(&e->appels), atomic_load(&e->erreurs), atomic_load(&e->perimes));
+}
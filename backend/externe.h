@@ -0,0 +1,86 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+#include "travailleurs.h"
+
+#define EXTERNE_AMONT "https://gutendex.com/books/"
+#define EXTERNE_CAPACITE 256                  // recherches gardees
+#define EXTERNE_ALVEOLES 512                  // puissance de 2
+#define EXTERNE_TTL_MS (10 * 60 * 1000)       // fraicheur d'une reponse de l'amont
+#define EXTERNE_DELAI_MS 8000                 // attente maximale de l'amont
+#define EXTERNE_RESULTATS 10                  // livres gardes par recherche
+#define EXTERNE_RECHERCHE 128
+
+// Un livre de l'amont, deja normalise (memes champs que les livres locaux)
+typedef struct LivreExterne {
+    char *titre;
+    char *auteur;
+    char *json;                 // objet JSON complet, "source": "api"
+} LivreExterne;
+
+/* Reponse de l'amont pour une recherche, figee une fois publiee et
+   partagee par les reponses en cours d'envoi. */
+typedef struct ResultatExterne {
+    int references;             // l'entree + chaque reponse en construction (sous verrou)
+    size_t nb;
+    LivreExterne livres[EXTERNE_RESULTATS];
+} ResultatExterne;
+
+/* Une recherche (normalisee : minuscules, espaces reduits). Pendant un
+   appel a l'amont, les requetes identiques attendent dans attente au lieu
+   de relancer le meme appel. */
+typedef struct EntreeExterne {
+    char cle[EXTERNE_RECHERCHE];
+    uint32_t hachage;
+    ResultatExterne *resultat;  // derniere reponse, NULL avant la premiere
+    uint64_t expire;            // mg_millis
+    Bool en_vol;
+    Travail **attente;
+    size_t nb_attente;
+    size_t cap_attente;
+    struct EntreeExterne *suivant_alveole;
+    struct EntreeExterne *plus_recent;
+    struct EntreeExterne *moins_recent;
+} EntreeExterne;
+
+/* Corps de la reponse pour une recherche : le serveur y ajoute les livres
+   locaux et retire les doublons. etat : "frais" (cache), "amont" (appel
+   qui vient de repondre), "perime" (amont en echec, ancien resultat) ou
+   "indisponible" (r vaut alors NULL). */
+typedef char *(*ComposerExterne)(const char *recherche, const ResultatExterne *r, const char *etat,
+                                 size_t *longueur);
+
+/* Mandataire du catalogue Gutendex : cache LRU avec duree de vie, un seul
+   appel a l'amont (client HTTP de Mongoose, dans la boucle de la requete
+   qui le lance) par recherche manquante. Les requetes qui attendent ce
+   resultat sur d'autres boucles sont suspendues (travail_suspendre) et
+   reveillees par mg_wakeup. */
+typedef struct Externe {
+    pthread_mutex_t verrou;
+    char amont[256];            // url de la liste des livres ; un faux local pour les tests
+    ComposerExterne composer;
+    EntreeExterne *alveoles[EXTERNE_ALVEOLES];
+    EntreeExterne *plus_recente;
+    EntreeExterne *moins_recente;
+    size_t nb;
+    size_t capacite;
+    atomic_ulong succes;        // reponses fraiches du cache
+    atomic_ulong echecs;        // absentes ou perimees
+    atomic_ulong partages;      // requetes jointes a un appel deja en cours
+    atomic_ulong appels;        // appels a l'amont
+    atomic_ulong erreurs;       // appels echoues (reseau, statut, JSON, delai)
+    atomic_ulong perimes;       // reponses perimees servies faute d'amont
+} Externe;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void externe_init(Externe *e, const char *amont, size_t capacite, ComposerExterne composer);
+void externe_free(Externe *e);
+
+// Repond tout de suite (cache frais) ou suspend c jusqu'a la reponse de l'amont
+void externe_repondre(Externe *e, struct mg_connection *c, const char *recherche);
+char *externe_stats_json(Externe *e);
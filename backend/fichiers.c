@@ -11,6 +11,38 @@ void nouvelle_ligne(char *s) {
     s[strcspn(s, "\r\n")] = '\0';
 }
 
+/* Decoupe en place une ligne "id|titre|auteur|annee|categorie|fichier|
+   emprunte|description|couverture". Un champ peut etre vide (livre sans
+   pdf, par exemple) ; les deux derniers sont optionnels. */
+static Bool lire_livre(char *ligne, Livre *livre) {
+    char *champs[9];
+    size_t n = 0;
+    char *p = ligne;
+    while (n < 9) {
+        champs[n++] = p;
+        p = strchr(p, '|');
+        if (p == NULL)
+            break;
+        *p++ = '\0';
+    }
+    if (n < 7 || champs[1][0] == '\0')
+        return FAUX;
+
+    memset(livre, 0, sizeof(Livre));
+    livre->id = atoi(champs[0]);
+    snprintf(livre->titre, sizeof(livre->titre), "%s", champs[1]);
+    snprintf(livre->auteur, sizeof(livre->auteur), "%s", champs[2]);
+    livre->annee = atoi(champs[3]);
+    snprintf(livre->categorie, sizeof(livre->categorie), "%s", champs[4]);
+    snprintf(livre->fichier, sizeof(livre->fichier), "%s", champs[5]);
+    livre->est_emprunte = (atoi(champs[6]) == 1) ? VRAI : FAUX;
+    if (n >= 8)
+        snprintf(livre->description, sizeof(livre->description), "%s", champs[7]);
+    if (n >= 9)
+        snprintf(livre->couverture, sizeof(livre->couverture), "%s", champs[8]);
+    return VRAI;
+}
+
 Bool fichiers_charger(Bibliotheque *bibli, const char *path) {
     if (bibli == NULL || path == NULL)
         return FAUX;
@@ -20,6 +52,7 @@ Bool fichiers_charger(Bibliotheque *bibli, const char *path) {
         return FAUX; 
   
     char ligne[4096];
+    biblio_lot_debut(bibli);  // index tries construits une fois, apres la derniere ligne
     while (fgets(ligne, sizeof(ligne), fichier)) {
         nouvelle_ligne(ligne);
         
@@ -27,35 +60,84 @@ Bool fichiers_charger(Bibliotheque *bibli, const char *path) {
             continue;
 
         Livre livre;
-        memset(&livre, 0, sizeof(Livre)); 
-
-        char desc[512] = "";
-        char couv[256] = "";
-        int emprunte = 0;
-        int n = sscanf(ligne, "%d|%[^|]|%[^|]|%d|%[^|]|%[^|]|%d|%[^|]|%[^|]",
-           &livre.id, livre.titre, livre.auteur,
-           &livre.annee, livre.categorie, livre.fichier,
-           &emprunte, desc, couv);
-
-        if (n >= 7) {
-            livre.est_emprunte = (emprunte == 1) ? VRAI : FAUX;
-            if (n >= 8) {
-                strncpy(livre.description, desc, sizeof(livre.description) - 1);
-                livre.description[sizeof(livre.description) - 1] = '\0';
-            }
-            if (n >= 9) {
-                strncpy(livre.couverture, couv, sizeof(livre.couverture) - 1);
-                livre.couverture[sizeof(livre.couverture) - 1] = '\0';
-            }
+        if (lire_livre(ligne, &livre))
             biblio_add(bibli, &livre);
-        }
-
     }
+    biblio_lot_fin(bibli);
 
     fclose(fichier);
     return VRAI;
 }
 
+// Meme format que livres.dat, sans fin de ligne ; renvoie la longueur (comme snprintf)
+int fichiers_formater_livre(char *dst, size_t taille, const Livre *livre) {
+    return snprintf(dst, taille, "%d|%s|%s|%d|%s|%s|%d|%s|%s",
+                    livre->id, livre->titre, livre->auteur,
+                    livre->annee, livre->categorie, livre->fichier,
+                    livre->est_emprunte, livre->description, livre->couverture);
+}
+
+/* Un seul fwrite pour toutes les lignes d'un lot. taille recoit la
+   longueur du journal apres l'ajout (pour decider d'une reecriture). */
+Bool fichiers_journal_ajouter(const char *path, const char *lignes, size_t longueur, long *taille) {
+    if (path == NULL || lignes == NULL)
+        return FAUX;
+    FILE *journal = fopen(path, "ab");
+    if (journal == NULL)
+        return FAUX;
+    Bool ok = fwrite(lignes, 1, longueur, journal) == longueur;
+    if (taille != NULL)
+        *taille = ftell(journal);
+    if (fclose(journal) != 0)
+        ok = FAUX;
+    return ok;
+}
+
+// Apres une reecriture complete de livres.dat, le journal n'apporte plus rien
+void fichiers_journal_vider(const char *path) {
+    if (path != NULL)
+        remove(path);
+}
+
+/* Rejoue le journal sur un catalogue charge depuis livres.dat. Chaque
+   ligne donne l'etat final d'un livre : rejouer une ligne deja contenue
+   dans livres.dat (reecriture interrompue avant le vidage) ne change rien.
+   Renvoie le nombre de lignes appliquees ; journal absent : 0. */
+size_t fichiers_rejouer(Bibliotheque *bibli, const char *path) {
+    if (bibli == NULL || path == NULL)
+        return 0;
+    FILE *journal = fopen(path, "r");
+    if (journal == NULL)
+        return 0;
+
+    size_t nb = 0;
+    char ligne[4096];
+    while (fgets(ligne, sizeof(ligne), journal)) {
+        if (strchr(ligne, '\n') == NULL)
+            break;  // derniere ligne incomplete : arret pendant un ajout
+        nouvelle_ligne(ligne);
+        if (ligne[0] == '-' && ligne[1] == '|') {
+            Livre *l = biblio_find_by_id(bibli, atoi(ligne + 2));
+            if (l != NULL) {
+                biblio_remove_livre(bibli, l);
+                nb++;
+            }
+            continue;
+        }
+        Livre livre;
+        if (ligne[0] != '+' || ligne[1] != '|' || !lire_livre(ligne + 2, &livre) || livre.id <= 0)
+            continue;
+        Livre *existant = biblio_find_by_id(bibli, livre.id);
+        if (existant != NULL)
+            biblio_update(bibli, existant, &livre);
+        else
+            biblio_add(bibli, &livre);
+        nb++;
+    }
+    fclose(journal);
+    return nb;
+}
+
 Bool fichiers_sauvegarder(const Bibliotheque *bibli, const char *path){
   if (bibli == NULL || path == NULL)
     return FAUX;
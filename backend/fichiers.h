@@ -5,3 +5,8 @@
 
 Bool fichiers_charger(Bibliotheque *bibli, const char *path);
 Bool fichiers_sauvegarder(const Bibliotheque *bibli, const char *path);
+
+int fichiers_formater_livre(char *dst, size_t taille, const Livre *livre);
+Bool fichiers_journal_ajouter(const char *path, const char *lignes, size_t longueur, long *taille);
+void fichiers_journal_vider(const char *path);
+size_t fichiers_rejouer(Bibliotheque *bibli, const char *path);
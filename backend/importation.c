@@ -0,0 +1,728 @@
+#include "importation.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parametres.h"
+
+#define IMPORT_ENTETE_MAX (64 * 1024)
+
+// Taille de chaque texte dans Livre, terminateur compris
+static const size_t s_tailles[IMPORT_NB_TEXTES] = {
+    sizeof(((Livre *) 0)->titre),   sizeof(((Livre *) 0)->auteur),      sizeof(((Livre *) 0)->categorie),
+    sizeof(((Livre *) 0)->fichier), sizeof(((Livre *) 0)->description), sizeof(((Livre *) 0)->couverture)};
+static const char *s_noms[IMPORT_NB_TEXTES] = {"titre", "auteur", "categorie", "fichier", "description", "couverture"};
+
+// Memes noms (et alias) que les champs de POST /api/add
+static const struct {
+  const char *nom;
+  int champ;
+} s_alias[] = {
+    {"titre", IMPORT_TITRE},       {"auteur", IMPORT_AUTEUR},           {"annee", IMPORT_ANNEE},
+    {"categorie", IMPORT_CATEGORIE}, {"cat", IMPORT_CATEGORIE},         {"fichier", IMPORT_FICHIER},
+    {"emprunte", IMPORT_EMPRUNTE}, {"est_emprunte", IMPORT_EMPRUNTE},   {"description", IMPORT_DESCRIPTION},
+    {"couverture", IMPORT_COUVERTURE}};
+
+// Les n octets de a (sans casse) valent exactement b, en minuscules
+static Bool egal_sans_casse(const char *a, size_t n, const char *b) {
+  for (size_t i = 0; i < n; i++, b++) {
+    if (*b == '\0' || tolower((unsigned char) a[i]) != *b) return FAUX;
+  }
+  return *b == '\0';
+}
+
+// Champ designe par un nom de colonne ou une cle JSON, -1 s'il est inconnu
+static int champ_de(const char *nom, size_t n) {
+  while (n > 0 && isspace((unsigned char) nom[0])) nom++, n--;
+  while (n > 0 && isspace((unsigned char) nom[n - 1])) n--;
+  for (size_t i = 0; i < sizeof(s_alias) / sizeof(s_alias[0]); i++) {
+    if (egal_sans_casse(nom, n, s_alias[i].nom)) return s_alias[i].champ;
+  }
+  return -1;
+}
+
+static uint32_t hachage(const char *s) {
+  uint32_t h = 2166136261u;  // FNV-1a
+  for (; *s; s++) h = (h ^ (unsigned char) *s) * 16777619u;
+  return h;
+}
+
+Bool importation_format(const char *nom, FormatImport *format) {
+  static const struct {
+    const char *nom;
+    FormatImport format;
+  } formats[] = {{"csv", IMPORT_CSV},   {"tsv", IMPORT_CSV},  {"ndjson", IMPORT_NDJSON},
+                 {"jsonl", IMPORT_NDJSON}, {"marc", IMPORT_MARC}, {"mrk", IMPORT_MARC}};
+  if (nom == NULL) return FAUX;
+  const char *point = strrchr(nom, '.');
+  const char *ext = point != NULL ? point + 1 : nom;
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    if (egal_sans_casse(ext, strlen(ext), formats[i].nom)) {
+      *format = formats[i].format;
+      return VRAI;
+    }
+  }
+  return FAUX;
+}
+
+const char *importation_nom_format(FormatImport format) {
+  return format == IMPORT_NDJSON ? "ndjson" : format == IMPORT_MARC ? "marc" : "csv";
+}
+
+// --- Analyse d'un bloc (thread du pool) ---
+
+// Enregistrement en cours de lecture : ses textes sont deja dans l'arene
+typedef struct Saisie {
+  uint32_t champs[IMPORT_NB_CHAMPS];  // decalages dans l'arene, 0 : absent
+  size_t debut;                       // arene au debut de l'enregistrement
+  const char *motif;                  // refus constate en cours de lecture
+} Saisie;
+
+// Place pour n octets et un terminateur a la fin de l'arene
+static char *arene_reserver(BlocImport *b, size_t n) {
+  if (b->utilise + n + 1 > b->cap_arene) {
+    size_t cap = b->cap_arene ? b->cap_arene : 4096;
+    while (cap < b->utilise + n + 1) cap *= 2;
+    if (cap > UINT32_MAX) return NULL;  // decalages sur 32 bits
+    char *tmp = realloc(b->arene, cap);
+    if (tmp == NULL) return NULL;
+    if (b->arene == NULL) tmp[0] = '\0';  // decalage 0 : texte vide
+    b->arene = tmp;
+    b->cap_arene = cap;
+  }
+  return b->arene + b->utilise;
+}
+
+static void saisie_debut(BlocImport *b, Saisie *s) {
+  memset(s->champs, 0, sizeof(s->champs));
+  s->debut = b->utilise;
+  s->motif = NULL;
+}
+
+// Ou ecrire au plus n octets du champ ; NULL s'il est ignore ou deja lu (le premier l'emporte)
+static char *champ_debut(BlocImport *b, Saisie *s, int champ, size_t n) {
+  if (champ < 0 || s->champs[champ] != 0 || s->motif != NULL) return NULL;
+  char *dest = arene_reserver(b, n);
+  if (dest == NULL) s->motif = "memoire insuffisante";
+  return dest;
+}
+
+/* Garde les n octets ecrits par l'appelant, espaces de bord retires ; vide :
+   absent. livres.dat range un livre par ligne, champs separes par '|' : les
+   caracteres de controle deviennent des espaces et '|' est refuse. */
+static void champ_fin(BlocImport *b, Saisie *s, int champ, size_t n) {
+  char *dest = b->arene + b->utilise;
+  size_t debut = 0;
+  for (size_t i = 0; i < n; i++) {
+    if ((unsigned char) dest[i] < ' ') dest[i] = ' ';
+    if (dest[i] == '|' && s->motif == NULL) s->motif = "caractere '|' interdit";
+  }
+  while (debut < n && isspace((unsigned char) dest[debut])) debut++;
+  while (n > debut && isspace((unsigned char) dest[n - 1])) n--;
+  if (n == debut) return;
+  if (debut > 0) memmove(dest, dest + debut, n - debut);
+  dest[n - debut] = '\0';
+  s->champs[champ] = (uint32_t) b->utilise;
+  b->utilise += n - debut + 1;
+}
+
+// Valide l'enregistrement (motif : refus deja constate) et l'ajoute aux fiches du bloc
+static void fiche_terminer(BlocImport *b, Saisie *s, const char *motif) {
+  char tampon[48];
+  long annee = 0;
+  Bool emprunte = FAUX;
+  b->lignes++;
+  if (motif == NULL) motif = s->motif;
+  if (motif == NULL && s->champs[IMPORT_TITRE] == 0) motif = "titre manquant";
+  if (motif == NULL && s->champs[IMPORT_AUTEUR] == 0) motif = "auteur manquant";
+  for (int i = 0; motif == NULL && i < IMPORT_NB_TEXTES; i++) {
+    if (s->champs[i] != 0 && strlen(b->arene + s->champs[i]) >= s_tailles[i]) {
+      snprintf(tampon, sizeof(tampon), "%s trop long", s_noms[i]);
+      motif = tampon;
+    }
+  }
+  if (motif == NULL && s->champs[IMPORT_ANNEE] != 0) {
+    char *fin;
+    errno = 0;
+    annee = strtol(b->arene + s->champs[IMPORT_ANNEE], &fin, 10);
+    if (*fin != '\0' || errno != 0 || annee < INT_MIN || annee > INT_MAX) motif = "annee invalide";
+  }
+  if (motif == NULL && s->champs[IMPORT_EMPRUNTE] != 0 &&
+      !params_parse_bool(b->arene + s->champs[IMPORT_EMPRUNTE], &emprunte)) {
+    motif = "emprunte invalide";
+  }
+  if (motif == NULL && b->nb_fiches == b->cap_fiches) {
+    size_t cap = b->cap_fiches ? b->cap_fiches * 2 : 1024;
+    FicheImport *tmp = realloc(b->fiches, cap * sizeof(FicheImport));
+    if (tmp == NULL) {
+      motif = "memoire insuffisante";
+    } else {
+      b->fiches = tmp;
+      b->cap_fiches = cap;
+    }
+  }
+  if (motif != NULL) {
+    b->rejetees++;
+    if (b->ligne_erreur == 0) {
+      b->ligne_erreur = b->lignes;
+      snprintf(b->erreur, sizeof(b->erreur), "%s", motif);
+    }
+    b->utilise = s->debut;  // textes de l'enregistrement refuse abandonnes
+    return;
+  }
+  FicheImport *f = &b->fiches[b->nb_fiches++];
+  memcpy(f->textes, s->champs, sizeof(f->textes));
+  f->annee = (int) annee;
+  f->emprunte = emprunte;
+  f->gardee = FAUX;
+  f->hachage = hachage(b->arene + f->textes[IMPORT_TITRE]);
+}
+
+/* Champ CSV commencant en p : [*debut, *fin_champ) sans les guillemets
+   englobants ("" y vaut alors un guillemet). Renvoie la position apres le
+   separateur ou la fin de ligne (*fin_ligne). */
+static const char *csv_champ(const char *p, const char *fin, char sep, const char **debut,
+                             const char **fin_champ, Bool *guillemets, Bool *fin_ligne) {
+  while (p < fin && (*p == ' ' || (*p == '\t' && sep != '\t'))) p++;
+  *guillemets = p < fin && *p == '"';
+  if (*guillemets) {
+    *debut = ++p;
+    while (p < fin && !(*p == '"' && (p + 1 >= fin || p[1] != '"'))) p += *p == '"' ? 2 : 1;
+    *fin_champ = p;
+    if (p < fin) p++;
+  } else {
+    *debut = p;
+  }
+  while (p < fin && *p != sep && *p != '\n') p++;  // apres le guillemet fermant : ignore
+  if (!*guillemets) *fin_champ = p;
+  *fin_ligne = p >= fin || *p == '\n';
+  return p < fin ? p + 1 : p;
+}
+
+static size_t csv_copier(const char *debut, const char *fin, Bool guillemets, char *dest) {
+  size_t n = 0;
+  for (const char *p = debut; p < fin; p++) {
+    dest[n++] = *p;
+    if (guillemets && *p == '"') p++;
+  }
+  return n;
+}
+
+static void analyser_csv(BlocImport *b) {
+  const Importation *imp = b->imp;
+  const char *p = b->donnees, *fin = b->donnees + b->longueur;
+  Saisie s;
+  while (p < fin) {
+    const char *q = p;
+    while (q < fin && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+    if (q >= fin || *q == '\n') {  // ligne vide
+      p = q + 1;
+      continue;
+    }
+    saisie_debut(b, &s);
+    Bool fin_ligne = FAUX;
+    for (size_t colonne = 0; !fin_ligne; colonne++) {
+      const char *debut, *fin_champ;
+      Bool guillemets;
+      p = csv_champ(p, fin, imp->separateur, &debut, &fin_champ, &guillemets, &fin_ligne);
+      int champ = colonne < imp->nb_colonnes ? imp->colonnes[colonne] : -1;
+      char *dest = champ_debut(b, &s, champ, (size_t) (fin_champ - debut));
+      if (dest != NULL) champ_fin(b, &s, champ, csv_copier(debut, fin_champ, guillemets, dest));
+    }
+    fiche_terminer(b, &s, NULL);
+  }
+}
+
+static int hex4(const char *p) {
+  int v = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = tolower((unsigned char) p[i]);
+    if (!isxdigit(c)) return -1;
+    v = v * 16 + (isdigit(c) ? c - '0' : c - 'a' + 10);
+  }
+  return v;
+}
+
+static size_t utf8(unsigned long cp, char *sortie) {
+  if (cp < 0x80) return sortie[0] = (char) cp, 1;
+  if (cp < 0x800) return sortie[0] = (char) (0xC0 | (cp >> 6)), sortie[1] = (char) (0x80 | (cp & 0x3F)), 2;
+  if (cp < 0x10000) {
+    sortie[0] = (char) (0xE0 | (cp >> 12));
+    sortie[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+    sortie[2] = (char) (0x80 | (cp & 0x3F));
+    return 3;
+  }
+  sortie[0] = (char) (0xF0 | (cp >> 18));
+  sortie[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+  sortie[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+  sortie[3] = (char) (0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/* Chaine JSON (guillemets compris) decodee dans dest, jamais plus longue :
+   \uXXXX et paires de substitution en UTF-8, comme externe.c. */
+static size_t json_copier(struct mg_str jeton, char *dest) {
+  const char *p = jeton.buf + 1, *fin = jeton.buf + jeton.len - 1;
+  char *q = dest;
+  while (p < fin) {
+    if (*p != '\\' || p + 1 >= fin) {
+      *q++ = *p++;
+      continue;
+    }
+    char c = p[1];
+    p += 2;
+    if (c == 'u' && p + 4 <= fin && hex4(p) >= 0) {
+      unsigned long cp = (unsigned long) hex4(p);
+      p += 4;
+      if (cp >= 0xD800 && cp < 0xDC00 && p + 6 <= fin && p[0] == '\\' && p[1] == 'u' && hex4(p + 2) >= 0xDC00 &&
+          hex4(p + 2) < 0xE000) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + ((unsigned long) hex4(p + 2) - 0xDC00);
+        p += 6;
+      }
+      q += utf8(cp, q);
+    } else {
+      *q++ = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+    }
+  }
+  return (size_t) (q - dest);
+}
+
+static void analyser_ndjson(BlocImport *b) {
+  const char *p = b->donnees, *fin = b->donnees + b->longueur;
+  Saisie s;
+  while (p < fin) {
+    const char *nl = memchr(p, '\n', (size_t) (fin - p));
+    struct mg_str ligne = mg_str_n(p, (size_t) ((nl != NULL ? nl : fin) - p));
+    p = nl != NULL ? nl + 1 : fin;
+    size_t i = 0;
+    while (i < ligne.len && isspace((unsigned char) ligne.buf[i])) i++;
+    if (i == ligne.len) continue;
+    saisie_debut(b, &s);
+    int n = 0, ofs = ligne.buf[i] == '{' ? mg_json_get(ligne, "$", &n) : -1;
+    if (ofs < 0) {
+      fiche_terminer(b, &s, "objet JSON invalide");
+      continue;
+    }
+    struct mg_str objet = mg_str_n(ligne.buf + ofs, (size_t) n), cle, valeur;
+    size_t suivant = 0;
+    while ((suivant = mg_json_next(objet, suivant, &cle, &valeur)) > 0) {
+      if (cle.len < 2 || valeur.len == 0 || strchr("n{[", valeur.buf[0]) != NULL) continue;  // null, objet, tableau
+      int champ = champ_de(cle.buf + 1, cle.len - 2);
+      char *dest = champ_debut(b, &s, champ, valeur.len);
+      if (dest == NULL) continue;
+      if (valeur.buf[0] == '"') {
+        champ_fin(b, &s, champ, json_copier(valeur, dest));
+      } else {
+        memcpy(dest, valeur.buf, valeur.len);  // nombre ou booleen, tel quel
+        champ_fin(b, &s, champ, valeur.len);
+      }
+    }
+    fiche_terminer(b, &s, NULL);
+  }
+}
+
+/* Sous-champ $code d'une ligne .mrk "=TAG  ii$a...$b...", sans la
+   ponctuation ISBD qui le termine (" /", " :", "."). */
+static Bool marc_sous_champ(const char *p, const char *fin, char code, const char **debut, const char **fin_valeur) {
+  for (; p + 1 < fin; p++) {
+    if (p[0] != '$' || p[1] != code) continue;
+    const char *q = *debut = p + 2;
+    while (q < fin && *q != '$') q++;
+    while (q > *debut && strchr(" /:;,.=", q[-1]) != NULL) q--;
+    *fin_valeur = q;
+    return VRAI;
+  }
+  return FAUX;
+}
+
+// Notices MARC en texte (.mrk, MarcEdit) separees par une ligne vide
+static void analyser_marc(BlocImport *b) {
+  const char *p = b->donnees, *fin = b->donnees + b->longueur;
+  Saisie s;
+  Bool ouverte = FAUX;
+  while (p < fin) {
+    const char *nl = memchr(p, '\n', (size_t) (fin - p));
+    const char *ligne = p, *fin_ligne = nl != NULL ? nl : fin;
+    p = nl != NULL ? nl + 1 : fin;
+    while (fin_ligne > ligne && isspace((unsigned char) fin_ligne[-1])) fin_ligne--;
+    if (fin_ligne == ligne) {
+      if (ouverte) fiche_terminer(b, &s, NULL);
+      ouverte = FAUX;
+      continue;
+    }
+    if (fin_ligne - ligne < 5 || ligne[0] != '=') continue;
+    if (!ouverte) saisie_debut(b, &s);
+    ouverte = VRAI;
+    if (!isdigit((unsigned char) ligne[1]) || !isdigit((unsigned char) ligne[2]) || !isdigit((unsigned char) ligne[3])) {
+      continue;  // =LDR
+    }
+    int tag = (ligne[1] - '0') * 100 + (ligne[2] - '0') * 10 + (ligne[3] - '0'), champ;
+    char code = 'a';
+    switch (tag) {
+      case 245: champ = IMPORT_TITRE; break;
+      case 100: case 110: case 700: case 710: champ = IMPORT_AUTEUR; break;
+      case 260: case 264: champ = IMPORT_ANNEE, code = 'c'; break;
+      case 650: case 655: champ = IMPORT_CATEGORIE; break;
+      case 520: champ = IMPORT_DESCRIPTION; break;
+      default: continue;
+    }
+    const char *debut, *fin_valeur;
+    if (!marc_sous_champ(ligne + 4, fin_ligne, code, &debut, &fin_valeur)) continue;
+    if (champ == IMPORT_ANNEE) {  // "c1862." ou "[1862?]" : quatre premiers chiffres consecutifs
+      while (debut + 4 <= fin_valeur && !(isdigit((unsigned char) debut[0]) && isdigit((unsigned char) debut[1]) &&
+                                          isdigit((unsigned char) debut[2]) && isdigit((unsigned char) debut[3]))) {
+        debut++;
+      }
+      if (debut + 4 > fin_valeur) continue;
+      fin_valeur = debut + 4;
+    }
+    char *dest = champ_debut(b, &s, champ, (size_t) (fin_valeur - debut));
+    if (dest == NULL) continue;
+    memcpy(dest, debut, (size_t) (fin_valeur - debut));
+    champ_fin(b, &s, champ, (size_t) (fin_valeur - debut));
+  }
+  if (ouverte) fiche_terminer(b, &s, NULL);
+}
+
+// Sous imp->verrou : VRAI pour le seul appel qui constate la fin des analyses
+static Bool terminer(Importation *imp) {
+  if (!imp->ferme || imp->en_cours > 0 || imp->termine) return FAUX;
+  imp->termine = VRAI;
+  imp->analyse_ms = mg_millis() - imp->debut_ms;
+  for (size_t i = 0; i < imp->nb_blocs; i++) {
+    imp->lignes += imp->blocs[i]->lignes;
+    imp->rejetees += imp->blocs[i]->rejetees;
+  }
+  pthread_cond_broadcast(&imp->termine_cond);
+  return VRAI;
+}
+
+static void analyser_tache(void *arg) {
+  BlocImport *b = (BlocImport *) arg;
+  Importation *imp = b->imp;
+  b->utilise = 1;
+  arene_reserver(b, b->longueur);  // les textes tiennent d'ordinaire dans la taille brute
+  if (imp->format == IMPORT_CSV) {
+    analyser_csv(b);
+  } else if (imp->format == IMPORT_NDJSON) {
+    analyser_ndjson(b);
+  } else {
+    analyser_marc(b);
+  }
+  free(b->donnees);
+  b->donnees = NULL;
+
+  pthread_mutex_lock(&imp->verrou);
+  imp->en_cours--;
+  Bool fini = terminer(imp);
+  FinImport fin = imp->fin;
+  void *fin_arg = imp->arg;
+  pthread_mutex_unlock(&imp->verrou);
+  if (fini && fin != NULL) fin(imp, fin_arg);  // imp peut etre libere des lors
+}
+
+// --- Decoupage du flux (thread qui fournit les donnees) ---
+
+Bool importation_init(Importation *imp, FormatImport format, PoolTravailleurs *pool, FinImport fin, void *arg) {
+  memset(imp, 0, sizeof(Importation));
+  imp->format = format;
+  imp->pool = pool;
+  imp->fin = fin;
+  imp->arg = arg;
+  imp->separateur = ',';
+  pthread_mutex_init(&imp->verrou, NULL);
+  pthread_cond_init(&imp->termine_cond, NULL);
+  imp->debut_ms = mg_millis();
+  imp->cap = 2 * IMPORT_BLOC;
+  imp->courant = malloc(imp->cap);
+  return imp->courant != NULL;
+}
+
+void importation_free(Importation *imp) {
+  for (size_t i = 0; i < imp->nb_blocs; i++) {
+    BlocImport *b = imp->blocs[i];
+    free(b->donnees);
+    free(b->fiches);
+    free(b->arene);
+    free(b);
+  }
+  free(imp->blocs);
+  free(imp->courant);
+  pthread_mutex_destroy(&imp->verrou);
+  pthread_cond_destroy(&imp->termine_cond);
+}
+
+// Confie les coupe premiers octets de courant a un travailleur
+static void expedier(Importation *imp, size_t coupe) {
+  BlocImport *b = calloc(1, sizeof(BlocImport));
+  char *reste = malloc(imp->cap);
+  if (b != NULL && reste != NULL && imp->nb_blocs == imp->cap_blocs) {
+    size_t cap = imp->cap_blocs ? imp->cap_blocs * 2 : 64;
+    BlocImport **tmp = realloc(imp->blocs, cap * sizeof(BlocImport *));
+    if (tmp != NULL) {
+      imp->blocs = tmp;
+      imp->cap_blocs = cap;
+    }
+  }
+  if (b == NULL || reste == NULL || imp->nb_blocs == imp->cap_blocs) {
+    free(b);
+    free(reste);
+    snprintf(imp->erreur, sizeof(imp->erreur), "memoire insuffisante");
+    return;
+  }
+  b->imp = imp;
+  b->donnees = imp->courant;
+  b->longueur = coupe;
+  imp->longueur -= coupe;
+  memcpy(reste, imp->courant + coupe, imp->longueur);
+  imp->courant = reste;
+  imp->blocs[imp->nb_blocs++] = b;
+
+  pthread_mutex_lock(&imp->verrou);
+  imp->en_cours++;
+  pthread_mutex_unlock(&imp->verrou);
+  if (!pool_soumettre(imp->pool, analyser_tache, b)) analyser_tache(b);
+}
+
+// Longueur du plus long prefixe de courant fini par une fin d'enregistrement, 0 : aucun
+static size_t couper(const Importation *imp) {
+  const char *d = imp->courant;
+  size_t n = imp->longueur;
+  if (imp->format == IMPORT_MARC) {
+    for (size_t i = n; i >= 2; i--) {
+      if (d[i - 1] == '\n' && (d[i - 2] == '\n' || (i >= 3 && d[i - 2] == '\r' && d[i - 3] == '\n'))) return i;
+    }
+    return 0;
+  }
+  if (imp->format == IMPORT_CSV && memchr(d, '"', n) != NULL) {
+    size_t coupe = 0;
+    Bool dedans = FAUX;  // un saut de ligne entre guillemets ne finit pas l'enregistrement
+    for (size_t i = 0; i < n; i++) {
+      if (d[i] == '"') {
+        dedans = !dedans;
+      } else if (d[i] == '\n' && !dedans) {
+        coupe = i + 1;
+      }
+    }
+    return coupe;
+  }
+  for (size_t i = n; i > 0; i--) {
+    if (d[i - 1] == '\n') return i;
+  }
+  return 0;
+}
+
+/* En-tete CSV : separateur le plus frequent hors guillemets, puis champ de
+   chaque colonne (les colonnes inconnues sont ignorees). */
+static Bool lire_entete(Importation *imp, const char *ligne, size_t n) {
+  size_t virgules = 0, points_virgules = 0, tabulations = 0;
+  Bool dedans = FAUX, titre = FAUX, auteur = FAUX, fin_ligne = FAUX;
+  for (size_t i = 0; i < n; i++) {
+    dedans ^= ligne[i] == '"';
+    virgules += !dedans && ligne[i] == ',';
+    points_virgules += !dedans && ligne[i] == ';';
+    tabulations += !dedans && ligne[i] == '\t';
+  }
+  imp->separateur = tabulations > virgules && tabulations > points_virgules ? '\t'
+                    : points_virgules > virgules                          ? ';'
+                                                                          : ',';
+  const char *p = ligne, *fin = ligne + n;
+  while (!fin_ligne && imp->nb_colonnes < IMPORT_COLONNES) {
+    const char *debut, *fin_champ;
+    Bool guillemets;
+    p = csv_champ(p, fin, imp->separateur, &debut, &fin_champ, &guillemets, &fin_ligne);
+    int champ = champ_de(debut, (size_t) (fin_champ - debut));
+    imp->colonnes[imp->nb_colonnes++] = champ;
+    titre |= champ == IMPORT_TITRE;
+    auteur |= champ == IMPORT_AUTEUR;
+  }
+  return titre && auteur;
+}
+
+/* Debut du fichier : BOM UTF-8 retire, en-tete CSV lu et retire. FAUX tant
+   qu'il n'est pas complet (dernier : plus rien ne viendra) ou en erreur. */
+static Bool lire_debut(Importation *imp, Bool dernier) {
+  size_t n = imp->longueur >= 3 && memcmp(imp->courant, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+  if (imp->format == IMPORT_CSV) {
+    const char *nl = memchr(imp->courant, '\n', imp->longueur);
+    if (nl == NULL && !dernier) {
+      if (imp->longueur > IMPORT_ENTETE_MAX) snprintf(imp->erreur, sizeof(imp->erreur), "en-tete CSV trop long");
+      return FAUX;
+    }
+    size_t bom = n;
+    n = nl != NULL ? (size_t) (nl - imp->courant) + 1 : imp->longueur;
+    if (!lire_entete(imp, imp->courant + bom, n - bom)) {
+      snprintf(imp->erreur, sizeof(imp->erreur), "en-tete CSV sans colonnes titre et auteur");
+      return FAUX;
+    }
+  } else if (imp->longueur < 3 && !dernier) {
+    return FAUX;
+  }
+  imp->entete_lu = VRAI;
+  imp->longueur -= n;
+  memmove(imp->courant, imp->courant + n, imp->longueur);
+  return VRAI;
+}
+
+Bool importation_ajouter(Importation *imp, const char *donnees, size_t longueur) {
+  imp->octets += longueur;
+  if (imp->erreur[0] != '\0' || imp->annule) return FAUX;
+  if (imp->longueur + longueur > imp->cap) {  // enregistrement plus long qu'un bloc
+    size_t cap = imp->cap * 2;
+    while (cap < imp->longueur + longueur) cap *= 2;
+    char *tmp = realloc(imp->courant, cap);
+    if (tmp == NULL) {
+      snprintf(imp->erreur, sizeof(imp->erreur), "memoire insuffisante");
+      return FAUX;
+    }
+    imp->courant = tmp;
+    imp->cap = cap;
+  }
+  memcpy(imp->courant + imp->longueur, donnees, longueur);
+  imp->longueur += longueur;
+  if (!imp->entete_lu && !lire_debut(imp, FAUX)) return imp->erreur[0] == '\0';
+  if (imp->longueur >= IMPORT_BLOC) {
+    size_t coupe = couper(imp);
+    if (coupe > 0) expedier(imp, coupe);
+  }
+  return imp->erreur[0] == '\0';
+}
+
+// Analyses deja finies a la fermeture : fin part quand meme dans le pool
+static void finir_tache(void *arg) {
+  Importation *imp = (Importation *) arg;
+  imp->fin(imp, imp->arg);
+}
+
+void importation_fermer(Importation *imp) {
+  if (imp->erreur[0] == '\0' && !imp->annule && (imp->entete_lu || lire_debut(imp, VRAI)) && imp->longueur > 0) {
+    expedier(imp, imp->longueur);
+  }
+  pthread_mutex_lock(&imp->verrou);
+  imp->ferme = VRAI;
+  Bool fini = terminer(imp);
+  pthread_mutex_unlock(&imp->verrou);
+  if (fini && imp->fin != NULL && !pool_soumettre(imp->pool, finir_tache, imp)) finir_tache(imp);
+}
+
+void importation_attendre(Importation *imp) {
+  pthread_mutex_lock(&imp->verrou);
+  while (!imp->termine) pthread_cond_wait(&imp->termine_cond, &imp->verrou);
+  pthread_mutex_unlock(&imp->verrou);
+}
+
+// --- Insertion ---
+
+typedef struct Titre {
+  uint32_t hachage;
+  const char *titre;
+} Titre;
+
+// Ajoute titre a l'ensemble (adressage ouvert) ; FAUX s'il y etait deja
+static Bool titres_ajouter(Titre *t, size_t masque, uint32_t h, const char *titre) {
+  for (size_t i = h & masque;; i = (i + 1) & masque) {
+    if (t[i].titre == NULL) {
+      t[i].hachage = h;
+      t[i].titre = titre;
+      return VRAI;
+    }
+    if (t[i].hachage == h && strcmp(t[i].titre, titre) == 0) return FAUX;
+  }
+}
+
+// Garde la premiere fiche de chaque titre absent du catalogue
+static void choisir(Importation *imp, const Bibliotheque *bibli) {
+  size_t total = 0, cap = 16;
+  for (size_t i = 0; i < imp->nb_blocs; i++) total += imp->blocs[i]->nb_fiches;
+  while (cap < 2 * (bibli->nb_livres + total)) cap *= 2;
+  Titre *t = calloc(cap, sizeof(Titre));
+  if (t == NULL) {
+    snprintf(imp->erreur, sizeof(imp->erreur), "memoire insuffisante");
+    return;
+  }
+  for (size_t id = 1; id < bibli->cap_id; id++) {
+    const Livre *l = bibli->par_id[id];
+    if (l != NULL) titres_ajouter(t, cap - 1, hachage(l->titre), l->titre);
+  }
+  imp->doublons = 0;
+  for (size_t i = 0; i < imp->nb_blocs; i++) {
+    const BlocImport *b = imp->blocs[i];
+    for (size_t j = 0; j < b->nb_fiches; j++) {
+      FicheImport *f = &b->fiches[j];
+      f->gardee = titres_ajouter(t, cap - 1, f->hachage, b->arene + f->textes[IMPORT_TITRE]);
+      imp->doublons += !f->gardee;
+    }
+  }
+  free(t);
+}
+
+size_t importation_inserer(Importation *imp, Bibliotheque *bibli, Bool premiere, VisiteImport visite, void *arg) {
+  if (bibli == NULL || imp->annule) return 0;
+  if (premiere) choisir(imp, bibli);
+  int id = biblio_next_id(bibli);
+  size_t nb = 0;
+  Livre livre;
+  char *textes[IMPORT_NB_TEXTES] = {livre.titre,   livre.auteur,      livre.categorie,
+                                    livre.fichier, livre.description, livre.couverture};
+  biblio_lot_debut(bibli);
+  for (size_t i = 0; i < imp->nb_blocs; i++) {
+    const BlocImport *b = imp->blocs[i];
+    for (size_t j = 0; j < b->nb_fiches; j++) {
+      const FicheImport *f = &b->fiches[j];
+      if (!f->gardee) continue;
+      memset(&livre, 0, sizeof(Livre));
+      livre.id = id++;  // consecutifs depuis next_id, identiques sur les deux copies
+      livre.annee = f->annee;
+      livre.est_emprunte = f->emprunte;
+      for (int k = 0; k < IMPORT_NB_TEXTES; k++) {
+        const char *texte = b->arene + f->textes[k];
+        memcpy(textes[k], texte, strlen(texte) + 1);  // longueur verifiee par fiche_terminer
+      }
+      if (!biblio_add(bibli, &livre)) {
+        id--;  // au-dela de BIBLIO_ID_MAX : les suivants le seraient aussi
+        continue;
+      }
+      nb++;
+      const Livre *insere = premiere && visite != NULL ? biblio_find_by_id(bibli, livre.id) : NULL;
+      if (insere != NULL) visite(insere, arg);
+    }
+  }
+  biblio_lot_fin(bibli);
+  if (premiere) {
+    imp->importees = nb;
+    imp->premier_id = nb > 0 ? id - (int) nb : 0;
+    imp->dernier_id = nb > 0 ? id - 1 : 0;
+  }
+  return nb;
+}
+
+char *importation_rapport_json(const Importation *imp, uint64_t insertion_ms, uint64_t total_ms) {
+  char erreur[160] = "";
+  size_t avant = 0;
+  if (imp->erreur[0] != '\0') snprintf(erreur, sizeof(erreur), "%s", imp->erreur);
+  for (size_t i = 0; erreur[0] == '\0' && i < imp->nb_blocs; i++) {
+    const BlocImport *b = imp->blocs[i];
+    if (b->ligne_erreur > 0) {
+      snprintf(erreur, sizeof(erreur), "enregistrement %lu : %s", (unsigned long) (avant + b->ligne_erreur),
+               b->erreur);
+    }
+    avant += b->lignes;
+  }
+  char *json_erreur = erreur[0] != '\0' ? mg_mprintf("%m", MG_ESC(erreur)) : NULL;
+  char *json = mg_mprintf("{ \"format\": \"%s\", \"octets\": %llu, \"blocs\": %lu, \"lignes\": %lu, "
+                          "\"importees\": %lu, \"doublons\": %lu, \"rejetees\": %lu, \"premiere_erreur\": %s, "
+                          "\"premier_id\": %d, \"dernier_id\": %d, \"analyse_ms\": %llu, \"insertion_ms\": %llu, "
+                          "\"total_ms\": %llu, \"lignes_par_seconde\": %lu }",
+                          importation_nom_format(imp->format), (unsigned long long) imp->octets,
+                          (unsigned long) imp->nb_blocs, (unsigned long) imp->lignes, (unsigned long) imp->importees,
+                          (unsigned long) imp->doublons, (unsigned long) imp->rejetees,
+                          json_erreur != NULL ? json_erreur : "null", imp->premier_id, imp->dernier_id,
+                          (unsigned long long) imp->analyse_ms, (unsigned long long) insertion_ms,
+                          (unsigned long long) total_ms,
+                          (unsigned long) ((uint64_t) imp->lignes * 1000 / (total_ms > 0 ? total_ms : 1)));
+  free(json_erreur);
+  return json;
+}
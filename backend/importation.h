@@ -0,0 +1,122 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "bibliotheque.h"
+#include "model.h"
+#include "travailleurs.h"
+
+#define IMPORT_BLOC (4 * 1024 * 1024)                 // octets analyses par une tache
+#define IMPORT_TAILLE_MAX (2048LL * 1024 * 1024)      // corps d'un POST /api/import
+#define IMPORT_COLONNES 64                            // colonnes CSV reconnues
+
+typedef enum { IMPORT_CSV = 0, IMPORT_NDJSON, IMPORT_MARC } FormatImport;
+
+// Champs d'une fiche ; les textes sont ranges dans l'arene de son bloc
+enum {
+  IMPORT_TITRE = 0,
+  IMPORT_AUTEUR,
+  IMPORT_CATEGORIE,
+  IMPORT_FICHIER,
+  IMPORT_DESCRIPTION,
+  IMPORT_COUVERTURE,
+  IMPORT_NB_TEXTES,
+  IMPORT_ANNEE = IMPORT_NB_TEXTES,
+  IMPORT_EMPRUNTE,
+  IMPORT_NB_CHAMPS
+};
+
+// Un livre lu et valide, en attente d'insertion (quelques dizaines d'octets)
+typedef struct FicheImport {
+    uint32_t textes[IMPORT_NB_TEXTES];  // decalages dans l'arene, 0 : ""
+    int annee;
+    Bool emprunte;
+    Bool gardee;                // ni doublon du lot ni titre deja au catalogue
+    uint32_t hachage;           // du titre, calcule par le travailleur
+} FicheImport;
+
+struct Importation;
+
+/* Une tranche du fichier coupee sur une fin d'enregistrement, analysee par
+   un travailleur independamment des autres. */
+typedef struct BlocImport {
+    struct Importation *imp;
+    char *donnees;
+    size_t longueur;
+    FicheImport *fiches;
+    size_t nb_fiches;
+    size_t cap_fiches;
+    char *arene;
+    size_t utilise;
+    size_t cap_arene;
+    size_t lignes;              // enregistrements lus (valides ou non)
+    size_t rejetees;
+    size_t ligne_erreur;        // rang du premier refus dans le bloc (1 : premier)
+    char erreur[96];            // motif de ce refus
+} BlocImport;
+
+// Appelee une fois toutes les analyses finies, dans un thread du pool (l'appelant sans pool)
+typedef void (*FinImport)(struct Importation *imp, void *arg);
+
+// Rappel pour chaque livre insere, a la premiere application seulement
+typedef void (*VisiteImport)(const Livre *livre, void *arg);
+
+/* Import en masse : le fichier arrive par morceaux (importation_ajouter),
+   est decoupe en blocs d'environ IMPORT_BLOC octets sur des fins
+   d'enregistrement, et chaque bloc est analyse par le pool pendant que la
+   suite arrive. importation_inserer ajoute ensuite les fiches dans l'ordre
+   du fichier, sans doublon de titre, ids consecutifs depuis next_id, index
+   tries fusionnes une seule fois (biblio_lot_debut/fin). */
+typedef struct Importation {
+    FormatImport format;
+    PoolTravailleurs *pool;     // NULL : analyse dans le thread appelant
+    FinImport fin;
+    void *arg;
+    char separateur;            // CSV : ',' ';' ou tabulation, d'apres l'en-tete
+    int colonnes[IMPORT_COLONNES];  // CSV : champ de chaque colonne, -1 : ignoree
+    size_t nb_colonnes;
+    Bool entete_lu;
+    char *courant;              // bloc en cours de remplissage
+    size_t longueur;
+    size_t cap;
+    BlocImport **blocs;         // dans l'ordre du fichier
+    size_t nb_blocs;
+    size_t cap_blocs;
+    pthread_mutex_t verrou;
+    pthread_cond_t termine_cond;
+    size_t en_cours;            // blocs confies au pool, pas encore analyses
+    Bool ferme;
+    Bool termine;
+    Bool annule;                // client parti : rien ne sera insere
+    char erreur[96];            // erreur du fichier entier (en-tete, memoire)
+    uint64_t octets;
+    uint64_t debut_ms;
+    uint64_t analyse_ms;        // debut -> derniere analyse terminee
+    // Resultats de importation_inserer
+    size_t lignes;
+    size_t importees;
+    size_t doublons;
+    size_t rejetees;
+    int premier_id;
+    int dernier_id;
+} Importation;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+// "csv", "ndjson" / "jsonl", "marc" / "mrk", ou l'extension d'un nom de fichier
+Bool importation_format(const char *nom, FormatImport *format);
+const char *importation_nom_format(FormatImport format);
+
+Bool importation_init(Importation *imp, FormatImport format, PoolTravailleurs *pool, FinImport fin, void *arg);
+void importation_free(Importation *imp);
+
+Bool importation_ajouter(Importation *imp, const char *donnees, size_t longueur);
+void importation_fermer(Importation *imp);
+void importation_attendre(Importation *imp);
+
+/* Insere les fiches dans bibli. La premiere application choisit les
+   fiches gardees et remplit les compteurs ; une seconde (autre copie du
+   catalogue, identique) refait exactement les memes ajouts. */
+size_t importation_inserer(Importation *imp, Bibliotheque *bibli, Bool premiere, VisiteImport visite, void *arg);
+char *importation_rapport_json(const Importation *imp, uint64_t insertion_ms, uint64_t total_ms);
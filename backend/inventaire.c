@@ -0,0 +1,346 @@
+#include "inventaire.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t fnv1a(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; s++) {
+    h ^= (unsigned char) *s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static Bool nom_liste(const Inventaire *inv, const char *nom) {
+  size_t n = strlen(nom), s = strlen(inv->suffixe);
+  return nom[0] != '.' && strchr(nom, '/') == NULL && n > s && mg_ncasecmp(nom + n - s, inv->suffixe, s) == 0;
+}
+
+// --- Table par nom (tout sous inv->verrou) ---
+
+static EntreeInventaire *entree_chercher(Inventaire *inv, const char *nom, uint32_t hachage) {
+  for (EntreeInventaire *e = inv->alveoles[hachage & (inv->nb_alveoles - 1)]; e != NULL; e = e->suivant) {
+    if (e->hachage == hachage && strcmp(e->nom, nom) == 0) return e;
+  }
+  return NULL;
+}
+
+static void table_agrandir(Inventaire *inv) {
+  size_t nb = inv->nb_alveoles * 2;
+  EntreeInventaire **alveoles = calloc(nb, sizeof(EntreeInventaire *));
+  if (alveoles == NULL) return;  // chaines plus longues, rien de faux
+  for (size_t i = 0; i < inv->nb_alveoles; i++) {
+    while (inv->alveoles[i] != NULL) {
+      EntreeInventaire *e = inv->alveoles[i];
+      inv->alveoles[i] = e->suivant;
+      e->suivant = alveoles[e->hachage & (nb - 1)];
+      alveoles[e->hachage & (nb - 1)] = e;
+    }
+  }
+  free(inv->alveoles);
+  inv->alveoles = alveoles;
+  inv->nb_alveoles = nb;
+}
+
+static EntreeInventaire *entree_creer(Inventaire *inv, const char *nom, uint32_t hachage) {
+  EntreeInventaire *e = calloc(1, sizeof(EntreeInventaire));
+  if (e == NULL || (e->nom = strdup(nom)) == NULL) {
+    free(e);
+    return NULL;
+  }
+  if (inv->nb_entrees >= 2 * inv->nb_alveoles) table_agrandir(inv);
+  e->hachage = hachage;
+  EntreeInventaire **alveole = &inv->alveoles[hachage & (inv->nb_alveoles - 1)];
+  e->suivant = *alveole;
+  *alveole = e;
+  inv->nb_entrees++;
+  return e;
+}
+
+// Ni present, ni designe, ni dans l'ordre : l'entree ne sert plus
+static void entree_oublier_si_inutile(Inventaire *inv, EntreeInventaire *e) {
+  if (e->present || e->references > 0 || e->dans_ordre) return;
+  for (EntreeInventaire **p = &inv->alveoles[e->hachage & (inv->nb_alveoles - 1)]; *p != NULL; p = &(*p)->suivant) {
+    if (*p == e) {
+      *p = e->suivant;
+      break;
+    }
+  }
+  inv->nb_entrees--;
+  free(e->json);
+  free(e->nom);
+  free(e);
+}
+
+static void entree_serialiser(EntreeInventaire *e) {
+  free(e->json);
+  e->json = mg_mprintf("{\"nom\": %m, \"taille\": %llu, \"mtime\": %lld, \"reference\": %s}", MG_ESC(e->nom),
+                       (unsigned long long) e->taille, (long long) e->mtime, e->references > 0 ? "true" : "false");
+  e->json_len = e->json != NULL ? strlen(e->json) : 0;
+}
+
+static void entree_fixer(Inventaire *inv, EntreeInventaire *e, Bool present, uint64_t taille, int64_t mtime) {
+  if (e->present == present && (!present || (e->taille == taille && e->mtime == mtime))) return;
+  e->present = present;
+  e->taille = taille;
+  e->mtime = mtime;
+  if (present) {
+    entree_serialiser(e);
+    if (!e->dans_ordre && inv->nb_nouvelles == inv->cap_nouvelles) {
+      size_t cap = inv->cap_nouvelles ? inv->cap_nouvelles * 2 : 64;
+      EntreeInventaire **n = realloc(inv->nouvelles, cap * sizeof(EntreeInventaire *));
+      if (n != NULL) inv->nouvelles = n, inv->cap_nouvelles = cap;
+    }
+    if (!e->dans_ordre && inv->nb_nouvelles < inv->cap_nouvelles) {
+      inv->nouvelles[inv->nb_nouvelles++] = e;
+      e->dans_ordre = VRAI;
+    }
+  }
+  inv->version++;
+}
+
+static void actualiser(Inventaire *inv, const char *nom) {
+  char chemin[MG_PATH_MAX];
+  size_t taille = 0;
+  time_t mtime = 0;
+  snprintf(chemin, sizeof(chemin), "%s/%s", inv->repertoire, nom);
+  int drapeaux = mg_fs_posix.st(chemin, &taille, &mtime);
+  Bool present = drapeaux != 0 && (drapeaux & MG_FS_DIR) == 0;
+  uint32_t hachage = fnv1a(nom);
+  EntreeInventaire *e = entree_chercher(inv, nom, hachage);
+  if (e == NULL && (!present || (e = entree_creer(inv, nom, hachage)) == NULL)) return;
+  entree_fixer(inv, e, present, taille, (int64_t) mtime);
+  if (present) e->passage = inv->passage;
+  entree_oublier_si_inutile(inv, e);
+}
+
+// --- Mises a jour ---
+
+void inventaire_actualiser(Inventaire *inv, const char *nom) {
+  if (inv == NULL || nom == NULL || !nom_liste(inv, nom)) return;
+  pthread_mutex_lock(&inv->verrou);  // stat compris : deux evenements ne s'inversent pas
+  actualiser(inv, nom);
+  pthread_mutex_unlock(&inv->verrou);
+}
+
+static void relire_nom(const char *nom, void *arg) {
+  Inventaire *inv = (Inventaire *) arg;
+  if (nom_liste(inv, nom)) actualiser(inv, nom);
+}
+
+void inventaire_relire(Inventaire *inv) {
+  pthread_mutex_lock(&inv->verrou);
+  inv->passage++;
+  mg_fs_posix.ls(inv->repertoire, relire_nom, inv);  // une seule lecture du repertoire
+  for (size_t i = 0; i < inv->nb_alveoles; i++) {
+    for (EntreeInventaire *e = inv->alveoles[i], *suivante; e != NULL; e = suivante) {
+      suivante = e->suivant;
+      if (e->present && e->passage != inv->passage) {
+        entree_fixer(inv, e, FAUX, 0, 0);  // disparu sans qu'on le sache
+        entree_oublier_si_inutile(inv, e);
+      }
+    }
+  }
+  pthread_mutex_unlock(&inv->verrou);
+}
+
+void inventaire_ecouter(void *arg, const char *repertoire, const char *nom) {
+  Inventaire *inv = (Inventaire *) arg;
+  if (strcmp(repertoire, inv->repertoire) != 0) return;
+  if (nom == NULL) {
+    inventaire_relire(inv);
+  } else {
+    inventaire_actualiser(inv, nom);
+  }
+}
+
+void inventaire_referencer(Inventaire *inv, const char *nom, int delta) {
+  if (inv == NULL || nom == NULL || nom[0] == '\0') return;
+  uint32_t hachage = fnv1a(nom);
+  pthread_mutex_lock(&inv->verrou);
+  EntreeInventaire *e = entree_chercher(inv, nom, hachage);
+  if (e == NULL && delta > 0) e = entree_creer(inv, nom, hachage);
+  if (e != NULL) {
+    Bool avant = e->references > 0;
+    e->references += delta;
+    if (e->references < 0) e->references = 0;
+    if (e->present && avant != (e->references > 0)) {
+      entree_serialiser(e);
+      inv->version++;
+    }
+    entree_oublier_si_inutile(inv, e);
+  }
+  pthread_mutex_unlock(&inv->verrou);
+}
+
+void inventaire_oublier_references(Inventaire *inv) {
+  pthread_mutex_lock(&inv->verrou);
+  for (size_t i = 0; i < inv->nb_alveoles; i++) {
+    for (EntreeInventaire *e = inv->alveoles[i], *suivante; e != NULL; e = suivante) {
+      suivante = e->suivant;
+      if (e->references == 0) continue;
+      e->references = 0;
+      if (e->present) {
+        entree_serialiser(e);
+        inv->version++;
+      }
+      entree_oublier_si_inutile(inv, e);
+    }
+  }
+  pthread_mutex_unlock(&inv->verrou);
+}
+
+// --- Ordre et serialisation (sous inv->verrou) ---
+
+static int comparer_noms(const void *a, const void *b) {
+  return strcmp((*(EntreeInventaire *const *) a)->nom, (*(EntreeInventaire *const *) b)->nom);
+}
+
+/* Trie les noms apparus et les fusionne avec l'ordre existant ; les
+   absents en sortent (et sont liberes s'ils ne servent plus). */
+static Bool fusionner(Inventaire *inv) {
+  EntreeInventaire **fusion = malloc((inv->nb_tries + inv->nb_nouvelles + 1) * sizeof(EntreeInventaire *));
+  if (fusion == NULL) return FAUX;
+  qsort(inv->nouvelles, inv->nb_nouvelles, sizeof(EntreeInventaire *), comparer_noms);
+  size_t i = 0, j = 0, k = 0;
+  while (i < inv->nb_tries || j < inv->nb_nouvelles) {
+    EntreeInventaire *e;
+    if (j == inv->nb_nouvelles || (i < inv->nb_tries && strcmp(inv->tries[i]->nom, inv->nouvelles[j]->nom) < 0)) {
+      e = inv->tries[i++];
+    } else {
+      e = inv->nouvelles[j++];
+    }
+    if (e->present) {
+      fusion[k++] = e;
+    } else {
+      e->dans_ordre = FAUX;
+      entree_oublier_si_inutile(inv, e);
+    }
+  }
+  free(inv->tries);
+  inv->tries = fusion;
+  inv->nb_tries = k;
+  inv->nb_nouvelles = 0;
+  return VRAI;
+}
+
+static void instantane_relacher(InstantaneInventaire *s) {
+  if (s == NULL || --s->references > 0) return;
+  free(s->debuts);
+  free(s->json);
+  free(s);
+}
+
+static InstantaneInventaire *serialiser(Inventaire *inv) {
+  if (!fusionner(inv)) return NULL;
+  size_t total = 0;
+  for (size_t i = 0; i < inv->nb_tries; i++) total += inv->tries[i]->json_len + 2;
+  InstantaneInventaire *s = calloc(1, sizeof(InstantaneInventaire));
+  if (s == NULL || (s->debuts = malloc((inv->nb_tries + 1) * sizeof(size_t))) == NULL ||
+      (s->json = malloc(total + 1)) == NULL) {
+    if (s != NULL) free(s->debuts);
+    free(s);
+    return NULL;
+  }
+  size_t position = 0;
+  for (size_t i = 0; i < inv->nb_tries; i++) {
+    const EntreeInventaire *e = inv->tries[i];
+    if (e->json == NULL) continue;  // allocation ratee : absent de cette version
+    s->debuts[s->nb++] = position;
+    memcpy(s->json + position, e->json, e->json_len);
+    memcpy(s->json + position + e->json_len, ",\n", 2);
+    position += e->json_len + 2;
+  }
+  s->debuts[s->nb] = position;
+  s->version = inv->version;
+  s->references = 1;
+  return s;
+}
+
+void inventaire_repondre(Inventaire *inv, struct mg_connection *c, struct mg_http_message *hm, size_t debut,
+                         size_t limite) {
+  if (limite == 0) limite = INVENTAIRE_PAGE;
+  if (limite > INVENTAIRE_PAGE_MAX) limite = INVENTAIRE_PAGE_MAX;
+  char etag[64], entetes[128];
+  struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+
+  pthread_mutex_lock(&inv->verrou);
+  mg_snprintf(etag, sizeof(etag), "\"%llu-%lu-%lu\"", (unsigned long long) inv->version, (unsigned long) debut,
+              (unsigned long) limite);
+  if (inm != NULL && mg_vcasecmp(inm, etag) == 0) {
+    pthread_mutex_unlock(&inv->verrou);
+    mg_snprintf(entetes, sizeof(entetes), "ETag: %s\r\n", etag);
+    mg_http_reply(c, 304, entetes, "");
+    return;
+  }
+  InstantaneInventaire *s = inv->instantane;
+  if (s == NULL || s->version != inv->version) {
+    InstantaneInventaire *neuf = serialiser(inv);
+    if (neuf != NULL) {
+      instantane_relacher(s);
+      inv->instantane = s = neuf;
+    }
+  }
+  if (s != NULL) s->references++;
+  pthread_mutex_unlock(&inv->verrou);
+  if (s == NULL) {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+    return;
+  }
+
+  if (debut > s->nb) debut = s->nb;
+  size_t fin = s->nb - debut < limite ? s->nb : debut + limite;
+  size_t longueur = fin > debut ? s->debuts[fin] - s->debuts[debut] - 2 : 0;  // sans le dernier ",\n"
+  char tete[160], suivant[24] = "null";
+  if (fin < s->nb) mg_snprintf(suivant, sizeof(suivant), "%lu", (unsigned long) fin);
+  size_t n = mg_snprintf(tete, sizeof(tete), "{ \"version\": %llu, \"total\": %lu, \"debut\": %lu, \"suivant\": %s, "
+                         "\"fichiers\": [\n", (unsigned long long) s->version, (unsigned long) s->nb,
+                         (unsigned long) debut, suivant);
+  mg_snprintf(etag, sizeof(etag), "\"%llu-%lu-%lu\"", (unsigned long long) s->version, (unsigned long) debut,
+              (unsigned long) limite);
+  // La tranche part telle quelle : mg_http_reply la recopierait octet par octet
+  mg_printf(c, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nETag: %s\r\nCache-Control: no-cache\r\n"
+            "Content-Length: %lu\r\n\r\n", etag, (unsigned long) (n + longueur + 5));
+  if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) {
+    mg_send(c, tete, n);
+    mg_send(c, s->json + s->debuts[debut], longueur);
+    mg_send(c, "\n] }\n", 5);
+  }
+  c->is_resp = 0;  // reponse complete, comme apres mg_http_reply
+
+  pthread_mutex_lock(&inv->verrou);
+  instantane_relacher(s);
+  pthread_mutex_unlock(&inv->verrou);
+}
+
+// --- Cycle de vie ---
+
+Bool inventaire_init(Inventaire *inv, const char *repertoire, const char *suffixe) {
+  memset(inv, 0, sizeof(Inventaire));
+  pthread_mutex_init(&inv->verrou, NULL);
+  snprintf(inv->repertoire, sizeof(inv->repertoire), "%s", repertoire);
+  snprintf(inv->suffixe, sizeof(inv->suffixe), "%s", suffixe);
+  inv->nb_alveoles = INVENTAIRE_ALVEOLES;
+  if ((inv->alveoles = calloc(inv->nb_alveoles, sizeof(EntreeInventaire *))) == NULL) return FAUX;
+  inventaire_relire(inv);
+  return VRAI;
+}
+
+void inventaire_free(Inventaire *inv) {
+  for (size_t i = 0; inv->alveoles != NULL && i < inv->nb_alveoles; i++) {
+    while (inv->alveoles[i] != NULL) {
+      EntreeInventaire *e = inv->alveoles[i];
+      inv->alveoles[i] = e->suivant;
+      free(e->json);
+      free(e->nom);
+      free(e);
+    }
+  }
+  instantane_relacher(inv->instantane);
+  free(inv->alveoles);
+  free(inv->tries);
+  free(inv->nouvelles);
+  pthread_mutex_destroy(&inv->verrou);
+}
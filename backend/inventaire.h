@@ -0,0 +1,79 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define INVENTAIRE_ALVEOLES 1024    // au depart ; doublees quand la table se remplit
+#define INVENTAIRE_PAGE 1000        // fichiers par page par defaut
+#define INVENTAIRE_PAGE_MAX 10000
+
+/* Un nom du repertoire, ou un nom que des livres designent sans qu'il y
+   soit (present == FAUX, hors de la liste). */
+typedef struct EntreeInventaire {
+    char *nom;
+    uint32_t hachage;
+    uint64_t taille;
+    int64_t mtime;
+    int references;             // livres qui designent ce fichier
+    Bool present;
+    Bool dans_ordre;            // dans tries ou nouvelles
+    unsigned int passage;       // derniere relecture complete qui l'a vu
+    char *json;                 // son objet JSON, refait a chaque changement
+    size_t json_len;
+    struct EntreeInventaire *suivant;
+} EntreeInventaire;
+
+/* Liste serialisee d'une version : les objets JSON des fichiers, dans
+   l'ordre des noms, separes par ",\n". Une page en est une tranche. */
+typedef struct InstantaneInventaire {
+    int references;             // l'inventaire + chaque reponse en cours (sous verrou)
+    uint64_t version;
+    size_t nb;
+    size_t *debuts;             // nb + 1 positions dans json
+    char *json;
+} InstantaneInventaire;
+
+/* Index en memoire d'un repertoire (les pdf de data/livres), tenu a jour
+   par les evenements inotify et les fins d'upload : une table par nom pour
+   les mises a jour, plus l'ordre des noms. Les noms apparus depuis la
+   derniere lecture attendent dans nouvelles ; a la lecture suivante, ils
+   sont tries puis fusionnes avec tries (les absents en sortent), et la
+   version est serialisee une fois pour toutes ses pages. */
+typedef struct Inventaire {
+    pthread_mutex_t verrou;
+    char repertoire[128];
+    char suffixe[16];           // seuls ces fichiers sont listes (sans casse)
+    EntreeInventaire **alveoles;
+    size_t nb_alveoles;
+    size_t nb_entrees;
+    EntreeInventaire **tries;   // presents a la derniere fusion, par nom
+    size_t nb_tries;
+    EntreeInventaire **nouvelles;
+    size_t nb_nouvelles;
+    size_t cap_nouvelles;
+    uint64_t version;           // change a chaque modification visible
+    unsigned int passage;
+    InstantaneInventaire *instantane;  // derniere version serialisee
+} Inventaire;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool inventaire_init(Inventaire *inv, const char *repertoire, const char *suffixe);
+void inventaire_free(Inventaire *inv);
+
+// Relit l'etat d'un nom du repertoire (stat) ; NULL-safe pour inv
+void inventaire_actualiser(Inventaire *inv, const char *nom);
+void inventaire_relire(Inventaire *inv);
+// EcouteurRepertoire (envoi.h) : arg est l'Inventaire
+void inventaire_ecouter(void *arg, const char *repertoire, const char *nom);
+
+void inventaire_referencer(Inventaire *inv, const char *nom, int delta);
+void inventaire_oublier_references(Inventaire *inv);
+
+/* Repond la page [debut, debut + limite) de la version courante :
+   { version, total, debut, suivant, fichiers: [{nom, taille, mtime,
+   reference}] }. ETag par version et page : 304 si rien n'a change. */
+void inventaire_repondre(Inventaire *inv, struct mg_connection *c, struct mg_http_message *hm, size_t debut,
+                         size_t limite);
@@ -0,0 +1,197 @@
+#include "ordonnanceur.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// --- Plafonds par IP (seaux a jetons, sous p->verrou) ---
+
+static uint32_t hacher_ip(const uint8_t ip[16]) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < 16; i++) {
+    h ^= ip[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+Bool plafonds_ip_init(PlafondsIP *p, size_t octets_par_seconde) {
+  if (p == NULL || octets_par_seconde == 0) return FAUX;
+  memset(p, 0, sizeof(PlafondsIP));
+  pthread_mutex_init(&p->verrou, NULL);
+  p->debit = octets_par_seconde;
+  return VRAI;
+}
+
+void plafonds_ip_free(PlafondsIP *p) {
+  if (p == NULL) return;
+  for (size_t i = 0; i < PLAFONDS_IP_ALVEOLES; i++) {
+    while (p->alveoles[i] != NULL) {
+      SeauIP *s = p->alveoles[i];
+      p->alveoles[i] = s->suivant;
+      free(s);
+    }
+  }
+  pthread_mutex_destroy(&p->verrou);
+}
+
+/* Seau de l'adresse, rempli jusqu'a maintenant. Les seaux sans flux et
+   inactifs croises en chemin sont liberes. NULL si memoire epuisee. */
+static SeauIP *seau(PlafondsIP *p, const uint8_t ip[16], uint64_t maintenant) {
+  SeauIP **lien = &p->alveoles[hacher_ip(ip) & (PLAFONDS_IP_ALVEOLES - 1)];
+  SeauIP *trouve = NULL;
+  while (*lien != NULL) {
+    SeauIP *s = *lien;
+    if (memcmp(s->ip, ip, 16) == 0) {
+      trouve = s;
+    } else if (s->nb_flux == 0 && maintenant - s->maj > PLAFONDS_IP_OUBLI_MS) {
+      *lien = s->suivant;
+      free(s);
+      continue;
+    }
+    lien = &s->suivant;
+  }
+  if (trouve == NULL) {
+    if ((trouve = calloc(1, sizeof(SeauIP))) == NULL) return NULL;
+    memcpy(trouve->ip, ip, 16);
+    trouve->jetons = (double) p->debit;
+    trouve->maj = maintenant;
+    trouve->suivant = p->alveoles[hacher_ip(ip) & (PLAFONDS_IP_ALVEOLES - 1)];
+    p->alveoles[hacher_ip(ip) & (PLAFONDS_IP_ALVEOLES - 1)] = trouve;
+  }
+  trouve->jetons += (double) (maintenant - trouve->maj) * (double) p->debit / 1000.0;
+  if (trouve->jetons > (double) p->debit) trouve->jetons = (double) p->debit;
+  trouve->maj = maintenant;
+  return trouve;
+}
+
+static void compter_flux(PlafondsIP *p, const uint8_t ip[16], Bool ajout) {
+  pthread_mutex_lock(&p->verrou);
+  SeauIP *s = seau(p, ip, mg_millis());
+  if (s != NULL && ajout) s->nb_flux++;
+  else if (s != NULL && s->nb_flux > 0) s->nb_flux--;
+  pthread_mutex_unlock(&p->verrou);
+}
+
+/* Part des jetons revenant a un flux : sans partage, le premier servi
+   apres chaque remplissage prendrait tout et les autres connexions de la
+   meme adresse n'avanceraient plus. */
+static size_t jetons_disponibles(PlafondsIP *p, const uint8_t ip[16]) {
+  pthread_mutex_lock(&p->verrou);
+  SeauIP *s = seau(p, ip, mg_millis());
+  size_t n = 0;
+  if (s != NULL && s->jetons >= 1.0) {
+    n = (size_t) s->jetons;
+    if (s->nb_flux > 1) n = n / s->nb_flux > 0 ? n / s->nb_flux : 1;
+  }
+  pthread_mutex_unlock(&p->verrou);
+  return n;
+}
+
+static void prendre_jetons(PlafondsIP *p, const uint8_t ip[16], size_t n) {
+  pthread_mutex_lock(&p->verrou);
+  SeauIP *s = seau(p, ip, mg_millis());
+  if (s != NULL) s->jetons -= (double) n;
+  pthread_mutex_unlock(&p->verrou);
+}
+
+// --- Deficit round robin d'une boucle ---
+
+void ordonnanceur_init(Ordonnanceur *o, size_t budget, PlafondsIP *plafonds) {
+  memset(o, 0, sizeof(Ordonnanceur));
+  o->budget = budget;
+  o->quantum = budget;
+  o->plafonds = plafonds;
+}
+
+void ordonnanceur_inscrire(Ordonnanceur *o, Flux *f, const struct mg_addr *ip) {
+  memset(f, 0, sizeof(Flux));
+  if (ip != NULL) memcpy(f->ip, ip->ip, sizeof(f->ip));
+  if (o == NULL) return;
+  if (o->plafonds != NULL) compter_flux(o->plafonds, f->ip, VRAI);
+  f->tour = o->tour - 1;  // quantum des ce tour-ci
+  f->suivant = o->flux;
+  if (o->flux != NULL) o->flux->precedent = f;
+  o->flux = f;
+  o->nb_flux++;
+}
+
+void ordonnanceur_retirer(Ordonnanceur *o, Flux *f) {
+  if (o == NULL) return;
+  if (f->precedent != NULL) f->precedent->suivant = f->suivant;
+  else if (o->flux == f) o->flux = f->suivant;
+  else return;  // pas inscrit
+  if (f->suivant != NULL) f->suivant->precedent = f->precedent;
+  f->suivant = f->precedent = NULL;
+  o->nb_flux--;
+  o->deficits -= f->deficit;
+  if (f->tour == o->tour && o->servis > 0) o->servis--;
+  if (o->plafonds != NULL) compter_flux(o->plafonds, f->ip, FAUX);
+}
+
+/* Delai a passer a mg_mgr_poll : aucun si un flux attend seulement le tour
+   suivant, court si un plafond retient un flux (aucun evenement ne le
+   reveillerait), sinon le delai habituel. */
+int ordonnanceur_attente(const Ordonnanceur *o, int defaut) {
+  if (o->attente_budget) return 0;
+  if (o->attente_plafond) return defaut < ORDONNANCEUR_ATTENTE_PLAFOND ? defaut : ORDONNANCEUR_ATTENTE_PLAFOND;
+  return defaut;
+}
+
+// Avant chaque mg_mgr_poll de la boucle
+void ordonnanceur_tour(Ordonnanceur *o) {
+  o->tour++;
+  o->quantum = o->nb_flux > 0 ? o->budget / o->nb_flux : o->budget;
+  if (o->quantum < ORDONNANCEUR_QUANTUM_MIN) o->quantum = ORDONNANCEUR_QUANTUM_MIN;
+  o->envoye_tour = 0;
+  o->servis = 0;
+  o->attente_budget = o->attente_plafond = FAUX;
+}
+
+/* Budget du tour que personne n'attend : ni depense, ni dans un deficit,
+   ni reserve au quantum d'un flux pas encore servi. */
+static size_t budget_libre(const Ordonnanceur *o) {
+  size_t attendus = o->nb_flux > o->servis ? o->nb_flux - o->servis : 0;
+  size_t pris = o->envoye_tour + o->deficits + attendus * o->quantum;
+  return pris < o->budget ? o->budget - pris : 0;
+}
+
+/* Octets que le flux peut envoyer maintenant (au plus voulu) : d'abord son
+   deficit, puis seulement le budget libre. En dessous de voulu, la boucle
+   ne dormira pas avant le tour suivant. */
+size_t ordonnanceur_autoriser(Ordonnanceur *o, Flux *f, size_t voulu) {
+  if (o == NULL) return voulu;
+  if (f->tour != o->tour) {
+    // Un flux bloque par sa socket ne cumule pas plus de deux quanta
+    size_t avant = f->deficit;
+    f->tour = o->tour;
+    f->deficit += o->quantum;
+    if (f->deficit > 2 * o->quantum) f->deficit = 2 * o->quantum;
+    o->deficits += f->deficit - avant;
+    o->servis++;
+  }
+  size_t n = voulu < f->deficit ? voulu : f->deficit;
+  if (n < voulu) {
+    size_t libre = budget_libre(o);
+    n += voulu - n < libre ? voulu - n : libre;
+  }
+  if (n < voulu) o->attente_budget = VRAI;
+  if (n > 0 && o->plafonds != NULL) {
+    size_t jetons = jetons_disponibles(o->plafonds, f->ip);
+    if (jetons < n) {
+      n = jetons;
+      o->attente_plafond = VRAI;
+    }
+  }
+  if (n < voulu) atomic_fetch_add(&o->retenues, 1);
+  return n;
+}
+
+void ordonnanceur_consommer(Ordonnanceur *o, Flux *f, size_t envoye) {
+  if (o == NULL || envoye == 0) return;
+  size_t pris = envoye < f->deficit ? envoye : f->deficit;
+  f->deficit -= pris;
+  o->deficits -= pris;
+  o->envoye_tour += envoye;
+  if (o->plafonds != NULL) prendre_jetons(o->plafonds, f->ip, envoye);
+  atomic_fetch_add(&o->octets, envoye);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define ORDONNANCEUR_BUDGET_TOUR (1024 * 1024)  // octets de masse par tour de boucle
+#define ORDONNANCEUR_QUANTUM_MIN (64 * 1024)
+#define ORDONNANCEUR_ATTENTE_PLAFOND 10        // ms, quand seul un plafond par IP retient
+#define PLAFONDS_IP_ALVEOLES 256               // puissance de 2
+#define PLAFONDS_IP_OUBLI_MS 60000             // seau sans flux et inactif : libere
+
+/* Seau a jetons d'une adresse, partage par toutes ses connexions (et toutes
+   les boucles). */
+typedef struct SeauIP {
+    uint8_t ip[16];
+    double jetons;              // octets disponibles, au plus un debit d'une seconde
+    uint64_t maj;               // mg_millis du dernier remplissage
+    size_t nb_flux;             // transferts en cours : chacun a sa part
+    struct SeauIP *suivant;
+} SeauIP;
+
+typedef struct PlafondsIP {
+    pthread_mutex_t verrou;
+    size_t debit;               // octets par seconde et par IP
+    SeauIP *alveoles[PLAFONDS_IP_ALVEOLES];
+} PlafondsIP;
+
+/* Un transfert de masse (pdf, couverture) inscrit aupres de l'ordonnanceur
+   de sa boucle. */
+typedef struct Flux {
+    struct Flux *suivant;
+    struct Flux *precedent;
+    size_t deficit;             // octets encore permis ce tour-ci
+    uint64_t tour;              // dernier tour ou le quantum a ete ajoute
+    uint8_t ip[16];
+} Flux;
+
+/* Deficit round robin entre les transferts de masse d'une boucle : a chaque
+   tour de mg_mgr_poll, chaque flux recoit un quantum (budget du tour divise
+   entre les flux) et n'envoie pas au-dela. Le reste du budget n'est prete
+   qu'une fois les quanta des flux pas encore servis et les deficits en
+   cours mis de cote : un flux arrive tot ne prend jamais la part d'un
+   autre. Un tour ne depasse donc jamais de beaucoup le budget, quel que
+   soit le nombre de telechargements. Les reponses d'API ne passent pas par
+   ici : elles partent au tour ou elles sont pretes. Propre a une boucle,
+   donc sans verrou ; seuls les plafonds par IP sont partages. */
+typedef struct Ordonnanceur {
+    Flux *flux;
+    size_t nb_flux;
+    uint64_t tour;
+    size_t budget;
+    size_t quantum;
+    size_t envoye_tour;         // octets de masse deja partis ce tour-ci
+    size_t servis;              // flux deja credites de leur quantum ce tour-ci
+    size_t deficits;            // somme des deficits des flux inscrits
+    PlafondsIP *plafonds;       // NULL : pas de plafond par IP
+    Bool attente_budget;        // un flux a ete retenu par le budget au tour precedent
+    Bool attente_plafond;       // un flux attend des jetons
+    atomic_ulong octets;        // octets de masse envoyes
+    atomic_ulong retenues;      // fois ou un flux a du attendre le tour suivant
+} Ordonnanceur;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool plafonds_ip_init(PlafondsIP *p, size_t octets_par_seconde);
+void plafonds_ip_free(PlafondsIP *p);
+
+void ordonnanceur_init(Ordonnanceur *o, size_t budget, PlafondsIP *plafonds);
+void ordonnanceur_inscrire(Ordonnanceur *o, Flux *f, const struct mg_addr *ip);
+void ordonnanceur_retirer(Ordonnanceur *o, Flux *f);
+int ordonnanceur_attente(const Ordonnanceur *o, int defaut);
+void ordonnanceur_tour(Ordonnanceur *o);
+size_t ordonnanceur_autoriser(Ordonnanceur *o, Flux *f, size_t voulu);
+void ordonnanceur_consommer(Ordonnanceur *o, Flux *f, size_t envoye);
@@ -0,0 +1,154 @@
+/* Outil de construction : emballe un repertoire (le frontend) dans un
+   fichier C qui fournit mg_unpack / mg_unlist, les crochets du systeme de
+   fichiers "packed" de Mongoose (MG_ENABLE_PACKED_FS=1).
+
+   Usage : emballer frontend > backend/frontend_emballe.c
+
+   Chaque fichier devient "/frontend/<chemin>". La liste est triee (Mongoose
+   le suppose pour lister un repertoire) et indexee par une table de hachage
+   a adressage ouvert calculee ici : mg_unpack ne parcourt pas la liste. Les
+   variantes .gz produites par "make precompresser" sont emballees avec le
+   reste. */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct Fichier {
+    char nom[520];              // "/frontend/icon/loupe.png"
+    char chemin[512];           // sur le disque
+    long long mtime;
+} Fichier;
+
+static Fichier *s_fichiers;
+static size_t s_nb, s_cap;
+
+static uint32_t fnv1a(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s != '\0'; s++) {
+        h ^= (unsigned char) *s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int ajouter(const char *chemin, long long mtime) {
+    if (s_nb == s_cap) {
+        size_t cap = s_cap == 0 ? 64 : s_cap * 2;
+        Fichier *f = realloc(s_fichiers, cap * sizeof(Fichier));
+        if (f == NULL) return 0;
+        s_fichiers = f;
+        s_cap = cap;
+    }
+    Fichier *f = &s_fichiers[s_nb++];
+    snprintf(f->chemin, sizeof(f->chemin), "%s", chemin);
+    snprintf(f->nom, sizeof(f->nom), "/%s", chemin);
+    f->mtime = mtime;
+    return 1;
+}
+
+static int parcourir(const char *repertoire) {
+    DIR *d = opendir(repertoire);
+    if (d == NULL) return 0;
+    struct dirent *e;
+    int ok = 1;
+    while (ok && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char chemin[512];
+        struct stat st;
+        snprintf(chemin, sizeof(chemin), "%s/%s", repertoire, e->d_name);
+        if (stat(chemin, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) ok = parcourir(chemin);
+        else ok = ajouter(chemin, (long long) st.st_mtime);
+    }
+    closedir(d);
+    return ok;
+}
+
+static int comparer(const void *a, const void *b) {
+    return strcmp(((const Fichier *) a)->nom, ((const Fichier *) b)->nom);
+}
+
+static int ecrire_contenu(size_t i) {
+    FILE *f = fopen(s_fichiers[i].chemin, "rb");
+    if (f == NULL) return -1;
+    printf("static const unsigned char v%lu[] = {", (unsigned long) i);
+    int c, n = 0;
+    while ((c = fgetc(f)) != EOF) {
+        printf("%s%d,", (n++ % 24) == 0 ? "\n  " : "", c);
+    }
+    printf("%s0  // fin de chaine, hors taille\n};\n\n", n % 24 == 0 ? "\n  " : "");
+    fclose(f);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage : %s <repertoire>\n", argv[0]);
+        return 1;
+    }
+    if (!parcourir(argv[1])) {
+        fprintf(stderr, "Erreur : impossible de lire %s\n", argv[1]);
+        return 1;
+    }
+    if (s_nb > 0) qsort(s_fichiers, s_nb, sizeof(Fichier), comparer);
+
+    long *tailles = calloc(s_nb + 1, sizeof(long));
+    size_t nb_alveoles = 16;
+    while (nb_alveoles < s_nb * 2) nb_alveoles *= 2;  // remplissage <= 1/2
+    unsigned *index = calloc(nb_alveoles, sizeof(unsigned));
+    if (tailles == NULL || index == NULL) return 1;
+
+    printf("// Genere par backend/outils/emballer a partir de %s/ : ne pas modifier.\n\n", argv[1]);
+    printf("#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n#include <time.h>\n\n");
+    for (size_t i = 0; i < s_nb; i++) {
+        tailles[i] = ecrire_contenu(i);
+        if (tailles[i] < 0) {
+            fprintf(stderr, "Erreur : impossible de lire %s\n", s_fichiers[i].chemin);
+            return 1;
+        }
+        size_t j = fnv1a(s_fichiers[i].nom) & (nb_alveoles - 1);
+        while (index[j] != 0) j = (j + 1) & (nb_alveoles - 1);
+        index[j] = (unsigned) i + 1;
+    }
+
+    printf("static const struct fichier_emballe {\n  const char *nom;\n  const unsigned char *donnees;\n"
+           "  size_t taille;\n  time_t mtime;\n} s_emballes[] = {\n");
+    for (size_t i = 0; i < s_nb; i++) {
+        printf("  {\"%s\", v%lu, %ld, %lld},\n", s_fichiers[i].nom, (unsigned long) i, tailles[i],
+               s_fichiers[i].mtime);
+    }
+    printf("  {NULL, NULL, 0, 0}\n};\n\n");
+
+    // Alveole : indice + 1 dans s_emballes, 0 si vide ; sondage lineaire
+    printf("static const unsigned short s_index[%lu] = {", (unsigned long) nb_alveoles);
+    for (size_t j = 0; j < nb_alveoles; j++) printf("%s%u,", (j % 16) == 0 ? "\n  " : "", index[j]);
+    printf("\n};\n\n");
+
+    printf("static uint32_t hacher(const char *s) {\n"
+           "  uint32_t h = 2166136261u;\n"
+           "  for (; *s != '\\0'; s++) h = (h ^ (unsigned char) *s) * 16777619u;\n"
+           "  return h;\n}\n\n");
+    printf("const char *mg_unlist(size_t no);\n"
+           "const char *mg_unpack(const char *nom, size_t *taille, time_t *mtime);\n\n");
+    printf("const char *mg_unlist(size_t no) {\n"
+           "  return no < sizeof(s_emballes) / sizeof(s_emballes[0]) ? s_emballes[no].nom : NULL;\n}\n\n");
+    printf("const char *mg_unpack(const char *nom, size_t *taille, time_t *mtime) {\n"
+           "  for (size_t j = hacher(nom) & %luu; s_index[j] != 0; j = (j + 1) & %luu) {\n"
+           "    const struct fichier_emballe *f = &s_emballes[s_index[j] - 1];\n"
+           "    if (strcmp(f->nom, nom) != 0) continue;\n"
+           "    if (taille != NULL) *taille = f->taille;\n"
+           "    if (mtime != NULL) *mtime = f->mtime;\n"
+           "    return (const char *) f->donnees;\n"
+           "  }\n"
+           "  return NULL;\n}\n",
+           (unsigned long) (nb_alveoles - 1), (unsigned long) (nb_alveoles - 1));
+
+    free(index);
+    free(tailles);
+    free(s_fichiers);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* Mesure : diffusion des evenements du catalogue aux abonnes de /ws.
+
+   Usage : mesure_diffusion [abonnes] [evenements] [url]
+   Defauts : 1000 abonnes, 20 evenements, http://localhost:8000
+
+   Le serveur doit deja tourner. Ouvre les abonnements par paquets de 200
+   (chacun attend son message "bonjour"), puis envoie une a une les
+   modifications /api/modifier?id=1&annee=i. Affiche le temps mis pour que
+   toutes les trames (abonnes x evenements) soient recues, celui des seules
+   requetes, et /api/diffusion a la fin (dont les abonnes decroches). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define PAQUET 200
+
+typedef struct Mesure {
+    int abonnes;            // "bonjour" recus
+    long trames;            // evenements recus apres le "bonjour"
+    long fermes;            // abonnes perdus en cours de mesure
+    int envoyes;            // modifications envoyees
+    int repondus;           // modifications repondues
+    Bool fin;               // fermetures voulues : pas des pertes
+} Mesure;
+
+static void abonne_fn(struct mg_connection *c, int ev, void *ev_data) {
+    Mesure *m = (Mesure *) c->fn_data;
+    if (ev == MG_EV_WS_MSG) {
+        if (c->data[0] == 0) {
+            c->data[0] = 1;
+            m->abonnes++;
+        } else {
+            m->trames++;
+        }
+    } else if (ev == MG_EV_ERROR) {
+        fprintf(stderr, "Abonne : %s\n", (char *) ev_data);
+    } else if (ev == MG_EV_CLOSE && !m->fin) {
+        m->fermes++;
+    }
+}
+
+static void modifier_fn(struct mg_connection *c, int ev, void *ev_data) {
+    Mesure *m = (Mesure *) c->fn_data;
+    if (ev == MG_EV_HTTP_MSG) {
+        struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+        if (mg_http_status(hm) != 200)
+            fprintf(stderr, "Modification : %.*s\n", (int) hm->body.len, hm->body.buf);
+        m->repondus++;
+        c->is_draining = 1;
+    } else if (ev == MG_EV_ERROR) {
+        fprintf(stderr, "Modification : %s\n", (char *) ev_data);
+        m->repondus++;
+    }
+}
+
+// Reponse a une requete isolee (/api/diffusion), affichee telle quelle
+static void stats_fn(struct mg_connection *c, int ev, void *ev_data) {
+    if (ev == MG_EV_HTTP_MSG) {
+        struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+        printf("/api/diffusion : %.*s\n", (int) hm->body.len, hm->body.buf);
+        *(Bool *) c->fn_data = VRAI;
+        c->is_draining = 1;
+    } else if (ev == MG_EV_ERROR || ev == MG_EV_CLOSE) {
+        *(Bool *) c->fn_data = VRAI;
+    }
+}
+
+static Bool envoyer_get(struct mg_mgr *mgr, const char *base, const char *uri, mg_event_handler_t fn,
+                        void *donnees) {
+    char url[512];
+    mg_snprintf(url, sizeof(url), "%s%s", base, uri);
+    struct mg_connection *c = mg_http_connect(mgr, url, fn, donnees);
+    struct mg_str hote = mg_url_host(base);
+    if (c == NULL) return FAUX;
+    mg_printf(c, "GET %s HTTP/1.1\r\nHost: %.*s\r\n\r\n", uri, (int) hote.len, hote.buf);
+    return VRAI;
+}
+
+int main(int argc, char **argv) {
+    int nb_abonnes = argc > 1 ? atoi(argv[1]) : 1000;
+    int nb_evenements = argc > 2 ? atoi(argv[2]) : 20;
+    const char *base = argc > 3 ? argv[3] : "http://localhost:8000";
+    if (nb_abonnes <= 0 || nb_evenements <= 0) {
+        fprintf(stderr, "Usage : %s [abonnes] [evenements] [url]\n", argv[0]);
+        return 1;
+    }
+
+    struct mg_mgr mgr;
+    mg_mgr_init(&mgr);
+    mg_log_set(MG_LL_ERROR);
+    Mesure m;
+    memset(&m, 0, sizeof(m));
+    struct mg_str hote = mg_url_host(base);
+    char url_ws[512];
+    mg_snprintf(url_ws, sizeof(url_ws), "ws://%.*s:%hu/ws", (int) hote.len, hote.buf, mg_url_port(base));
+
+    uint64_t debut = mg_millis();
+    for (int i = 0; i < nb_abonnes; i += PAQUET) {
+        int jusqua = i + PAQUET < nb_abonnes ? i + PAQUET : nb_abonnes;
+        for (int k = i; k < jusqua; k++) {
+            if (mg_ws_connect(&mgr, url_ws, abonne_fn, &m, NULL) == NULL) {
+                fprintf(stderr, "Connexion impossible a %s\n", url_ws);
+                return 1;
+            }
+        }
+        uint64_t limite = mg_millis() + 10000;
+        while (m.abonnes + m.fermes < jusqua && mg_millis() < limite) mg_mgr_poll(&mgr, 50);
+        if (m.abonnes < jusqua) {
+            fprintf(stderr, "%d abonnes sur %d\n", m.abonnes, jusqua);
+            return 1;
+        }
+    }
+    printf("%d abonnes en %.2f s\n", nb_abonnes, (double) (mg_millis() - debut) / 1000);
+
+    // Une modification a la fois : la suivante part a la reponse de la precedente
+    long attendues = (long) nb_abonnes * nb_evenements;
+    uint64_t requetes = 0;
+    debut = mg_millis();
+    uint64_t limite = debut + 60000;
+    while ((m.trames < attendues || m.repondus < nb_evenements) && mg_millis() < limite) {
+        if (m.envoyes == m.repondus && m.envoyes < nb_evenements) {
+            char uri[64];
+            m.envoyes++;
+            mg_snprintf(uri, sizeof(uri), "/api/modifier?id=1&annee=%d", 1000 + m.envoyes);
+            if (!envoyer_get(&mgr, base, uri, modifier_fn, &m)) m.repondus++;
+        }
+        mg_mgr_poll(&mgr, 1);
+        if (requetes == 0 && m.repondus == nb_evenements) requetes = mg_millis();
+    }
+    double duree = (double) (mg_millis() - debut) / 1000;
+    printf("%d evenements x %d abonnes = %ld trames recues sur %ld en %.2f s (%.0f trames/s), "
+           "requetes finies a %.2f s, %ld abonnes perdus\n",
+           nb_evenements, nb_abonnes, m.trames, attendues, duree, duree > 0 ? m.trames / duree : 0,
+           requetes != 0 ? (double) (requetes - debut) / 1000 : duree, m.fermes);
+
+    m.fin = VRAI;
+    Bool fini = FAUX;
+    if (!envoyer_get(&mgr, base, "/api/diffusion", stats_fn, &fini)) fini = VRAI;
+    limite = mg_millis() + 5000;
+    while (!fini && mg_millis() < limite) mg_mgr_poll(&mgr, 50);
+    mg_mgr_free(&mgr);
+    return m.trames != attendues || m.fermes != 0;
+}
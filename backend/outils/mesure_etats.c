@@ -0,0 +1,135 @@
+/* Mesure : contention sur l'emprunt d'un meme livre.
+
+   Usage : mesure_etats [duree_s]      (defaut 1)
+
+   N threads (1, 4, 16, 64) empruntent puis rendent le meme livre en boucle
+   pendant duree_s secondes, de deux facons :
+   - ecrivain a chaque essai : chaque tentative passe par catalogue_ecrire,
+     comme avant les mots d'etat ;
+   - CAS d'abord : catalogue_transition DISPONIBLE -> EMPRUNTE, et seul le
+     gagnant passe par l'ecrivain (le chemin de /api/emprunter).
+   Affiche les essais et les emprunts gagnes par seconde, et le nombre de
+   fois ou deux threads ont tenu le livre en meme temps (doit rester 0). */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "catalogue.h"
+
+#define LIVRE 1
+#define MAX_THREADS 64
+
+static Catalogue s_catalogue;
+static Bool s_cas;
+static atomic_int s_arret;
+static atomic_int s_detenteurs;
+static atomic_long s_essais;
+static atomic_long s_gagnes;
+static atomic_long s_doubles;
+
+static double maintenant(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int op_ajouter(Bibliotheque *bibli, void *arg) {
+    Livre *l = (Livre *) arg;
+    l->id = biblio_next_id(bibli);
+    biblio_add(bibli, l);
+    return l->id;
+}
+
+// Comme op_emprunter / op_retourner de server.c : l'etat des copies tranche
+static int op_emprunter(Bibliotheque *bibli, void *arg) {
+    Livre *l = biblio_find_by_id(bibli, *(int *) arg);
+    if (l == NULL || l->est_emprunte)
+        return 0;
+    biblio_marquer_emprunte(bibli, l, VRAI);
+    return 1;
+}
+
+static int op_retourner(Bibliotheque *bibli, void *arg) {
+    Livre *l = biblio_find_by_id(bibli, *(int *) arg);
+    if (l == NULL || !l->est_emprunte)
+        return 0;
+    biblio_marquer_emprunte(bibli, l, FAUX);
+    return 1;
+}
+
+static void *emprunteur(void *arg) {
+    (void) arg;
+    int id = LIVRE;
+    while (!atomic_load(&s_arret)) {
+        atomic_fetch_add(&s_essais, 1);
+        Bool gagne;
+        if (s_cas)
+            gagne = catalogue_transition(&s_catalogue, id, LIVRE_DISPONIBLE, LIVRE_EMPRUNTE) &&
+                    catalogue_ecrire(&s_catalogue, op_emprunter, &id) == 1;
+        else
+            gagne = catalogue_ecrire(&s_catalogue, op_emprunter, &id) == 1;
+        if (!gagne)
+            continue;
+
+        if (atomic_fetch_add(&s_detenteurs, 1) != 0)
+            atomic_fetch_add(&s_doubles, 1);
+        atomic_fetch_add(&s_gagnes, 1);
+        atomic_fetch_sub(&s_detenteurs, 1);
+
+        if (!s_cas) {
+            catalogue_ecrire(&s_catalogue, op_retourner, &id);
+        } else if (catalogue_transition(&s_catalogue, id, LIVRE_EMPRUNTE, LIVRE_EN_RETOUR)) {
+            catalogue_ecrire(&s_catalogue, op_retourner, &id);
+            catalogue_fixer_etat(&s_catalogue, id, LIVRE_DISPONIBLE);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    double duree = argc > 1 ? atof(argv[1]) : 1.0;
+    if (duree <= 0) {
+        fprintf(stderr, "Usage : %s [duree_s]\n", argv[0]);
+        return 1;
+    }
+    if (!catalogue_init(&s_catalogue))
+        return 1;
+    s_catalogue.copies[0]->muet = VRAI;
+    for (int i = 0; i < 20000; i++) {
+        Livre l;
+        memset(&l, 0, sizeof(l));
+        snprintf(l.titre, sizeof(l.titre), "Livre %d", i);
+        strcpy(l.categorie, "Roman");
+        catalogue_ecrire(&s_catalogue, op_ajouter, &l);
+    }
+
+    const int nb_threads[] = {1, 4, 16, MAX_THREADS};
+    printf("%-24s %8s %12s %12s %8s\n", "chemin", "threads", "essais/s", "emprunts/s", "doubles");
+    for (int mode = 0; mode < 2; mode++) {
+        s_cas = mode == 1;
+        for (size_t k = 0; k < sizeof(nb_threads) / sizeof(nb_threads[0]); k++) {
+            int n = nb_threads[k];
+            atomic_store(&s_arret, 0);
+            atomic_store(&s_essais, 0);
+            atomic_store(&s_gagnes, 0);
+            atomic_store(&s_doubles, 0);
+            pthread_t threads[MAX_THREADS];
+            double debut = maintenant();
+            for (int i = 0; i < n; i++)
+                pthread_create(&threads[i], NULL, emprunteur, NULL);
+            struct timespec attente = {(time_t) duree, (long) ((duree - (time_t) duree) * 1e9)};
+            nanosleep(&attente, NULL);
+            atomic_store(&s_arret, 1);
+            for (int i = 0; i < n; i++)
+                pthread_join(threads[i], NULL);
+            double ecoule = maintenant() - debut;
+            printf("%-24s %8d %12.0f %12.0f %8ld\n", s_cas ? "CAS d'abord" : "ecrivain a chaque essai", n,
+                   atomic_load(&s_essais) / ecoule, atomic_load(&s_gagnes) / ecoule, atomic_load(&s_doubles));
+        }
+    }
+    catalogue_free(&s_catalogue);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/* Mesure : facettes de /api/livres et /api/categorie sur un gros catalogue.
+
+   Usage : mesure_facettes [nb_livres]      (defaut 1000000)
+
+   Catalogue synthetique : 40 categories, annees 1800-2024 (23 decennies),
+   un livre sur trois emprunte, graine fixe. Pour quatre filtres de
+   selectivite croissante, affiche le temps de biblio_filtrer, celui de
+   biblio_facettes_to_json (resultat densifie en bitset), et celui des memes
+   comptes faits directement sur le resultat non densifie, pour comparaison. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bibliotheque.h"
+
+#define REPETITIONS 20
+#define NB_CATEGORIES 40
+
+static double maintenant(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Les comptes de biblio_facettes_to_json, sans densifier ni ecrire de JSON
+static size_t compter_sans_densifier(const Bibliotheque *bibli, const Bitmap *resultat) {
+    size_t somme = bitmap_cardinal(resultat) + bitmap_and_cardinal(resultat, &bibli->disponibles);
+    for (size_t i = 0; i < bibli->nb_categories; i++)
+        somme += bitmap_and_cardinal(resultat, &bibli->categories[i].livres);
+    for (size_t i = 0; i < bibli->nb_decennies; i++)
+        somme += bitmap_and_cardinal(resultat, &bibli->decennies[i].livres);
+    return somme;
+}
+
+int main(int argc, char **argv) {
+    long nb_livres = argc > 1 ? atol(argv[1]) : 1000000;
+    if (nb_livres <= 0) {
+        fprintf(stderr, "Usage : %s [nb_livres]\n", argv[0]);
+        return 1;
+    }
+
+    Bibliotheque bibli;
+    biblio_init(&bibli);
+    bibli.muet = VRAI;
+    srand(1);
+    double debut = maintenant();
+    biblio_lot_debut(&bibli);
+    for (long i = 0; i < nb_livres; i++) {
+        Livre l;
+        memset(&l, 0, sizeof(l));
+        l.id = (int) i + 1;
+        snprintf(l.titre, sizeof(l.titre), "Titre %ld", i);
+        snprintf(l.categorie, sizeof(l.categorie), "Categorie %d", rand() % NB_CATEGORIES);
+        l.annee = 1800 + rand() % 225;
+        l.est_emprunte = rand() % 3 == 0;
+        biblio_add(&bibli, &l);
+    }
+    biblio_lot_fin(&bibli);
+    printf("%ld livres construits en %.2f s\n\n", nb_livres, maintenant() - debut);
+
+    const char *noms[] = {"tout", "2 categories", "+ disponibles", "+ 2 decennies"};
+    printf("%-15s %9s %12s %14s %16s\n", "filtre", "resultats", "filtre (ms)", "facettes (ms)",
+           "sans bitset (ms)");
+    for (int k = 0; k < 4; k++) {
+        CriteresLivres crit;
+        biblio_criteres_init(&crit);
+        if (k >= 1) {
+            crit.categories[crit.nb_categories++] = "Categorie 3";
+            crit.categories[crit.nb_categories++] = "Categorie 7";
+        }
+        if (k >= 2)
+            crit.disponible = 1;
+        if (k >= 3) {
+            crit.decennies[crit.nb_decennies++] = 1990;
+            crit.decennies[crit.nb_decennies++] = 2000;
+        }
+
+        Bitmap resultat;
+        debut = maintenant();
+        for (int r = 0; r < REPETITIONS; r++) {
+            biblio_filtrer(&bibli, &crit, &resultat);
+            bitmap_free(&resultat);
+        }
+        double filtre = (maintenant() - debut) / REPETITIONS;
+
+        biblio_filtrer(&bibli, &crit, &resultat);
+        debut = maintenant();
+        for (int r = 0; r < REPETITIONS; r++)
+            free(biblio_facettes_to_json(&bibli, &resultat));
+        double facettes = (maintenant() - debut) / REPETITIONS;
+
+        volatile size_t puits = 0;
+        debut = maintenant();
+        for (int r = 0; r < REPETITIONS; r++)
+            puits += compter_sans_densifier(&bibli, &resultat);
+        double bruts = (maintenant() - debut) / REPETITIONS;
+
+        printf("%-15s %9zu %12.3f %14.3f %16.3f\n", noms[k], bitmap_cardinal(&resultat), filtre * 1e3,
+               facettes * 1e3, bruts * 1e3);
+        bitmap_free(&resultat);
+    }
+    biblio_free(&bibli);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* Mesure : lecture des parametres d'une requete a 11 champs.
+
+   Usage : mesure_parametres [iterations]      (defaut 1000000)
+
+   Compare l'ancienne lecture, un mg_http_get_var par champ (la query string
+   est reparcourue et decodee a chaque fois), a params_decoder +
+   params_lier, qui decodent une seule fois puis remplissent la structure
+   cible d'apres un schema. Resultat en ns par requete. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parametres.h"
+
+typedef struct Requete {
+    char titre[512];
+    char email[128];
+    int id;
+    char link[512];
+    char couverture[512];
+    Bool reserve;
+    char categorie[512];
+    char decennie[128];
+    char sort[16];
+    int annee_min;
+    int annee_max;
+} Requete;
+
+static const ChampParam s_schema[] = {
+    CHAMP_TEXTE(Requete, titre, "titre", NULL, 0),
+    CHAMP_TEXTE(Requete, email, "email", NULL, 0),
+    CHAMP_ENTIER(Requete, id, "id", 0),
+    CHAMP_TEXTE(Requete, link, "link", NULL, 0),
+    CHAMP_TEXTE(Requete, couverture, "couverture", NULL, 0),
+    CHAMP_BOOL(Requete, reserve, "reserve", NULL, 0),
+    CHAMP_TEXTE(Requete, categorie, "categorie", "cat", 0),
+    CHAMP_TEXTE(Requete, decennie, "decennie", NULL, 0),
+    CHAMP_TEXTE(Requete, sort, "sort", NULL, 0),
+    CHAMP_ENTIER(Requete, annee_min, "annee_min", 0),
+    CHAMP_ENTIER(Requete, annee_max, "annee_max", 0),
+};
+
+static const char *s_query =
+    "titre=Le%20Petit%20Prince&email=a%40b.fr&id=42&link=https%3A%2F%2Fx.org%2Fa&couverture=c.jpg"
+    "&reserve=1&categorie=Roman%2CScience&decennie=1990%2C2000&sort=annee&annee_min=1900&annee_max=2020";
+
+static double maintenant(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage : %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    struct mg_http_message hm;
+    memset(&hm, 0, sizeof(hm));
+    hm.query = mg_str(s_query);
+    volatile long puits = 0;
+
+    double debut = maintenant();
+    for (long i = 0; i < iterations; i++) {
+        char valeur[512];
+        for (size_t k = 0; k < NB_CHAMPS(s_schema); k++)
+            puits += mg_http_get_var(&hm.query, s_schema[k].nom, valeur, sizeof(valeur));
+    }
+    double get_var = (maintenant() - debut) / iterations;
+
+    debut = maintenant();
+    for (long i = 0; i < iterations; i++) {
+        Parametres p;
+        Requete req;
+        char erreur[64];
+        unsigned long presents;
+        memset(&req, 0, sizeof(req));
+        params_decoder(&p, &hm);
+        if (params_lier(&p, s_schema, NB_CHAMPS(s_schema), &req, &presents, erreur, sizeof(erreur)))
+            puits += req.id;
+    }
+    double lier = (maintenant() - debut) / iterations;
+
+    printf("%zu champs, %ld iterations\n", NB_CHAMPS(s_schema), iterations);
+    printf("  %zu x mg_http_get_var   %6.0f ns/requete\n", NB_CHAMPS(s_schema), get_var);
+    printf("  params_decoder + lier %6.0f ns/requete\n", lier);
+    return puits == -1;
+}
@@ -0,0 +1,191 @@
+/* Mesure : ruee de requetes identiques sur une route ROUTE_PARTAGEE.
+
+   Usage : mesure_partages [clients] [vagues] [url] [--distinctes]
+   Defauts : 200 clients, 10 vagues,
+             http://localhost:8000/api/categorie?categorie=Roman
+
+   Le serveur doit deja tourner. Chaque client a sa connexion ; a chaque
+   vague, tous envoient la meme requete dans le meme tour de boucle, puis
+   la vague se termine quand toutes les reponses sont arrivees. Affiche le
+   temps moyen et le meilleur par vague, et /api/partages a la fin.
+   --distinctes ajoute a chaque requete un parametre propre au client :
+   plus aucune requete ne peut partager le calcul d'une autre, ce qui donne
+   la reference sans partage. Les corps sont comptes puis jetes au fil de
+   la lecture, sans etre gardes en memoire. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mongoose.h"
+#include "model.h"
+
+typedef struct Client {
+    struct mg_connection *c;
+    long reste;             // octets du corps encore attendus, -1 : en-tetes
+    Bool attendu;           // reponse de la vague en cours pas encore recue
+} Client;
+
+typedef struct Mesure {
+    Client *clients;
+    int nb_clients;
+    int connectes;
+    int recues;
+    long erreurs;
+    unsigned long long octets;
+    Bool fin;               // fermetures voulues : pas des erreurs
+} Mesure;
+
+// Lit les reponses au fil de l'eau : en-tetes analyses, corps seulement compte
+static void lire_reponses(struct mg_connection *c, Mesure *m, Client *cl) {
+    for (;;) {
+        if (cl->reste < 0) {
+            int n = mg_http_get_request_len(c->recv.buf, c->recv.len);
+            if (n <= 0) {
+                if (n < 0) c->is_closing = 1;
+                return;
+            }
+            struct mg_http_message hm;
+            mg_http_parse((char *) c->recv.buf, (size_t) n, &hm);
+            if (mg_http_status(&hm) != 200) m->erreurs++;
+            struct mg_str *cl_entete = mg_http_get_header(&hm, "Content-Length");
+            cl->reste = cl_entete != NULL ? atol(cl_entete->buf) : 0;
+            mg_iobuf_del(&c->recv, 0, (size_t) n);
+        }
+        size_t pris = c->recv.len < (size_t) cl->reste ? c->recv.len : (size_t) cl->reste;
+        mg_iobuf_del(&c->recv, 0, pris);
+        cl->reste -= (long) pris;
+        m->octets += pris;
+        if (cl->reste > 0) return;
+        cl->reste = -1;
+        if (cl->attendu) {
+            cl->attendu = FAUX;
+            m->recues++;
+        }
+    }
+}
+
+static void client_fn(struct mg_connection *c, int ev, void *ev_data) {
+    Mesure *m = (Mesure *) c->fn_data;
+    Client *cl = NULL;
+    for (int i = 0; i < m->nb_clients && cl == NULL; i++) {
+        if (m->clients[i].c == c) cl = &m->clients[i];
+    }
+    if (cl == NULL) return;
+    if (ev == MG_EV_CONNECT) {
+        m->connectes++;
+    } else if (ev == MG_EV_READ) {
+        lire_reponses(c, m, cl);
+    } else if (ev == MG_EV_ERROR) {
+        fprintf(stderr, "Client %d : %s\n", (int) (cl - m->clients), (char *) ev_data);
+    } else if (ev == MG_EV_CLOSE) {
+        if (!m->fin) m->erreurs++;
+        if (cl->attendu) {
+            cl->attendu = FAUX;
+            m->recues++;
+        }
+        cl->c = NULL;
+    }
+}
+
+// Reponse a une requete isolee (/api/partages), affichee telle quelle
+static void stats_fn(struct mg_connection *c, int ev, void *ev_data) {
+    if (ev == MG_EV_HTTP_MSG) {
+        struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+        printf("/api/partages : %.*s\n", (int) hm->body.len, hm->body.buf);
+        *(Bool *) c->fn_data = VRAI;
+        c->is_draining = 1;
+    } else if (ev == MG_EV_ERROR || ev == MG_EV_CLOSE) {
+        *(Bool *) c->fn_data = VRAI;
+    }
+}
+
+int main(int argc, char **argv) {
+    int nb_clients = 200, nb_vagues = 10;
+    const char *url = "http://localhost:8000/api/categorie?categorie=Roman";
+    Bool distinctes = FAUX;
+    int positionnel = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--distinctes") == 0) {
+            distinctes = VRAI;
+        } else if (positionnel == 0) {
+            nb_clients = atoi(argv[i]);
+            positionnel++;
+        } else if (positionnel == 1) {
+            nb_vagues = atoi(argv[i]);
+            positionnel++;
+        } else {
+            url = argv[i];
+        }
+    }
+    if (nb_clients <= 0 || nb_vagues <= 0) {
+        fprintf(stderr, "Usage : %s [clients] [vagues] [url] [--distinctes]\n", argv[0]);
+        return 1;
+    }
+
+    struct mg_mgr mgr;
+    mg_mgr_init(&mgr);
+    mg_log_set(MG_LL_ERROR);
+    Mesure m;
+    memset(&m, 0, sizeof(m));
+    m.nb_clients = nb_clients;
+    m.clients = calloc((size_t) nb_clients, sizeof(Client));
+    if (m.clients == NULL) return 1;
+    for (int i = 0; i < nb_clients; i++) {
+        m.clients[i].reste = -1;
+        m.clients[i].c = mg_connect(&mgr, url, client_fn, &m);
+        if (m.clients[i].c == NULL) {
+            fprintf(stderr, "Connexion impossible a %s\n", url);
+            return 1;
+        }
+    }
+    uint64_t limite = mg_millis() + 10000;
+    while (m.connectes < nb_clients && mg_millis() < limite) mg_mgr_poll(&mgr, 50);
+    if (m.connectes < nb_clients) {
+        fprintf(stderr, "%d clients connectes sur %d\n", m.connectes, nb_clients);
+        return 1;
+    }
+
+    struct mg_str hote = mg_url_host(url);
+    const char *uri = mg_url_uri(url);
+    double total = 0, meilleure = 0;
+    for (int v = 0; v < nb_vagues; v++) {
+        m.recues = 0;
+        uint64_t debut = mg_millis();
+        for (int i = 0; i < nb_clients; i++) {
+            Client *cl = &m.clients[i];
+            if (cl->c == NULL) {
+                m.recues++;
+                continue;
+            }
+            cl->attendu = VRAI;
+            if (distinctes)
+                mg_printf(cl->c, "GET %s%sclient=%d HTTP/1.1\r\nHost: %.*s\r\n\r\n", uri,
+                          strchr(uri, '?') ? "&" : "?", i, (int) hote.len, hote.buf);
+            else
+                mg_printf(cl->c, "GET %s HTTP/1.1\r\nHost: %.*s\r\n\r\n", uri, (int) hote.len, hote.buf);
+        }
+        while (m.recues < nb_clients) mg_mgr_poll(&mgr, 50);
+        double duree = (double) (mg_millis() - debut);
+        total += duree;
+        if (v == 0 || duree < meilleure) meilleure = duree;
+    }
+    printf("%d clients x %d vagues%s : moyenne %.0f ms, meilleure %.0f ms par vague, %llu octets, %ld erreurs\n",
+           nb_clients, nb_vagues, distinctes ? " (requetes distinctes)" : "", total / nb_vagues, meilleure,
+           m.octets, m.erreurs);
+
+    m.fin = VRAI;
+    for (int i = 0; i < nb_clients; i++) {
+        if (m.clients[i].c != NULL) m.clients[i].c->is_closing = 1;
+    }
+    char stats[512];
+    mg_snprintf(stats, sizeof(stats), "http://%.*s:%hu/api/partages", (int) hote.len, hote.buf,
+                mg_url_port(url));
+    Bool fini = FAUX;
+    struct mg_connection *c = mg_http_connect(&mgr, stats, stats_fn, &fini);
+    if (c != NULL) mg_printf(c, "GET /api/partages HTTP/1.1\r\nHost: %.*s\r\n\r\n", (int) hote.len, hote.buf);
+    limite = mg_millis() + 5000;
+    while (c != NULL && !fini && mg_millis() < limite) mg_mgr_poll(&mgr, 50);
+    mg_mgr_free(&mgr);
+    free(m.clients);
+    return m.erreurs != 0;
+}
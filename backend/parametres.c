@@ -0,0 +1,197 @@
+#include "parametres.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int commence_par_ci(struct mg_str s, const char *prefixe) {
+  size_t n = strlen(prefixe);
+  if (s.len < n) return 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tolower((unsigned char) s.buf[i]) != tolower((unsigned char) prefixe[i])) return 0;
+  }
+  return 1;
+}
+
+// Decode src (URL) dans le tampon ; NULL si le tampon est plein ou l'encodage invalide
+static const char *stocker_url(Parametres *p, const char *src, size_t len) {
+  char *dst = p->tampon + p->utilise;
+  int n = mg_url_decode(src, len, dst, sizeof(p->tampon) - p->utilise, 1);
+  if (n < 0) return NULL;
+  p->utilise += (size_t) n + 1;
+  return dst;
+}
+
+static const char *stocker_json(Parametres *p, struct mg_str tok) {
+  char *dst = p->tampon + p->utilise;
+  size_t reste = sizeof(p->tampon) - p->utilise;
+  if (tok.len >= 2 && tok.buf[0] == '"') {
+    if (!mg_json_unescape(mg_str_n(tok.buf + 1, tok.len - 2), dst, reste)) return NULL;
+  } else {
+    if (tok.len + 1 > reste) return NULL;
+    memcpy(dst, tok.buf, tok.len);
+    dst[tok.len] = '\0';
+  }
+  p->utilise += strlen(dst) + 1;
+  return dst;
+}
+
+static Bool ajouter(Parametres *p, const char *cle, const char *valeur) {
+  if (cle == NULL || valeur == NULL || p->nb >= PARAMS_MAX) return FAUX;
+  p->items[p->nb].cle = cle;
+  p->items[p->nb].valeur = valeur;
+  p->items[p->nb].longueur = strlen(valeur);
+  p->nb++;
+  return VRAI;
+}
+
+// a=1&b=deux : un seul passage, chaque cle/valeur decodee une fois
+static Bool decoder_formulaire(Parametres *p, struct mg_str s) {
+  size_t i = 0;
+  while (i < s.len) {
+    size_t debut = i;
+    while (i < s.len && s.buf[i] != '&') i++;
+    size_t fin = i++;
+    if (fin == debut) continue;
+    size_t egal = debut;
+    while (egal < fin && s.buf[egal] != '=') egal++;
+    const char *cle = stocker_url(p, s.buf + debut, egal - debut);
+    const char *valeur = (egal < fin) ? stocker_url(p, s.buf + egal + 1, fin - egal - 1)
+                                      : stocker_url(p, "", 0);
+    if (!ajouter(p, cle, valeur)) return FAUX;
+  }
+  return VRAI;
+}
+
+// Objet JSON plat : {"titre": "...", "annee": 1999, "emprunte": true}
+static Bool decoder_json(Parametres *p, struct mg_str s) {
+  struct mg_str cle, valeur;
+  size_t ofs = 0;
+  while ((ofs = mg_json_next(s, ofs, &cle, &valeur)) > 0) {
+    if (valeur.len == 4 && memcmp(valeur.buf, "null", 4) == 0) continue;
+    const char *k = stocker_json(p, cle);
+    const char *v = stocker_json(p, valeur);
+    if (!ajouter(p, k, v)) return FAUX;
+  }
+  return VRAI;
+}
+
+Bool params_decoder(Parametres *p, struct mg_http_message *hm) {
+  if (p == NULL || hm == NULL) return FAUX;
+  p->nb = 0;
+  p->utilise = 0;
+  if (!decoder_formulaire(p, hm->query)) return FAUX;
+
+  struct mg_str *type = mg_http_get_header(hm, "Content-Type");
+  if (type == NULL || hm->body.len == 0) return VRAI;
+  if (commence_par_ci(*type, "application/x-www-form-urlencoded")) {
+    return decoder_formulaire(p, hm->body);
+  }
+  if (commence_par_ci(*type, "application/json")) {
+    return decoder_json(p, hm->body);
+  }
+  return VRAI;
+}
+
+// Un objet JSON seul (element d'un lot), sans query string
+Bool params_decoder_json(Parametres *p, struct mg_str objet) {
+  if (p == NULL) return FAUX;
+  p->nb = 0;
+  p->utilise = 0;
+  return decoder_json(p, objet);
+}
+
+// Premiere occurrence de la cle (meme regle que mg_http_get_var)
+const char *params_get(const Parametres *p, const char *cle) {
+  if (p == NULL || cle == NULL) return NULL;
+  for (size_t i = 0; i < p->nb; i++) {
+    if (strcmp(p->items[i].cle, cle) == 0) return p->items[i].valeur;
+  }
+  return NULL;
+}
+
+Bool params_parse_bool(const char *s, Bool *valeur) {
+  static const char *vrais[] = {"1", "true", "oui", "vrai", "on"};
+  static const char *faux[] = {"0", "false", "non", "faux", "off"};
+  for (size_t i = 0; i < sizeof(vrais) / sizeof(vrais[0]); i++) {
+    const char *a = s, *b = vrais[i];
+    while (*a && tolower((unsigned char) *a) == *b) a++, b++;
+    if (*a == '\0' && *b == '\0') {
+      *valeur = VRAI;
+      return VRAI;
+    }
+    a = s, b = faux[i];
+    while (*a && tolower((unsigned char) *a) == *b) a++, b++;
+    if (*a == '\0' && *b == '\0') {
+      *valeur = FAUX;
+      return VRAI;
+    }
+  }
+  return FAUX;
+}
+
+/* Remplit cible selon le schema. presents recoit un bit par champ fourni.
+   En cas d'erreur, erreur contient un message pret pour la reponse JSON. */
+Bool params_lier(const Parametres *p, const ChampParam *schema, size_t nb_champs,
+                 void *cible, unsigned long *presents, char *erreur, size_t taille_erreur) {
+  if (p == NULL || schema == NULL || cible == NULL) return FAUX;
+  unsigned long bits = 0;
+  for (size_t i = 0; i < nb_champs; i++) {
+    const ChampParam *ch = &schema[i];
+    const char *v = params_get(p, ch->nom);
+    if ((v == NULL || v[0] == '\0') && ch->alias != NULL) {
+      const char *a = params_get(p, ch->alias);
+      if (a != NULL && (v == NULL || a[0] != '\0')) v = a;
+    }
+    Bool fourni = (v != NULL && (v[0] != '\0' || (ch->drapeaux & PARAM_VIDE_PERMIS))) ? VRAI : FAUX;
+    if (!fourni) {
+      if (ch->drapeaux & PARAM_OBLIGATOIRE) {
+        snprintf(erreur, taille_erreur, "Parametre %s manquant", ch->nom);
+        return FAUX;
+      }
+      continue;
+    }
+
+    char *dst = (char *) cible + ch->decalage;
+    if (ch->type == PARAM_TEXTE) {
+      size_t len = strlen(v);
+      if (len >= ch->taille) {
+        snprintf(erreur, taille_erreur, "Parametre %s trop long", ch->nom);
+        return FAUX;
+      }
+      memcpy(dst, v, len + 1);
+    } else if (ch->type == PARAM_ENTIER) {
+      char *fin = NULL;
+      errno = 0;
+      long n = strtol(v, &fin, 10);
+      if (errno != 0 || fin == v || *fin != '\0' || n < INT_MIN || n > INT_MAX) {
+        snprintf(erreur, taille_erreur, "Parametre %s invalide", ch->nom);
+        return FAUX;
+      }
+      *(int *) dst = (int) n;
+    } else {
+      Bool b;
+      if (!params_parse_bool(v, &b)) {
+        snprintf(erreur, taille_erreur, "Parametre %s invalide", ch->nom);
+        return FAUX;
+      }
+      *(Bool *) dst = b;
+    }
+    bits |= 1UL << i;
+  }
+  if (presents != NULL) *presents = bits;
+  return VRAI;
+}
+
+// Copie de src vers dst les seuls champs marques presents (mise a jour partielle)
+void params_fusionner(const ChampParam *schema, size_t nb_champs, unsigned long presents,
+                      void *dst, const void *src) {
+  if (schema == NULL || dst == NULL || src == NULL) return;
+  for (size_t i = 0; i < nb_champs; i++) {
+    if (!PARAM_PRESENT(presents, i)) continue;
+    memcpy((char *) dst + schema[i].decalage, (const char *) src + schema[i].decalage, schema[i].taille);
+  }
+}
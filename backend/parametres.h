@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define PARAMS_MAX 32
+#define PARAMS_TAILLE_TAMPON 8192
+
+typedef struct Parametre {
+    const char *cle;
+    const char *valeur;
+    size_t longueur;
+} Parametre;
+
+/* Parametres d'une requete, decodes une seule fois (query string, puis corps
+   en x-www-form-urlencoded ou objet JSON plat). Cles et valeurs pointent dans
+   tampon : la structure est faite pour vivre sur la pile du handler. */
+typedef struct Parametres {
+    Parametre items[PARAMS_MAX];
+    size_t nb;
+    size_t utilise;
+    char tampon[PARAMS_TAILLE_TAMPON];
+} Parametres;
+
+typedef enum {
+    PARAM_TEXTE = 0,
+    PARAM_ENTIER,
+    PARAM_BOOL
+} TypeParam;
+
+#define PARAM_OBLIGATOIRE 0x01   // absent ou vide -> erreur
+#define PARAM_VIDE_PERMIS 0x02   // une valeur vide compte comme fournie
+
+// Description d'un champ : ou et comment ecrire la valeur dans la structure cible
+typedef struct ChampParam {
+    const char *nom;
+    const char *alias;
+    TypeParam type;
+    size_t decalage;
+    size_t taille;
+    unsigned int drapeaux;
+} ChampParam;
+
+#define CHAMP_TEXTE(st, champ, nom, alias, drapeaux) \
+    { nom, alias, PARAM_TEXTE, offsetof(st, champ), sizeof(((st *) 0)->champ), drapeaux }
+#define CHAMP_ENTIER(st, champ, nom, drapeaux) \
+    { nom, NULL, PARAM_ENTIER, offsetof(st, champ), sizeof(int), drapeaux }
+#define CHAMP_BOOL(st, champ, nom, alias, drapeaux) \
+    { nom, alias, PARAM_BOOL, offsetof(st, champ), sizeof(Bool), drapeaux }
+
+#define NB_CHAMPS(schema) (sizeof(schema) / sizeof((schema)[0]))
+#define PARAM_PRESENT(presents, i) (((presents) >> (i)) & 1UL)
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool params_decoder(Parametres *p, struct mg_http_message *hm);
+Bool params_decoder_json(Parametres *p, struct mg_str objet);
+const char *params_get(const Parametres *p, const char *cle);
+Bool params_lier(const Parametres *p, const ChampParam *schema, size_t nb_champs,
+                 void *cible, unsigned long *presents, char *erreur, size_t taille_erreur);
+Bool params_parse_bool(const char *s, Bool *valeur);
+void params_fusionner(const ChampParam *schema, size_t nb_champs, unsigned long presents,
+                      void *dst, const void *src);
@@ -0,0 +1,157 @@
+#include "routeur.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t fnv1a(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static unsigned int methode_masque(struct mg_str m) {
+  if (m.len == 3 && memcmp(m.buf, "GET", 3) == 0) return ROUTE_GET;
+  if (m.len == 4 && memcmp(m.buf, "HEAD", 4) == 0) return ROUTE_HEAD;
+  if (m.len == 4 && memcmp(m.buf, "POST", 4) == 0) return ROUTE_POST;
+  if (m.len == 3 && memcmp(m.buf, "PUT", 3) == 0) return ROUTE_PUT;
+  if (m.len == 6 && memcmp(m.buf, "DELETE", 6) == 0) return ROUTE_DELETE;
+  return 0;
+}
+
+void routeur_init(Routeur *r, RouteHandler defaut) {
+  if (r == NULL) return;
+  memset(r, 0, sizeof(Routeur));
+  r->defaut.chemin = "*";
+  r->defaut.handler = defaut;
+  r->defaut.methodes = ROUTE_LECTURE;
+}
+
+void routeur_free(Routeur *r) {
+  if (r == NULL) return;
+  free(r->routes);
+  free(r->alveoles);
+  r->routes = NULL;
+  r->alveoles = NULL;
+  r->nb_routes = r->cap_routes = r->nb_alveoles = 0;
+}
+
+static Route *route_nouvelle(Routeur *r, const char *chemin, unsigned int methodes,
+                             unsigned int drapeaux) {
+  if (r->nb_routes == r->cap_routes) {
+    size_t cap = r->cap_routes ? r->cap_routes * 2 : 32;
+    Route *tmp = realloc(r->routes, cap * sizeof(Route));
+    if (tmp == NULL) return NULL;
+    r->routes = tmp;
+    r->cap_routes = cap;
+  }
+  Route *route = &r->routes[r->nb_routes++];
+  memset(route, 0, sizeof(Route));
+  route->chemin = chemin;
+  route->longueur = strlen(chemin);
+  route->methodes = methodes;
+  route->drapeaux = drapeaux;
+  return route;
+}
+
+Bool routeur_ajouter(Routeur *r, const char *chemin, RouteHandler handler,
+                     unsigned int methodes, unsigned int drapeaux) {
+  if (r == NULL || chemin == NULL || handler == NULL) return FAUX;
+  Route *route = route_nouvelle(r, chemin, methodes, drapeaux);
+  if (route == NULL) return FAUX;
+  route->handler = handler;
+  return VRAI;
+}
+
+// Route dont le traitement part dans le pool ; la boucle ne fait que l'I/O
+Bool routeur_ajouter_tache(Routeur *r, const char *chemin, TacheRoute tache,
+                           unsigned int methodes, unsigned int drapeaux) {
+  if (r == NULL || chemin == NULL || tache == NULL) return FAUX;
+  Route *route = route_nouvelle(r, chemin, methodes, drapeaux | ROUTE_LOURDE);
+  if (route == NULL) return FAUX;
+  route->tache = tache;
+  return VRAI;
+}
+
+// Construit la table de hachage ; a appeler une fois toutes les routes ajoutees
+Bool routeur_finaliser(Routeur *r) {
+  if (r == NULL) return FAUX;
+  size_t n = 16;
+  while (n < r->nb_routes * 4) n *= 2;  // facteur de charge <= 1/4
+  int *alveoles = malloc(n * sizeof(int));
+  if (alveoles == NULL) return FAUX;
+  for (size_t i = 0; i < n; i++) alveoles[i] = -1;
+
+  for (size_t i = 0; i < r->nb_routes; i++) {
+    size_t pos = fnv1a(r->routes[i].chemin, r->routes[i].longueur) & (n - 1);
+    while (alveoles[pos] != -1) pos = (pos + 1) & (n - 1);
+    alveoles[pos] = (int) i;
+  }
+  free(r->alveoles);
+  r->alveoles = alveoles;
+  r->nb_alveoles = n;
+  return VRAI;
+}
+
+Route *routeur_trouver(const Routeur *r, struct mg_str uri) {
+  if (r == NULL || r->alveoles == NULL) return NULL;
+  size_t masque = r->nb_alveoles - 1;
+  size_t pos = fnv1a(uri.buf, uri.len) & masque;
+  while (r->alveoles[pos] != -1) {
+    Route *route = &r->routes[r->alveoles[pos]];
+    if (route->longueur == uri.len && memcmp(route->chemin, uri.buf, uri.len) == 0) {
+      return route;
+    }
+    pos = (pos + 1) & masque;
+  }
+  return NULL;
+}
+
+void routeur_dispatch(Routeur *r, struct mg_connection *c, struct mg_http_message *hm) {
+  Route *route = routeur_trouver(r, hm->uri);
+  if (route == NULL) route = &r->defaut;
+  if (route->handler == NULL && route->tache == NULL) {
+    mg_http_reply(c, 404, "", "{\"error\": \"Route inconnue\"}\n");
+    return;
+  }
+  if (route->methodes != 0 && (methode_masque(hm->method) & route->methodes) == 0) {
+    atomic_fetch_add(&route->nb_refus, 1);
+    mg_http_reply(c, 405, "", "{\"error\": \"Methode non autorisee\"}\n");
+    return;
+  }
+  atomic_fetch_add(&route->nb_appels, 1);
+  if (route->tache != NULL) {
+    travail_differer(r->pool, (route->drapeaux & ROUTE_PARTAGEE) ? r->vols : NULL, c, hm, route->tache);
+  } else {
+    route->handler(c, hm);
+  }
+}
+
+static void route_stats_ajouter(char *buf, size_t cap, size_t *len, const Route *route, Bool premier) {
+  *len += snprintf(buf + *len, cap - *len,
+                   "%s  { \"route\": \"%s\", \"appels\": %lu, \"refus\": %lu, "
+                   "\"lourde\": %s, \"partagee\": %s }",
+                   premier ? "" : ",\n", route->chemin, atomic_load(&route->nb_appels),
+                   atomic_load(&route->nb_refus),
+                   (route->drapeaux & ROUTE_LOURDE) ? "true" : "false",
+                   (route->drapeaux & ROUTE_PARTAGEE) ? "true" : "false");
+}
+
+// Compteurs par route, route par defaut en dernier
+char *routeur_stats_json(const Routeur *r) {
+  if (r == NULL) return NULL;
+  size_t cap = (r->nb_routes + 1) * 320 + 16;
+  char *json = malloc(cap);
+  if (json == NULL) return NULL;
+  size_t len = 0;
+  len += snprintf(json + len, cap - len, "[\n");
+  for (size_t i = 0; i < r->nb_routes; i++) {
+    route_stats_ajouter(json, cap, &len, &r->routes[i], i == 0);
+  }
+  route_stats_ajouter(json, cap, &len, &r->defaut, r->nb_routes == 0);
+  snprintf(json + len, cap - len, "\n]");
+  return json;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mongoose.h"
+#include "model.h"
+#include "travailleurs.h"
+
+// Methodes acceptees par une route (masque)
+#define ROUTE_GET    0x01
+#define ROUTE_HEAD   0x02
+#define ROUTE_POST   0x04
+#define ROUTE_PUT    0x08
+#define ROUTE_DELETE 0x10
+#define ROUTE_LECTURE (ROUTE_GET | ROUTE_HEAD)
+
+// Metadonnees d'une route
+#define ROUTE_LOURDE    0x04   // executee par le pool de travailleurs
+#define ROUTE_PARTAGEE  0x08   // requetes identiques simultanees calculees une fois
+
+typedef void (*RouteHandler)(struct mg_connection *c, struct mg_http_message *hm);
+
+typedef struct Route {
+    const char *chemin;
+    size_t longueur;
+    RouteHandler handler;
+    TacheRoute tache;           // ROUTE_LOURDE : remplace handler
+    unsigned int methodes;
+    unsigned int drapeaux;
+    atomic_ulong nb_appels;     // incrementes par toutes les boucles
+    atomic_ulong nb_refus;      // methode non autorisee
+} Route;
+
+/* Table de routes figee au demarrage : hachage FNV-1a du chemin en adressage
+   ouvert, puis comparaison longueur + memcmp. Le cout d'un dispatch ne
+   depend pas du nombre de routes enregistrees. */
+typedef struct Routeur {
+    Route *routes;
+    size_t nb_routes;
+    size_t cap_routes;
+    int *alveoles;              // indices dans routes, -1 = vide
+    size_t nb_alveoles;         // puissance de 2
+    Route defaut;               // route de repli (fichiers statiques)
+    PoolTravailleurs *pool;     // NULL : routes lourdes executees sur place
+    VolsPartages *vols;         // calculs en cours des routes ROUTE_PARTAGEE
+} Routeur;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void routeur_init(Routeur *r, RouteHandler defaut);
+void routeur_free(Routeur *r);
+Bool routeur_ajouter(Routeur *r, const char *chemin, RouteHandler handler,
+                     unsigned int methodes, unsigned int drapeaux);
+Bool routeur_ajouter_tache(Routeur *r, const char *chemin, TacheRoute tache,
+                           unsigned int methodes, unsigned int drapeaux);
+Bool routeur_finaliser(Routeur *r);
+Route *routeur_trouver(const Routeur *r, struct mg_str uri);
+void routeur_dispatch(Routeur *r, struct mg_connection *c, struct mg_http_message *hm);
+char *routeur_stats_json(const Routeur *r);
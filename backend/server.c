@@ -1,4 +1,5 @@
 // Simple HTTP server + API for library backend
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,23 +38,60 @@ static char *strtok_r(char *s, const char *delim, char **saveptr) {
 #include "mongoose.h"
 #include "bibliotheque.h"
 #include "fichiers.h"
+#include "routeur.h"
+#include "parametres.h"
+#include "travailleurs.h"
+#include "catalogue.h"
+#include "boucles.h"
+#include "envoi.h"
+#include "statiques.h"
+#include "televersement.h"
+#include "depot.h"
+#include "inventaire.h"
+#include "externe.h"
+#include "importation.h"
+#include "exportation.h"
+#include "diffusion.h"
+#include "changements.h"
 
 // --- VARIABLES GLOBALES ---
-static int s_signo = 0;
+static atomic_int s_signo;  // lu par toutes les boucles
 static int s_debug_level = MG_LL_INFO;
 static const char *s_root_dir = "frontend";
+static struct mg_fs *s_root_fs = &mg_fs_posix;  // &mg_fs_packed : frontend embarque
 static const char *s_listening_address = "http://0.0.0.0:8000";
 static const char *s_data_file = "data/livres.dat";
+static const char *s_journal_file = "data/livres.journal";  // lots ecrits depuis la derniere reecriture
 static const char *s_books_dir = "data/livres";
 static const char *s_covers_dir = "data/couvertures";
 
-static struct Bibliotheque ma_biblio;
+#define UPLOAD_PDF_MAX (50 * 1024 * 1024)
+#define UPLOAD_COUVERTURE_MAX (10 * 1024 * 1024)
+
+/* Le catalogue est lu sans verrou par la boucle et les travailleurs (voir
+   catalogue.h), modifie par catalogue_ecrire. s_verrou_fichiers serialise les
+   acces aux fichiers .dat de data/ ; on peut lire le catalogue en le tenant,
+   jamais l'inverse pour une ecriture. */
+static Catalogue s_catalogue;
+static Routeur s_routeur;
+static PoolTravailleurs s_pool;
+static VolsPartages s_vols;           // requetes identiques en cours (ROUTE_PARTAGEE)
+static Boucles s_boucles;
+static CacheFichiers s_cache_fichiers;
+static Statiques s_statiques;
+static PlafondsIP s_plafonds_ip;
+static Televersements s_televersements;
+static Depot s_depot_livres;
+static Depot s_depot_couvertures;
+static Inventaire s_inventaire_pdfs;  // liste de data/livres pour /api/pdfs
+static Externe s_externe;             // mandataire Gutendex
+static Diffusion s_diffusion;         // abonnes WebSocket de /ws
+static Changements s_changements;     // changements numerotes de /api/changes
+static const char *s_changements_file = "data/changements.journal";
+static pthread_mutex_t s_verrou_annonces = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_verrou_fichiers = PTHREAD_MUTEX_INITIALIZER;
 // -------------------------
 
-static int uri_eq(struct mg_http_message *hm, const char *s) {
-  return mg_vcmp(&hm->uri, s) == 0;
-}
-
 static int str_eq_ci(const char *a, const char *b) {
   if (a == NULL || b == NULL) return 0;
   while (*a && *b) {
@@ -64,6 +102,14 @@ static int str_eq_ci(const char *a, const char *b) {
   return *a == *b;
 }
 
+static int contient_ci(const char *texte, const char *motif) {
+  size_t n = strlen(motif);
+  for (; *texte; texte++) {
+    if (mg_ncasecmp(texte, motif, n) == 0) return 1;
+  }
+  return n == 0;
+}
+
 static const char *basename_of(const char *path) {
   if (path == NULL) return NULL;
   const char *slash = strrchr(path, '/');
@@ -88,67 +134,262 @@ static int is_safe_filename(const char *s) {
   return 1;
 }
 
-static char *biblio_categorie_to_json(const Bibliotheque *bibli, const char *categorie) {
-  if (bibli == NULL || categorie == NULL) return NULL;
+/* Remplit les listes de categories / decennies depuis des valeurs "a,b,c".
+   Les chaines pointent dans buf, qui doit vivre aussi longtemps que crit. */
+static void criteres_ajouter_categories(CriteresLivres *crit, char *buf) {
+  char *saveptr = NULL;
+  for (char *tok = strtok_r(buf, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+    if (crit->nb_categories >= CRITERES_MAX_VALEURS) break;
+    crit->categories[crit->nb_categories++] = tok;
+  }
+}
 
-  size_t taille_max = (bibli->nb_livres * 900) + 1024;
-  char *json = malloc(taille_max);
-  if (json == NULL) return NULL;
+static void criteres_ajouter_decennies(CriteresLivres *crit, char *buf) {
+  char *saveptr = NULL;
+  for (char *tok = strtok_r(buf, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+    if (crit->nb_decennies >= CRITERES_MAX_VALEURS) break;
+    crit->decennies[crit->nb_decennies++] = atoi(tok);
+  }
+}
 
-  strcpy(json, "[\n");
-  Bool premier_livre = VRAI;
-
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    NoeudLivre *actuel = bibli->table.table[i].head;
-    while (actuel != NULL) {
-      if (str_eq_ci(actuel->data.categorie, categorie)) {
-        if (!premier_livre) strcat(json, ",\n");
-
-        char livre_json[4096];
-        snprintf(livre_json, sizeof(livre_json),
-                 "  {\n"
-                 "    \"id\": %d,\n"
-                 "    \"titre\": \"%s\",\n"
-                 "    \"auteur\": \"%s\",\n"
-                 "    \"annee\": %d,\n"
-                 "    \"categorie\": \"%s\",\n"
-                 "    \"fichier\": \"%s\",\n"
-                 "    \"est_emprunte\": %s,\n"
-                 "    \"description\": \"%s\",\n"
-                 "    \"couverture\": \"%s\"\n"
-                 "  }",
-                 actuel->data.id,
-                 actuel->data.titre,
-                 actuel->data.auteur,
-                 actuel->data.annee,
-                 actuel->data.categorie,
-                 actuel->data.fichier,
-                 actuel->data.est_emprunte ? "true" : "false",
-                 actuel->data.description,
-                 actuel->data.couverture);
-        strcat(json, livre_json);
-        premier_livre = FAUX;
-      }
-      actuel = actuel->noeudnext;
+/* Repond avec la selection ; avec facettes, la reponse devient
+   { "livres": [...], "facettes": {...} } au lieu du tableau seul. */
+static void reply_selection(Travail *t, const CriteresLivres *crit, int facettes) {
+  char *json = NULL;
+  char *json_facettes = NULL;
+  size_t nb = 0;
+  Bitmap resultat;
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Livre **selection = biblio_selection(bibli, crit, &nb, facettes ? &resultat : NULL);
+  if (selection != NULL) {
+    json = biblio_selection_to_json(selection, nb);
+    free(selection);
+    if (facettes) {
+      json_facettes = biblio_facettes_to_json(bibli, &resultat);
+      bitmap_free(&resultat);
     }
   }
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (json != NULL && !facettes) {
+    travail_repondre_corps(t, 200, "Content-Type: application/json\r\n", json, strlen(json));
+    return;
+  }
+  if (json != NULL && json_facettes != NULL) {
+    travail_repondre(t, 200, "Content-Type: application/json\r\n",
+                     "{\n  \"livres\": %s,\n  \"facettes\": %s\n}\n", json, json_facettes);
+  } else {
+    travail_repondre(t, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+  free(json);
+  free(json_facettes);
+}
 
-  strcat(json, "\n]");
-  return json;
+/* Decode la requete une fois et remplit cible selon le schema.
+   En cas d'erreur, repond 400 et retourne 0. */
+static int lier_requete(struct mg_connection *c, struct mg_http_message *hm, Parametres *params,
+                        const ChampParam *schema, size_t nb_champs, void *cible,
+                        unsigned long *presents) {
+  char erreur[128];
+  if (!params_decoder(params, hm)) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Parametres invalides ou trop volumineux\"}\n");
+    return 0;
+  }
+  if (!params_lier(params, schema, nb_champs, cible, presents, erreur, sizeof(erreur))) {
+    mg_http_reply(c, 400, "", "{\"error\": \"%s\"}\n", erreur);
+    return 0;
+  }
+  return 1;
 }
 
-static Livre *biblio_find_by_id(Bibliotheque *bibli, int id) {
-  if (bibli == NULL) return NULL;
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    NoeudLivre *actuel = bibli->table.table[i].head;
-    while (actuel != NULL) {
-      if (actuel->data.id == id) {
-        return &actuel->data;
-      }
-      actuel = actuel->noeudnext;
+// Meme chose pour une route lourde : parametres deja decodes par la boucle
+static int lier_travail(Travail *t, const ChampParam *schema, size_t nb_champs, void *cible,
+                        unsigned long *presents) {
+  char erreur[128];
+  if (!params_lier(&t->params, schema, nb_champs, cible, presents, erreur, sizeof(erreur))) {
+    travail_repondre(t, 400, "", "{\"error\": \"%s\"}\n", erreur);
+    return 0;
+  }
+  return 1;
+}
+
+/* Nom du fichier de couverture dans une url "/api/couverture?fichier=..."
+   (le champ couverture d'un livre) ; FAUX pour une autre url. */
+#define URL_COUVERTURE "/api/couverture?fichier="
+
+static Bool nom_couverture(const char *url, char *nom, size_t taille) {
+  size_t n = strlen(URL_COUVERTURE);
+  if (strncmp(url, URL_COUVERTURE, n) != 0) return FAUX;
+  return mg_url_decode(url + n, strlen(url + n), nom, taille, 0) > 0;
+}
+
+/* Les references des blobs suivent le catalogue : les operations d'ecriture
+   les mettent a jour a la premiere de leurs deux applications, sous le
+   verrou de l'ecrivain, donc dans le meme ordre que les modifications. */
+static void references_livre(const Livre *l, int delta) {
+  char nom[DEPOT_NOM + 8];
+  depot_referencer(&s_depot_livres, basename_of(l->fichier), delta);
+  inventaire_referencer(&s_inventaire_pdfs, basename_of(l->fichier), delta);
+  if (nom_couverture(l->couverture, nom, sizeof(nom))) depot_referencer(&s_depot_couvertures, nom, delta);
+}
+
+static Bool premiere_application(Bool *faite) {
+  if (*faite) return FAUX;
+  return *faite = VRAI;
+}
+
+/* Changements du catalogue et des prets, publies comme les references a
+   la premiere application d'une ecriture : ils arrivent dans l'ordre des
+   modifications. Chacun recoit son seq (/api/changes) puis part, seq
+   compris, aux abonnes de /ws ; le verrou garde le meme ordre aux deux. */
+static void annoncer(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  char *corps = mg_vmprintf(fmt, &ap);
+  va_end(ap);
+  if (corps == NULL) return;
+  char *ligne = NULL;
+  pthread_mutex_lock(&s_verrou_annonces);
+  changements_ajouter(&s_changements, corps, diffusion_active(&s_diffusion) ? &ligne : NULL);
+  if (ligne != NULL) diffusion_publier_texte(&s_diffusion, ligne, strlen(ligne));
+  pthread_mutex_unlock(&s_verrou_annonces);
+  free(ligne);
+  free(corps);
+}
+
+static void annoncer_livre(const char *type, const Livre *l) {
+  annoncer("{\"type\": \"%s\", \"livre\": {\"id\": %d, \"titre\": %m, \"auteur\": %m, \"annee\": %d, "
+           "\"categorie\": %m, \"fichier\": %m, \"est_emprunte\": %s, \"description\": %m, "
+           "\"couverture\": %m}}",
+           type, l->id, MG_ESC(l->titre), MG_ESC(l->auteur), l->annee, MG_ESC(l->categorie),
+           MG_ESC(l->fichier), l->est_emprunte ? "true" : "false", MG_ESC(l->description),
+           MG_ESC(l->couverture));
+}
+
+static void annoncer_etat(int id, Bool emprunte) {
+  annoncer("{\"type\": \"etat\", \"id\": %d, \"est_emprunte\": %s}", id, emprunte ? "true" : "false");
+}
+
+static void annoncer_suppression(int id) {
+  annoncer("{\"type\": \"suppression\", \"id\": %d}", id);
+}
+
+static int op_recompter(Bibliotheque *bibli, void *arg) {
+  if (!premiere_application((Bool *) arg)) return 0;
+  depot_oublier_references(&s_depot_livres);
+  depot_oublier_references(&s_depot_couvertures);
+  inventaire_oublier_references(&s_inventaire_pdfs);
+  for (size_t id = 0; id < bibli->cap_id; id++) {
+    if (bibli->par_id[id] != NULL) references_livre(bibli->par_id[id], 1);
+  }
+  return 0;
+}
+
+static void recompter_references(void) {
+  Bool faite = FAUX;
+  catalogue_ecrire(&s_catalogue, op_recompter, &faite);
+}
+
+/* Migration des fichiers au nom libre que designent des livres : chacun
+   devient le blob de son contenu (ou disparait si ce contenu y est deja),
+   et les livres sont mis a jour. Au demarrage, avant les boucles. */
+typedef struct Migration {
+  int id;
+  char ancien[2][sizeof(((Livre *) 0)->fichier)];  // pdf, couverture
+  char nouveau[2][DEPOT_NOM];                      // "" : inchange
+} Migration;
+
+typedef struct Migrations {
+  Migration *liste;
+  size_t nb;
+} Migrations;
+
+static int op_migrer(Bibliotheque *bibli, void *arg) {
+  Migrations *m = (Migrations *) arg;
+  for (size_t i = 0; i < m->nb; i++) {
+    const Migration *e = &m->liste[i];
+    Livre *existant = biblio_find_by_id(bibli, e->id);
+    if (existant == NULL) continue;
+    Livre updated = *existant;
+    if (e->nouveau[0][0] != '\0') snprintf(updated.fichier, sizeof(updated.fichier), "%s", e->nouveau[0]);
+    if (e->nouveau[1][0] != '\0') {
+      snprintf(updated.couverture, sizeof(updated.couverture), "%s%s", URL_COUVERTURE, e->nouveau[1]);
+    }
+    biblio_update(bibli, existant, &updated);
+  }
+  return 0;
+}
+
+// k : 0 pour le pdf, 1 pour la couverture. Un fichier deja migre pour un autre livre garde son blob
+static Bool migrer_fichier(Depot *d, Migrations *m, Migration *e, int k, const char *ancien, size_t *nb_fichiers) {
+  snprintf(e->ancien[k], sizeof(e->ancien[k]), "%s", ancien);
+  for (size_t i = 0; i < m->nb; i++) {
+    if (m->liste[i].nouveau[k][0] != '\0' && strcmp(m->liste[i].ancien[k], ancien) == 0) {
+      memcpy(e->nouveau[k], m->liste[i].nouveau[k], DEPOT_NOM);
+      return VRAI;
+    }
+  }
+  char chemin[MG_PATH_MAX], extension[DEPOT_EXTENSION + 1];
+  snprintf(chemin, sizeof(chemin), "%s/%s", d->repertoire, ancien);
+  depot_extension(ancien, extension);
+  if (!depot_importer(d, chemin, extension, e->nouveau[k])) {
+    e->nouveau[k][0] = '\0';  // fichier absent : le livre garde son nom
+    return FAUX;
+  }
+  (*nb_fichiers)++;
+  return VRAI;
+}
+
+static size_t migrer_vers_depot(void) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Migrations m = {calloc(bibli->cap_id + 1, sizeof(Migration)), 0};
+  size_t nb_fichiers = 0;
+  for (size_t id = 0; m.liste != NULL && id < bibli->cap_id; id++) {
+    const Livre *l = bibli->par_id[id];
+    if (l == NULL) continue;
+    Migration *e = &m.liste[m.nb];
+    memset(e, 0, sizeof(Migration));
+    char couverture[sizeof(l->couverture)];
+    const char *fichier = basename_of(l->fichier);
+    Bool change = FAUX;
+    if (fichier[0] != '\0' && is_safe_filename(fichier) && !depot_nom_valide(fichier)) {
+      change |= migrer_fichier(&s_depot_livres, &m, e, 0, fichier, &nb_fichiers);
+    }
+    if (nom_couverture(l->couverture, couverture, sizeof(couverture)) && is_safe_filename(couverture) &&
+        !depot_nom_valide(couverture)) {
+      change |= migrer_fichier(&s_depot_couvertures, &m, e, 1, couverture, &nb_fichiers);
+    }
+    if (change) {
+      e->id = l->id;
+      m.nb++;
     }
   }
-  return NULL;
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (m.nb > 0) catalogue_ecrire(&s_catalogue, op_migrer, &m);
+  free(m.liste);
+  return nb_fichiers;
+}
+
+/* Ecrit data/livres.dat depuis le catalogue, s_verrou_fichiers tenu. Une
+   ecriture du catalogue et sa sauvegarde se font sous le meme verrou, comme
+   lot_appliquer : un rechargement, qui le tient aussi, passe avant ou apres
+   les deux, jamais entre (l'ecriture serait perdue). */
+static Bool sauvegarder_sous_verrou(void) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Bool ok = fichiers_sauvegarder(bibli, s_data_file);
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (ok) fichiers_journal_vider(s_journal_file);
+  return ok;
+}
+
+// Ecrit data/livres.dat depuis le catalogue (appele par les travailleurs)
+static Bool sauvegarder_catalogue(void) {
+  pthread_mutex_lock(&s_verrou_fichiers);
+  Bool ok = sauvegarder_sous_verrou();
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  return ok;
 }
 
 static int ends_with_ci(const char *s, const char *suffix) {
@@ -187,731 +428,2237 @@ static int json_append_escaped(char **buf, size_t *cap, size_t *len, const char
   return 1;
 }
 
-static char *pdfs_to_json(const char *dir_path) {
-  if (dir_path == NULL) return NULL;
-  size_t cap = 1024;
-  size_t len = 0;
-  char *json = malloc(cap);
-  if (json == NULL) return NULL;
-  json[0] = '\0';
-  if (!json_append(&json, &cap, &len, "[\n")) {
-    free(json);
-    return NULL;
-  }
+// --- ROUTE 1 : Liste de tous les livres (Catalogue) ---
+typedef struct RequeteLivres {
+  char categorie[512];
+  char decennie[128];
+  char sort[16];
+  Bool disponible;
+  int annee_min;
+  int annee_max;
+  Bool facettes;
+} RequeteLivres;
+
+static const ChampParam s_schema_livres[] = {
+    CHAMP_TEXTE(RequeteLivres, categorie, "categorie", "cat", 0),
+    CHAMP_TEXTE(RequeteLivres, decennie, "decennie", NULL, 0),
+    CHAMP_TEXTE(RequeteLivres, sort, "sort", NULL, 0),
+    CHAMP_BOOL(RequeteLivres, disponible, "disponible", NULL, 0),
+    CHAMP_ENTIER(RequeteLivres, annee_min, "annee_min", 0),
+    CHAMP_ENTIER(RequeteLivres, annee_max, "annee_max", 0),
+    CHAMP_BOOL(RequeteLivres, facettes, "facettes", NULL, 0),
+};
+enum { LIVRES_DISPONIBLE = 3, LIVRES_ANNEE_MIN = 4, LIVRES_ANNEE_MAX = 5 };
+
+static void route_livres(Travail *t) {
+  RequeteLivres req;
+  unsigned long presents;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_livres, NB_CHAMPS(s_schema_livres), &req, &presents)) return;
+
+  CriteresLivres crit;
+  biblio_criteres_init(&crit);
+  criteres_ajouter_categories(&crit, req.categorie);
+  criteres_ajouter_decennies(&crit, req.decennie);
+  if (PARAM_PRESENT(presents, LIVRES_DISPONIBLE)) crit.disponible = req.disponible ? 1 : 0;
+  if (PARAM_PRESENT(presents, LIVRES_ANNEE_MIN)) crit.annee_min = req.annee_min;
+  if (PARAM_PRESENT(presents, LIVRES_ANNEE_MAX)) crit.annee_max = req.annee_max;
+  if (str_eq_ci(req.sort, "titre")) crit.tri = TRI_TITRE;
+  else if (str_eq_ci(req.sort, "annee")) crit.tri = TRI_ANNEE;
+  reply_selection(t, &crit, req.facettes);
+}
 
-  Bool first = VRAI;
-  char name[256] = "";
-  while (mg_fs_ls(&mg_fs_posix, dir_path, name, sizeof(name))) {
-    if (!ends_with_ci(name, ".pdf")) continue;
-    if (!first) {
-      if (!json_append(&json, &cap, &len, ",\n")) break;
-    }
-    if (!json_append(&json, &cap, &len, "  \"")) break;
-    if (!json_append_escaped(&json, &cap, &len, name)) break;
-    if (!json_append(&json, &cap, &len, "\"")) break;
-    first = FAUX;
+// --- ROUTE 2 : Recherche par titre ---
+typedef struct RequeteTitre {
+  char titre[128];
+} RequeteTitre;
+
+static const ChampParam s_schema_titre[] = {
+    CHAMP_TEXTE(RequeteTitre, titre, "titre", NULL, PARAM_OBLIGATOIRE),
+};
+
+static void route_recherche(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteTitre req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_titre, NB_CHAMPS(s_schema_titre), &req, NULL)) return;
+
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Livre *l = biblio_search(bibli, req.titre);
+  if (l != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", 
+                  "{\"status\": \"trouve\", \"titre\": \"%s\", \"auteur\": \"%s\"}\n", 
+                  l->titre, l->auteur);
+  } else {
+    mg_http_reply(c, 404, "", "{\"error\": \"Livre non trouve\"}\n");
   }
+  catalogue_lire_fin(&s_catalogue, &lecture);
+}
 
-  if (!json_append(&json, &cap, &len, "\n]")) {
-    free(json);
-    return NULL;
+// --- ROUTE 3 : Ajouter un livre (API) ---
+// Champs d'un livre lus directement dans une struct Livre
+#define CHAMPS_LIVRE(oblig) \
+    CHAMP_TEXTE(Livre, titre, "titre", NULL, oblig), \
+    CHAMP_TEXTE(Livre, auteur, "auteur", NULL, oblig), \
+    CHAMP_ENTIER(Livre, annee, "annee", 0), \
+    CHAMP_TEXTE(Livre, categorie, "categorie", "cat", 0), \
+    CHAMP_TEXTE(Livre, fichier, "fichier", NULL, 0), \
+    CHAMP_BOOL(Livre, est_emprunte, "emprunte", "est_emprunte", 0), \
+    CHAMP_TEXTE(Livre, description, "description", NULL, PARAM_VIDE_PERMIS), \
+    CHAMP_TEXTE(Livre, couverture, "couverture", NULL, PARAM_VIDE_PERMIS)
+
+static const ChampParam s_schema_ajout[] = {
+    CHAMPS_LIVRE(PARAM_OBLIGATOIRE),
+};
+
+typedef struct Ajout {
+  Livre livre;
+  Bool compte;            // references du depot deja ajoutees
+} Ajout;
+
+static int op_ajouter(Bibliotheque *bibli, void *arg) {
+  Ajout *a = (Ajout *) arg;
+  a->livre.id = biblio_next_id(bibli);  // id autogenere, identique sur les deux copies
+  if (!biblio_add(bibli, &a->livre)) return 0;
+  if (premiere_application(&a->compte)) {
+    references_livre(&a->livre, 1);
+    annoncer_livre("ajout", &a->livre);
   }
-  return json;
+  return a->livre.id;
 }
 
-static void event_handler(struct mg_connection *c, int ev, void *ev_data) {
-  if (ev == MG_EV_HTTP_MSG) {
-    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
-
-    // --- ROUTE 1 : Liste de tous les livres (Catalogue) ---
-if (uri_eq(hm, "/api/livres")) {
-    char query[128], cat[128];
-    int has_q = mg_http_get_var(&hm->query, "q", query, sizeof(query));
-    int has_cat = mg_http_get_var(&hm->query, "categorie", cat, sizeof(cat));
-
-    char *json = NULL;
-
-    
-    if (has_cat > 0) {
-        json = biblio_categorie_to_json(&ma_biblio, cat);
-    } 
-    
-    else if (has_q > 0) {
-        json = biblio_to_json(&ma_biblio); 
-    }
-   
-    else {
-        json = biblio_to_json(&ma_biblio);
-    }
+static void route_add(Travail *t) {
+  Ajout a;
+  memset(&a, 0, sizeof(a));
+  Livre *n = &a.livre;
+  if (!lier_travail(t, s_schema_ajout, NB_CHAMPS(s_schema_ajout), n, NULL)) return;
+
+  pthread_mutex_lock(&s_verrou_fichiers);
+  if (catalogue_ecrire(&s_catalogue, op_ajouter, &a) == 0) {
+    pthread_mutex_unlock(&s_verrou_fichiers);
+    travail_repondre(t, 500, "", "{\"error\": \"Catalogue plein\"}\n");
+    return;
+  }
+  catalogue_fixer_etat(&s_catalogue, n->id, n->est_emprunte ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+  sauvegarder_sous_verrou(); // Sauvegarde auto
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\": \"success\", \"id\": %d}\n", n->id);
+}
 
-    if (json != NULL) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
-        free(json); 
-    } else {
-        mg_http_reply(c, 500, "", "{\"error\": \"Erreur binaire\"}\n");
-    }
+// --- ROUTE 3bis : Inscription utilisateur (API) ---
+typedef struct RequeteCompte {
+  char nom[64];
+  char prenom[64];
+  char email[128];
+  char pwd[128];
+} RequeteCompte;
+
+static const ChampParam s_schema_inscription[] = {
+    CHAMP_TEXTE(RequeteCompte, nom, "nom", NULL, PARAM_OBLIGATOIRE),
+    CHAMP_TEXTE(RequeteCompte, prenom, "prenom", NULL, PARAM_OBLIGATOIRE),
+    CHAMP_TEXTE(RequeteCompte, email, "email", NULL, PARAM_OBLIGATOIRE),
+    CHAMP_TEXTE(RequeteCompte, pwd, "pwd", NULL, PARAM_OBLIGATOIRE),
+};
+
+static void route_register(Travail *t) {
+  RequeteCompte req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_inscription, NB_CHAMPS(s_schema_inscription), &req, NULL)) return;
+
+  pthread_mutex_lock(&s_verrou_fichiers);
+  FILE *f = fopen("data/utilisateurs.dat", "a");
+  if (f) {
+      fprintf(f, "%s|%s|%s|%s\n", req.nom, req.prenom, req.email, req.pwd);
+      fclose(f);
+  }
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  if (f) {
+      travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\"}\n");
+  } else {
+      travail_repondre(t, 500, "", "{\"error\":\"impossible d'ecrire\"}\n");
+  }
 }
 
-    // --- ROUTE 2 : Recherche par titre ---
-    else if (uri_eq(hm, "/api/recherche")) {
-      char titre[128];
-      if (mg_http_get_var(&hm->query, "titre", titre, sizeof(titre)) > 0) {
-        Livre *l = biblio_search(&ma_biblio, titre);
-        if (l != NULL) {
-          mg_http_reply(c, 200, "Content-Type: application/json\r\n", 
-                        "{\"status\": \"trouve\", \"titre\": \"%s\", \"auteur\": \"%s\"}\n", 
-                        l->titre, l->auteur);
-        } else {
-          mg_http_reply(c, 404, "", "{\"error\": \"Livre non trouve\"}\n");
+// --- ROUTE 3ter : Connexion utilisateur (API) ---
+static const ChampParam s_schema_connexion[] = {
+    CHAMP_TEXTE(RequeteCompte, email, "email", NULL, 0),
+    CHAMP_TEXTE(RequeteCompte, pwd, "pwd", NULL, 0),
+};
+
+static void route_login(Travail *t) {
+  RequeteCompte req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_connexion, NB_CHAMPS(s_schema_connexion), &req, NULL)) return;
+  const char *email = req.email;
+  const char *pwd = req.pwd;
+
+  /* 1) vérifier si c'est un administrateur */
+  int found = 0;
+  int is_admin = 0;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  FILE *fa = fopen("data/admins.dat", "r");
+  if (fa) {
+    char line[512];
+    while (fgets(line, sizeof(line), fa)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      char n[64], p[64], e[128], pass[128];
+      if (sscanf(line, "%63[^|]|%63[^|]|%127[^|]|%127s", n, p, e, pass) == 4) {
+        if (strcmp(e, email) == 0 && strcmp(pass, pwd) == 0) {
+          found = 1; is_admin = 1; break;
         }
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre manquant\"}\n");
       }
     }
+    fclose(fa);
+  }
 
-    // --- ROUTE 3 : Ajouter un livre (API) ---
-    else if (uri_eq(hm, "/api/add")) {
-        char annee_s[10], titre[128], auteur[128];
-        char categorie[64], fichier[256], emprunte_s[16];
-        char description[512], couverture[256];
-        
-        // Extraction des données de l'URL (id is autogenerated)
-        int n2 = mg_http_get_var(&hm->query, "titre", titre, sizeof(titre));
-        int n3 = mg_http_get_var(&hm->query, "auteur", auteur, sizeof(auteur));
-        int n4 = mg_http_get_var(&hm->query, "annee", annee_s, sizeof(annee_s));
-        int n5 = mg_http_get_var(&hm->query, "categorie", categorie, sizeof(categorie));
-        int n6 = (n5 > 0) ? n5 : mg_http_get_var(&hm->query, "cat", categorie, sizeof(categorie));
-        int n7 = mg_http_get_var(&hm->query, "fichier", fichier, sizeof(fichier));
-        int n8 = mg_http_get_var(&hm->query, "emprunte", emprunte_s, sizeof(emprunte_s));
-        int n9 = (n8 > 0) ? n8 : mg_http_get_var(&hm->query, "est_emprunte", emprunte_s, sizeof(emprunte_s));
-        int n10 = mg_http_get_var(&hm->query, "description", description, sizeof(description));
-        int n11 = mg_http_get_var(&hm->query, "couverture", couverture, sizeof(couverture));
-
-        if (n2 > 0 && n3 > 0) {
-            Livre n;
-            memset(&n, 0, sizeof(Livre));
-            n.id = biblio_next_id(&ma_biblio);
-            strncpy(n.titre, titre, sizeof(n.titre) - 1);
-            strncpy(n.auteur, auteur, sizeof(n.auteur) - 1);
-            if (n4 > 0) n.annee = atoi(annee_s);
-            if (n6 > 0) strncpy(n.categorie, categorie, sizeof(n.categorie) - 1);
-            if (n7 > 0) strncpy(n.fichier, fichier, sizeof(n.fichier) - 1);
-            n.est_emprunte = FAUX;
-            if (n9 > 0) {
-              if (strcmp(emprunte_s, "1") == 0 || str_eq_ci(emprunte_s, "true") ||
-                  str_eq_ci(emprunte_s, "oui")) {
-                n.est_emprunte = VRAI;
-              }
-            }
-            if (n10 > 0) {
-              strncpy(n.description, description, sizeof(n.description) - 1);
-              n.description[sizeof(n.description) - 1] = '\0';
-            }
-            if (n11 > 0) {
-              strncpy(n.couverture, couverture, sizeof(n.couverture) - 1);
-              n.couverture[sizeof(n.couverture) - 1] = '\0';
-            }
-            biblio_add(&ma_biblio, &n);
-            fichiers_sauvegarder(&ma_biblio, s_data_file); // Sauvegarde auto
-            mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\": \"success\", \"id\": %d}\n", n.id);
-        } else {
-            mg_http_reply(c, 400, "", "{\"error\": \"Champs manquants\"}\n");
+  /* 2) si pas admin, vérifier utilisateur classique */
+  if (!found) {
+    FILE *f = fopen("data/utilisateurs.dat", "r");
+    if (f) {
+      char line[512];
+      while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char n[64], p[64], e[128], pass[128];
+        if (sscanf(line, "%63[^|]|%63[^|]|%127[^|]|%127s", n, p, e, pass) == 4) {
+          if (strcmp(e, email) == 0 && strcmp(pass, pwd) == 0) {
+            found = 1; is_admin = 0; break;
+          }
         }
+      }
+      fclose(f);
     }
+  }
+  pthread_mutex_unlock(&s_verrou_fichiers);
 
-    // --- ROUTE 3bis : Inscription utilisateur (API) ---
-    else if (uri_eq(hm, "/api/register")) {
-        char nom[64] = "", prenom[64] = "", email[128] = "", pwd[128] = "";
-        mg_http_get_var(&hm->query, "nom", nom, sizeof(nom));
-        mg_http_get_var(&hm->query, "prenom", prenom, sizeof(prenom));
-        mg_http_get_var(&hm->query, "email", email, sizeof(email));
-        mg_http_get_var(&hm->query, "pwd", pwd, sizeof(pwd));
-        if (nom[0] && prenom[0] && email[0] && pwd[0]) {
-            FILE *f = fopen("data/utilisateurs.dat", "a");
-            if (f) {
-                fprintf(f, "%s|%s|%s|%s\n", nom, prenom, email, pwd);
-                fclose(f);
-                mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\"}\n");
-            } else {
-                mg_http_reply(c, 500, "", "{\"error\":\"impossible d'ecrire\"}\n");
-            }
-        } else {
-            mg_http_reply(c, 400, "", "{\"error\":\"champs manquants\"}\n");
-        }
+  if (found) {
+    if (is_admin) {
+      travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\", \"role\":\"admin\"}\n");
+    } else {
+      travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\", \"role\":\"user\"}\n");
     }
+  } else {
+    travail_repondre(t, 401, "", "{\"error\":\"identifiants invalides\"}\n");
+  }
+}
 
-    // --- ROUTE 3ter : Connexion utilisateur (API) ---
-    else if (uri_eq(hm, "/api/login")) {
-      char email[128] = "", pwd[128] = "";
-      mg_http_get_var(&hm->query, "email", email, sizeof(email));
-      mg_http_get_var(&hm->query, "pwd", pwd, sizeof(pwd));
-
-      /* 1) vérifier si c'est un administrateur */
-      int found = 0;
-      int is_admin = 0;
-      FILE *fa = fopen("data/admins.dat", "r");
-      if (fa) {
-        char line[512];
-        while (fgets(line, sizeof(line), fa)) {
-          line[strcspn(line, "\r\n")] = '\0';
-          char n[64], p[64], e[128], pass[128];
-          if (sscanf(line, "%63[^|]|%63[^|]|%127[^|]|%127s", n, p, e, pass) == 4) {
-            if (strcmp(e, email) == 0 && strcmp(pass, pwd) == 0) {
-              found = 1; is_admin = 1; break;
-            }
-          }
-        }
-        fclose(fa);
-      }
+// --- ROUTE 3B : Modifier un livre (API) ---
+static const ChampParam s_schema_modif[] = {
+    CHAMPS_LIVRE(0),
+    CHAMP_ENTIER(Livre, id, "id", PARAM_OBLIGATOIRE),
+};
+enum { MODIF_TITRE = 0 };
+
+typedef struct Modification {
+  Livre saisie;
+  unsigned long presents;
+  Bool emprunte;          // etat du livre apres modification
+  Bool compte;            // references du depot deja deplacees
+} Modification;
+
+static int op_modifier(Bibliotheque *bibli, void *arg) {
+  Modification *m = (Modification *) arg;
+  Livre *existant = biblio_find_by_id(bibli, m->saisie.id);
+  if (existant == NULL) return 404;
+  if (PARAM_PRESENT(m->presents, MODIF_TITRE) && strcmp(m->saisie.titre, existant->titre) != 0) {
+    return 400;
+  }
+  // Seuls les champs fournis remplacent ceux du livre existant
+  Livre updated = *existant;
+  params_fusionner(s_schema_modif, NB_CHAMPS(s_schema_modif), m->presents, &updated, &m->saisie);
+  if (premiere_application(&m->compte)) {
+    references_livre(&updated, 1);
+    references_livre(existant, -1);
+    annoncer_livre("modification", &updated);
+  }
+  biblio_update(bibli, existant, &updated);
+  m->emprunte = updated.est_emprunte;
+  return 200;
+}
 
-      /* 2) si pas admin, vérifier utilisateur classique */
-      if (!found) {
-        FILE *f = fopen("data/utilisateurs.dat", "r");
-        if (f) {
-          char line[512];
-          while (fgets(line, sizeof(line), f)) {
-            line[strcspn(line, "\r\n")] = '\0';
-            char n[64], p[64], e[128], pass[128];
-            if (sscanf(line, "%63[^|]|%63[^|]|%127[^|]|%127s", n, p, e, pass) == 4) {
-              if (strcmp(e, email) == 0 && strcmp(pass, pwd) == 0) {
-                found = 1; is_admin = 0; break;
-              }
-            }
-          }
-          fclose(f);
-        }
-      }
+static void route_modifier(Travail *t) {
+  Modification m;
+  memset(&m, 0, sizeof(m));
+  if (!lier_travail(t, s_schema_modif, NB_CHAMPS(s_schema_modif), &m.saisie, &m.presents)) return;
 
-      if (found) {
-        if (is_admin) {
-          mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\", \"role\":\"admin\"}\n");
-        } else {
-          mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\", \"role\":\"user\"}\n");
-        }
-      } else {
-        mg_http_reply(c, 401, "", "{\"error\":\"identifiants invalides\"}\n");
-      }
-    }
+  pthread_mutex_lock(&s_verrou_fichiers);
+  int status = catalogue_ecrire(&s_catalogue, op_modifier, &m);
+  if (status == 200) {
+    catalogue_fixer_etat(&s_catalogue, m.saisie.id, m.emprunte ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+    sauvegarder_sous_verrou();
+  }
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  if (status == 404) {
+      travail_repondre(t, 404, "", "{\"error\": \"Livre introuvable\"}\n");
+  } else if (status == 400) {
+      travail_repondre(t, 400, "", "{\"error\": \"Modification du titre interdite\"}\n");
+  } else {
+      travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\": \"modifie\"}\n");
+  }
+}
 
-    // --- ROUTE 3B : Modifier un livre (API) ---
-    else if (uri_eq(hm, "/api/modifier")) {
-        char id_s[10], annee_s[10], titre[128], auteur[128];
-        char categorie[64], fichier[256], emprunte_s[16];
-        char description[512] = "";
-        char couverture[256] = "";
-
-        int n1 = mg_http_get_var(&hm->query, "id", id_s, sizeof(id_s));
-        int n2 = mg_http_get_var(&hm->query, "titre", titre, sizeof(titre));
-        int n3 = mg_http_get_var(&hm->query, "auteur", auteur, sizeof(auteur));
-        int n4 = mg_http_get_var(&hm->query, "annee", annee_s, sizeof(annee_s));
-        int n5 = mg_http_get_var(&hm->query, "categorie", categorie, sizeof(categorie));
-        int n6 = (n5 > 0) ? n5 : mg_http_get_var(&hm->query, "cat", categorie, sizeof(categorie));
-        int n7 = mg_http_get_var(&hm->query, "fichier", fichier, sizeof(fichier));
-        int n8 = mg_http_get_var(&hm->query, "emprunte", emprunte_s, sizeof(emprunte_s));
-        int n9 = (n8 > 0) ? n8 : mg_http_get_var(&hm->query, "est_emprunte", emprunte_s, sizeof(emprunte_s));
-        int n10 = mg_http_get_var(&hm->query, "description", description, sizeof(description));
-        int n11 = mg_http_get_var(&hm->query, "couverture", couverture, sizeof(couverture));
-
-        if (n1 > 0) {
-            Livre *existant = biblio_find_by_id(&ma_biblio, atoi(id_s));
-            if (existant == NULL) {
-                mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
-            } else {
-                if (n2 > 0 && strcmp(titre, existant->titre) != 0) {
-                    mg_http_reply(c, 400, "", "{\"error\": \"Modification du titre interdite\"}\n");
-                    return;
-                }
-                Livre updated = *existant;
-                char ancien_titre[128];
-                strncpy(ancien_titre, existant->titre, sizeof(ancien_titre) - 1);
-                ancien_titre[sizeof(ancien_titre) - 1] = '\0';
-
-                if (n2 > 0) {
-                    strncpy(updated.titre, titre, sizeof(updated.titre) - 1);
-                    updated.titre[sizeof(updated.titre) - 1] = '\0';
-                }
-                if (n3 > 0) {
-                    strncpy(updated.auteur, auteur, sizeof(updated.auteur) - 1);
-                    updated.auteur[sizeof(updated.auteur) - 1] = '\0';
-                }
-                if (n4 > 0) updated.annee = atoi(annee_s);
-                if (n6 > 0) {
-                    strncpy(updated.categorie, categorie, sizeof(updated.categorie) - 1);
-                    updated.categorie[sizeof(updated.categorie) - 1] = '\0';
-                }
-                if (n7 > 0) {
-                    strncpy(updated.fichier, fichier, sizeof(updated.fichier) - 1);
-                    updated.fichier[sizeof(updated.fichier) - 1] = '\0';
-                }
-                if (n9 > 0) {
-                    if (strcmp(emprunte_s, "1") == 0 || str_eq_ci(emprunte_s, "true") ||
-                        str_eq_ci(emprunte_s, "oui")) {
-                        updated.est_emprunte = VRAI;
-                    } else {
-                        updated.est_emprunte = FAUX;
-                    }
-                }
-                if (n10 >= 0) {
-                    strncpy(updated.description, description, sizeof(updated.description) - 1);
-                    updated.description[sizeof(updated.description) - 1] = '\0';
-                }
-                if (n11 >= 0) {
-                    strncpy(updated.couverture, couverture, sizeof(updated.couverture) - 1);
-                    updated.couverture[sizeof(updated.couverture) - 1] = '\0';
-                }
-
-                if (strcmp(ancien_titre, updated.titre) != 0) {
-                    hash_remove(&ma_biblio.table, ancien_titre);
-                    hash_insert(&ma_biblio.table, &updated);
-                } else {
-                    *existant = updated;
-                }
-                fichiers_sauvegarder(&ma_biblio, s_data_file);
-                mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\": \"modifie\"}\n");
-            }
-        } else {
-            mg_http_reply(c, 400, "", "{\"error\": \"Parametre id manquant\"}\n");
-        }
-    }
+// --- ROUTE 4 : Supprimer un livre (API) ---
+typedef struct Suppression {
+  const char *titre;
+  Bool compte;
+} Suppression;
+
+static int op_supprimer(Bibliotheque *bibli, void *arg) {
+  Suppression *s = (Suppression *) arg;
+  Livre *l = biblio_search(bibli, s->titre);
+  if (l == NULL) return 0;
+  if (premiere_application(&s->compte)) {
+    references_livre(l, -1);
+    annoncer_suppression(l->id);
+  }
+  biblio_remove_livre(bibli, l);
+  return 1;
+}
 
-    // --- ROUTE 4 : Supprimer un livre (API) ---
-    else if (uri_eq(hm, "/api/supprimer")) {
-      char titre[128];
-      if (mg_http_get_var(&hm->query, "titre", titre, sizeof(titre)) > 0) {
-        Livre *l = biblio_search(&ma_biblio, titre);
-        if (l == NULL) {
-          mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
-        } else {
-          biblio_remove(&ma_biblio, titre);
-          fichiers_sauvegarder(&ma_biblio, s_data_file);
-          mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\": \"supprime\"}\n");
-        }
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre manquant\"}\n");
-      }
+static void route_supprimer(Travail *t) {
+  RequeteTitre req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_titre, NB_CHAMPS(s_schema_titre), &req, NULL)) return;
+
+  Suppression s = {req.titre, FAUX};
+  pthread_mutex_lock(&s_verrou_fichiers);
+  int supprime = catalogue_ecrire(&s_catalogue, op_supprimer, &s);
+  if (supprime) sauvegarder_sous_verrou();
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  if (!supprime) {
+    travail_repondre(t, 404, "", "{\"error\": \"Livre introuvable\"}\n");
+  } else {
+    travail_repondre(t, 200, "Content-Type: application/json\r\n", "{\"status\": \"supprime\"}\n");
+  }
+}
+
+// --- ROUTE 5 : Liste des livres par categorie ---
+static const ChampParam s_schema_categorie[] = {
+    CHAMP_TEXTE(RequeteLivres, categorie, "categorie", "cat", PARAM_OBLIGATOIRE),
+    CHAMP_BOOL(RequeteLivres, facettes, "facettes", NULL, 0),
+};
+
+static void route_categorie(Travail *t) {
+  RequeteLivres req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_categorie, NB_CHAMPS(s_schema_categorie), &req, NULL)) return;
+
+  CriteresLivres crit;
+  biblio_criteres_init(&crit);
+  crit.categories[crit.nb_categories++] = req.categorie;
+  reply_selection(t, &crit, req.facettes);
+}
+
+// --- ROUTE 6 : Compter les livres ---
+static void route_compter(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  LectureCatalogue lecture;
+  unsigned long nb = (unsigned long) biblio_count(catalogue_lire_debut(&s_catalogue, &lecture));
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                "{ \"count\": %lu }\n", nb);  // le printf de Mongoose ne connait pas %zu
+}
+
+// --- ROUTE 7 : Afficher un livre PDF ---
+/* Un blob du depot (nom = empreinte du contenu) ne change jamais sous son
+   url : cacheable sans revalidation. Un nom de blob inconnu du depot est
+   un 404 immediat. */
+#define DEPOT_CACHE "Cache-Control: " STATIQUES_CACHE_IMMUABLE "\r\n"
+
+typedef struct RequeteFichier {
+  char titre[128];
+  char fichier[256];
+} RequeteFichier;
+
+static const ChampParam s_schema_fichier[] = {
+    CHAMP_TEXTE(RequeteFichier, titre, "titre", NULL, 0),
+    CHAMP_TEXTE(RequeteFichier, fichier, "fichier", NULL, 0),
+};
+
+static void route_afficher(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteFichier req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_fichier, NB_CHAMPS(s_schema_fichier), &req, NULL)) return;
+  const char *filename = NULL;
+  char fichier_livre[sizeof(((Livre *) 0)->fichier)];
+
+  if (req.titre[0] != '\0') {
+    LectureCatalogue lecture;
+    Livre *l = biblio_search(catalogue_lire_debut(&s_catalogue, &lecture), req.titre);
+    if (l != NULL) memcpy(fichier_livre, l->fichier, sizeof(fichier_livre));
+    catalogue_lire_fin(&s_catalogue, &lecture);
+    if (l == NULL) {
+      mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
+      return;
     }
+    filename = fichier_livre;
+  } else if (req.fichier[0] != '\0') {
+    filename = req.fichier;
+  } else {
+    mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre ou fichier manquant\"}\n");
+    return;
+  }
 
-    // --- ROUTE 5 : Liste des livres par categorie ---
-    else if (uri_eq(hm, "/api/categorie")) {
-      char categorie[128];
-      int n1 = mg_http_get_var(&hm->query, "categorie", categorie, sizeof(categorie));
-      int n2 = (n1 > 0) ? n1 : mg_http_get_var(&hm->query, "cat", categorie, sizeof(categorie));
+  const char *base = basename_of(filename);
+  if (!is_safe_filename(base)) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
+    return;
+  }
 
-      if (n2 > 0) {
-        char *json = biblio_categorie_to_json(&ma_biblio, categorie);
-        if (json != NULL) {
-          mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
-          free(json);
-        } else {
-          mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
-        }
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre categorie manquant\"}\n");
-      }
+  Bool blob = depot_nom_valide(base);
+  if (blob && !depot_servir(&s_depot_livres, base)) {
+    mg_http_reply(c, 404, "", "{\"error\": \"Fichier introuvable\"}\n");
+    return;
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", s_books_dir, base);
+  struct mg_http_serve_opts opts = {
+      .extra_headers = blob ? "Content-Type: application/pdf\r\n" DEPOT_CACHE
+                            : "Content-Type: application/pdf\r\n",
+      .mime_types = "pdf=application/pdf"
+  };
+  envoi_fichier(&s_cache_fichiers, c, hm, path, &opts);
+}
+
+// --- ROUTE 7B : Afficher une couverture image ---
+static void route_couverture(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteFichier req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_fichier, NB_CHAMPS(s_schema_fichier), &req, NULL)) return;
+  if (req.fichier[0] != '\0') {
+    const char *base = basename_of(req.fichier);
+    if (!is_safe_filename(base)) {
+      mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
+      return;
     }
 
-    // --- ROUTE 6 : Compter les livres ---
-    else if (uri_eq(hm, "/api/compter")) {
-      mg_http_reply(c, 200, "Content-Type: application/json\r\n",
-                    "{ \"count\": %zu }\n", biblio_count(&ma_biblio));
+    Bool blob = depot_nom_valide(base);
+    if (blob && !depot_servir(&s_depot_couvertures, base)) {
+      mg_http_reply(c, 404, "", "{\"error\": \"Fichier introuvable\"}\n");
+      return;
     }
 
-    // --- ROUTE 7 : Afficher un livre PDF ---
-    else if (uri_eq(hm, "/api/afficher")) {
-      char titre[128], fichier[256];
-      int has_titre = mg_http_get_var(&hm->query, "titre", titre, sizeof(titre));
-      int has_fichier = mg_http_get_var(&hm->query, "fichier", fichier, sizeof(fichier));
-      const char *filename = NULL;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", s_covers_dir, base);
+    struct mg_http_serve_opts opts = {
+        .extra_headers = blob ? DEPOT_CACHE : NULL,
+        .mime_types = "jpg=image/jpeg,jpeg=image/jpeg,png=image/png,webp=image/webp,gif=image/gif"
+    };
+    envoi_fichier(&s_cache_fichiers, c, hm, path, &opts);
+  } else {
+    mg_http_reply(c, 400, "", "{\"error\": \"Parametre fichier manquant\"}\n");
+  }
+}
 
-      if (has_titre > 0) {
-        Livre *l = biblio_search(&ma_biblio, titre);
-        if (l == NULL) {
-          mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
-          return;
-        }
-        filename = l->fichier;
-      } else if (has_fichier > 0) {
-        filename = fichier;
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre ou fichier manquant\"}\n");
-        return;
-      }
+// --- ROUTE 8 : Liste des PDFs (paginee, depuis l'inventaire en memoire) ---
+typedef struct RequetePdfs {
+  int debut;
+  int limite;
+} RequetePdfs;
+
+static const ChampParam s_schema_pdfs[] = {
+    CHAMP_ENTIER(RequetePdfs, debut, "debut", 0),
+    CHAMP_ENTIER(RequetePdfs, limite, "limite", 0),
+};
+
+static void route_pdfs(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequetePdfs req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_pdfs, NB_CHAMPS(s_schema_pdfs), &req, NULL)) return;
+  if (req.debut < 0 || req.limite < 0) {
+    mg_http_reply(c, 400, "", "{\"error\": \"debut et limite doivent etre positifs\"}\n");
+    return;
+  }
+  inventaire_repondre(&s_inventaire_pdfs, c, hm, (size_t) req.debut, (size_t) req.limite);
+}
 
-      const char *base = basename_of(filename);
-      if (!is_safe_filename(base)) {
-        mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
-        return;
-      }
+/* Chaque morceau recu change le fichier : on retire son descripteur du
+   cache sans attendre inotify (absent ou en retard), et l'inventaire du
+   repertoire s'il en a un relit sa taille. */
+static void invalider_upload(struct mg_http_message *hm, const char *dir, Inventaire *inventaire) {
+  char file[MG_PATH_MAX / 2], path[MG_PATH_MAX];
+  if (mg_http_get_var(&hm->query, "file", file, sizeof(file)) <= 0) return;
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  cache_fichiers_invalider(&s_cache_fichiers, path);
+  inventaire_actualiser(inventaire, file);
+}
 
-      char path[512];
-      snprintf(path, sizeof(path), "%s/%s", s_books_dir, base);
-      struct mg_http_serve_opts opts = {
-          .extra_headers = "Content-Type: application/pdf\r\n",
-          .mime_types = "pdf=application/pdf"
-      };
-      mg_http_serve_file(c, hm, path, &opts);
-    }
-
-    // --- ROUTE 7B : Afficher une couverture image ---
-    else if (uri_eq(hm, "/api/couverture")) {
-      char fichier[256];
-      if (mg_http_get_var(&hm->query, "fichier", fichier, sizeof(fichier)) > 0) {
-        const char *base = basename_of(fichier);
-        if (!is_safe_filename(base)) {
-          mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
-          return;
-        }
+// --- ROUTE 9 : Upload PDF ---
+static void route_upload(struct mg_connection *c, struct mg_http_message *hm) {
+  // Upload brut: /api/upload?file=nom.pdf&offset=0
+  mg_http_upload(c, hm, &mg_fs_posix, s_books_dir, UPLOAD_PDF_MAX);
+  invalider_upload(hm, s_books_dir, &s_inventaire_pdfs);
+}
 
-        char path[512];
-        snprintf(path, sizeof(path), "%s/%s", s_covers_dir, base);
-        struct mg_http_serve_opts opts = {
-            .mime_types = "jpg=image/jpeg,jpeg=image/jpeg,png=image/png,webp=image/webp,gif=image/gif"
-        };
-        mg_http_serve_file(c, hm, path, &opts);
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre fichier manquant\"}\n");
-      }
-    }
+// --- ROUTE 9B : Upload couverture image ---
+static void route_upload_couverture(struct mg_connection *c, struct mg_http_message *hm) {
+  // Upload brut: /api/upload_couverture?file=nom.jpg&offset=0
+  mg_http_upload(c, hm, &mg_fs_posix, s_covers_dir, UPLOAD_COUVERTURE_MAX);
+  invalider_upload(hm, s_covers_dir, NULL);
+}
 
-    // --- ROUTE 8 : Liste des PDFs ---
-    else if (uri_eq(hm, "/api/pdfs")) {
-      char *json = pdfs_to_json(s_books_dir);
-      if (json != NULL) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
-        free(json);
-      } else {
-        mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
-      }
-    }
+// --- ROUTE 9 : Sauvegarder ---
+static void route_sauvegarder(Travail *t) {
+  if (sauvegarder_catalogue()) {
+    travail_repondre(t, 200, "", "{\"status\": \"sauvegarde\"}\n");
+  } else {
+    travail_repondre(t, 500, "", "{\"error\": \"Sauvegarde impossible\"}\n");
+  }
+}
 
-    // --- ROUTE 9 : Upload PDF ---
-    else if (uri_eq(hm, "/api/upload")) {
-      // Upload brut: /api/upload?file=nom.pdf&offset=0
-      mg_http_upload(c, hm, &mg_fs_posix, s_books_dir, 50 * 1024 * 1024);
-    }
+// --- ROUTE 10 : Recharger ---
+static void route_recharger(Travail *t) {
+  /* Le fichier ne doit pas changer entre la lecture des deux copies, et
+     une ecriture deja appliquee au catalogue doit y etre sauvegardee */
+  long pause_ns = 0;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  Bool ok = catalogue_charger(&s_catalogue, s_data_file, s_journal_file, &pause_ns);
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  if (ok) recompter_references();
+  if (ok) annoncer("{\"type\": \"recharge\"}");
+  LectureCatalogue lecture;
+  unsigned long nb = (unsigned long) biblio_count(catalogue_lire_debut(&s_catalogue, &lecture));
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (ok) {
+    travail_repondre(t, 200, "Content-Type: application/json\r\n",
+                     "{ \"status\": \"recharge\", \"count\": %lu, \"pause_us\": %ld }\n",
+                     nb, pause_ns / 1000);
+  } else {
+    travail_repondre(t, 404, "", "{\"error\": \"Fichier introuvable\"}\n");
+  }
+}
 
-    // --- ROUTE 9B : Upload couverture image ---
-    else if (uri_eq(hm, "/api/upload_couverture")) {
-      // Upload brut: /api/upload_couverture?file=nom.jpg&offset=0
-      mg_http_upload(c, hm, &mg_fs_posix, s_covers_dir, 10 * 1024 * 1024);
-    }
+// --- ROUTE 11 : Emprunter ---
+typedef struct RequeteEmprunt {
+  char titre[512];
+  char email[128];
+  int id;
+  char link[512];
+  char couverture[512];
+  Bool reserve;
+} RequeteEmprunt;
+
+static const ChampParam s_schema_emprunt[] = {
+    CHAMP_TEXTE(RequeteEmprunt, titre, "titre", NULL, 0),
+    CHAMP_TEXTE(RequeteEmprunt, email, "email", NULL, 0),
+    CHAMP_ENTIER(RequeteEmprunt, id, "id", 0),
+    CHAMP_TEXTE(RequeteEmprunt, link, "link", NULL, 0),
+    CHAMP_TEXTE(RequeteEmprunt, couverture, "couverture", NULL, 0),
+    CHAMP_BOOL(RequeteEmprunt, reserve, "reserve", NULL, 0),
+};
+
+typedef struct Emprunt {
+  int id;                 // 0 : recherche par titre
+  const char *titre;
+  int id_livre;
+  char titre_livre[sizeof(((Livre *) 0)->titre)];
+  Bool compte;            // evenement deja publie
+} Emprunt;
+
+/* 0 : livre absent, -1 : deja emprunte, 1 : emprunte (id et titre copies
+   pour l'historique). */
+static int op_emprunter(Bibliotheque *bibli, void *arg) {
+  Emprunt *e = (Emprunt *) arg;
+  Livre *l = biblio_find_by_id(bibli, e->id_livre);
+  if (l == NULL) return 0;
+  if (l->est_emprunte) return -1;
+  biblio_marquer_emprunte(bibli, l, VRAI);
+  memcpy(e->titre_livre, l->titre, sizeof(e->titre_livre));
+  if (premiere_application(&e->compte)) annoncer_etat(l->id, VRAI);
+  return 1;
+}
 
-    // --- ROUTE 9 : Sauvegarder ---
-    else if (uri_eq(hm, "/api/sauvegarder")) {
-      if (fichiers_sauvegarder(&ma_biblio, s_data_file)) {
-        mg_http_reply(c, 200, "", "{\"status\": \"sauvegarde\"}\n");
-      } else {
-        mg_http_reply(c, 500, "", "{\"error\": \"Sauvegarde impossible\"}\n");
-      }
-    }
+/* Un seul des emprunteurs concurrents d'un meme livre gagne le passage
+   DISPONIBLE -> EMPRUNTE ; les autres repartent sans toucher a l'ecrivain
+   ni aux fichiers. Le gagnant applique et sauvegarde l'emprunt sous le
+   verrou des fichiers, puis refixe le mot : un rechargement passe entre le
+   CAS et l'ecriture a pu le recalculer. Memes retours que op_emprunter. */
+static int emprunter_livre(Emprunt *e) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Livre *l = (e->id != 0) ? biblio_find_by_id(bibli, e->id) : biblio_search_etat(bibli, e->titre, FAUX);
+  e->id_livre = (l != NULL) ? l->id : 0;
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (e->id_livre == 0) return 0;
+  if (!catalogue_transition(&s_catalogue, e->id_livre, LIVRE_DISPONIBLE, LIVRE_EMPRUNTE)) return -1;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  int etat = catalogue_ecrire(&s_catalogue, op_emprunter, e);
+  if (etat == 0) catalogue_fixer_etat(&s_catalogue, e->id_livre, LIVRE_DISPONIBLE);  // supprime entre-temps
+  if (etat > 0) {
+    catalogue_fixer_etat(&s_catalogue, e->id_livre, LIVRE_EMPRUNTE);
+    sauvegarder_sous_verrou();
+  }
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  return etat;
+}
 
-    // --- ROUTE 10 : Recharger ---
-    else if (uri_eq(hm, "/api/recharger")) {
-      biblio_free(&ma_biblio);
-      biblio_init(&ma_biblio);
-      if (fichiers_charger(&ma_biblio, s_data_file)) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n",
-                      "{ \"status\": \"recharge\", \"count\": %zu }\n", biblio_count(&ma_biblio));
+static void route_emprunter(Travail *t) {
+  RequeteEmprunt req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_emprunt, NB_CHAMPS(s_schema_emprunt), &req, NULL)) return;
+  const char *titre = req.titre;
+  const char *email = req.email;
+  const char *link = req.link;
+  const char *cover_s = req.couverture;
+
+  int id_val = req.id;
+  int used_id = (id_val != 0);
+
+  if (used_id) {
+    if (email[0] == '\0') {
+      travail_repondre(t, 400, "", "{\"error\": \"email manquant\"}\n");
+    } else {
+      Emprunt e = { .id = id_val };
+      int etat = emprunter_livre(&e);
+      if (etat == 0) {
+        travail_repondre(t, 404, "", "{\"error\": \"Livre introuvable\"}\n");
+      } else if (etat < 0) {
+        travail_repondre(t, 400, "", "{\"error\": \"Indisponible\"}\n");
       } else {
-        mg_http_reply(c, 404, "", "{\"error\": \"Fichier introuvable\"}\n");
+        pthread_mutex_lock(&s_verrou_fichiers);
+        FILE *fe = fopen("data/emprunts.dat", "a");
+        if (fe) {
+          time_t now = time(NULL);
+          fprintf(fe, "%s|%d|%s|%ld|%s\n", email, e.id_livre, e.titre_livre, (long) now, "");
+          fclose(fe);
+        }
+        pthread_mutex_unlock(&s_verrou_fichiers);
+        travail_repondre(t, 200, "", "{\"status\": \"emprunte\", \"id\": %d}\n", id_val);
       }
     }
-
-    // --- ROUTE 11 : Emprunter ---
-    else if (uri_eq(hm, "/api/emprunter")) {
-      char titre[512];
-      char email[128] = "";
-      char id_s[32] = "";
-      char link[512] = "";
-      char cover_s[512] = "";
-      char reserve_s[8] = "";
-      mg_http_get_var(&hm->query, "email", email, sizeof(email));
-      mg_http_get_var(&hm->query, "id", id_s, sizeof(id_s));
-      mg_http_get_var(&hm->query, "link", link, sizeof(link));
-      mg_http_get_var(&hm->query, "couverture", cover_s, sizeof(cover_s));
-      mg_http_get_var(&hm->query, "reserve", reserve_s, sizeof(reserve_s));
-
-      int used_id = 0;
-      int id_val = 0;
-      if (id_s[0] != '\0') { id_val = atoi(id_s); if (id_val != 0) used_id = 1; }
-
-      if (used_id) {
-        if (email[0] == '\0') {
-          mg_http_reply(c, 400, "", "{\"error\": \"email manquant\"}\n");
-        } else {
-          Livre *l = biblio_find_by_id(&ma_biblio, id_val);
-          if (l == NULL) {
-            mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
-          } else if (l->est_emprunte) {
-            mg_http_reply(c, 400, "", "{\"error\": \"Indisponible\"}\n");
+  } else {
+    if (titre[0] != '\0') {
+      if (email[0] == '\0') {
+        travail_repondre(t, 400, "", "{\"error\": \"email manquant\"}\n");
+      } else {
+        /* essayer d'emprunter localement sans appeler biblio_emprunter() (évite logs inutiles)
+           On recherche le livre localement et on met à jour son état si disponible. */
+        Emprunt e = { .titre = titre };
+        int etat = emprunter_livre(&e);
+        if (etat != 0) {
+          if (etat < 0) {
+            travail_repondre(t, 400, "", "{\"error\": \"Indisponible\"}\n");
           } else {
-            l->est_emprunte = VRAI;
-            fichiers_sauvegarder(&ma_biblio, s_data_file);
+            pthread_mutex_lock(&s_verrou_fichiers);
             FILE *fe = fopen("data/emprunts.dat", "a");
             if (fe) {
               time_t now = time(NULL);
-              fprintf(fe, "%s|%d|%s|%ld|%s\n", email, l->id, l->titre, (long) now, "");
+              fprintf(fe, "%s|%d|%s|%ld|%s|%s\n", email, e.id_livre, e.titre_livre, (long) now, "", "");
               fclose(fe);
             }
-            mg_http_reply(c, 200, "", "{\"status\": \"emprunte\", \"id\": %d}\n", l->id);
-          }
-        }
-      } else {
-        if (mg_http_get_var(&hm->query, "titre", titre, sizeof(titre)) > 0) {
-          if (email[0] == '\0') {
-            mg_http_reply(c, 400, "", "{\"error\": \"email manquant\"}\n");
-          } else {
-            /* essayer d'emprunter localement sans appeler biblio_emprunter() (évite logs inutiles)
-               On recherche le livre localement et on met à jour son état si disponible. */
-            Livre *l = biblio_search(&ma_biblio, titre);
-            if (l != NULL) {
-              if (l->est_emprunte) {
-                mg_http_reply(c, 400, "", "{\"error\": \"Indisponible\"}\n");
-              } else {
-                l->est_emprunte = VRAI;
-                fichiers_sauvegarder(&ma_biblio, s_data_file);
-                FILE *fe = fopen("data/emprunts.dat", "a");
-                if (fe) {
-                  time_t now = time(NULL);
-                  fprintf(fe, "%s|%d|%s|%ld|%s|%s\n", email, l->id, l->titre, (long) now, "", "");
-                  fclose(fe);
-                }
-                mg_http_reply(c, 200, "", "{\"status\": \"emprunte\"}\n");
-              }
-            } else {
-              /* si demande explicite de reservation ou lien fourni, enregistrer la réservation */
-              int want_reserve = (reserve_s[0] != '\0' && strcmp(reserve_s, "1") == 0) || (link[0] != '\0');
-              if (want_reserve) {
-                FILE *fe = fopen("data/emprunts.dat", "a");
-                if (fe) {
-                  time_t now = time(NULL);
-                  /* id 0 pour emprunt externe ou non-local */
-                  fprintf(fe, "%s|%d|%s|%ld|%s|%s\n", email, 0, titre, (long) now, link, cover_s);
-                  fclose(fe);
-                }
-                mg_http_reply(c, 200, "", "{\"status\": \"reserve\"}\n");
-              } else {
-                mg_http_reply(c, 400, "", "{\"error\": \"Indisponible\"}\n");
-              }
-            }
+            pthread_mutex_unlock(&s_verrou_fichiers);
+            travail_repondre(t, 200, "", "{\"status\": \"emprunte\"}\n");
           }
         } else {
-          mg_http_reply(c, 400, "", "{\"error\": \"titre ou id manquant\"}\n");
-        }
-      }
-    }
-
-    // --- ROUTE 12 : Retourner ---
-    else if (uri_eq(hm, "/api/retourner")) {
-      char titre[128];
-      char email[128] = "";
-      mg_http_get_var(&hm->query, "email", email, sizeof(email));
-      if (mg_http_get_var(&hm->query, "titre", titre, sizeof(titre)) > 0) {
-        biblio_retour(&ma_biblio, titre);
-        fichiers_sauvegarder(&ma_biblio, s_data_file);
-        /* supprimer l'emprunt correspondant dans data/emprunts.dat */
-        if (email[0] != '\0') {
-          FILE *fin = fopen("data/emprunts.dat", "r");
-          FILE *fout = fopen("data/emprunts.tmp", "w");
-          if (fin && fout) {
-            char line[512];
-            while (fgets(line, sizeof(line), fin)) {
-              char copy[512];
-              strncpy(copy, line, sizeof(copy)-1);
-              copy[sizeof(copy)-1] = '\0';
-              copy[strcspn(copy, "\r\n")] = '\0';
-              char le[128]; int id; char lt[256]; long ts;
-              if (sscanf(copy, "%127[^|]|%d|%255[^|]|%ld", le, &id, lt, &ts) == 4) {
-                if (!(strcmp(le, email) == 0 && strcmp(lt, titre) == 0)) {
-                  fprintf(fout, "%s\n", copy);
-                }
-              }
-            }
-            fclose(fin); fclose(fout);
-            remove("data/emprunts.dat");
-            rename("data/emprunts.tmp", "data/emprunts.dat");
-          } else {
-            if (fin) {
-              fclose(fin);
-            }
-            if (fout) {
-              fclose(fout);
-            }
-          }
-        }
-        mg_http_reply(c, 200, "", "{\"status\": \"retourne\"}\n");
-      }
-    }
-
-    // --- ROUTE 13 : Lister emprunts d'un utilisateur ---
-    else if (uri_eq(hm, "/api/emprunts")) {
-      char email[128] = "";
-      mg_http_get_var(&hm->query, "email", email, sizeof(email));
-      if (email[0] == '\0') {
-        mg_http_reply(c, 400, "", "{\"error\": \"email manquant\"}\n");
-        return;
-      }
-      FILE *fe = fopen("data/emprunts.dat", "r");
-      if (!fe) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "[]\n");
-        return;
-      }
-      size_t cap = 1024; size_t len = 0;
-      char *json = malloc(cap);
-      if (!json) { fclose(fe); mg_http_reply(c, 500, "", "{\"error\":\"mem\"}\n"); return; }
-      json[0] = '\0';
-      if (!json_append(&json, &cap, &len, "[\n")) { fclose(fe); free(json); mg_http_reply(c,500,"","{\"error\":\"mem\"}\n"); return; }
-      int first = 1;
-      char line[8192];
-      while (fgets(line, sizeof(line), fe)) {
-        /* strip newline */
-        line[strcspn(line, "\r\n")] = '\0';
-        char *saveptr = NULL;
-        char *tok = NULL;
-        char le[512] = "", id_s[64] = "", lt[2048] = "", ts_s[64] = "", link[2048] = "", cover[2048] = "";
-        tok = strtok_r(line, "|", &saveptr); if (tok) strncpy(le, tok, sizeof(le)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(id_s, tok, sizeof(id_s)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(lt, tok, sizeof(lt)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(ts_s, tok, sizeof(ts_s)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(link, tok, sizeof(link)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(cover, tok, sizeof(cover)-1);
-        if (strcmp(le, email) == 0) {
-          int id_val = atoi(id_s);
-          if (id_val > 0) {
-            Livre *lv = biblio_find_by_id(&ma_biblio, id_val);
-            if (lv) {
-              if (!first) json_append(&json, &cap, &len, ",\n");
-              json_append(&json, &cap, &len, "  { ");
-              char num[64]; snprintf(num, sizeof(num), "\"id\": %d, ", lv->id); json_append(&json, &cap, &len, num);
-              json_append(&json, &cap, &len, "\"titre\": \""); json_append_escaped(&json,&cap,&len,lv->titre); json_append(&json,&cap,&len,"\", ");
-              json_append(&json, &cap, &len, "\"auteur\": \""); json_append_escaped(&json,&cap,&len,lv->auteur); json_append(&json,&cap,&len,"\", ");
-              char ann[64]; snprintf(ann,sizeof(ann),"\"annee\": %d, ", lv->annee); json_append(&json,&cap,&len,ann);
-              json_append(&json,&cap,&len,"\"categorie\": \""); json_append_escaped(&json,&cap,&len,lv->categorie); json_append(&json,&cap,&len,"\", ");
-              json_append(&json,&cap,&len,"\"fichier\": \""); json_append_escaped(&json,&cap,&len,lv->fichier); json_append(&json,&cap,&len,"\", ");
-              json_append(&json,&cap,&len,"\"est_emprunte\": "); json_append(&json,&cap,&len, lv->est_emprunte?"true":"false"); json_append(&json,&cap,&len,", ");
-              json_append(&json,&cap,&len,"\"description\": \""); json_append_escaped(&json,&cap,&len,lv->description); json_append(&json,&cap,&len,"\", ");
-              json_append(&json,&cap,&len,"\"couverture\": \""); json_append_escaped(&json,&cap,&len,lv->couverture); json_append(&json,&cap,&len,"\" }");
-              first = 0;
+          /* si demande explicite de reservation ou lien fourni, enregistrer la réservation */
+          int want_reserve = req.reserve || (link[0] != '\0');
+          if (want_reserve) {
+            pthread_mutex_lock(&s_verrou_fichiers);
+            FILE *fe = fopen("data/emprunts.dat", "a");
+            if (fe) {
+              time_t now = time(NULL);
+              /* id 0 pour emprunt externe ou non-local */
+              fprintf(fe, "%s|%d|%s|%ld|%s|%s\n", email, 0, titre, (long) now, link, cover_s);
+              fclose(fe);
+              annoncer("{\"type\": \"reservation\", \"titre\": %m, \"lien\": %m}", MG_ESC(titre), MG_ESC(link));
             }
+            pthread_mutex_unlock(&s_verrou_fichiers);
+            travail_repondre(t, 200, "", "{\"status\": \"reserve\"}\n");
           } else {
-            const char *safe_link = link[0] ? link : "";
-            const char *safe_cover = cover[0] ? cover : "";
-            const char *cover_to_use = "/icon/reading_education_knowledge_learning_library_book_icon_256746.png";
-            if (safe_cover[0] != '\0') cover_to_use = safe_cover;
-            else if (safe_link[0] != '\0') {
-              if (ends_with_ci(safe_link, ".jpg") || ends_with_ci(safe_link, ".jpeg") || ends_with_ci(safe_link, ".png") || ends_with_ci(safe_link, ".webp") || ends_with_ci(safe_link, ".gif")) {
-                cover_to_use = safe_link;
-              }
-            }
-            if (!first) json_append(&json, &cap, &len, ",\n");
-            json_append(&json, &cap, &len, "  { \"id\": 0, \"titre\": \""); json_append_escaped(&json,&cap,&len,lt);
-            json_append(&json,&cap,&len,"\", \"auteur\": \"\", \"annee\": 0, \"categorie\": \"\", \"fichier\": \""); json_append_escaped(&json,&cap,&len,safe_link);
-            json_append(&json,&cap,&len,"\", \"est_emprunte\": false, \"description\": \"\", \"couverture\": \""); json_append_escaped(&json,&cap,&len,cover_to_use); json_append(&json,&cap,&len,"\" }");
-            first = 0;
+            travail_repondre(t, 400, "", "{\"error\": \"Indisponible\"}\n");
           }
         }
       }
-      fclose(fe);
-      json_append(&json, &cap, &len, "\n]");
-      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
-      free(json);
+    } else {
+      travail_repondre(t, 400, "", "{\"error\": \"titre ou id manquant\"}\n");
     }
+  }
+}
 
-    // --- ROUTE 14 : Lister tous les emprunts (admin) ---
-    else if (uri_eq(hm, "/api/emprunts_all")) {
-      FILE *fe = fopen("data/emprunts.dat", "r");
-      if (!fe) {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "[]\n");
-        return;
-      }
-      size_t cap = 1024; size_t len = 0;
-      char *json = malloc(cap);
-      if (!json) { fclose(fe); mg_http_reply(c, 500, "", "{\"error\":\"mem\"}\n"); return; }
-      json[0] = '\0';
-      if (!json_append(&json, &cap, &len, "[\n")) { fclose(fe); free(json); mg_http_reply(c,500,"","{\"error\":\"mem\"}\n"); return; }
-      int first = 1;
-      char line[8192];
-      while (fgets(line, sizeof(line), fe)) {
-        line[strcspn(line, "\r\n")] = '\0';
-        char *saveptr = NULL; char *tok = NULL;
-        char le[512] = "", id_s[64] = "", lt[2048] = "", ts_s[64] = "", link[2048] = "", cover[2048] = "";
-        tok = strtok_r(line, "|", &saveptr); if (tok) strncpy(le, tok, sizeof(le)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(id_s, tok, sizeof(id_s)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(lt, tok, sizeof(lt)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(ts_s, tok, sizeof(ts_s)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(link, tok, sizeof(link)-1);
-        tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(cover, tok, sizeof(cover)-1);
-        long ts = atol(ts_s);
-        if (!first) json_append(&json, &cap, &len, ",\n");
-        json_append(&json, &cap, &len, "  { \"email\": \""); json_append_escaped(&json,&cap,&len,le); json_append(&json,&cap,&len,"\", ");
-        char idnum[64]; snprintf(idnum,sizeof(idnum),"\"id\": %d, ", atoi(id_s)); json_append(&json,&cap,&len,idnum);
-        json_append(&json,&cap,&len,"\"titre\": \""); json_append_escaped(&json,&cap,&len,lt); json_append(&json,&cap,&len,"\", ");
-        char tss[64]; snprintf(tss,sizeof(tss),"\"ts\": %ld, ", ts); json_append(&json,&cap,&len,tss);
-        json_append(&json,&cap,&len,"\"link\": \""); json_append_escaped(&json,&cap,&len,link); json_append(&json,&cap,&len,"\", ");
-        json_append(&json,&cap,&len,"\"cover\": \""); json_append_escaped(&json,&cap,&len,cover); json_append(&json,&cap,&len,"\" }");
-        first = 0;
-      }
-      fclose(fe);
-      json_append(&json, &cap, &len, "\n]");
-      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
-      free(json);
-    }
+// --- ROUTE 12 : Retourner ---
+static const ChampParam s_schema_retour[] = {
+    CHAMP_TEXTE(RequeteEmprunt, titre, "titre", NULL, 0),
+    CHAMP_TEXTE(RequeteEmprunt, email, "email", NULL, 0),
+    CHAMP_ENTIER(RequeteEmprunt, id, "id", 0),
+};
+
+typedef struct Retour {
+  int id;                 // 0 : recherche par titre
+  const char *titre;
+  int id_livre;
+  char titre_livre[sizeof(((Livre *) 0)->titre)];
+  Bool compte;            // evenement deja publie
+} Retour;
+
+// Comme op_emprunter : le livre gagne par le CAS, retrouve par son id
+static int op_retourner(Bibliotheque *bibli, void *arg) {
+  Retour *r = (Retour *) arg;
+  Livre *l = biblio_find_by_id(bibli, r->id_livre);
+  if (l == NULL || !l->est_emprunte) return 0;
+  biblio_marquer_emprunte(bibli, l, FAUX);
+  memcpy(r->titre_livre, l->titre, sizeof(r->titre_livre));
+  if (premiere_application(&r->compte)) annoncer_etat(l->id, FAUX);
+  return 1;
+}
 
-    // --- ROUTE X : Page HTML pour lire un PDF ---
-    else if (uri_eq(hm, "/lire")) {
-      char titre[128], fichier[256], enc[512];
-      const char *filename = NULL;
+/* EMPRUNTE -> EN_RETOUR par CAS, retour applique aux copies et sauvegarde
+   sous le verrou des fichiers, puis DISPONIBLE. Par titre, un exemplaire
+   emprunte est prefere aux autres livres du meme titre. FAUX si le livre
+   est absent ou deja rendu. */
+static Bool retourner_livre(Retour *r) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Livre *l = (r->id != 0) ? biblio_find_by_id(bibli, r->id) : biblio_search_etat(bibli, r->titre, VRAI);
+  r->id_livre = (l != NULL) ? l->id : 0;
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (r->id_livre == 0 || !catalogue_transition(&s_catalogue, r->id_livre, LIVRE_EMPRUNTE, LIVRE_EN_RETOUR))
+    return FAUX;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  Bool ok = catalogue_ecrire(&s_catalogue, op_retourner, r) ? VRAI : FAUX;
+  catalogue_fixer_etat(&s_catalogue, r->id_livre, LIVRE_DISPONIBLE);
+  if (ok) sauvegarder_sous_verrou();
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  return ok;
+}
 
-      if (mg_http_get_var(&hm->query, "titre", titre, sizeof(titre)) > 0) {
-        Livre *l = biblio_search(&ma_biblio, titre);
-        if (l == NULL) {
-          mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
-          return;
+/* Retire de data/emprunts.dat les lignes (email, titre) donnees, en une
+   seule reecriture du fichier. Renvoie le nombre de lignes retirees. */
+static size_t retirer_emprunts(const char *const *emails, const char *const *titres, size_t nb) {
+  size_t retirees = 0;
+  if (nb == 0) return 0;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  FILE *fin = fopen("data/emprunts.dat", "r");
+  FILE *fout = fopen("data/emprunts.tmp", "w");
+  if (fin && fout) {
+    char line[512];
+    while (fgets(line, sizeof(line), fin)) {
+      char copy[512];
+      strncpy(copy, line, sizeof(copy)-1);
+      copy[sizeof(copy)-1] = '\0';
+      copy[strcspn(copy, "\r\n")] = '\0';
+      char le[128]; int id; char lt[256]; long ts;
+      if (sscanf(copy, "%127[^|]|%d|%255[^|]|%ld", le, &id, lt, &ts) == 4) {
+        Bool retire = FAUX;
+        for (size_t i = 0; i < nb && !retire; i++) {
+          retire = strcmp(le, emails[i]) == 0 && strcmp(lt, titres[i]) == 0;
+        }
+        if (!retire) {
+          fprintf(fout, "%s\n", copy);
+        } else {
+          retirees++;
         }
-        filename = l->fichier;
-      } else if (mg_http_get_var(&hm->query, "fichier", fichier, sizeof(fichier)) > 0) {
-        filename = fichier;
-      } else {
-        mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre ou fichier manquant\"}\n");
-        return;
-      }
-
-      const char *base = basename_of(filename);
-      if (!is_safe_filename(base)) {
-        mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
-        return;
       }
-
-      /* Encoder le nom de fichier pour l'utiliser côté client si nécessaire */
-      mg_url_encode(filename, strlen(filename), enc, sizeof(enc));
-      enc[sizeof(enc) - 1] = '\0';
-
-      /* Répondre avec le chemin encodé (client gère l'affichage) */
-      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"fichier\": \"%s\"}\n", enc);
     }
-
-    /* --- ROUTE PAR DÉFAUT : Serveur de fichiers (Frontend) --- */
-    else {
-      struct mg_http_serve_opts opts = {.root_dir = s_root_dir};
-      mg_http_serve_dir(c, hm, &opts);
+    fclose(fin); fclose(fout);
+    remove("data/emprunts.dat");
+    rename("data/emprunts.tmp", "data/emprunts.dat");
+  } else {
+    if (fin) {
+      fclose(fin);
+    }
+    if (fout) {
+      fclose(fout);
     }
   }
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  return retirees;
 }
 
-static void signal_handler(int sig) {
-  s_signo = sig;
+static void route_retourner(Travail *t) {
+  RequeteEmprunt req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_retour, NB_CHAMPS(s_schema_retour), &req, NULL)) return;
+  if (req.id == 0 && req.titre[0] == '\0') {
+    travail_repondre(t, 400, "", "{\"error\": \"titre ou id manquant\"}\n");
+    return;
+  }
+  Retour r = { .id = req.id, .titre = req.titre };
+  Bool local = retourner_livre(&r);
+  const char *titre = local ? r.titre_livre : req.titre;
+  const char *email = req.email;
+  /* supprimer l'emprunt correspondant dans data/emprunts.dat */
+  size_t retirees = email[0] != '\0' ? retirer_emprunts(&email, &titre, 1) : 0;
+  if (!local && retirees > 0) annoncer("{\"type\": \"fin_reservation\", \"titre\": %m}", MG_ESC(titre));
+  travail_repondre(t, 200, "", "{\"status\": \"retourne\"}\n");
 }
 
-int main(void) {
-  struct mg_mgr mgr; 
-  
-  biblio_init(&ma_biblio);
+// --- ROUTE 13 : Lister emprunts d'un utilisateur ---
+static const ChampParam s_schema_email[] = {
+    CHAMP_TEXTE(RequeteEmprunt, email, "email", NULL, PARAM_OBLIGATOIRE),
+};
+
+static void route_emprunts(Travail *t) {
+  RequeteEmprunt req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_travail(t, s_schema_email, NB_CHAMPS(s_schema_email), &req, NULL)) return;
+  const char *email = req.email;
+  pthread_mutex_lock(&s_verrou_fichiers);
+  FILE *fe = fopen("data/emprunts.dat", "r");
+  if (!fe) {
+    pthread_mutex_unlock(&s_verrou_fichiers);
+    travail_repondre(t, 200, "Content-Type: application/json\r\n", "[]\n");
+    return;
+  }
+  size_t cap = 1024; size_t len = 0;
+  char *json = malloc(cap);
+  if (!json || !json_append(&json, &cap, &len, "[\n")) {
+    fclose(fe); free(json); pthread_mutex_unlock(&s_verrou_fichiers);
+    travail_repondre(t, 500, "", "{\"error\":\"mem\"}\n");
+    return;
+  }
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  int first = 1;
+  char line[8192];
+  while (fgets(line, sizeof(line), fe)) {
+    /* strip newline */
+    line[strcspn(line, "\r\n")] = '\0';
+    char *saveptr = NULL;
+    char *tok = NULL;
+    char le[512] = "", id_s[64] = "", lt[2048] = "", ts_s[64] = "", link[2048] = "", cover[2048] = "";
+    tok = strtok_r(line, "|", &saveptr); if (tok) strncpy(le, tok, sizeof(le)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(id_s, tok, sizeof(id_s)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(lt, tok, sizeof(lt)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(ts_s, tok, sizeof(ts_s)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(link, tok, sizeof(link)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(cover, tok, sizeof(cover)-1);
+    if (strcmp(le, email) == 0) {
+      int id_val = atoi(id_s);
+      if (id_val > 0) {
+        Livre *lv = biblio_find_by_id(bibli, id_val);
+        if (lv) {
+          if (!first) json_append(&json, &cap, &len, ",\n");
+          json_append(&json, &cap, &len, "  { ");
+          char num[64]; snprintf(num, sizeof(num), "\"id\": %d, ", lv->id); json_append(&json, &cap, &len, num);
+          json_append(&json, &cap, &len, "\"titre\": \""); json_append_escaped(&json,&cap,&len,lv->titre); json_append(&json,&cap,&len,"\", ");
+          json_append(&json, &cap, &len, "\"auteur\": \""); json_append_escaped(&json,&cap,&len,lv->auteur); json_append(&json,&cap,&len,"\", ");
+          char ann[64]; snprintf(ann,sizeof(ann),"\"annee\": %d, ", lv->annee); json_append(&json,&cap,&len,ann);
+          json_append(&json,&cap,&len,"\"categorie\": \""); json_append_escaped(&json,&cap,&len,lv->categorie); json_append(&json,&cap,&len,"\", ");
+          json_append(&json,&cap,&len,"\"fichier\": \""); json_append_escaped(&json,&cap,&len,lv->fichier); json_append(&json,&cap,&len,"\", ");
+          json_append(&json,&cap,&len,"\"est_emprunte\": "); json_append(&json,&cap,&len, lv->est_emprunte?"true":"false"); json_append(&json,&cap,&len,", ");
+          json_append(&json,&cap,&len,"\"description\": \""); json_append_escaped(&json,&cap,&len,lv->description); json_append(&json,&cap,&len,"\", ");
+          json_append(&json,&cap,&len,"\"couverture\": \""); json_append_escaped(&json,&cap,&len,lv->couverture); json_append(&json,&cap,&len,"\" }");
+          first = 0;
+        }
+      } else {
+        const char *safe_link = link[0] ? link : "";
+        const char *safe_cover = cover[0] ? cover : "";
+        const char *cover_to_use = "/icon/reading_education_knowledge_learning_library_book_icon_256746.png";
+        if (safe_cover[0] != '\0') cover_to_use = safe_cover;
+        else if (safe_link[0] != '\0') {
+          if (ends_with_ci(safe_link, ".jpg") || ends_with_ci(safe_link, ".jpeg") || ends_with_ci(safe_link, ".png") || ends_with_ci(safe_link, ".webp") || ends_with_ci(safe_link, ".gif")) {
+            cover_to_use = safe_link;
+          }
+        }
+        if (!first) json_append(&json, &cap, &len, ",\n");
+        json_append(&json, &cap, &len, "  { \"id\": 0, \"titre\": \""); json_append_escaped(&json,&cap,&len,lt);
+        json_append(&json,&cap,&len,"\", \"auteur\": \"\", \"annee\": 0, \"categorie\": \"\", \"fichier\": \""); json_append_escaped(&json,&cap,&len,safe_link);
+        json_append(&json,&cap,&len,"\", \"est_emprunte\": false, \"description\": \"\", \"couverture\": \""); json_append_escaped(&json,&cap,&len,cover_to_use); json_append(&json,&cap,&len,"\" }");
+        first = 0;
+      }
+    }
+  }
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  fclose(fe);
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  json_append(&json, &cap, &len, "\n]\n");
+  travail_repondre_corps(t, 200, "Content-Type: application/json\r\n", json, len);
+}
+
+// --- ROUTE 14 : Lister tous les emprunts (admin) ---
+static void route_emprunts_all(Travail *t) {
+  pthread_mutex_lock(&s_verrou_fichiers);
+  FILE *fe = fopen("data/emprunts.dat", "r");
+  if (!fe) {
+    pthread_mutex_unlock(&s_verrou_fichiers);
+    travail_repondre(t, 200, "Content-Type: application/json\r\n", "[]\n");
+    return;
+  }
+  size_t cap = 1024; size_t len = 0;
+  char *json = malloc(cap);
+  if (!json || !json_append(&json, &cap, &len, "[\n")) {
+    fclose(fe); free(json); pthread_mutex_unlock(&s_verrou_fichiers);
+    travail_repondre(t, 500, "", "{\"error\":\"mem\"}\n");
+    return;
+  }
+  int first = 1;
+  char line[8192];
+  while (fgets(line, sizeof(line), fe)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *saveptr = NULL; char *tok = NULL;
+    char le[512] = "", id_s[64] = "", lt[2048] = "", ts_s[64] = "", link[2048] = "", cover[2048] = "";
+    tok = strtok_r(line, "|", &saveptr); if (tok) strncpy(le, tok, sizeof(le)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(id_s, tok, sizeof(id_s)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(lt, tok, sizeof(lt)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(ts_s, tok, sizeof(ts_s)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(link, tok, sizeof(link)-1);
+    tok = strtok_r(NULL, "|", &saveptr); if (tok) strncpy(cover, tok, sizeof(cover)-1);
+    long ts = atol(ts_s);
+    if (!first) json_append(&json, &cap, &len, ",\n");
+    json_append(&json, &cap, &len, "  { \"email\": \""); json_append_escaped(&json,&cap,&len,le); json_append(&json,&cap,&len,"\", ");
+    char idnum[64]; snprintf(idnum,sizeof(idnum),"\"id\": %d, ", atoi(id_s)); json_append(&json,&cap,&len,idnum);
+    json_append(&json,&cap,&len,"\"titre\": \""); json_append_escaped(&json,&cap,&len,lt); json_append(&json,&cap,&len,"\", ");
+    char tss[64]; snprintf(tss,sizeof(tss),"\"ts\": %ld, ", ts); json_append(&json,&cap,&len,tss);
+    json_append(&json,&cap,&len,"\"link\": \""); json_append_escaped(&json,&cap,&len,link); json_append(&json,&cap,&len,"\", ");
+    json_append(&json,&cap,&len,"\"cover\": \""); json_append_escaped(&json,&cap,&len,cover); json_append(&json,&cap,&len,"\" }");
+    first = 0;
+  }
+  fclose(fe);
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  json_append(&json, &cap, &len, "\n]\n");
+  travail_repondre_corps(t, 200, "Content-Type: application/json\r\n", json, len);
+}
+
+// --- ROUTE X : Page HTML pour lire un PDF ---
+static void route_lire(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteFichier req;
+  char enc[512];
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_fichier, NB_CHAMPS(s_schema_fichier), &req, NULL)) return;
+  const char *filename = NULL;
+  char fichier_livre[sizeof(((Livre *) 0)->fichier)];
+
+  if (req.titre[0] != '\0') {
+    LectureCatalogue lecture;
+    Livre *l = biblio_search(catalogue_lire_debut(&s_catalogue, &lecture), req.titre);
+    if (l != NULL) memcpy(fichier_livre, l->fichier, sizeof(fichier_livre));
+    catalogue_lire_fin(&s_catalogue, &lecture);
+    if (l == NULL) {
+      mg_http_reply(c, 404, "", "{\"error\": \"Livre introuvable\"}\n");
+      return;
+    }
+    filename = fichier_livre;
+  } else if (req.fichier[0] != '\0') {
+    filename = req.fichier;
+  } else {
+    mg_http_reply(c, 400, "", "{\"error\": \"Parametre titre ou fichier manquant\"}\n");
+    return;
+  }
+
+  const char *base = basename_of(filename);
+  if (!is_safe_filename(base)) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
+    return;
+  }
+
+  /* Encoder le nom de fichier pour l'utiliser côté client si nécessaire */
+  mg_url_encode(filename, strlen(filename), enc, sizeof(enc));
+  enc[sizeof(enc) - 1] = '\0';
+
+  /* Répondre avec le chemin encodé (client gère l'affichage) */
+  mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"fichier\": \"%s\"}\n", enc);
+}
+
+// --- ROUTE PAR DÉFAUT : Serveur de fichiers (Frontend) ---
+static void route_fichiers_statiques(struct mg_connection *c, struct mg_http_message *hm) {
+  if (statiques_servir(&s_statiques, c, hm)) return;
+  struct mg_http_serve_opts opts = {.root_dir = s_root_dir, .fs = s_root_fs};
+  mg_http_serve_dir(c, hm, &opts);
+}
+
+// --- ROUTE 15 : Compteurs par route ---
+static void route_routes(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = routeur_stats_json(&s_routeur);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 16 : Activite du pool de travailleurs ---
+static void route_travailleurs(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = pool_stats_json(&s_pool);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 17 : Repartition des connexions entre boucles ---
+static void route_boucles(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = boucles_stats_json(&s_boucles);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 18 : Cache des descripteurs pdf / couvertures ---
+static void route_cache_fichiers(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = cache_fichiers_stats_json(&s_cache_fichiers);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 19 : Televersement par morceaux ---
+/* POST ?file=&taille=[&sha256=][&type=couverture] ouvre une session et
+   renvoie son id ; les morceaux arrivent en PUT ?id=&morceau=k, dans
+   n'importe quel ordre (televersement.c, hors routeur) ; le fichier est
+   publie dans le depot a la reception du dernier, et la reponse donne son
+   nom de blob ("publie"), a mettre dans le livre. Si sha256 designe un
+   blob deja present, le POST repond ce nom tout de suite, sans session.
+   GET ?id= : morceaux manquants, pour reprendre ; sans id : compteurs.
+   DELETE ?id= : abandon. */
+typedef struct RequeteTeleversement {
+  char id[17];
+  char fichier[128];
+  int taille;
+  char sha256[65];
+  char type[16];
+} RequeteTeleversement;
+
+static const ChampParam s_schema_televersement[] = {
+    CHAMP_TEXTE(RequeteTeleversement, id, "id", NULL, 0),
+    CHAMP_TEXTE(RequeteTeleversement, fichier, "file", "fichier", 0),
+    CHAMP_ENTIER(RequeteTeleversement, taille, "taille", 0),
+    CHAMP_TEXTE(RequeteTeleversement, sha256, "sha256", NULL, 0),
+    CHAMP_TEXTE(RequeteTeleversement, type, "type", NULL, 0),
+};
+
+static void route_televersement(struct mg_connection *c, struct mg_http_message *hm) {
+  if (mg_vcasecmp(&hm->method, "PUT") == 0) {  // sans Content-Length : pas intercepte
+    mg_http_reply(c, 411, "", "{\"error\": \"Content-Length requis\"}\n");
+    return;
+  }
+  Parametres params;
+  RequeteTeleversement req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_televersement, NB_CHAMPS(s_schema_televersement), &req, NULL)) {
+    return;
+  }
+  char *json = NULL;
+  if (mg_vcasecmp(&hm->method, "DELETE") == 0) {
+    if (televersement_annuler(&s_televersements, req.id)) {
+      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"annule\": \"%s\"}\n", req.id);
+    } else {
+      mg_http_reply(c, 404, "", "{\"error\": \"Televersement inconnu\"}\n");
+    }
+    return;
+  }
+  if (mg_vcasecmp(&hm->method, "POST") != 0) {
+    json = req.id[0] != '\0' ? televersement_etat_json(&s_televersements, req.id)
+                             : televersements_stats_json(&s_televersements);
+    if (json != NULL) {
+      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+      free(json);
+    } else {
+      mg_http_reply(c, 404, "", "{\"error\": \"Televersement inconnu\"}\n");
+    }
+    return;
+  }
+
+  Bool couverture = strcmp(req.type, "couverture") == 0;
+  const char *base = basename_of(req.fichier);
+  if (!is_safe_filename(base) || base[0] == '.') {
+    mg_http_reply(c, 400, "", "{\"error\": \"Nom de fichier invalide\"}\n");
+    return;
+  }
+  if (req.taille <= 0 || req.taille > (couverture ? UPLOAD_COUVERTURE_MAX : UPLOAD_PDF_MAX)) {
+    mg_http_reply(c, 413, "", "{\"error\": \"Taille absente ou trop grande\"}\n");
+    return;
+  }
+  Depot *depot = couverture ? &s_depot_couvertures : &s_depot_livres;
+  char extension[DEPOT_EXTENSION + 1], nom[DEPOT_NOM], id[17];
+  depot_extension(base, extension);
+  if (req.sha256[0] != '\0' && depot_trouver(depot, req.sha256, extension, nom)) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n",  // contenu deja la : rien a envoyer
+                  "{\"publie\": \"%s\", \"doublon\": true, \"taille\": %d}\n", nom, req.taille);
+    return;
+  }
+  int code = televersement_ouvrir(&s_televersements, depot, extension, (uint64_t) req.taille,
+                                  req.sha256[0] != '\0' ? req.sha256 : NULL, id);
+  if (code != 0) {
+    mg_http_reply(c, code, "", "{\"error\": \"Ouverture du televersement impossible\"}\n");
+    return;
+  }
+  mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                "{\"id\": \"%s\", \"morceau\": %d, \"morceaux\": %d}\n", id, TELEVERSEMENT_MORCEAU,
+                (req.taille + TELEVERSEMENT_MORCEAU - 1) / TELEVERSEMENT_MORCEAU);
+}
+
+// --- ROUTE 20 : Depot des pdf et couvertures ---
+/* GET : blobs, octets, references, taux de succes et de doublons des deux
+   depots. POST [?delai=s] : ramasse-miettes immediat des blobs sans
+   reference depuis delai secondes (par defaut, le delai de grace). */
+typedef struct RequeteDepot {
+  int delai;
+} RequeteDepot;
+
+static const ChampParam s_schema_depot[] = {
+    CHAMP_ENTIER(RequeteDepot, delai, "delai", 0),
+};
+
+static void route_depot(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteDepot req = {DEPOT_DELAI_MS / 1000};
+  if (!lier_requete(c, hm, &params, s_schema_depot, NB_CHAMPS(s_schema_depot), &req, NULL)) return;
+  size_t pdf = 0, couvertures = 0;
+  if (mg_vcasecmp(&hm->method, "POST") == 0) {
+    uint64_t delai = req.delai > 0 ? (uint64_t) req.delai * 1000 : 0;
+    pdf = depot_collecter(&s_depot_livres, delai);
+    couvertures = depot_collecter(&s_depot_couvertures, delai);
+  }
+  char *livres = depot_stats_json(&s_depot_livres);
+  char *images = depot_stats_json(&s_depot_couvertures);
+  if (livres != NULL && images != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                  "{ \"collectes\": %lu, \"livres\": %s, \"couvertures\": %s }\n",
+                  (unsigned long) (pdf + couvertures), livres, images);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+  free(livres);
+  free(images);
+}
+
+// --- ROUTE 21 : Catalogue Gutendex (mandataire avec cache) ---
+/* ?search= : livres locaux dont le titre ou l'auteur contient la
+   recherche, puis les livres Gutendex qui ne sont pas deja au catalogue.
+   La reponse de Gutendex vient du cache (externe.c) ou d'un appel partage
+   par toutes les requetes identiques. */
+#define EXTERNE_LOCAUX_MAX 50
+
+static char *composer_externe(const char *recherche, const ResultatExterne *r, const char *etat,
+                              size_t *longueur) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  Livre *locaux[EXTERNE_LOCAUX_MAX];
+  size_t nb_locaux = 0;
+  for (size_t id = 0; recherche[0] != '\0' && id < bibli->cap_id && nb_locaux < EXTERNE_LOCAUX_MAX; id++) {
+    Livre *l = bibli->par_id[id];
+    if (l != NULL && (contient_ci(l->titre, recherche) || contient_ci(l->auteur, recherche))) {
+      locaux[nb_locaux++] = l;
+    }
+  }
+  // Doublon : titre exact au catalogue, ou meme titre (sans casse) qu'un livre trouve
+  Bool garde[EXTERNE_RESULTATS];
+  size_t nb_externes = 0, taille = 0;
+  for (size_t i = 0; r != NULL && i < r->nb; i++) {
+    garde[i] = biblio_search(bibli, r->livres[i].titre) == NULL;
+    for (size_t j = 0; j < nb_locaux && garde[i]; j++) garde[i] = !str_eq_ci(locaux[j]->titre, r->livres[i].titre);
+    if (garde[i]) nb_externes++, taille += strlen(r->livres[i].json) + 2;
+  }
+  char *json_locaux = biblio_selection_to_json(locaux, nb_locaux);
+  catalogue_lire_fin(&s_catalogue, &lecture);
+  if (json_locaux == NULL) return NULL;
+
+  char tete[1024];
+  size_t n = mg_snprintf(tete, sizeof(tete),
+                         "{ \"recherche\": %m, \"cache\": \"%s\", \"locaux\": %lu, \"externes\": %lu, "
+                         "\"doublons\": %lu, \"livres\": ",
+                         MG_ESC(recherche), etat, (unsigned long) nb_locaux, (unsigned long) nb_externes,
+                         (unsigned long) ((r != NULL ? r->nb : 0) - nb_externes));
+  size_t n_locaux = strlen(json_locaux) - 2;  // sans le "\n]" final
+  char *json = malloc(n + n_locaux + taille + 6);
+  if (json != NULL) {
+    size_t len = 0;
+    memcpy(json, tete, n), len += n;
+    memcpy(json + len, json_locaux, n_locaux), len += n_locaux;
+    for (size_t i = 0; r != NULL && i < r->nb; i++) {
+      if (!garde[i]) continue;
+      if (len > n + 2) memcpy(json + len, ",\n", 2), len += 2;  // apres "[\n", un element deja ecrit
+      size_t l = strlen(r->livres[i].json);
+      memcpy(json + len, r->livres[i].json, l), len += l;
+    }
+    memcpy(json + len, "\n] }\n", 6);
+    *longueur = len + 5;
+  }
+  free(json_locaux);
+  return json;
+}
+
+typedef struct RequeteExterne {
+  char recherche[EXTERNE_RECHERCHE];
+} RequeteExterne;
+
+static const ChampParam s_schema_externe[] = {
+    CHAMP_TEXTE(RequeteExterne, recherche, "search", "recherche", PARAM_VIDE_PERMIS),
+};
+
+static void route_externe(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteExterne req;
+  memset(&req, 0, sizeof(req));
+  if (!lier_requete(c, hm, &params, s_schema_externe, NB_CHAMPS(s_schema_externe), &req, NULL)) return;
+  if (!s_boucles.reveil) {  // les requetes en attente ne pourraient pas etre reveillees
+    mg_http_reply(c, 503, "", "{\"error\": \"Mandataire indisponible\"}\n");
+    return;
+  }
+  externe_repondre(&s_externe, c, req.recherche);
+}
+
+// --- ROUTE 22 : Compteurs du mandataire Gutendex ---
+static void route_cache_externe(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = externe_stats_json(&s_externe);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 23 : Requetes identiques partagees ---
+static void route_partages(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *json = vols_stats_json(&s_vols);
+  if (json != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json);
+    free(json);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+// --- ROUTE 24 : Lot d'operations (POST /api/batch) ---
+/* Corps : un tableau JSON ou du NDJSON (un objet par ligne), chaque objet
+   {"op": "ajouter" | "modifier" | "supprimer" | "emprunter" | "retourner", ...}
+   avec les champs de la route unitaire correspondante. Les operations
+   valides sont appliquees dans l'ordre en une seule ecriture du catalogue,
+   puis persistees par un seul ajout a data/livres.journal (au lieu d'une
+   reecriture de livres.dat par livre) ; la reponse donne le resultat de
+   chacune. */
+#define LOT_MAX_OPERATIONS 20000
+#define JOURNAL_REECRITURE (16L * 1024 * 1024)  // au-dela, livres.dat est reecrit et le journal vide
+
+typedef enum { LOT_AJOUTER = 0, LOT_MODIFIER, LOT_SUPPRIMER, LOT_EMPRUNTER, LOT_RETOURNER, LOT_NB_TYPES } TypeLot;
+
+static const char *s_operations_lot[LOT_NB_TYPES] = {"ajouter", "modifier", "supprimer", "emprunter", "retourner"};
+
+typedef struct OperationLot {
+  TypeLot type;
+  int status;             // 0 : a appliquer ; sinon resultat (200 : appliquee)
+  char erreur[96];
+  int id;                 // livre ajoute, supprime, emprunte ou rendu
+  unsigned long presents; // modifier : champs fournis
+  Livre livre;            // ajouter, modifier ; titre seul sinon
+  char email[128];
+  Bool emprunte;          // modifier : etat du livre apres modification
+  Bool transition;        // emprunter, retourner : etat de pret gagne par CAS
+} OperationLot;
+
+typedef struct Lot {
+  OperationLot *ops;
+  size_t nb;
+  size_t cap;
+  Bool compte;            // premiere application faite (references, journal)
+  char *journal;          // lignes "+|livre" ou "-|id", dans l'ordre
+  size_t longueur_journal;
+  size_t cap_journal;
+} Lot;
+
+static void echec_lot(OperationLot *op, int status, const char *erreur) {
+  op->status = status;
+  snprintf(op->erreur, sizeof(op->erreur), "%s", erreur);
+}
+
+static void journaliser(Lot *lot, const Livre *l, int id_supprime) {
+  char ligne[sizeof(Livre) + 32];
+  if (l != NULL) {
+    memcpy(ligne, "+|", 2);
+    size_t n = 2 + (size_t) fichiers_formater_livre(ligne + 2, sizeof(ligne) - 3, l);
+    if (n > sizeof(ligne) - 2) n = sizeof(ligne) - 2;
+    memcpy(ligne + n, "\n", 2);
+  } else {
+    snprintf(ligne, sizeof(ligne), "-|%d\n", id_supprime);
+  }
+  json_append(&lot->journal, &lot->cap_journal, &lot->longueur_journal, ligne);
+}
+
+// Un objet du lot, decode et lie selon son type ; status 400 si invalide
+static void lot_lire_operation(Lot *lot, struct mg_str objet, Parametres *params) {
+  OperationLot *op = &lot->ops[lot->nb++];
+  memset(op, 0, sizeof(OperationLot));
+  if (objet.len == 0 || objet.buf[0] != '{' || !params_decoder_json(params, objet)) {
+    echec_lot(op, 400, "Objet JSON invalide");
+    return;
+  }
+  const char *nom = params_get(params, "op");
+  op->type = LOT_NB_TYPES;
+  for (int i = 0; nom != NULL && i < LOT_NB_TYPES; i++) {
+    if (strcmp(nom, s_operations_lot[i]) == 0) op->type = (TypeLot) i;
+  }
+  char erreur[128];
+  Bool ok = VRAI;
+  if (op->type == LOT_AJOUTER) {
+    ok = params_lier(params, s_schema_ajout, NB_CHAMPS(s_schema_ajout), &op->livre, NULL, erreur, sizeof(erreur));
+  } else if (op->type == LOT_MODIFIER) {
+    ok = params_lier(params, s_schema_modif, NB_CHAMPS(s_schema_modif), &op->livre, &op->presents, erreur,
+                     sizeof(erreur));
+  } else if (op->type == LOT_SUPPRIMER) {
+    ok = params_lier(params, s_schema_titre, NB_CHAMPS(s_schema_titre), op->livre.titre, NULL, erreur,
+                     sizeof(erreur));
+  } else if (op->type == LOT_EMPRUNTER || op->type == LOT_RETOURNER) {
+    RequeteEmprunt req;
+    memset(&req, 0, sizeof(req));
+    if (op->type == LOT_EMPRUNTER) {
+      ok = params_lier(params, s_schema_emprunt, NB_CHAMPS(s_schema_emprunt), &req, NULL, erreur, sizeof(erreur));
+    } else {
+      ok = params_lier(params, s_schema_retour, NB_CHAMPS(s_schema_retour), &req, NULL, erreur, sizeof(erreur));
+    }
+    if (ok && op->type == LOT_EMPRUNTER && req.email[0] == '\0') {
+      ok = FAUX;
+      snprintf(erreur, sizeof(erreur), "email manquant");
+    } else if (ok && req.id == 0 && req.titre[0] == '\0') {
+      ok = FAUX;
+      snprintf(erreur, sizeof(erreur), "titre ou id manquant");
+    } else if (ok && strlen(req.titre) >= sizeof(op->livre.titre)) {
+      echec_lot(op, 404, "Livre introuvable");  // plus long que tout titre du catalogue
+      return;
+    }
+    if (ok) {
+      op->id = req.id;
+      memcpy(op->livre.titre, req.titre, strlen(req.titre) + 1);
+      snprintf(op->email, sizeof(op->email), "%s", req.email);
+    }
+  } else {
+    ok = FAUX;
+    snprintf(erreur, sizeof(erreur), "Operation inconnue");
+  }
+  if (!ok) echec_lot(op, 400, erreur);
+}
+
+static Bool lot_ajouter(Lot *lot, struct mg_str objet, Parametres *params) {
+  if (lot->nb == lot->cap) {
+    size_t cap = lot->cap == 0 ? 64 : lot->cap * 2;
+    OperationLot *ops = realloc(lot->ops, cap * sizeof(OperationLot));
+    if (ops == NULL) return FAUX;
+    lot->ops = ops;
+    lot->cap = cap;
+  }
+  lot_lire_operation(lot, objet, params);
+  return VRAI;
+}
+
+/* Decoupe le corps en operations. FAUX (erreur renseignee, status de la
+   reponse dans *status) si le corps entier est refuse. */
+static Bool lot_decoder(Lot *lot, struct mg_str corps, int *status, const char **erreur) {
+  Parametres *params = malloc(sizeof(Parametres));
+  Bool ok = params != NULL;
+  *status = 400;
+  *erreur = ok ? NULL : "Memoire insuffisante";
+  while (corps.len > 0 && isspace((unsigned char) corps.buf[0])) corps.buf++, corps.len--;
+  while (corps.len > 0 && isspace((unsigned char) corps.buf[corps.len - 1])) corps.len--;
+
+  if (ok && corps.len > 0 && corps.buf[0] == '[') {
+    int n = 0;
+    if (mg_json_get(corps, "$", &n) != 0 || (size_t) n != corps.len) {
+      ok = FAUX;
+      *erreur = "Tableau JSON invalide";
+    }
+    struct mg_str element;
+    for (size_t ofs = 0; ok && (ofs = mg_json_next(corps, ofs, NULL, &element)) > 0;) {
+      if (lot->nb == LOT_MAX_OPERATIONS) {
+        ok = FAUX;
+      } else {
+        ok = lot_ajouter(lot, element, params);
+      }
+    }
+  } else {
+    // NDJSON : un objet par ligne, lignes vides ignorees
+    const char *p = corps.buf, *fin = corps.buf + corps.len;
+    while (ok && p < fin) {
+      const char *eol = memchr(p, '\n', (size_t) (fin - p));
+      struct mg_str ligne = mg_str_n(p, (size_t) ((eol != NULL ? eol : fin) - p));
+      p = eol != NULL ? eol + 1 : fin;
+      while (ligne.len > 0 && isspace((unsigned char) ligne.buf[ligne.len - 1])) ligne.len--;
+      while (ligne.len > 0 && isspace((unsigned char) ligne.buf[0])) ligne.buf++, ligne.len--;
+      if (ligne.len == 0) continue;
+      ok = lot->nb < LOT_MAX_OPERATIONS && lot_ajouter(lot, ligne, params);
+    }
+  }
+  if (!ok && *erreur == NULL) {
+    *status = lot->nb == LOT_MAX_OPERATIONS ? 413 : 503;
+    *erreur = lot->nb == LOT_MAX_OPERATIONS ? "Trop d'operations dans le lot" : "Memoire insuffisante";
+  } else if (ok && lot->nb == 0) {
+    ok = FAUX;
+    *erreur = "Lot vide";
+  }
+  free(params);
+  return ok;
+}
+
+/* Avant l'ecrivain, comme les routes unitaires : chaque emprunt gagne
+   DISPONIBLE -> EMPRUNTE et chaque retour EMPRUNTE -> EN_RETOUR par CAS,
+   ce qui ordonne le lot avec les emprunts concurrents. */
+static void lot_transitions(Lot *lot) {
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  for (size_t i = 0; i < lot->nb; i++) {
+    OperationLot *op = &lot->ops[i];
+    if (op->status != 0 || (op->type != LOT_EMPRUNTER && op->type != LOT_RETOURNER)) continue;
+    Livre *l = op->id != 0 ? biblio_find_by_id(bibli, op->id)
+                           : biblio_search_etat(bibli, op->livre.titre, op->type == LOT_RETOURNER);
+    op->id = l != NULL ? l->id : 0;
+  }
+  catalogue_lire_fin(&s_catalogue, &lecture);
+
+  for (size_t i = 0; i < lot->nb; i++) {
+    OperationLot *op = &lot->ops[i];
+    if (op->status != 0 || (op->type != LOT_EMPRUNTER && op->type != LOT_RETOURNER)) continue;
+    if (op->id == 0) {
+      echec_lot(op, 404, "Livre introuvable");
+    } else if (op->type == LOT_EMPRUNTER) {
+      op->transition = catalogue_transition(&s_catalogue, op->id, LIVRE_DISPONIBLE, LIVRE_EMPRUNTE);
+      if (!op->transition) echec_lot(op, 400, "Indisponible");
+    } else {
+      op->transition = catalogue_transition(&s_catalogue, op->id, LIVRE_EMPRUNTE, LIVRE_EN_RETOUR);
+      if (!op->transition) echec_lot(op, 409, "Livre non emprunte");
+    }
+  }
+}
+
+/* Tout le lot en une operation d'ecriture. A la premiere application les
+   resultats, ids, references du depot et lignes du journal sont notes ;
+   la seconde rejoue sur l'autre copie les seules operations appliquees. */
+static int op_lot(Bibliotheque *bibli, void *arg) {
+  Lot *lot = (Lot *) arg;
+  Bool premiere = premiere_application(&lot->compte);
+  int appliquees = 0;
+  for (size_t i = 0; i < lot->nb; i++) {
+    OperationLot *op = &lot->ops[i];
+    if (op->status != (premiere ? 0 : 200)) continue;
+    int status = 200;
+    const char *erreur = NULL;
+    if (op->type == LOT_AJOUTER) {
+      op->livre.id = biblio_next_id(bibli);  // identique sur les deux copies
+      if (!biblio_add(bibli, &op->livre)) {
+        status = 500, erreur = "Catalogue plein";
+      } else if (premiere) {
+        op->id = op->livre.id;
+        references_livre(&op->livre, 1);
+        journaliser(lot, &op->livre, 0);
+        annoncer_livre("ajout", &op->livre);
+      }
+    } else if (op->type == LOT_MODIFIER) {
+      Livre *existant = biblio_find_by_id(bibli, op->livre.id);
+      if (existant == NULL) {
+        status = 404, erreur = "Livre introuvable";
+      } else if (PARAM_PRESENT(op->presents, MODIF_TITRE) && strcmp(op->livre.titre, existant->titre) != 0) {
+        status = 400, erreur = "Modification du titre interdite";
+      } else {
+        Livre updated = *existant;
+        params_fusionner(s_schema_modif, NB_CHAMPS(s_schema_modif), op->presents, &updated, &op->livre);
+        if (premiere) {
+          references_livre(&updated, 1);
+          references_livre(existant, -1);
+          journaliser(lot, &updated, 0);
+          annoncer_livre("modification", &updated);
+          op->id = updated.id;
+          op->emprunte = updated.est_emprunte;
+        }
+        biblio_update(bibli, existant, &updated);
+      }
+    } else if (op->type == LOT_SUPPRIMER) {
+      Livre *l = biblio_search(bibli, op->livre.titre);
+      if (l == NULL) {
+        status = 404, erreur = "Livre introuvable";
+      } else {
+        if (premiere) {
+          op->id = l->id;
+          references_livre(l, -1);
+          journaliser(lot, NULL, l->id);
+          annoncer_suppression(l->id);
+        }
+        biblio_remove_livre(bibli, l);
+      }
+    } else {
+      Livre *l = biblio_find_by_id(bibli, op->id);
+      Bool emprunter = op->type == LOT_EMPRUNTER;
+      if (l == NULL) {
+        status = 404, erreur = "Livre introuvable";  // supprime entre-temps
+      } else if (l->est_emprunte == emprunter) {
+        status = emprunter ? 400 : 409, erreur = emprunter ? "Indisponible" : "Livre non emprunte";
+      } else {
+        biblio_marquer_emprunte(bibli, l, emprunter);
+        if (premiere) {
+          memcpy(op->livre.titre, l->titre, sizeof(op->livre.titre));
+          journaliser(lot, l, 0);
+          annoncer_etat(l->id, emprunter);
+        }
+      }
+    }
+    if (premiere) {
+      if (erreur != NULL) {
+        echec_lot(op, status, erreur);
+      } else {
+        op->status = 200;
+      }
+    }
+    appliquees += status == 200;
+  }
+  return appliquees;
+}
+
+// Etat de pret des livres touches, une fois les deux copies a jour
+static void lot_fixer_etats(const Lot *lot) {
+  for (size_t i = 0; i < lot->nb; i++) {
+    const OperationLot *op = &lot->ops[i];
+    if (op->status == 200 && op->type == LOT_AJOUTER) {
+      catalogue_fixer_etat(&s_catalogue, op->id, op->livre.est_emprunte ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+    } else if (op->status == 200 && op->type == LOT_MODIFIER) {
+      catalogue_fixer_etat(&s_catalogue, op->id, op->emprunte ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+    } else if (op->transition && op->type == LOT_EMPRUNTER && op->status == 404) {
+      catalogue_fixer_etat(&s_catalogue, op->id, LIVRE_DISPONIBLE);
+    } else if (op->transition && op->type == LOT_RETOURNER) {
+      catalogue_fixer_etat(&s_catalogue, op->id, LIVRE_DISPONIBLE);
+    }
+  }
+}
+
+/* Applique le lot et le persiste. Le verrou des fichiers couvre
+   l'ecriture et l'ajout au journal : les lots y sont dans l'ordre ou ils
+   ont modifie le catalogue. Renvoie le nombre d'operations appliquees. */
+static int lot_appliquer(Lot *lot, long *taille_journal, Bool *reecrit) {
+  lot_transitions(lot);
+  pthread_mutex_lock(&s_verrou_fichiers);
+  int appliquees = catalogue_ecrire(&s_catalogue, op_lot, lot);
+  Bool journalise = lot->longueur_journal == 0 ||
+                    fichiers_journal_ajouter(s_journal_file, lot->journal, lot->longueur_journal, taille_journal);
+  FILE *fe = NULL;
+  time_t now = time(NULL);
+  for (size_t i = 0; i < lot->nb; i++) {
+    const OperationLot *op = &lot->ops[i];
+    if (op->status != 200 || op->type != LOT_EMPRUNTER) continue;
+    if (fe == NULL && (fe = fopen("data/emprunts.dat", "a")) == NULL) break;
+    fprintf(fe, "%s|%d|%s|%ld|%s\n", op->email, op->id, op->livre.titre, (long) now, "");
+  }
+  if (fe != NULL) fclose(fe);
+  pthread_mutex_unlock(&s_verrou_fichiers);
+  lot_fixer_etats(lot);
+
+  const char **emails = malloc(lot->nb * sizeof(char *));
+  const char **titres = malloc(lot->nb * sizeof(char *));
+  size_t nb_retours = 0;
+  for (size_t i = 0; emails != NULL && titres != NULL && i < lot->nb; i++) {
+    const OperationLot *op = &lot->ops[i];
+    if (op->status != 200 || op->type != LOT_RETOURNER || op->email[0] == '\0') continue;
+    emails[nb_retours] = op->email;
+    titres[nb_retours++] = op->livre.titre;
+  }
+  retirer_emprunts(emails, titres, nb_retours);
+  free(emails);
+  free(titres);
+
+  // Journal illisible ou trop long : reecriture complete, qui le vide
+  *reecrit = !journalise || *taille_journal > JOURNAL_REECRITURE;
+  if (*reecrit) sauvegarder_catalogue();
+  return appliquees;
+}
+
+static char *lot_resultats_json(const Lot *lot, int appliquees, long taille_journal, Bool reecrit,
+                                size_t *longueur) {
+  size_t cap = 256 + lot->nb * 48, len = 0;
+  char *json = malloc(cap);
+  if (json == NULL) return NULL;
+  json[0] = '\0';
+  char morceau[160];
+  snprintf(morceau, sizeof(morceau),
+           "{ \"operations\": %lu, \"appliquees\": %d, \"echecs\": %lu, \"persistance\": \"%s\", "
+           "\"journal_octets\": %ld, \"resultats\": [",
+           (unsigned long) lot->nb, appliquees, (unsigned long) (lot->nb - (size_t) appliquees),
+           reecrit ? "reecriture" : "journal", reecrit ? 0L : taille_journal);
+  Bool ok = json_append(&json, &cap, &len, morceau);
+  for (size_t i = 0; ok && i < lot->nb; i++) {
+    const OperationLot *op = &lot->ops[i];
+    snprintf(morceau, sizeof(morceau), "%s\n  {\"status\": %d", i > 0 ? "," : "", op->status);
+    ok = json_append(&json, &cap, &len, morceau);
+    if (op->status == 200) {
+      snprintf(morceau, sizeof(morceau), ", \"id\": %d}", op->id);
+      ok = ok && json_append(&json, &cap, &len, morceau);
+    } else {
+      ok = ok && json_append(&json, &cap, &len, ", \"error\": \"") &&
+           json_append_escaped(&json, &cap, &len, op->erreur) && json_append(&json, &cap, &len, "\"}");
+    }
+  }
+  ok = ok && json_append(&json, &cap, &len, "\n] }\n");
+  if (!ok) {
+    free(json);
+    return NULL;
+  }
+  *longueur = len;
+  return json;
+}
+
+static void traiter_lot(Travail *t, struct mg_str corps) {
+  Lot lot;
+  memset(&lot, 0, sizeof(lot));
+  int status;
+  const char *erreur;
+  if (lot_decoder(&lot, corps, &status, &erreur)) {
+    lot.cap_journal = 256 + lot.nb * 256;
+    lot.journal = malloc(lot.cap_journal);
+    if (lot.journal == NULL) status = 503, erreur = "Memoire insuffisante";
+  }
+  if (lot.journal == NULL) {
+    travail_repondre(t, status, "", "{\"error\": \"%s\"}\n", erreur);
+  } else {
+    long taille_journal = 0;
+    Bool reecrit = FAUX;
+    int appliquees = lot_appliquer(&lot, &taille_journal, &reecrit);
+    size_t longueur = 0;
+    char *json = lot_resultats_json(&lot, appliquees, taille_journal, reecrit, &longueur);
+    if (json != NULL) {
+      travail_repondre_corps(t, 200, "Content-Type: application/json\r\n", json, longueur);
+    } else {
+      travail_repondre(t, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+    }
+  }
+  free(lot.ops);
+  free(lot.journal);
+}
+
+typedef struct TacheLot {
+  Travail *t;
+  char *corps;
+  size_t longueur;
+} TacheLot;
+
+static void executer_lot(void *arg) {
+  TacheLot *tl = (TacheLot *) arg;
+  traiter_lot(tl->t, mg_str_n(tl->corps, tl->longueur));
+  travail_terminer(tl->t);
+  free(tl->corps);
+  free(tl);
+}
+
+/* Le corps (hm n'est plus valide apres le retour) est copie pour le pool ;
+   la connexion attend la reponse comme une route lourde. */
+static void route_batch(struct mg_connection *c, struct mg_http_message *hm) {
+  if (hm->body.len == 0) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Lot vide\"}\n");
+    return;
+  }
+  if (s_routeur.pool == NULL) {
+    // Sans pool : le lot s'execute dans la boucle
+    Travail t;
+    memset(&t, 0, sizeof(t));
+    traiter_lot(&t, hm->body);
+    mg_http_reply(c, t.status, t.entetes, "%.*s", (int) t.longueur, t.corps);
+    free(t.corps);
+    return;
+  }
+  TacheLot *tl = malloc(sizeof(TacheLot));
+  char *corps = malloc(hm->body.len);
+  Travail *t = (tl != NULL && corps != NULL) ? travail_suspendre(c) : NULL;
+  if (t == NULL) {
+    free(tl);
+    free(corps);
+    mg_http_reply(c, 503, "", "{\"error\": \"Requete precedente en cours ou memoire insuffisante\"}\n");
+    return;
+  }
+  memcpy(corps, hm->body.buf, hm->body.len);
+  *tl = (TacheLot) {t, corps, hm->body.len};
+  if (!pool_soumettre(&s_pool, executer_lot, tl)) {
+    free(corps);
+    free(tl);
+    travail_repondre(t, 503, "", "{\"error\": \"File de travail pleine\"}\n");
+    travail_terminer(t);
+  }
+}
+
+// --- ROUTE 25 : Import en masse (POST /api/import?format=csv|ndjson|marc) ---
+/* Le corps n'est jamais garde entier : event_handler l'intercepte des les
+   en-tetes et le passe par morceaux a importation_ajouter, qui confie
+   chaque bloc au pool pendant que la suite arrive. La reponse (rapport de
+   l'import) part une fois les livres inseres et persistes. */
+#define IMPORT_TAMPON (1024 * 1024)  // lectures de socket pendant la reception
+
+typedef struct ImportHttp {
+  Importation imp;
+  Travail *travail;       // NULL sans pool : tout se fait dans la boucle
+  uint64_t longueur;      // Content-Length
+  uint64_t recu;
+  size_t a_sauter;        // octets deja traites en tete de c->recv
+  Bool compte;            // premiere application faite (references, journal)
+  char *journal;          // lignes "+|livre", abandonnees au-dela de JOURNAL_REECRITURE
+  size_t longueur_journal;
+  size_t cap_journal;
+  Bool trop_long;
+  mg_event_handler_t pfn;
+  void *pfn_data;
+} ImportHttp;
+
+static void import_visiter(const Livre *l, void *arg) {
+  ImportHttp *ih = (ImportHttp *) arg;
+  references_livre(l, 1);
+  catalogue_fixer_etat(&s_catalogue, l->id, l->est_emprunte ? LIVRE_EMPRUNTE : LIVRE_DISPONIBLE);
+  char ligne[sizeof(Livre) + 32];
+  memcpy(ligne, "+|", 2);
+  size_t n = 2 + (size_t) fichiers_formater_livre(ligne + 2, sizeof(ligne) - 3, l);
+  if (n > sizeof(ligne) - 2) n = sizeof(ligne) - 2;
+  memcpy(ligne + n, "\n", 2);
+  if (ih->trop_long || ih->longueur_journal + n + 1 > JOURNAL_REECRITURE) {
+    ih->trop_long = VRAI;  // livres.dat sera reecrit
+  } else if (ih->journal == NULL && (ih->journal = malloc(ih->cap_journal = 64 * 1024)) == NULL) {
+    ih->trop_long = VRAI;
+  } else if (!json_append(&ih->journal, &ih->cap_journal, &ih->longueur_journal, ligne)) {
+    ih->trop_long = VRAI;
+  }
+}
+
+/* Un import ne publie qu'un evenement (l'intervalle d'ids ajoutes), pas
+   un par livre : les abonnes rechargent les listes s'il les concerne. */
+static int op_importer(Bibliotheque *bibli, void *arg) {
+  ImportHttp *ih = (ImportHttp *) arg;
+  Bool premiere = premiere_application(&ih->compte);
+  int nb = (int) importation_inserer(&ih->imp, bibli, premiere, import_visiter, ih);
+  if (premiere && nb > 0) {
+    annoncer("{\"type\": \"import\", \"premier_id\": %d, \"dernier_id\": %d, \"nb\": %d}", ih->imp.premier_id,
+             ih->imp.dernier_id, nb);
+  }
+  return nb;
+}
+
+// Analyse terminee : insertion et persistance, comme lot_appliquer
+static void traiter_import(ImportHttp *ih, Travail *t) {
+  Importation *imp = &ih->imp;
+  uint64_t debut = mg_millis();
+  if (imp->erreur[0] == '\0' && !imp->annule) {
+    long taille_journal = 0;
+    pthread_mutex_lock(&s_verrou_fichiers);
+    catalogue_ecrire(&s_catalogue, op_importer, ih);
+    Bool journalise = !ih->trop_long && (ih->longueur_journal == 0 ||
+                                         fichiers_journal_ajouter(s_journal_file, ih->journal, ih->longueur_journal,
+                                                                  &taille_journal));
+    pthread_mutex_unlock(&s_verrou_fichiers);
+    if (!journalise || taille_journal > JOURNAL_REECRITURE) sauvegarder_catalogue();
+  }
+  uint64_t fin = mg_millis();
+  char *rapport = importation_rapport_json(imp, fin - debut, fin - imp->debut_ms);
+  if (rapport != NULL) {
+    travail_repondre_corps(t, imp->erreur[0] != '\0' ? 400 : 200, "Content-Type: application/json\r\n", rapport,
+                           strlen(rapport));
+  } else {
+    travail_repondre(t, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+}
+
+static void import_free(ImportHttp *ih) {
+  importation_free(&ih->imp);
+  free(ih->journal);
+  free(ih);
+}
+
+// Analyses terminees (thread du pool) : ih appartient desormais a cet appel
+static void import_analyse_finie(Importation *imp, void *arg) {
+  ImportHttp *ih = (ImportHttp *) arg;
+  (void) imp;
+  traiter_import(ih, ih->travail);
+  travail_terminer(ih->travail);
+  import_free(ih);
+}
+
+static void import_rendre(struct mg_connection *c, ImportHttp *ih) {
+  c->pfn = ih->pfn;
+  c->pfn_data = ih->pfn_data;
+  if (c->recv.len == 0) mg_iobuf_resize(&c->recv, 0);
+}
+
+// Corps entierement lu (ou client parti) : plus rien ne viendra
+static void import_fermer(struct mg_connection *c, ImportHttp *ih) {
+  if (ih->travail != NULL) {
+    importation_fermer(&ih->imp);  // import_analyse_finie prend la suite
+    return;
+  }
+  importation_fermer(&ih->imp);  // sans pool : blocs deja analyses
+  if (!ih->imp.annule) {
+    Travail t;
+    memset(&t, 0, sizeof(t));
+    traiter_import(ih, &t);
+    mg_http_reply(c, t.status, t.entetes, "%.*s", (int) t.longueur, t.corps);
+    free(t.corps);
+    c->is_resp = 0;
+  }
+  import_free(ih);
+}
+
+static void import_cb(struct mg_connection *c, int ev, void *ev_data) {
+  ImportHttp *ih = (ImportHttp *) c->pfn_data;
+  if (ev == MG_EV_CLOSE) {
+    import_rendre(c, ih);
+    ih->imp.annule = VRAI;  // corps incomplet : rien n'est insere
+    import_fermer(c, ih);
+    return;
+  }
+  if (ev != MG_EV_READ && ev != MG_EV_POLL) return;
+  size_t saute = ih->a_sauter < c->recv.len ? ih->a_sauter : c->recv.len;
+  size_t utile = c->recv.len - saute;
+  if (utile > ih->longueur - ih->recu) utile = (size_t) (ih->longueur - ih->recu);
+  ih->a_sauter -= saute;
+  if (utile > 0) importation_ajouter(&ih->imp, (const char *) c->recv.buf + saute, utile);
+  ih->recu += utile;
+  if (saute + utile > 0) mg_iobuf_del(&c->recv, 0, saute + utile);
+  if (ih->recu < ih->longueur || ih->a_sauter > 0) {
+    if (c->recv.size < IMPORT_TAMPON) mg_iobuf_resize(&c->recv, IMPORT_TAMPON);
+    return;
+  }
+  import_rendre(c, ih);
+  c->is_resp = 1;  // requetes suivantes en attente de la reponse
+  import_fermer(c, ih);
+  if (!c->is_resp && c->recv.len > 0) c->pfn(c, MG_EV_READ, NULL);  // requete suivante deja recue
+  (void) ev_data;
+}
+
+/* Prepare l'import demande par hm (format, taille, connexion libre) ; sinon
+   repond l'erreur et renvoie NULL. flux : corps pas encore recu, la
+   connexion ne pourra pas resservir apres un refus. */
+static ImportHttp *import_commencer(struct mg_connection *c, struct mg_http_message *hm, Bool flux) {
+  char nom[16];
+  FormatImport format;
+  int code = 0;
+  const char *erreur = NULL;
+  if (mg_http_get_var(&hm->query, "format", nom, sizeof(nom)) <= 0) snprintf(nom, sizeof(nom), "csv");
+  if (!importation_format(nom, &format)) {
+    code = 400, erreur = "Format inconnu (csv, ndjson ou marc)";
+  } else if (hm->body.len == 0) {
+    code = 400, erreur = "Corps vide";
+  } else if ((long long) hm->body.len > IMPORT_TAILLE_MAX) {
+    code = 413, erreur = "Fichier trop volumineux";
+  }
+  ImportHttp *ih = erreur == NULL ? calloc(1, sizeof(ImportHttp)) : NULL;
+  FinImport fin = s_routeur.pool != NULL ? import_analyse_finie : NULL;  // sans pool : import_fermer enchaine
+  if (ih != NULL && (!importation_init(&ih->imp, format, s_routeur.pool, fin, ih) ||
+                     (s_routeur.pool != NULL && (ih->travail = travail_suspendre(c)) == NULL))) {
+    import_free(ih);
+    ih = NULL;
+  }
+  if (ih == NULL && erreur == NULL) code = 503, erreur = "Requete precedente en cours ou memoire insuffisante";
+  if (erreur != NULL) {
+    mg_http_reply(c, code, "Content-Type: application/json\r\n", "{\"error\": \"%s\"}\n", erreur);
+    if (flux) {
+      c->is_draining = 1;  // corps non lu
+      hm->body.len = (size_t) -1;
+    }
+  }
+  if (ih != NULL) ih->longueur = hm->body.len;
+  return ih;
+}
+
+/* MG_EV_HTTP_HDRS : prend en charge le corps de POST /api/import annonce
+   par Content-Length et pas encore entierement recu ; sinon la route
+   repond avec le corps en memoire (au plus MG_MAX_RECV_SIZE). */
+static void import_intercepter(struct mg_connection *c, struct mg_http_message *hm) {
+  if (mg_strcmp(hm->uri, mg_str("/api/import")) != 0 ||
+      (mg_vcasecmp(&hm->method, "POST") != 0 && mg_vcasecmp(&hm->method, "PUT") != 0) ||
+      mg_http_get_header(hm, "Content-Length") == NULL) {
+    return;
+  }
+  size_t present = (size_t) (c->recv.buf + c->recv.len - (unsigned char *) hm->body.buf);
+  if (present >= hm->body.len) return;
+  ImportHttp *ih = import_commencer(c, hm, VRAI);
+  if (ih == NULL) return;
+  ih->pfn = c->pfn;
+  ih->pfn_data = c->pfn_data;
+  c->pfn = import_cb;
+  c->pfn_data = ih;
+
+  // Comme televersement_intercepter : ce qui est deja recu est traite, puis saute au prochain evenement
+  importation_ajouter(&ih->imp, hm->body.buf, present);
+  ih->recu = present;
+  ih->a_sauter = hm->head.len + present;
+  hm->body.len = (size_t) -1;
+}
+
+// Corps deja entier (petit fichier, ou envoye en chunked) : meme traitement, sans flux
+static void route_import(struct mg_connection *c, struct mg_http_message *hm) {
+  ImportHttp *ih = import_commencer(c, hm, FAUX);
+  if (ih == NULL) return;
+  importation_ajouter(&ih->imp, hm->body.buf, hm->body.len);
+  import_fermer(c, ih);
+}
+
+// --- ROUTE 26 : Export NDJSON des livres et des emprunts ---
+/* ?format=ndjson&type=livres|emprunts[&apres=N] : une ligne JSON par
+   enregistrement, en chunked. Livres par id croissant, emprunts dans
+   l'ordre du fichier (id : numero de ligne) ; apres=N reprend apres le
+   dernier id recu. L'instantane est ecrit par un travailleur sous une
+   seule lecture du catalogue (ou sous le verrou des .dat) dans un fichier
+   temporaire de data/, envoye a mesure : un client lent ne retient ni les
+   ecritures du catalogue ni la memoire. */
+typedef struct RequeteExport {
+  char format[16];
+  char type[16];
+  int apres;
+} RequeteExport;
+
+static const ChampParam s_schema_export[] = {
+    CHAMP_TEXTE(RequeteExport, format, "format", NULL, 0),
+    CHAMP_TEXTE(RequeteExport, type, "type", NULL, 0),
+    CHAMP_ENTIER(RequeteExport, apres, "apres", 0),
+};
+
+static void export_produire(void *arg) {
+  Exportation *x = (Exportation *) arg;
+  Bool ok = VRAI;
+  if (x->type == EXPORT_LIVRES) {
+    LectureCatalogue lecture;
+    Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+    size_t id = x->apres < 0 ? 0 : (size_t) x->apres + 1;
+    for (; ok && id < bibli->cap_id; id++) {
+      if (bibli->par_id[id] != NULL) ok = exportation_livre(x, bibli->par_id[id]);
+    }
+    catalogue_lire_fin(&s_catalogue, &lecture);
+  } else {
+    pthread_mutex_lock(&s_verrou_fichiers);
+    FILE *f = fopen("data/emprunts.dat", "r");
+    if (f != NULL) {
+      char ligne[4096];
+      long long rang = 0;
+      while (ok && fgets(ligne, sizeof(ligne), f) != NULL) {
+        Bool entiere = strchr(ligne, '\n') != NULL;
+        if (++rang > x->apres) ok = exportation_ligne_dat(x, ligne, rang);
+        while (!entiere && fgets(ligne, sizeof(ligne), f) != NULL) entiere = strchr(ligne, '\n') != NULL;
+      }
+      fclose(f);
+    }
+    pthread_mutex_unlock(&s_verrou_fichiers);
+  }
+  exportation_terminer(x, ok);
+}
+
+static void route_export(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteExport req = {"ndjson", "livres", -1};
+  if (!lier_requete(c, hm, &params, s_schema_export, NB_CHAMPS(s_schema_export), &req, NULL)) return;
+  TypeExport type;
+  if (strcmp(req.format, "ndjson") != 0 && strcmp(req.format, "jsonl") != 0) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Format inconnu (ndjson)\"}\n");
+    return;
+  }
+  if (!exportation_type(req.type, &type)) {
+    mg_http_reply(c, 400, "", "{\"error\": \"Type inconnu (livres ou emprunts)\"}\n");
+    return;
+  }
+  Exportation *x = exportation_creer(type, req.apres, "data");
+  if (x == NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Fichier temporaire impossible\"}\n");
+    return;
+  }
+  x->mgr = c->mgr;
+  x->conn_id = c->id;
+  // Sans pool (ou file pleine) : instantane ecrit ici, envoye ensuite
+  if (!pool_soumettre(s_routeur.pool, export_produire, x)) export_produire(x);
+  exportation_envoyer(x, c);
+}
+
+// --- ROUTE 27 : Evenements du catalogue en WebSocket (/ws) ---
+/* A l'abonnement, un message "bonjour" donne la generation du catalogue et
+   les ids des livres empruntes ; ensuite arrivent les changements
+   ("etat", "ajout", "modification", "suppression", "import", "recharge"),
+   publies par les ecritures (annoncer_*). Le client n'a rien a envoyer. */
+static void route_ws(struct mg_connection *c, struct mg_http_message *hm) {
+  if (!diffusion_abonner(&s_diffusion, c, hm)) return;
+  LectureCatalogue lecture;
+  Bibliotheque *bibli = catalogue_lire_debut(&s_catalogue, &lecture);
+  unsigned long generation = atomic_load(&s_catalogue.generation);
+  size_t nb = bitmap_cardinal(&bibli->empruntes);
+  uint32_t *ids = malloc((nb + 1) * sizeof(uint32_t));
+  if (ids != NULL) nb = bitmap_to_array(&bibli->empruntes, ids);
+  catalogue_lire_fin(&s_catalogue, &lecture);
+
+  size_t cap = 96 + nb * 12, len = 0;
+  char *json = ids != NULL ? malloc(cap) : NULL;
+  if (json == NULL) {
+    free(ids);
+    c->is_draining = 1;  // le client se reabonnera
+    return;
+  }
+  len += (size_t) snprintf(json, cap, "{\"type\": \"bonjour\", \"generation\": %lu, \"empruntes\": [",
+                           generation);
+  for (size_t i = 0; i < nb; i++) {
+    len += (size_t) snprintf(json + len, cap - len, "%s%u", i > 0 ? "," : "", (unsigned) ids[i]);
+  }
+  len += (size_t) snprintf(json + len, cap - len, "]}");
+  mg_ws_send(c, json, len, WEBSOCKET_OP_TEXT);
+  free(json);
+  free(ids);
+}
+
+// --- ROUTE 28 : Compteurs de la diffusion WebSocket et du flux des changements ---
+static void route_diffusion(struct mg_connection *c, struct mg_http_message *hm) {
+  (void) hm;
+  char *ws = diffusion_stats_json(&s_diffusion);
+  char *flux = changements_stats_json(&s_changements);
+  if (ws != NULL && flux != NULL) {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{ \"ws\": %s, \"changements\": %s }\n", ws,
+                  flux);
+  } else {
+    mg_http_reply(c, 500, "", "{\"error\": \"Erreur generation JSON\"}\n");
+  }
+  free(ws);
+  free(flux);
+}
+
+// --- ROUTE 29 : Changements numerotes depuis un curseur (/api/changes) ---
+/* since=N : changements de seq > N, depuis l'anneau ou le journal.
+   Server-Sent Events (Accept: text/event-stream ou mode=sse, reprise par
+   Last-Event-ID) ou attente longue : la reponse part des qu'il y a du
+   nouveau, vide au bout de attente secondes. 410 : curseur sorti de
+   l'historique, repartir de /api/export puis de since=dernier. */
+typedef struct RequeteChangements {
+  char since[24];
+  char mode[16];
+  int attente;
+  int limite;
+} RequeteChangements;
+
+static const ChampParam s_schema_changements[] = {
+    CHAMP_TEXTE(RequeteChangements, since, "since", NULL, 0),
+    CHAMP_TEXTE(RequeteChangements, mode, "mode", NULL, 0),
+    CHAMP_ENTIER(RequeteChangements, attente, "attente", 0),
+    CHAMP_ENTIER(RequeteChangements, limite, "limite", 0),
+};
+
+static void route_changes(struct mg_connection *c, struct mg_http_message *hm) {
+  Parametres params;
+  RequeteChangements req = {"", "", 25, 100};
+  if (!lier_requete(c, hm, &params, s_schema_changements, NB_CHAMPS(s_schema_changements), &req, NULL)) return;
+  struct mg_str *accept = mg_http_get_header(hm, "Accept");
+  Bool sse = strcmp(req.mode, "sse") == 0 ||
+             (accept != NULL && mg_strstr(*accept, mg_str("text/event-stream")) != NULL);
+  struct mg_str *reprise = mg_http_get_header(hm, "Last-Event-ID");
+  char since[24];
+  if (reprise != NULL && reprise->len > 0 && reprise->len < sizeof(since)) {
+    snprintf(since, sizeof(since), "%.*s", (int) reprise->len, reprise->buf);
+  } else {
+    snprintf(since, sizeof(since), "%s", req.since);
+  }
+  // Sans curseur : a partir de maintenant
+  unsigned long long depuis = atomic_load(&s_changements.dernier);
+  if (since[0] != '\0') {
+    char *fin = NULL;
+    depuis = strtoull(since, &fin, 10);
+    if (!isdigit((unsigned char) since[0]) || *fin != '\0') {
+      mg_http_reply(c, 400, "", "{\"error\": \"since invalide\"}\n");
+      return;
+    }
+  }
+  if (req.attente < 0) req.attente = 0;
+  if (req.attente > 120) req.attente = 120;
+  if (req.limite <= 0) req.limite = 100;
+  changements_servir(&s_changements, c, depuis, sse, (unsigned long) req.attente * 1000, (size_t) req.limite);
+}
+
+// Ramasse-miettes periodique, dans la boucle 0
+static void collecter_depots(void *arg) {
+  (void) arg;
+  size_t nb = depot_collecter(&s_depot_livres, DEPOT_DELAI_MS) +
+              depot_collecter(&s_depot_couvertures, DEPOT_DELAI_MS);
+  if (nb > 0) MG_INFO(("Depot : %lu blobs sans reference effaces", (unsigned long) nb));
+}
+
+/* Table des routes. Les mutations restent accessibles en GET car le
+   frontend les appelle ainsi ; les uploads arrivent en POST.
+   routeur_ajouter_tache : tout ce qui ecrit le catalogue, touche aux
+   fichiers .dat de data/ ou serialise beaucoup de livres part dans le pool.
+   ROUTE_PARTAGEE : une selection demandee par beaucoup de clients a la fois
+   n'est calculee qu'une fois par version du catalogue. Aucune route ne
+   verifie d'identite : /api/login ne delivre pas de session. */
+static Bool routes_enregistrer(Routeur *r) {
+  const unsigned int ecriture = ROUTE_GET | ROUTE_POST;
+  Bool ok = VRAI;
+  ok = ok && routeur_ajouter_tache(r, "/api/livres", route_livres, ROUTE_LECTURE, ROUTE_PARTAGEE);
+  ok = ok && routeur_ajouter(r, "/api/recherche", route_recherche, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/add", route_add, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/register", route_register, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/login", route_login, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/modifier", route_modifier, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/supprimer", route_supprimer, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/categorie", route_categorie, ROUTE_LECTURE, ROUTE_PARTAGEE);
+  ok = ok && routeur_ajouter(r, "/api/compter", route_compter, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/afficher", route_afficher, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/couverture", route_couverture, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/pdfs", route_pdfs, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/upload", route_upload, ROUTE_POST | ROUTE_PUT, 0);
+  ok = ok && routeur_ajouter(r, "/api/upload_couverture", route_upload_couverture,
+                             ROUTE_POST | ROUTE_PUT, 0);
+  ok = ok && routeur_ajouter(r, "/api/televersement", route_televersement,
+                             ROUTE_LECTURE | ROUTE_POST | ROUTE_PUT | ROUTE_DELETE, 0);
+  ok = ok && routeur_ajouter(r, "/api/depot", route_depot, ROUTE_LECTURE | ROUTE_POST, 0);
+  ok = ok && routeur_ajouter(r, "/api/externe", route_externe, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/cache_externe", route_cache_externe, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/partages", route_partages, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/batch", route_batch, ROUTE_POST, 0);
+  ok = ok && routeur_ajouter(r, "/api/import", route_import, ROUTE_POST | ROUTE_PUT, 0);
+  ok = ok && routeur_ajouter(r, "/api/export", route_export, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/ws", route_ws, ROUTE_GET, 0);
+  ok = ok && routeur_ajouter(r, "/api/diffusion", route_diffusion, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/changes", route_changes, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/sauvegarder", route_sauvegarder, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/recharger", route_recharger, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/emprunter", route_emprunter, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/retourner", route_retourner, ecriture, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/emprunts", route_emprunts, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter_tache(r, "/api/emprunts_all", route_emprunts_all, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/routes", route_routes, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/travailleurs", route_travailleurs, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/boucles", route_boucles, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/api/cache_fichiers", route_cache_fichiers, ROUTE_LECTURE, 0);
+  ok = ok && routeur_ajouter(r, "/lire", route_lire, ROUTE_LECTURE, 0);
+  return ok && routeur_finaliser(r);
+}
+
+static void event_handler(struct mg_connection *c, int ev, void *ev_data) {
+  boucle_compter(c, ev);
+  if (ev == MG_EV_HTTP_HDRS) {
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    if (!televersement_intercepter(&s_televersements, c, hm)) import_intercepter(c, hm);  // corps en flux
+  } else if (ev == MG_EV_HTTP_MSG) {
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    routeur_dispatch(&s_routeur, c, hm);
+  } else if (ev == MG_EV_WAKEUP && c->is_listening) {
+    travail_livrer(c);                        // reponses des routes lourdes
+    diffusion_livrer(&s_diffusion, c);        // evenements pour les abonnes de /ws
+    changements_livrer(&s_changements, c);    // et ceux de /api/changes
+  } else if (ev == MG_EV_POLL && c->is_listening) {
+    travail_livrer(c);  // reveil perdu (tube plein)
+    diffusion_livrer(&s_diffusion, c);
+    changements_livrer(&s_changements, c);
+  } else if (ev == MG_EV_CLOSE) {
+    travail_abandonner(c);
+    diffusion_quitter(&s_diffusion, c);
+  }
+}
+
+static void signal_handler(int sig) {
+  atomic_store(&s_signo, sig);
+}
+
+/* --boucles=N : N boucles d'evenements sur le meme port (0 : une par coeur). */
+static size_t lire_nb_boucles(int argc, char **argv) {
+  size_t nb = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--boucles=", 10) == 0) nb = (size_t) strtoul(argv[i] + 10, NULL, 10);
+  }
+  return nb;
+}
+
+/* --plafond_ip=K : au plus K Kio/s de pdf et couvertures par adresse IP
+   (0, par defaut : pas de plafond). */
+static size_t lire_plafond_ip(int argc, char **argv) {
+  size_t kio = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--plafond_ip=", 13) == 0) kio = (size_t) strtoul(argv[i] + 13, NULL, 10);
+  }
+  return kio * 1024;
+}
+
+/* --gutendex=URL : liste des livres de l'amont du mandataire (par defaut
+   https://gutendex.com/books/), par exemple un faux serveur local. */
+static const char *lire_amont_externe(int argc, char **argv) {
+  const char *url = EXTERNE_AMONT;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--gutendex=", 11) == 0) url = argv[i] + 11;
+  }
+  return url;
+}
+
+static Bool option_presente(int argc, char **argv, const char *option) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], option) == 0) return VRAI;
+  }
+  return FAUX;
+}
+
+/* serveur_biblio importer <fichier> [--format=csv|ndjson|marc] : import en
+   masse hors ligne, serveur arrete (data/livres.dat est reecrit). Un seul
+   exemplaire du catalogue en memoire, analyse sur tous les coeurs. */
+static int commande_importer(int argc, char **argv) {
+  const char *chemin = argc > 2 ? argv[2] : NULL;
+  FormatImport format = IMPORT_CSV;
+  Bool format_ok = chemin != NULL && importation_format(chemin, &format);
+  for (int i = 3; i < argc; i++) {
+    if (strncmp(argv[i], "--format=", 9) == 0) format_ok = importation_format(argv[i] + 9, &format);
+  }
+  if (chemin == NULL || !format_ok) {
+    printf("Usage : %s importer <fichier.csv|.ndjson|.mrk> [--format=csv|ndjson|marc]\n", argv[0]);
+    return 2;
+  }
+  FILE *fp = fopen(chemin, "rb");
+  char *tampon = malloc(IMPORT_TAMPON);
+  if (fp == NULL || tampon == NULL) {
+    printf("Erreur : Impossible de lire %s\n", chemin);
+    if (fp != NULL) fclose(fp);
+    free(tampon);
+    return 1;
+  }
+
+  Bibliotheque bibli;
+  biblio_init(&bibli);
+  bibli.muet = VRAI;
+  fichiers_charger(&bibli, s_data_file);
+  fichiers_rejouer(&bibli, s_journal_file);
+  size_t avant = biblio_count(&bibli);
+
+  PoolTravailleurs pool;
+  Bool avec_pool = pool_init(&pool, 0);
+  Importation imp;
+  Bool ok = importation_init(&imp, format, avec_pool ? &pool : NULL, NULL, NULL);
+  size_t n;
+  while (ok && (n = fread(tampon, 1, IMPORT_TAMPON, fp)) > 0) importation_ajouter(&imp, tampon, n);
+  ok = ok && !ferror(fp);
+  fclose(fp);
+  free(tampon);
+  importation_fermer(&imp);
+  importation_attendre(&imp);
+  pool_arreter(&pool);
+
+  uint64_t debut = mg_millis();
+  if (ok && imp.erreur[0] == '\0') importation_inserer(&imp, &bibli, VRAI, NULL, NULL);
+  uint64_t insertion_ms = mg_millis() - debut;
+  char *rapport = importation_rapport_json(&imp, insertion_ms, mg_millis() - imp.debut_ms);
+  printf("%s\n", rapport != NULL ? rapport : "{}");
+  free(rapport);
+
+  debut = mg_millis();
+  Bool sauve = imp.importees == 0 || fichiers_sauvegarder(&bibli, s_data_file);
+  if (sauve && imp.importees > 0) fichiers_journal_vider(s_journal_file);
+  if (sauve) {
+    printf("%lu livres au catalogue (%lu avant), %s ecrit en %llu ms\n", (unsigned long) biblio_count(&bibli),
+           (unsigned long) avant, s_data_file, (unsigned long long) (mg_millis() - debut));
+  } else {
+    printf("Erreur : Impossible d'ecrire %s\n", s_data_file);
+  }
+  ok = ok && sauve && imp.erreur[0] == '\0';
+  importation_free(&imp);
+  biblio_free(&bibli);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "importer") == 0) return commande_importer(argc, argv);
+
+  if (!catalogue_init(&s_catalogue)) {
+    printf("Erreur fatale : Impossible d'allouer le catalogue\n");
+    return 1;
+  }
 
   mg_log_set(s_debug_level);
 
  
-  if (fichiers_charger(&ma_biblio, s_data_file)) {
-    printf("Succès : %zu livres chargés depuis %s\n", biblio_count(&ma_biblio), s_data_file);
+  if (catalogue_charger(&s_catalogue, s_data_file, s_journal_file, NULL)) {
+    printf("Succès : %zu livres chargés depuis %s\n", biblio_count(s_catalogue.copies[0]), s_data_file);
   } else {
     printf("Info : Aucun fichier trouvé, démarrage avec une bibliothèque vide.\n");
   }
@@ -920,31 +2667,113 @@ int main(void) {
   signal(SIGINT, signal_handler);
   signal(SIGTERM, signal_handler);
 
-  mg_mgr_init(&mgr); 
-  if (mg_http_listen(&mgr, s_listening_address, event_handler, NULL) == NULL) {
+  /* Frontend embarque dans le binaire (voir Makefile) s'il y en a un. --dev :
+     copie du disque, relue a chaque modification, sans cache immuable. */
+  Bool dev = option_presente(argc, argv, "--dev");
+  if (!dev && mg_unlist(0) != NULL) {
+    s_root_dir = "/frontend";
+    s_root_fs = &mg_fs_packed;
+  }
+  if (statiques_charger(&s_statiques, s_root_fs, s_root_dir, dev)) {
+    printf("Frontend en memoire : %lu fichiers, %lu Ko (%s)\n", (unsigned long) s_statiques.nb,
+           (unsigned long) (s_statiques.octets / 1024),
+           dev ? "mode dev" : s_root_fs == &mg_fs_packed ? "embarque" : "disque");
+  }
+
+  cache_fichiers_init(&s_cache_fichiers, CACHE_FICHIERS_CAPACITE);
+  inventaire_init(&s_inventaire_pdfs, s_books_dir, ".pdf");
+  cache_fichiers_ecouter(&s_cache_fichiers, inventaire_ecouter, &s_inventaire_pdfs);
+  if (!cache_fichiers_surveiller(&s_cache_fichiers, s_books_dir) ||
+      !cache_fichiers_surveiller(&s_cache_fichiers, s_covers_dir)) {
+    printf("Info : inotify indisponible, le cache des fichiers n'est invalide que par les uploads.\n");
+  }
+
+  if (!depot_init(&s_depot_livres, s_books_dir, &s_cache_fichiers, &s_inventaire_pdfs) ||
+      !depot_init(&s_depot_couvertures, s_covers_dir, &s_cache_fichiers, NULL)) {
+    printf("Info : repertoire %s ou %s absent, depot vide.\n", s_books_dir, s_covers_dir);
+  }
+  size_t migres = migrer_vers_depot();
+  recompter_references();
+  if (migres > 0) {
+    sauvegarder_catalogue();
+    printf("Depot : %lu fichiers renommes d'apres leur contenu\n", (unsigned long) migres);
+  }
+  printf("Depot : %lu pdf, %lu couvertures\n", (unsigned long) s_depot_livres.nb_blobs,
+         (unsigned long) s_depot_couvertures.nb_blobs);
+  televersements_init(&s_televersements);
+  externe_init(&s_externe, lire_amont_externe(argc, argv), EXTERNE_CAPACITE, composer_externe);
+
+  routeur_init(&s_routeur, route_fichiers_statiques);
+  if (!routes_enregistrer(&s_routeur)) {
+    printf("Erreur fatale : Impossible de construire la table des routes\n");
+    return 1;
+  }
+
+  PlafondsIP *plafonds = plafonds_ip_init(&s_plafonds_ip, lire_plafond_ip(argc, argv)) ? &s_plafonds_ip : NULL;
+  if (!boucles_init(&s_boucles, lire_nb_boucles(argc, argv), s_listening_address, event_handler, &s_signo,
+                    plafonds)) {
     printf("Erreur fatale : Impossible d'écouter sur %s\n", s_listening_address);
+    boucles_free(&s_boucles);
+    if (plafonds != NULL) plafonds_ip_free(plafonds);
     return 1;
   }
 
-  printf("Serveur en ligne sur %s\n", s_listening_address);
+  if (!diffusion_init(&s_diffusion, s_boucles.nb)) {
+    printf("Erreur fatale : Impossible d'allouer la diffusion\n");
+    return 1;
+  }
+  if (!changements_init(&s_changements, s_changements_file, s_boucles.nb)) {
+    printf("Erreur fatale : Impossible d'allouer le flux des changements\n");
+    return 1;
+  }
+  for (size_t i = 0; s_boucles.reveil && i < s_boucles.nb; i++) {
+    diffusion_boucle(&s_diffusion, i, &s_boucles.boucles[i].mgr, s_boucles.boucles[i].ecoute);
+    changements_boucle(&s_changements, i, &s_boucles.boucles[i].mgr, s_boucles.boucles[i].ecoute);
+  }
+
+  // Sans canal de reveil, les routes lourdes s'executent dans la boucle
+  vols_init(&s_vols, &s_catalogue.generation);
+  if (s_boucles.reveil && pool_init(&s_pool, 0)) {
+    s_routeur.pool = &s_pool;
+    s_routeur.vols = &s_vols;
+    printf("Pool de travail : %lu threads\n", (unsigned long) s_pool.nb);
+  } else {
+    pool_arreter(&s_pool);
+    printf("Info : pool de travail indisponible, traitement dans la boucle.\n");
+  }
+
+  mg_timer_add(&s_boucles.boucles[0].mgr, DEPOT_COLLECTE_MS, MG_TIMER_REPEAT, collecter_depots, NULL);
+
+  printf("Serveur en ligne sur %s (%lu boucles)\n", s_listening_address, (unsigned long) s_boucles.nb);
   printf("Appuyez sur Ctrl+C pour arrêter proprement.\n");
 
   
-  while (s_signo == 0) {
-    mg_mgr_poll(&mgr, 1000); 
-  }
+  boucles_executer(&s_boucles);  // jusqu'au signal d'arret
 
   
   printf("\nArrêt détecté. Sauvegarde des données...\n");
+  pool_arreter(&s_pool);  // termine les taches en cours avant la sauvegarde finale
   
 
-  if (fichiers_sauvegarder(&ma_biblio, s_data_file)) {
+  if (sauvegarder_catalogue()) {
     printf("Données sauvegardées avec succès.\n");
   }
 
 
-  mg_mgr_free(&mgr);
-  biblio_free(&ma_biblio);
+  boucles_free(&s_boucles);
+  diffusion_free(&s_diffusion);  // apres la fermeture des abonnes
+  changements_free(&s_changements);  // l'anneau part dans le journal
+  if (plafonds != NULL) plafonds_ip_free(plafonds);
+  televersements_free(&s_televersements);
+  externe_free(&s_externe);
+  depot_free(&s_depot_couvertures);
+  depot_free(&s_depot_livres);
+  cache_fichiers_free(&s_cache_fichiers);
+  inventaire_free(&s_inventaire_pdfs);
+  statiques_free(&s_statiques);
+  routeur_free(&s_routeur);
+  vols_free(&s_vols);
+  catalogue_free(&s_catalogue);
 
   printf("Fermeture propre. Au revoir !\n");
   return 0;
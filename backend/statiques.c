@@ -0,0 +1,325 @@
+#include "statiques.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t fnv1a(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; s++) {
+    h ^= (unsigned char) *s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static uint64_t fnv1a_64(struct mg_str s) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < s.len; i++) {
+    h ^= (unsigned char) s.buf[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static Bool finit_par(const char *s, const char *suffixe) {
+  size_t n = strlen(s), m = strlen(suffixe);
+  return n >= m && mg_ncasecmp(s + n - m, suffixe, m) == 0;
+}
+
+// Extension du dernier segment ("app.js" -> ".js"), NULL sans extension
+static const char *extension(const char *chemin) {
+  const char *base = strrchr(chemin, '/');
+  const char *point = strrchr(base != NULL ? base : chemin, '.');
+  return (point != NULL && point[1] != '\0') ? point : NULL;
+}
+
+static const char *type_mime(const char *chemin) {
+  static const char *types[][2] = {
+      {".html", "text/html; charset=utf-8"},  {".css", "text/css; charset=utf-8"},
+      {".js", "text/javascript; charset=utf-8"}, {".json", "application/json"},
+      {".png", "image/png"},                   {".jpg", "image/jpeg"},
+      {".jpeg", "image/jpeg"},                 {".gif", "image/gif"},
+      {".svg", "image/svg+xml"},               {".ico", "image/x-icon"},
+      {".webp", "image/webp"},                 {".woff2", "font/woff2"},
+      {".woff", "font/woff"},                  {".txt", "text/plain; charset=utf-8"},
+  };
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (finit_par(chemin, types[i][0])) return types[i][1];
+  }
+  return "application/octet-stream";
+}
+
+static Bool est_page(const Ressource *r) {
+  return finit_par(r->chemin, ".html");
+}
+
+static void calculer_etag(Ressource *r) {
+  uint64_t h = fnv1a_64(r->contenu);
+  mg_snprintf(r->etag, sizeof(r->etag), "\"%016llx\"", (unsigned long long) h);
+  mg_snprintf(r->etag_gz, sizeof(r->etag_gz), "\"%016llx-gz\"", (unsigned long long) h);
+  memcpy(r->empreinte, r->etag + 1, 8);
+  r->empreinte[8] = '\0';
+}
+
+static void liberer_contenu(Ressource *r) {
+  free((void *) r->contenu.buf);
+  free((void *) r->gz.buf);
+  r->contenu = r->gz = mg_str_n(NULL, 0);
+}
+
+/* Lit le fichier (et son .gz s'il est plus petit) dans r. FAUX si le
+   fichier n'existe plus, est un repertoire ou depasse la taille maximale. */
+static Bool lire_ressource(Statiques *s, Ressource *r) {
+  char complet[MG_PATH_MAX * 2], gz[MG_PATH_MAX * 2 + 4];
+  size_t taille = 0;
+  time_t mtime = 0;
+  mg_snprintf(complet, sizeof(complet), "%s/%s", s->racine, r->chemin);
+  int flags = s->fs->st(complet, &taille, &mtime);
+  if (flags == 0 || (flags & MG_FS_DIR) || taille > STATIQUES_TAILLE_MAX) return FAUX;
+  struct mg_str contenu = mg_file_read(s->fs, complet);
+  if (contenu.buf == NULL) return FAUX;
+
+  liberer_contenu(r);
+  r->contenu = contenu;
+  r->taille_source = taille;
+  r->mtime = mtime;
+  mg_snprintf(gz, sizeof(gz), "%s.gz", complet);
+  struct mg_str compresse = mg_file_read(s->fs, gz);
+  if (compresse.buf != NULL && compresse.len < contenu.len) r->gz = compresse;
+  else free((void *) compresse.buf);
+  r->mime = type_mime(r->chemin);
+  calculer_etag(r);
+  return VRAI;
+}
+
+static Ressource *trouver(Statiques *s, const char *chemin) {
+  uint32_t h = fnv1a(chemin);
+  for (Ressource *r = s->alveoles[h & (STATIQUES_ALVEOLES - 1)]; r != NULL; r = r->suivant) {
+    if (r->hachage == h && strcmp(r->chemin, chemin) == 0) return r;
+  }
+  return NULL;
+}
+
+static Ressource *ajouter(Statiques *s, const char *chemin) {
+  if (strlen(chemin) >= sizeof(((Ressource *) 0)->chemin)) return NULL;
+  Ressource *r = calloc(1, sizeof(Ressource));
+  if (r == NULL) return NULL;
+  strcpy(r->chemin, chemin);
+  if (!lire_ressource(s, r)) {
+    free(r);
+    return NULL;
+  }
+  r->hachage = fnv1a(chemin);
+  Ressource **alveole = &s->alveoles[r->hachage & (STATIQUES_ALVEOLES - 1)];
+  r->suivant = *alveole;
+  *alveole = r;
+  s->nb++;
+  s->octets += r->contenu.len + r->gz.len;
+  return r;
+}
+
+static void retirer(Statiques *s, Ressource *r) {
+  Ressource **p = &s->alveoles[r->hachage & (STATIQUES_ALVEOLES - 1)];
+  while (*p != r) p = &(*p)->suivant;
+  *p = r->suivant;
+  s->nb--;
+  s->octets -= r->contenu.len + r->gz.len;
+  liberer_contenu(r);
+  free(r);
+}
+
+typedef struct Parcours {
+  Statiques *s;
+  char relatif[MG_PATH_MAX];
+} Parcours;
+
+static void parcourir(Statiques *s, const char *relatif);
+
+static void parcourir_entree(const char *nom, void *arg) {
+  Parcours *p = (Parcours *) arg;
+  char chemin[MG_PATH_MAX], complet[MG_PATH_MAX * 2];
+  if (nom[0] == '.' || finit_par(nom, ".gz")) return;  // .gz : variante, pas ressource
+  if (p->relatif[0] == '\0') mg_snprintf(chemin, sizeof(chemin), "%s", nom);
+  else mg_snprintf(chemin, sizeof(chemin), "%s/%s", p->relatif, nom);
+  mg_snprintf(complet, sizeof(complet), "%s/%s", p->s->racine, chemin);
+  if (p->s->fs->st(complet, NULL, NULL) & MG_FS_DIR) parcourir(p->s, chemin);
+  else ajouter(p->s, chemin);
+}
+
+static void parcourir(Statiques *s, const char *relatif) {
+  Parcours p;
+  char complet[MG_PATH_MAX * 2];
+  p.s = s;
+  mg_snprintf(p.relatif, sizeof(p.relatif), "%s", relatif);
+  if (relatif[0] == '\0') mg_snprintf(complet, sizeof(complet), "%s", s->racine);
+  else mg_snprintf(complet, sizeof(complet), "%s/%s", s->racine, relatif);
+  s->fs->ls(complet, parcourir_entree, &p);
+}
+
+// "icon/x.png" -> "icon/x.<empreinte>.png"
+static void chemin_empreinte(const Ressource *r, char *dst, size_t taille) {
+  const char *ext = extension(r->chemin);
+  mg_snprintf(dst, taille, "%.*s.%s%s", (int) (ext - r->chemin), r->chemin, r->empreinte, ext);
+}
+
+/* Remplace dans les attributs href="..." et src="..." les chemins des
+   ressources connues (hors pages) par leur URL a empreinte. */
+static void reecrire_page(Statiques *s, Ressource *page) {
+  struct mg_str src = page->contenu;
+  size_t cap = src.len + 1024, len = 0;
+  char *dst = malloc(cap);
+  if (dst == NULL) return;
+  Bool change = FAUX;
+  size_t i = 0;
+  while (i < src.len) {
+    size_t attribut = 0;
+    if (i + 6 <= src.len && memcmp(src.buf + i, "href=\"", 6) == 0) attribut = 6;
+    else if (i + 5 <= src.len && memcmp(src.buf + i, "src=\"", 5) == 0) attribut = 5;
+    const char *fin = attribut ? memchr(src.buf + i + attribut, '"', src.len - i - attribut) : NULL;
+    char valeur[MG_PATH_MAX], url[MG_PATH_MAX + 16];
+    size_t n = fin != NULL ? (size_t) (fin - (src.buf + i + attribut)) : 0;
+    Ressource *r = NULL;
+    if (fin != NULL && n > 0 && n < sizeof(valeur)) {
+      memcpy(valeur, src.buf + i + attribut, n);
+      valeur[n] = '\0';
+      r = trouver(s, valeur[0] == '/' ? valeur + 1 : valeur);
+      if (r != NULL && (est_page(r) || extension(r->chemin) == NULL)) r = NULL;
+    }
+    if (r == NULL) {
+      if (len + 1 >= cap) break;
+      dst[len++] = src.buf[i++];
+      continue;
+    }
+    chemin_empreinte(r, url, sizeof(url));
+    int m = snprintf(dst + len, cap - len, "%.*s%s%s\"", (int) attribut, src.buf + i,
+                     valeur[0] == '/' ? "/" : "", url);
+    if (m < 0 || (size_t) m >= cap - len) break;
+    len += (size_t) m;
+    i += attribut + n + 1;
+    change = VRAI;
+  }
+  if (i < src.len || !change) {  // rien a faire, ou plus de place : page d'origine
+    free(dst);
+    return;
+  }
+  dst[len] = '\0';
+  s->octets += len - page->contenu.len;
+  free((void *) page->contenu.buf);
+  page->contenu = mg_str_n(dst, len);
+  // Le .gz a ete fait sur la page d'origine : il ne correspond plus
+  s->octets -= page->gz.len;
+  free((void *) page->gz.buf);
+  page->gz = mg_str_n(NULL, 0);
+  calculer_etag(page);
+}
+
+/* Charge tout le frontend en memoire. En mode normal, les pages sont
+   reecrites pour pointer vers les URL a empreinte. */
+Bool statiques_charger(Statiques *s, struct mg_fs *fs, const char *racine, Bool dev) {
+  if (s == NULL || fs == NULL || racine == NULL) return FAUX;
+  memset(s, 0, sizeof(Statiques));
+  pthread_mutex_init(&s->verrou, NULL);
+  s->fs = fs;
+  s->dev = dev;
+  mg_snprintf(s->racine, sizeof(s->racine), "%s", racine);
+  if (!(fs->st(racine, NULL, NULL) & MG_FS_DIR)) return FAUX;
+  parcourir(s, "");
+  if (!dev) {
+    for (size_t i = 0; i < STATIQUES_ALVEOLES; i++) {
+      for (Ressource *r = s->alveoles[i]; r != NULL; r = r->suivant) {
+        if (est_page(r)) reecrire_page(s, r);
+      }
+    }
+  }
+  return VRAI;
+}
+
+/* "app.3f2a9c1e.js" -> "app.js" si l'empreinte a la forme attendue ; la
+   correspondance avec l'empreinte courante est verifiee par l'appelant. */
+static Bool retirer_empreinte(const char *chemin, char *base, size_t taille, char *empreinte) {
+  const char *ext = extension(chemin);
+  if (ext == NULL || ext - chemin < 10 || ext[-9] != '.') return FAUX;
+  for (const char *p = ext - 8; p < ext; p++) {
+    if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'))) return FAUX;
+  }
+  memcpy(empreinte, ext - 8, 8);
+  empreinte[8] = '\0';
+  mg_snprintf(base, taille, "%.*s%s", (int) (ext - 9 - chemin), chemin, ext);
+  return VRAI;
+}
+
+// Mode dev : relit un fichier modifie, oublie un fichier supprime
+static Ressource *rafraichir(Statiques *s, Ressource *r, const char *chemin) {
+  char complet[MG_PATH_MAX * 2];
+  size_t taille = 0;
+  time_t mtime = 0;
+  if (r == NULL) return ajouter(s, chemin);
+  mg_snprintf(complet, sizeof(complet), "%s/%s", s->racine, r->chemin);
+  int flags = s->fs->st(complet, &taille, &mtime);
+  if (flags != 0 && taille == r->taille_source && mtime == r->mtime) return r;
+  size_t avant = r->contenu.len + r->gz.len;
+  if (flags == 0 || !lire_ressource(s, r)) {
+    retirer(s, r);
+    return NULL;
+  }
+  s->octets += r->contenu.len + r->gz.len - avant;
+  return r;
+}
+
+static void envoyer(struct mg_connection *c, struct mg_http_message *hm, const Ressource *r, Bool immuable) {
+  struct mg_str *ae = mg_http_get_header(hm, "Accept-Encoding");
+  Bool gzip = r->gz.buf != NULL && ae != NULL && mg_strstr(*ae, mg_str("gzip")) != NULL;
+  const char *etag = gzip ? r->etag_gz : r->etag;
+  const char *cache = immuable ? STATIQUES_CACHE_IMMUABLE : "no-cache";
+  const char *vary = r->gz.buf != NULL ? "Vary: Accept-Encoding\r\n" : "";
+  struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+  if (inm != NULL && mg_vcasecmp(inm, etag) == 0) {
+    mg_printf(c, "HTTP/1.1 304 Not Modified\r\nEtag: %s\r\nCache-Control: %s\r\n%sContent-Length: 0\r\n\r\n",
+              etag, cache, vary);
+    c->is_resp = 0;
+    return;
+  }
+  struct mg_str corps = gzip ? r->gz : r->contenu;
+  mg_printf(c,
+            "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nEtag: %s\r\nCache-Control: %s\r\n%s%s"
+            "Content-Length: %lu\r\n\r\n",
+            r->mime, etag, cache, gzip ? "Content-Encoding: gzip\r\n" : "", vary, (unsigned long) corps.len);
+  if (mg_strcmp(hm->method, mg_str("HEAD")) != 0) mg_send(c, corps.buf, corps.len);
+  c->is_resp = 0;  // reponse complete, comme apres mg_http_reply
+}
+
+/* VRAI si la reponse est partie de la table. FAUX (chemin inconnu, Range,
+   methode autre que GET/HEAD) : a l'appelant de passer par le disque. */
+Bool statiques_servir(Statiques *s, struct mg_connection *c, struct mg_http_message *hm) {
+  char chemin[MG_PATH_MAX], base[MG_PATH_MAX], empreinte[9];
+  if (s == NULL || s->fs == NULL) return FAUX;
+  if (mg_strcmp(hm->method, mg_str("GET")) != 0 && mg_strcmp(hm->method, mg_str("HEAD")) != 0) return FAUX;
+  if (mg_http_get_header(hm, "Range") != NULL) return FAUX;
+  int n = mg_url_decode(hm->uri.buf, hm->uri.len, chemin, sizeof(chemin) - 16, 0);
+  if (n <= 0 || chemin[0] != '/' || strstr(chemin, "..") != NULL) return FAUX;
+  memmove(chemin, chemin + 1, (size_t) n);  // sans le '/' initial
+  if (chemin[0] == '\0' || chemin[n - 2] == '/') strcat(chemin, "index.html");
+
+  if (s->dev) pthread_mutex_lock(&s->verrou);
+  Ressource *r = trouver(s, chemin);
+  Bool immuable = FAUX;
+  if (r == NULL && retirer_empreinte(chemin, base, sizeof(base), empreinte)) {
+    r = trouver(s, base);
+    // Empreinte perimee (frontend modifie en dev) : contenu actuel, sans cache immuable
+    immuable = r != NULL && !s->dev && strcmp(empreinte, r->empreinte) == 0;
+    if (r != NULL) memcpy(chemin, base, strlen(base) + 1);
+  }
+  if (s->dev) r = rafraichir(s, r, chemin);
+  if (r != NULL) envoyer(c, hm, r, immuable);
+  if (s->dev) pthread_mutex_unlock(&s->verrou);
+  return r != NULL;
+}
+
+void statiques_free(Statiques *s) {
+  if (s == NULL) return;
+  for (size_t i = 0; i < STATIQUES_ALVEOLES; i++) {
+    while (s->alveoles[i] != NULL) retirer(s, s->alveoles[i]);
+  }
+  pthread_mutex_destroy(&s->verrou);
+}
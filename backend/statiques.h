@@ -0,0 +1,49 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+
+#define STATIQUES_ALVEOLES 256            // puissance de 2
+#define STATIQUES_TAILLE_MAX (1024 * 1024)  // au-dela : laisse a mg_http_serve_dir
+#define STATIQUES_CACHE_IMMUABLE "public, max-age=31536000, immutable"
+
+/* Un fichier du frontend tel qu'il part sur le fil : contenu (pages deja
+   reecrites avec les URL a empreinte), variante gzip si un fichier .gz
+   l'accompagne, type MIME et ETag fort calcule sur le contenu. */
+typedef struct Ressource {
+    char chemin[MG_PATH_MAX];   // relatif a la racine : "icon/loupe.png"
+    uint32_t hachage;
+    const char *mime;
+    struct mg_str contenu;
+    struct mg_str gz;           // buf NULL : pas de variante compressee
+    char etag[24];
+    char etag_gz[28];
+    char empreinte[9];          // 8 premiers chiffres de l'ETag, dans les URL
+    size_t taille_source;       // taille et date du fichier lu (mode dev)
+    time_t mtime;
+    struct Ressource *suivant;
+} Ressource;
+
+/* Table construite au demarrage : servir une ressource ne demande aucun
+   appel systeme en dehors de l'ecriture sur la socket. Les pages HTML
+   referencent les css/js/images par une URL a empreinte
+   ("app.3f2a9c1e.js"), servie avec un Cache-Control immuable ; les pages
+   elles-memes se revalident par ETag. En mode dev, pas d'empreinte ni de
+   cache immuable, et un fichier modifie est relu a la requete suivante. */
+typedef struct Statiques {
+    struct mg_fs *fs;
+    char racine[MG_PATH_MAX];
+    Ressource *alveoles[STATIQUES_ALVEOLES];
+    size_t nb;
+    size_t octets;
+    Bool dev;
+    pthread_mutex_t verrou;     // mode dev seulement : la table change
+} Statiques;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+Bool statiques_charger(Statiques *s, struct mg_fs *fs, const char *racine, Bool dev);
+Bool statiques_servir(Statiques *s, struct mg_connection *c, struct mg_http_message *hm);
+void statiques_free(Statiques *s);
@@ -0,0 +1,614 @@
+#include "bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// --- OUTILS BAS NIVEAU ---
+
+static inline uint32_t popcount64(uint64_t x) {
+#if defined(__GNUC__)
+    return (uint32_t) __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (uint32_t) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline int ctz64(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// dst = a & b sur un conteneur bitset complet, retourne le cardinal
+static uint32_t mots_et(uint64_t *dst, const uint64_t *a, const uint64_t *b) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= BITMAP_MOTS; i += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                     _mm256_loadu_si256((const __m256i *) (b + i)));
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= BITMAP_MOTS; i += 2) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+                                  _mm_loadu_si128((const __m128i *) (b + i)));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+#endif
+    for (; i < BITMAP_MOTS; i++) {
+        dst[i] = a[i] & b[i];
+    }
+    uint32_t cardinal = 0;
+    for (i = 0; i < BITMAP_MOTS; i++) {
+        cardinal += popcount64(dst[i]);
+    }
+    return cardinal;
+}
+
+// dst = a | b sur un conteneur bitset complet, retourne le cardinal
+static uint32_t mots_ou(uint64_t *dst, const uint64_t *a, const uint64_t *b) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= BITMAP_MOTS; i += 4) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                    _mm256_loadu_si256((const __m256i *) (b + i)));
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= BITMAP_MOTS; i += 2) {
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+                                 _mm_loadu_si128((const __m128i *) (b + i)));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+#endif
+    for (; i < BITMAP_MOTS; i++) {
+        dst[i] = a[i] | b[i];
+    }
+    uint32_t cardinal = 0;
+    for (i = 0; i < BITMAP_MOTS; i++) {
+        cardinal += popcount64(dst[i]);
+    }
+    return cardinal;
+}
+
+static inline Bool mot_teste(const uint64_t *mots, uint16_t bas) {
+    return (mots[bas >> 6] >> (bas & 63)) & 1 ? VRAI : FAUX;
+}
+
+// Recherche dichotomique : position de bas dans le tableau (ou d'insertion)
+static uint32_t tableau_chercher(const uint16_t *tab, uint32_t n, uint16_t bas, Bool *trouve) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (tab[mid] < bas) lo = mid + 1;
+        else hi = mid;
+    }
+    *trouve = (lo < n && tab[lo] == bas) ? VRAI : FAUX;
+    return lo;
+}
+
+// --- CONTENEURS ---
+
+static void conteneur_liberer(Conteneur *c) {
+    free(c->tableau);
+    free(c->mots);
+    c->tableau = NULL;
+    c->mots = NULL;
+    c->cardinal = 0;
+    c->capacite = 0;
+}
+
+static Bool conteneur_vers_bitset(Conteneur *c) {
+    uint64_t *mots = calloc(BITMAP_MOTS, sizeof(uint64_t));
+    if (mots == NULL)
+        return FAUX;
+    for (uint32_t i = 0; i < c->cardinal; i++) {
+        mots[c->tableau[i] >> 6] |= 1ULL << (c->tableau[i] & 63);
+    }
+    free(c->tableau);
+    c->tableau = NULL;
+    c->capacite = 0;
+    c->mots = mots;
+    return VRAI;
+}
+
+static Bool conteneur_vers_tableau(Conteneur *c) {
+    uint16_t *tab = malloc((c->cardinal > 0 ? c->cardinal : 1) * sizeof(uint16_t));
+    if (tab == NULL)
+        return FAUX;
+    uint32_t n = 0;
+    for (int w = 0; w < BITMAP_MOTS; w++) {
+        uint64_t mot = c->mots[w];
+        while (mot != 0) {
+            tab[n++] = (uint16_t) (w * 64 + ctz64(mot));
+            mot &= mot - 1;
+        }
+    }
+    free(c->mots);
+    c->mots = NULL;
+    c->tableau = tab;
+    c->capacite = c->cardinal > 0 ? c->cardinal : 1;
+    return VRAI;
+}
+
+// Un resultat d'operation reste en bitset seulement s'il est assez peuple
+static Bool conteneur_normaliser(Conteneur *c) {
+    if (c->mots != NULL && c->cardinal <= BITMAP_TABLEAU_MAX)
+        return conteneur_vers_tableau(c);
+    if (c->tableau != NULL && c->cardinal > BITMAP_TABLEAU_MAX)
+        return conteneur_vers_bitset(c);
+    return VRAI;
+}
+
+static Bool conteneur_copier(Conteneur *dst, const Conteneur *src) {
+    *dst = *src;
+    dst->tableau = NULL;
+    dst->mots = NULL;
+    if (src->mots != NULL) {
+        dst->mots = malloc(BITMAP_MOTS * sizeof(uint64_t));
+        if (dst->mots == NULL)
+            return FAUX;
+        memcpy(dst->mots, src->mots, BITMAP_MOTS * sizeof(uint64_t));
+    } else {
+        dst->capacite = src->cardinal > 0 ? src->cardinal : 1;
+        dst->tableau = malloc(dst->capacite * sizeof(uint16_t));
+        if (dst->tableau == NULL)
+            return FAUX;
+        memcpy(dst->tableau, src->tableau, src->cardinal * sizeof(uint16_t));
+    }
+    return VRAI;
+}
+
+static Bool conteneur_et(Conteneur *res, const Conteneur *a, const Conteneur *b) {
+    memset(res, 0, sizeof(Conteneur));
+    res->cle = a->cle;
+    if (a->mots != NULL && b->mots != NULL) {
+        res->mots = malloc(BITMAP_MOTS * sizeof(uint64_t));
+        if (res->mots == NULL)
+            return FAUX;
+        res->cardinal = mots_et(res->mots, a->mots, b->mots);
+        return conteneur_normaliser(res);
+    }
+    if (a->mots != NULL) {
+        const Conteneur *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    // a est un tableau : le resultat tient dans a->cardinal valeurs
+    res->capacite = a->cardinal > 0 ? a->cardinal : 1;
+    res->tableau = malloc(res->capacite * sizeof(uint16_t));
+    if (res->tableau == NULL)
+        return FAUX;
+    if (b->mots != NULL) {
+        for (uint32_t i = 0; i < a->cardinal; i++) {
+            if (mot_teste(b->mots, a->tableau[i]))
+                res->tableau[res->cardinal++] = a->tableau[i];
+        }
+    } else {
+        uint32_t i = 0, j = 0;
+        while (i < a->cardinal && j < b->cardinal) {
+            if (a->tableau[i] < b->tableau[j]) i++;
+            else if (a->tableau[i] > b->tableau[j]) j++;
+            else {
+                res->tableau[res->cardinal++] = a->tableau[i];
+                i++;
+                j++;
+            }
+        }
+    }
+    return VRAI;
+}
+
+static Bool conteneur_ou(Conteneur *res, const Conteneur *a, const Conteneur *b) {
+    memset(res, 0, sizeof(Conteneur));
+    res->cle = a->cle;
+    if (a->mots != NULL && b->mots != NULL) {
+        res->mots = malloc(BITMAP_MOTS * sizeof(uint64_t));
+        if (res->mots == NULL)
+            return FAUX;
+        res->cardinal = mots_ou(res->mots, a->mots, b->mots);
+        return VRAI;
+    }
+    if (a->mots != NULL || b->mots != NULL) {
+        const Conteneur *bits = (a->mots != NULL) ? a : b;
+        const Conteneur *tab = (a->mots != NULL) ? b : a;
+        if (!conteneur_copier(res, bits))
+            return FAUX;
+        for (uint32_t i = 0; i < tab->cardinal; i++) {
+            uint16_t bas = tab->tableau[i];
+            if (!mot_teste(res->mots, bas)) {
+                res->mots[bas >> 6] |= 1ULL << (bas & 63);
+                res->cardinal++;
+            }
+        }
+        return VRAI;
+    }
+    res->capacite = a->cardinal + b->cardinal;
+    res->tableau = malloc((res->capacite > 0 ? res->capacite : 1) * sizeof(uint16_t));
+    if (res->tableau == NULL)
+        return FAUX;
+    uint32_t i = 0, j = 0;
+    while (i < a->cardinal || j < b->cardinal) {
+        if (j >= b->cardinal || (i < a->cardinal && a->tableau[i] < b->tableau[j])) {
+            res->tableau[res->cardinal++] = a->tableau[i++];
+        } else if (i >= a->cardinal || b->tableau[j] < a->tableau[i]) {
+            res->tableau[res->cardinal++] = b->tableau[j++];
+        } else {
+            res->tableau[res->cardinal++] = a->tableau[i];
+            i++;
+            j++;
+        }
+    }
+    return conteneur_normaliser(res);
+}
+
+static uint32_t conteneur_et_cardinal(const Conteneur *a, const Conteneur *b) {
+    uint32_t cardinal = 0;
+    if (a->mots != NULL && b->mots != NULL) {
+        for (int i = 0; i < BITMAP_MOTS; i++) {
+            cardinal += popcount64(a->mots[i] & b->mots[i]);
+        }
+        return cardinal;
+    }
+    if (a->mots != NULL) {
+        const Conteneur *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    if (b->mots != NULL) {
+        for (uint32_t i = 0; i < a->cardinal; i++) {
+            cardinal += mot_teste(b->mots, a->tableau[i]);
+        }
+        return cardinal;
+    }
+    uint32_t i = 0, j = 0;
+    while (i < a->cardinal && j < b->cardinal) {
+        if (a->tableau[i] < b->tableau[j]) i++;
+        else if (a->tableau[i] > b->tableau[j]) j++;
+        else {
+            cardinal++;
+            i++;
+            j++;
+        }
+    }
+    return cardinal;
+}
+
+// --- BITMAP ---
+
+static size_t bitmap_chercher(const Bitmap *bm, uint16_t cle, Bool *trouve) {
+    size_t lo = 0, hi = bm->nb;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (bm->conteneurs[mid].cle < cle) lo = mid + 1;
+        else hi = mid;
+    }
+    *trouve = (lo < bm->nb && bm->conteneurs[lo].cle == cle) ? VRAI : FAUX;
+    return lo;
+}
+
+static Bool bitmap_reserver(Bitmap *bm, size_t n) {
+    if (n <= bm->capacite)
+        return VRAI;
+    size_t cap = bm->capacite ? bm->capacite * 2 : 4;
+    while (cap < n) cap *= 2;
+    Conteneur *tmp = realloc(bm->conteneurs, cap * sizeof(Conteneur));
+    if (tmp == NULL)
+        return FAUX;
+    bm->conteneurs = tmp;
+    bm->capacite = cap;
+    return VRAI;
+}
+
+// Ajoute en fin un conteneur deja construit (cles croissantes) ; vide = libere
+static Bool bitmap_pousser(Bitmap *bm, Conteneur *c) {
+    if (c->cardinal == 0) {
+        conteneur_liberer(c);
+        return VRAI;
+    }
+    if (!bitmap_reserver(bm, bm->nb + 1)) {
+        conteneur_liberer(c);
+        return FAUX;
+    }
+    bm->conteneurs[bm->nb++] = *c;
+    return VRAI;
+}
+
+void bitmap_init(Bitmap *bm) {
+    if (bm == NULL)
+        return;
+    bm->conteneurs = NULL;
+    bm->nb = 0;
+    bm->capacite = 0;
+    bm->dense = FAUX;
+}
+
+void bitmap_init_dense(Bitmap *bm) {
+    if (bm == NULL)
+        return;
+    bitmap_init(bm);
+    bm->dense = VRAI;
+}
+
+void bitmap_free(Bitmap *bm) {
+    if (bm == NULL)
+        return;
+    for (size_t i = 0; i < bm->nb; i++) {
+        conteneur_liberer(&bm->conteneurs[i]);
+    }
+    free(bm->conteneurs);
+    bm->conteneurs = NULL;
+    bm->nb = 0;
+    bm->capacite = 0;
+}
+
+Bool bitmap_add(Bitmap *bm, uint32_t valeur) {
+    if (bm == NULL)
+        return FAUX;
+    uint16_t cle = (uint16_t) (valeur >> 16);
+    uint16_t bas = (uint16_t) (valeur & 0xFFFF);
+    Bool trouve;
+    size_t pos = bitmap_chercher(bm, cle, &trouve);
+
+    if (!trouve) {
+        if (!bitmap_reserver(bm, bm->nb + 1))
+            return FAUX;
+        Conteneur c;
+        memset(&c, 0, sizeof(Conteneur));
+        c.cle = cle;
+        if (bm->dense) {
+            c.mots = calloc(BITMAP_MOTS, sizeof(uint64_t));
+            if (c.mots == NULL)
+                return FAUX;
+        } else {
+            c.capacite = 4;
+            c.tableau = malloc(c.capacite * sizeof(uint16_t));
+            if (c.tableau == NULL)
+                return FAUX;
+        }
+        memmove(&bm->conteneurs[pos + 1], &bm->conteneurs[pos], (bm->nb - pos) * sizeof(Conteneur));
+        bm->conteneurs[pos] = c;
+        bm->nb++;
+    }
+
+    Conteneur *c = &bm->conteneurs[pos];
+    if (c->tableau != NULL) {
+        uint32_t i = tableau_chercher(c->tableau, c->cardinal, bas, &trouve);
+        if (trouve)
+            return FAUX;
+        if (c->cardinal >= BITMAP_TABLEAU_MAX) {
+            if (!conteneur_vers_bitset(c))
+                return FAUX;
+        } else {
+            if (c->cardinal == c->capacite) {
+                uint32_t cap = c->capacite * 2;
+                uint16_t *tmp = realloc(c->tableau, cap * sizeof(uint16_t));
+                if (tmp == NULL)
+                    return FAUX;
+                c->tableau = tmp;
+                c->capacite = cap;
+            }
+            memmove(&c->tableau[i + 1], &c->tableau[i], (c->cardinal - i) * sizeof(uint16_t));
+            c->tableau[i] = bas;
+            c->cardinal++;
+            return VRAI;
+        }
+    }
+    if (mot_teste(c->mots, bas))
+        return FAUX;
+    c->mots[bas >> 6] |= 1ULL << (bas & 63);
+    c->cardinal++;
+    return VRAI;
+}
+
+Bool bitmap_remove(Bitmap *bm, uint32_t valeur) {
+    if (bm == NULL)
+        return FAUX;
+    uint16_t cle = (uint16_t) (valeur >> 16);
+    uint16_t bas = (uint16_t) (valeur & 0xFFFF);
+    Bool trouve;
+    size_t pos = bitmap_chercher(bm, cle, &trouve);
+    if (!trouve)
+        return FAUX;
+
+    Conteneur *c = &bm->conteneurs[pos];
+    if (c->mots != NULL) {
+        if (!mot_teste(c->mots, bas))
+            return FAUX;
+        c->mots[bas >> 6] &= ~(1ULL << (bas & 63));
+        c->cardinal--;
+        // Un bitmap dense garde ses conteneurs : le prochain ajout reste en O(1)
+        if (bm->dense)
+            return VRAI;
+        if (c->cardinal > 0 && c->cardinal <= BITMAP_TABLEAU_MAX)
+            conteneur_vers_tableau(c);
+    } else {
+        uint32_t i = tableau_chercher(c->tableau, c->cardinal, bas, &trouve);
+        if (!trouve)
+            return FAUX;
+        memmove(&c->tableau[i], &c->tableau[i + 1], (c->cardinal - i - 1) * sizeof(uint16_t));
+        c->cardinal--;
+    }
+    if (c->cardinal == 0) {
+        conteneur_liberer(c);
+        memmove(&bm->conteneurs[pos], &bm->conteneurs[pos + 1], (bm->nb - pos - 1) * sizeof(Conteneur));
+        bm->nb--;
+    }
+    return VRAI;
+}
+
+Bool bitmap_contains(const Bitmap *bm, uint32_t valeur) {
+    if (bm == NULL)
+        return FAUX;
+    Bool trouve;
+    size_t pos = bitmap_chercher(bm, (uint16_t) (valeur >> 16), &trouve);
+    if (!trouve)
+        return FAUX;
+    const Conteneur *c = &bm->conteneurs[pos];
+    uint16_t bas = (uint16_t) (valeur & 0xFFFF);
+    if (c->mots != NULL)
+        return mot_teste(c->mots, bas);
+    tableau_chercher(c->tableau, c->cardinal, bas, &trouve);
+    return trouve;
+}
+
+size_t bitmap_cardinal(const Bitmap *bm) {
+    if (bm == NULL)
+        return 0;
+    size_t total = 0;
+    for (size_t i = 0; i < bm->nb; i++) {
+        total += bm->conteneurs[i].cardinal;
+    }
+    return total;
+}
+
+Bool bitmap_copy(Bitmap *dst, const Bitmap *src) {
+    if (dst == NULL || src == NULL)
+        return FAUX;
+    bitmap_init(dst);
+    if (!bitmap_reserver(dst, src->nb))
+        return FAUX;
+    for (size_t i = 0; i < src->nb; i++) {
+        if (src->conteneurs[i].cardinal == 0)
+            continue;
+        Conteneur c;
+        if (!conteneur_copier(&c, &src->conteneurs[i]) || !bitmap_pousser(dst, &c)) {
+            bitmap_free(dst);
+            return FAUX;
+        }
+    }
+    return VRAI;
+}
+
+/* Passe tous les conteneurs en bitset : les intersections avec ce bitmap
+   deviennent des tests de bits en O(1) (utile quand il sert de pivot). */
+Bool bitmap_densify(Bitmap *bm) {
+    if (bm == NULL)
+        return FAUX;
+    for (size_t i = 0; i < bm->nb; i++) {
+        if (bm->conteneurs[i].tableau != NULL && !conteneur_vers_bitset(&bm->conteneurs[i]))
+            return FAUX;
+    }
+    bm->dense = VRAI;
+    return VRAI;
+}
+
+// res = a & b (res est initialise par la fonction)
+Bool bitmap_and(Bitmap *res, const Bitmap *a, const Bitmap *b) {
+    if (res == NULL || a == NULL || b == NULL)
+        return FAUX;
+    bitmap_init(res);
+    size_t i = 0, j = 0;
+    while (i < a->nb && j < b->nb) {
+        const Conteneur *ca = &a->conteneurs[i];
+        const Conteneur *cb = &b->conteneurs[j];
+        if (ca->cle < cb->cle) i++;
+        else if (ca->cle > cb->cle) j++;
+        else {
+            Conteneur c;
+            if (!conteneur_et(&c, ca, cb) || !bitmap_pousser(res, &c)) {
+                conteneur_liberer(&c);
+                bitmap_free(res);
+                return FAUX;
+            }
+            i++;
+            j++;
+        }
+    }
+    return VRAI;
+}
+
+// res = a | b (res est initialise par la fonction)
+Bool bitmap_or(Bitmap *res, const Bitmap *a, const Bitmap *b) {
+    if (res == NULL || a == NULL || b == NULL)
+        return FAUX;
+    bitmap_init(res);
+    size_t i = 0, j = 0;
+    while (i < a->nb || j < b->nb) {
+        Conteneur c;
+        Bool ok;
+        if (j >= b->nb || (i < a->nb && a->conteneurs[i].cle < b->conteneurs[j].cle)) {
+            ok = conteneur_copier(&c, &a->conteneurs[i++]);
+        } else if (i >= a->nb || b->conteneurs[j].cle < a->conteneurs[i].cle) {
+            ok = conteneur_copier(&c, &b->conteneurs[j++]);
+        } else {
+            ok = conteneur_ou(&c, &a->conteneurs[i++], &b->conteneurs[j++]);
+        }
+        if (!ok || !bitmap_pousser(res, &c)) {
+            conteneur_liberer(&c);
+            bitmap_free(res);
+            return FAUX;
+        }
+    }
+    return VRAI;
+}
+
+Bool bitmap_and_inplace(Bitmap *a, const Bitmap *b) {
+    Bitmap res;
+    if (!bitmap_and(&res, a, b))
+        return FAUX;
+    bitmap_free(a);
+    *a = res;
+    return VRAI;
+}
+
+Bool bitmap_or_inplace(Bitmap *a, const Bitmap *b) {
+    Bitmap res;
+    if (!bitmap_or(&res, a, b))
+        return FAUX;
+    bitmap_free(a);
+    *a = res;
+    return VRAI;
+}
+
+// |a & b| sans construire le resultat (comptage de facettes)
+size_t bitmap_and_cardinal(const Bitmap *a, const Bitmap *b) {
+    if (a == NULL || b == NULL)
+        return 0;
+    size_t total = 0;
+    size_t i = 0, j = 0;
+    while (i < a->nb && j < b->nb) {
+        if (a->conteneurs[i].cle < b->conteneurs[j].cle) i++;
+        else if (a->conteneurs[i].cle > b->conteneurs[j].cle) j++;
+        else total += conteneur_et_cardinal(&a->conteneurs[i++], &b->conteneurs[j++]);
+    }
+    return total;
+}
+
+// Valeurs en ordre croissant ; out doit contenir bitmap_cardinal(bm) cases
+size_t bitmap_to_array(const Bitmap *bm, uint32_t *out) {
+    if (bm == NULL || out == NULL)
+        return 0;
+    size_t n = 0;
+    for (size_t i = 0; i < bm->nb; i++) {
+        const Conteneur *c = &bm->conteneurs[i];
+        uint32_t haut = (uint32_t) c->cle << 16;
+        if (c->mots != NULL) {
+            for (int w = 0; w < BITMAP_MOTS; w++) {
+                uint64_t mot = c->mots[w];
+                while (mot != 0) {
+                    out[n++] = haut | (uint32_t) (w * 64 + ctz64(mot));
+                    mot &= mot - 1;
+                }
+            }
+        } else {
+            for (uint32_t k = 0; k < c->cardinal; k++) {
+                out[n++] = haut | c->tableau[k];
+            }
+        }
+    }
+    return n;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "model.h"
+
+/* Bitmap compresse facon "Roaring" : les valeurs 32 bits sont regroupees par
+   tranches de 65536 (16 bits de poids fort). Chaque tranche est un conteneur
+   tableau (valeurs triees, peu peuplee) ou un conteneur bitset (1024 mots). */
+
+#define BITMAP_MOTS 1024
+#define BITMAP_TABLEAU_MAX 4096
+
+typedef struct Conteneur {
+    uint16_t cle;
+    uint32_t cardinal;
+    uint32_t capacite;   // capacite de tableau
+    uint16_t *tableau;   // NULL pour un conteneur bitset
+    uint64_t *mots;      // NULL pour un conteneur tableau
+} Conteneur;
+
+typedef struct Bitmap {
+    Conteneur *conteneurs;   // tries par cle
+    size_t nb;
+    size_t capacite;
+    Bool dense;              // toujours en bitset : ajout/retrait en O(1)
+} Bitmap;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void bitmap_init(Bitmap *bm);
+void bitmap_init_dense(Bitmap *bm);
+void bitmap_free(Bitmap *bm);
+Bool bitmap_add(Bitmap *bm, uint32_t valeur);
+Bool bitmap_remove(Bitmap *bm, uint32_t valeur);
+Bool bitmap_contains(const Bitmap *bm, uint32_t valeur);
+size_t bitmap_cardinal(const Bitmap *bm);
+Bool bitmap_copy(Bitmap *dst, const Bitmap *src);
+Bool bitmap_densify(Bitmap *bm);
+Bool bitmap_and(Bitmap *res, const Bitmap *a, const Bitmap *b);
+Bool bitmap_or(Bitmap *res, const Bitmap *a, const Bitmap *b);
+Bool bitmap_and_inplace(Bitmap *a, const Bitmap *b);
+Bool bitmap_or_inplace(Bitmap *a, const Bitmap *b);
+size_t bitmap_and_cardinal(const Bitmap *a, const Bitmap *b);
+size_t bitmap_to_array(const Bitmap *bm, uint32_t *out);
@@ -22,14 +22,17 @@ unsigned int hash_func(const char *titre){
         return  hash % TABLE_SIZE;
 }
 
-void hash_insert(HashTable *hash_t, const Livre *livre){
+Livre *hash_insert(HashTable *hash_t, const Livre *livre){
     if (hash_t == NULL || livre == NULL)
-        return;
+        return NULL;
     unsigned int index = hash_func(livre->titre);
     
-    liste_push_back (&hash_t->table[index],livre);
+    NoeudLivre *noeud = liste_push_back (&hash_t->table[index],livre);
+    if (noeud == NULL)
+        return NULL;
 
 hash_t->count++;
+    return &noeud->data;
 }
 ListeDC *hash_get_bucket(HashTable *hash_t, const char *titre){
     if (hash_t == NULL || titre == NULL)
@@ -74,6 +77,33 @@ void hash_remove(HashTable *hash_t, const char *titre){
     }
 }
 
+/* Sort ce livre-ci de la table sans liberer son noeud : livre reste
+   lisible jusqu'au free(noeud) de l'appelant. NULL s'il n'y est pas. */
+NoeudLivre *hash_detacher_livre(HashTable *hash_t, const Livre *livre){
+    if (hash_t == NULL || livre == NULL)
+        return NULL;
+    unsigned int index = hash_func(livre->titre);
+    NoeudLivre *actuel = hash_t->table[index].head;
+    while (actuel != NULL){
+        if (&actuel->data == livre){
+            liste_detacher_node(&hash_t->table[index], actuel);
+            hash_t->count--;
+            return actuel;
+        }
+        actuel = actuel->noeudnext;
+    }
+    return NULL;
+}
+
+// Retire ce livre-ci (plusieurs livres peuvent partager un titre)
+Bool hash_remove_livre(HashTable *hash_t, const Livre *livre){
+    NoeudLivre *noeud = hash_detacher_livre(hash_t, livre);
+    if (noeud == NULL)
+        return FAUX;
+    free(noeud);
+    return VRAI;
+}
+
 void hash_update(HashTable *hash_t, const char *titre, const Livre *new_info) {
     if (hash_t == NULL || titre == NULL || new_info == NULL) {
         return;
@@ -61,7 +61,8 @@ NoeudLivre *liste_push_front(ListeDC *li, const Livre *livre) {
     return new_node;
 }
 
-Bool liste_remove_node(ListeDC *li, NoeudLivre *node){
+// Sort le noeud de la liste sans le liberer
+Bool liste_detacher_node(ListeDC *li, NoeudLivre *node){
     if (li == NULL || node == NULL || liste_is_empty(li))
         return FAUX;
     
@@ -80,8 +81,14 @@ Bool liste_remove_node(ListeDC *li, NoeudLivre *node){
     }
 
     li->count--;
-    free(node);
+    node->noeudprev = node->noeudnext = NULL;
+    return VRAI;
+}
 
+Bool liste_remove_node(ListeDC *li, NoeudLivre *node){
+    if (!liste_detacher_node(li, node))
+        return FAUX;
+    free(node);
     return VRAI;
 }
 
@@ -25,6 +25,7 @@ void liste_init(ListeDC *l);
 NoeudLivre *liste_push_back(ListeDC *li, const Livre *livre);
 NoeudLivre *liste_push_front(ListeDC *li, const Livre *livre);
 Bool liste_is_empty(const ListeDC *li);
+Bool liste_detacher_node(ListeDC *li, NoeudLivre *node);
 Bool liste_remove_node(ListeDC *li, NoeudLivre *node);
 void liste_clear(ListeDC *li);
 void liste_print(const ListeDC *li);
\ No newline at end of file
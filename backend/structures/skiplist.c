@@ -0,0 +1,206 @@
+#include "skiplist.h"
+#include <stdlib.h>
+
+static NoeudSkip *noeud_creer(Livre *livre, int niveau) {
+    NoeudSkip *noeud = malloc(sizeof(NoeudSkip) + niveau * sizeof(NoeudSkip *));
+    if (noeud == NULL)
+        return NULL;
+    noeud->livre = livre;
+    noeud->niveau = niveau;
+    for (int i = 0; i < niveau; i++) {
+        noeud->suivant[i] = NULL;
+    }
+    return noeud;
+}
+
+// Niveau aleatoire : probabilite 1/4 de monter d'un etage (xorshift32)
+static int niveau_aleatoire(SkipList *sl) {
+    int niveau = 1;
+    for (;;) {
+        unsigned int x = sl->graine;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        sl->graine = x;
+        if ((x & 3) != 0 || niveau >= SKIPLIST_NIVEAU_MAX)
+            break;
+        niveau++;
+    }
+    return niveau;
+}
+
+void skiplist_init(SkipList *sl, SkipListCmp cmp) {
+    if (sl == NULL)
+        return;
+    sl->tete = noeud_creer(NULL, SKIPLIST_NIVEAU_MAX);
+    sl->niveau = 1;
+    sl->count = 0;
+    sl->cmp = cmp;
+    sl->graine = 2463534242u;
+}
+
+void skiplist_free(SkipList *sl) {
+    if (sl == NULL || sl->tete == NULL)
+        return;
+    NoeudSkip *actuel = sl->tete;
+    while (actuel != NULL) {
+        NoeudSkip *suivant = actuel->suivant[0];
+        free(actuel);
+        actuel = suivant;
+    }
+    sl->tete = NULL;
+    sl->niveau = 1;
+    sl->count = 0;
+}
+
+// Remplit prec[i] avec le dernier noeud < cle au niveau i
+static void chercher_predecesseurs(const SkipList *sl, const Livre *cle, NoeudSkip **prec) {
+    NoeudSkip *actuel = sl->tete;
+    for (int i = sl->niveau - 1; i >= 0; i--) {
+        while (actuel->suivant[i] != NULL && sl->cmp(actuel->suivant[i]->livre, cle) < 0) {
+            actuel = actuel->suivant[i];
+        }
+        prec[i] = actuel;
+    }
+}
+
+Bool skiplist_insert(SkipList *sl, Livre *livre) {
+    if (sl == NULL || sl->tete == NULL || livre == NULL)
+        return FAUX;
+    NoeudSkip *prec[SKIPLIST_NIVEAU_MAX];
+    chercher_predecesseurs(sl, livre, prec);
+
+    int niveau = niveau_aleatoire(sl);
+    NoeudSkip *noeud = noeud_creer(livre, niveau);
+    if (noeud == NULL)
+        return FAUX;
+    // La liste ne monte qu'une fois le noeud alloue
+    if (niveau > sl->niveau) {
+        for (int i = sl->niveau; i < niveau; i++) {
+            prec[i] = sl->tete;
+        }
+        sl->niveau = niveau;
+    }
+
+    for (int i = 0; i < niveau; i++) {
+        noeud->suivant[i] = prec[i]->suivant[i];
+        prec[i]->suivant[i] = noeud;
+    }
+    sl->count++;
+    return VRAI;
+}
+
+Bool skiplist_remove(SkipList *sl, const Livre *livre) {
+    if (sl == NULL || sl->tete == NULL || livre == NULL)
+        return FAUX;
+    NoeudSkip *prec[SKIPLIST_NIVEAU_MAX];
+    chercher_predecesseurs(sl, livre, prec);
+
+    NoeudSkip *cible = prec[0]->suivant[0];
+    if (cible == NULL || cible->livre != livre)
+        return FAUX;
+
+    for (int i = 0; i < cible->niveau; i++) {
+        prec[i]->suivant[i] = cible->suivant[i];
+    }
+    free(cible);
+    while (sl->niveau > 1 && sl->tete->suivant[sl->niveau - 1] == NULL) {
+        sl->niveau--;
+    }
+    sl->count--;
+    return VRAI;
+}
+
+NoeudSkip *skiplist_first(const SkipList *sl) {
+    if (sl == NULL || sl->tete == NULL)
+        return NULL;
+    return sl->tete->suivant[0];
+}
+
+// Premier noeud >= cle, en O(log n)
+NoeudSkip *skiplist_lower_bound(const SkipList *sl, const Livre *cle) {
+    if (sl == NULL || sl->tete == NULL || cle == NULL)
+        return NULL;
+    NoeudSkip *prec[SKIPLIST_NIVEAU_MAX];
+    chercher_predecesseurs(sl, cle, prec);
+    return prec[0]->suivant[0];
+}
+
+// Tri fusion ascendant de livres selon cmp ; tampon : nb places
+static void trier(Livre **livres, Livre **tampon, size_t nb, SkipListCmp cmp) {
+    Livre **src = livres, **dst = tampon;
+    for (size_t largeur = 1; largeur < nb; largeur *= 2) {
+        for (size_t debut = 0; debut < nb; debut += 2 * largeur) {
+            size_t milieu = debut + largeur < nb ? debut + largeur : nb;
+            size_t fin = debut + 2 * largeur < nb ? debut + 2 * largeur : nb;
+            size_t i = debut, j = milieu, k = debut;
+            while (i < milieu && j < fin)
+                dst[k++] = cmp(src[j], src[i]) < 0 ? src[j++] : src[i++];
+            while (i < milieu) dst[k++] = src[i++];
+            while (j < fin) dst[k++] = src[j++];
+        }
+        Livre **tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != livres) {
+        for (size_t i = 0; i < nb; i++) livres[i] = src[i];
+    }
+}
+
+/* Ajoute nb livres d'un coup : ils sont tries, puis fusionnes avec la
+   liste existante en un seul parcours qui refait tous les chainages. Les
+   noeuds existants sont gardes tels quels (niveau compris). En O(n + m log m)
+   au lieu de m insertions. */
+Bool skiplist_fusionner(SkipList *sl, Livre **livres, size_t nb) {
+    if (sl == NULL || sl->tete == NULL || livres == NULL)
+        return FAUX;
+    if (nb == 0)
+        return VRAI;
+    Livre **tampon = malloc(nb * sizeof(Livre *));
+    NoeudSkip **nouveaux = malloc(nb * sizeof(NoeudSkip *));
+    size_t crees = 0;
+    while (tampon != NULL && nouveaux != NULL && crees < nb) {
+        nouveaux[crees] = noeud_creer(NULL, niveau_aleatoire(sl));
+        if (nouveaux[crees] == NULL)
+            break;
+        crees++;
+    }
+    if (crees < nb) {
+        for (size_t i = 0; i < crees; i++) free(nouveaux[i]);
+        free(nouveaux);
+        free(tampon);
+        Bool ok = VRAI;
+        for (size_t i = 0; i < nb; i++) ok = skiplist_insert(sl, livres[i]) && ok;
+        return ok;
+    }
+    trier(livres, tampon, nb, sl->cmp);
+    free(tampon);
+
+    NoeudSkip *derniers[SKIPLIST_NIVEAU_MAX];
+    for (int i = 0; i < SKIPLIST_NIVEAU_MAX; i++) derniers[i] = sl->tete;
+    NoeudSkip *ancien = sl->tete->suivant[0];
+    size_t j = 0;
+    int niveau_max = 1;
+    while (ancien != NULL || j < nb) {
+        NoeudSkip *noeud;
+        if (ancien != NULL && (j == nb || sl->cmp(ancien->livre, livres[j]) < 0)) {
+            noeud = ancien;
+            ancien = ancien->suivant[0];  // lu avant que le chainage ne l'ecrase
+        } else {
+            noeud = nouveaux[j];
+            noeud->livre = livres[j++];
+        }
+        for (int i = 0; i < noeud->niveau; i++) {
+            derniers[i]->suivant[i] = noeud;
+            derniers[i] = noeud;
+        }
+        if (noeud->niveau > niveau_max)
+            niveau_max = noeud->niveau;
+    }
+    for (int i = 0; i < SKIPLIST_NIVEAU_MAX; i++) derniers[i]->suivant[i] = NULL;
+    free(nouveaux);
+    sl->niveau = niveau_max;
+    sl->count += nb;
+    return VRAI;
+}
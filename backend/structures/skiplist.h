@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include "model.h"
+
+#define SKIPLIST_NIVEAU_MAX 16
+
+// Comparaison de deux livres : < 0, 0 ou > 0 (l'id sert a departager)
+typedef int (*SkipListCmp)(const Livre *a, const Livre *b);
+
+typedef struct NoeudSkip {
+    Livre *livre;
+    int niveau;
+    struct NoeudSkip *suivant[];
+} NoeudSkip;
+
+typedef struct SkipList {
+    NoeudSkip *tete;
+    int niveau;
+    size_t count;
+    SkipListCmp cmp;
+    unsigned int graine;
+} SkipList;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void skiplist_init(SkipList *sl, SkipListCmp cmp);
+void skiplist_free(SkipList *sl);
+Bool skiplist_insert(SkipList *sl, Livre *livre);
+Bool skiplist_fusionner(SkipList *sl, Livre **livres, size_t nb);
+Bool skiplist_remove(SkipList *sl, const Livre *livre);
+NoeudSkip *skiplist_first(const SkipList *sl);
+NoeudSkip *skiplist_lower_bound(const SkipList *sl, const Livre *cle);
@@ -0,0 +1,490 @@
+#include "televersement.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+enum { MORCEAU_ABSENT = 0, MORCEAU_EN_COURS, MORCEAU_RECU };
+
+static uint64_t debut_morceau(size_t k) {
+  return (uint64_t) k * TELEVERSEMENT_MORCEAU;
+}
+
+static uint64_t longueur_morceau(const Televersement *s, size_t k) {
+  uint64_t reste = s->taille - debut_morceau(k);
+  return reste < TELEVERSEMENT_MORCEAU ? reste : TELEVERSEMENT_MORCEAU;
+}
+
+// --- Table des sessions (sous t->verrou) ---
+
+static void session_relacher(Televersement *s) {
+  if (--s->references > 0) return;
+  close(s->fd);
+  free(s->etats);
+  free(s);
+}
+
+static Televersement *session_chercher(Televersements *t, const char *id) {
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS; i++) {
+    if (t->sessions[i] != NULL && strcmp(t->sessions[i]->id, id) == 0) return t->sessions[i];
+  }
+  return NULL;
+}
+
+/* Retire la session de la table ; les morceaux encore en reception gardent
+   leur reference et apprendront l'annulation en finissant. effacer : le
+   fichier temporaire n'a pas ete publie. */
+static void session_retirer(Televersements *t, Televersement *s, Bool effacer) {
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS; i++) {
+    if (t->sessions[i] == s) t->sessions[i] = NULL;
+  }
+  if (effacer) unlink(s->temporaire);
+  s->annule = VRAI;
+  session_relacher(s);
+}
+
+static void sessions_expirer(Televersements *t, uint64_t maintenant) {
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS; i++) {
+    Televersement *s = t->sessions[i];
+    if (s != NULL && s->references == 1 && maintenant - s->maj > TELEVERSEMENT_OUBLI_MS) {
+      session_retirer(t, s, VRAI);
+    }
+  }
+}
+
+void televersements_init(Televersements *t) {
+  memset(t, 0, sizeof(Televersements));
+  pthread_mutex_init(&t->verrou, NULL);
+}
+
+void televersements_free(Televersements *t) {
+  pthread_mutex_lock(&t->verrou);
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS; i++) {
+    if (t->sessions[i] != NULL) session_retirer(t, t->sessions[i], VRAI);
+  }
+  pthread_mutex_unlock(&t->verrou);
+  pthread_mutex_destroy(&t->verrou);
+}
+
+static Bool hex_valide(const char *s, size_t longueur) {
+  if (strlen(s) != longueur) return FAUX;
+  for (const char *p = s; *p; p++) {
+    if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F'))) return FAUX;
+  }
+  return VRAI;
+}
+
+int televersement_ouvrir(Televersements *t, Depot *depot, const char *extension, uint64_t taille,
+                         const char *sha256, char id[17]) {
+  if (taille == 0 || (sha256 != NULL && !hex_valide(sha256, 64))) return 400;
+  Televersement *s = calloc(1, sizeof(Televersement));
+  if (s == NULL) return 500;
+  s->nb_morceaux = (size_t) ((taille + TELEVERSEMENT_MORCEAU - 1) / TELEVERSEMENT_MORCEAU);
+  if ((s->etats = calloc(s->nb_morceaux, 1)) == NULL) {
+    free(s);
+    return 500;
+  }
+  mg_random_str(s->id, sizeof(s->id));
+  s->taille = taille;
+  s->depot = depot;
+  snprintf(s->extension, sizeof(s->extension), "%s", extension);
+
+  // Meme repertoire que le depot : rename reste atomique
+  snprintf(s->temporaire, sizeof(s->temporaire), "%s/.%s.part", depot->repertoire, s->id);
+  s->fd = open(s->temporaire, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (s->fd < 0) {
+    free(s->etats);
+    free(s);
+    return 500;
+  }
+#ifdef __linux__
+  int place = posix_fallocate(s->fd, 0, (off_t) taille);  // disque plein : refuse tout de suite
+#else
+  int place = ftruncate(s->fd, (off_t) taille) == 0 ? 0 : errno;
+#endif
+  if (place != 0) {
+    close(s->fd);
+    unlink(s->temporaire);
+    free(s->etats);
+    free(s);
+    return place == ENOSPC ? 507 : 500;
+  }
+  empreinte_init(&s->hachage);
+  if (sha256 != NULL) {
+    for (size_t i = 0; i < 64; i++) s->attendu[i] = (char) (sha256[i] | 0x20);  // minuscules
+  }
+  s->maj = mg_millis();
+  s->references = 1;
+
+  pthread_mutex_lock(&t->verrou);
+  sessions_expirer(t, s->maj);
+  size_t libre = TELEVERSEMENT_SESSIONS;
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS && libre == TELEVERSEMENT_SESSIONS; i++) {
+    if (t->sessions[i] == NULL) libre = i;
+  }
+  if (libre < TELEVERSEMENT_SESSIONS) t->sessions[libre] = s;
+  pthread_mutex_unlock(&t->verrou);
+  if (libre == TELEVERSEMENT_SESSIONS) {
+    unlink(s->temporaire);
+    session_relacher(s);
+    return 503;
+  }
+  memcpy(id, s->id, sizeof(s->id));
+  return 0;
+}
+
+char *televersement_etat_json(Televersements *t, const char *id) {
+  pthread_mutex_lock(&t->verrou);
+  Televersement *s = session_chercher(t, id);
+  char *json = NULL;
+  size_t cap = s != NULL ? s->nb_morceaux * 12 + 256 : 0;
+  if (s != NULL && (json = malloc(cap)) != NULL) {
+    size_t len = (size_t) snprintf(json, cap,
+                                   "{ \"id\": \"%s\", \"taille\": %llu, \"morceau\": %d, \"morceaux\": %lu, "
+                                   "\"recus\": %lu, \"hache\": %llu, \"manquants\": [",
+                                   s->id, (unsigned long long) s->taille, TELEVERSEMENT_MORCEAU,
+                                   (unsigned long) s->nb_morceaux, (unsigned long) s->nb_recus,
+                                   (unsigned long long) s->hache);
+    Bool premier = VRAI;
+    for (size_t k = 0; k < s->nb_morceaux; k++) {
+      if (s->etats[k] == MORCEAU_RECU) continue;
+      len += (size_t) snprintf(json + len, cap - len, "%s%lu", premier ? "" : ", ", (unsigned long) k);
+      premier = FAUX;
+    }
+    snprintf(json + len, cap - len, "] }");
+  }
+  pthread_mutex_unlock(&t->verrou);
+  return json;
+}
+
+Bool televersement_annuler(Televersements *t, const char *id) {
+  pthread_mutex_lock(&t->verrou);
+  Televersement *s = session_chercher(t, id);
+  if (s != NULL) session_retirer(t, s, VRAI);
+  pthread_mutex_unlock(&t->verrou);
+  return s != NULL;
+}
+
+char *televersements_stats_json(Televersements *t) {
+  size_t nb = 0;
+  pthread_mutex_lock(&t->verrou);
+  for (size_t i = 0; i < TELEVERSEMENT_SESSIONS; i++) nb += t->sessions[i] != NULL;
+  pthread_mutex_unlock(&t->verrou);
+  return mg_mprintf("{ \"sessions\": %lu, \"octets\": %lu, \"publies\": %lu, \"rejets\": %lu }",
+                    (unsigned long) nb, atomic_load(&t->octets), atomic_load(&t->publies),
+                    atomic_load(&t->rejets));
+}
+
+// --- Hachage ---
+
+/* Avance le hachage sur les morceaux deja recus qui suivent le prefixe
+   hache. Appele sous t->verrou ; le verrou est relache pendant la relecture
+   (cache de pages), la session restant reservee par hachage_pris. */
+static Bool rattraper(Televersements *t, Televersement *s) {
+  unsigned char tampon[TELEVERSEMENT_LECTURE];
+  while (!s->hachage_pris && s->hache < s->taille &&
+         s->etats[s->hache / TELEVERSEMENT_MORCEAU] == MORCEAU_RECU) {
+    size_t k = (size_t) (s->hache / TELEVERSEMENT_MORCEAU);
+    uint64_t position = s->hache, fin = debut_morceau(k) + longueur_morceau(s, k);
+    s->hachage_pris = VRAI;
+    pthread_mutex_unlock(&t->verrou);
+    while (position < fin) {
+      size_t voulu = fin - position < sizeof(tampon) ? (size_t) (fin - position) : sizeof(tampon);
+      ssize_t n = pread(s->fd, tampon, voulu, (off_t) position);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      empreinte_ajouter(&s->hachage, tampon, (size_t) n);
+      position += (uint64_t) n;
+    }
+    pthread_mutex_lock(&t->verrou);
+    s->hachage_pris = FAUX;
+    if (position < fin) return FAUX;
+    s->hache = fin;
+  }
+  return VRAI;
+}
+
+// --- Reception d'un morceau ---
+
+/* Etat d'un PUT en cours, range dans c->pfn_data a la place de celui du
+   protocole HTTP, restaure une fois le corps consomme. */
+typedef struct Reception {
+  Televersements *t;
+  Televersement *s;             // NULL : morceau termine ou refuse
+  size_t morceau;
+  uint64_t debut;
+  uint64_t longueur;
+  uint64_t recu;
+  Bool en_direct;               // alimente s->hachage au fil de la reception
+  Empreinte avant;              // hachage avant ce morceau, en cas d'abandon
+  size_t a_sauter;              // octets deja traites en tete de c->recv
+  Bool fini;                    // reponse envoyee
+  Bool jeter;                   // requete refusee : le reste du corps est ignore
+  mg_event_handler_t pfn;
+  void *pfn_data;
+} Reception;
+
+// Sous t->verrou : le morceau redevient absent et peut etre renvoye
+static void morceau_abandonner(Reception *r) {
+  Televersement *s = r->s;
+  s->etats[r->morceau] = MORCEAU_ABSENT;
+  if (r->en_direct) {
+    s->hachage = r->avant;
+    s->hachage_pris = FAUX;
+  }
+  session_relacher(s);
+  r->s = NULL;
+}
+
+static void refuser(struct mg_connection *c, Reception *r, int code, const char *erreur) {
+  mg_http_reply(c, code, "Content-Type: application/json\r\n", "{\"error\": \"%s\"}\n", erreur);
+  c->is_draining = 1;  // corps non lu : la connexion ne peut pas resservir
+  r->fini = r->jeter = VRAI;
+}
+
+static void publier(struct mg_connection *c, Reception *r, Televersement *s) {
+  Televersements *t = r->t;
+  unsigned char brut[32];
+  char empreinte[65], nom[DEPOT_NOM];
+  Bool doublon = FAUX;
+  empreinte_finir(&s->hachage, brut);
+  for (size_t i = 0; i < 32; i++) snprintf(empreinte + 2 * i, 3, "%02x", brut[i]);
+
+  if (s->attendu[0] != '\0' && strcmp(empreinte, s->attendu) != 0) {
+    atomic_fetch_add(&t->rejets, 1);
+    unlink(s->temporaire);
+    mg_http_reply(c, 422, "Content-Type: application/json\r\n",
+                  "{\"error\": \"Empreinte differente\", \"sha256\": \"%s\"}\n", empreinte);
+  } else if (fsync(s->fd) != 0 ||
+             !depot_publier(s->depot, s->temporaire, empreinte, s->extension, s->taille, nom, &doublon)) {
+    unlink(s->temporaire);
+    mg_http_reply(c, 500, "Content-Type: application/json\r\n", "{\"error\": \"Publication impossible\"}\n");
+  } else {
+    atomic_fetch_add(&t->publies, 1);
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                  "{\"publie\": \"%s\", \"doublon\": %s, \"taille\": %llu, \"sha256\": \"%s\"}\n", nom,
+                  doublon ? "true" : "false", (unsigned long long) s->taille, empreinte);
+  }
+  pthread_mutex_lock(&t->verrou);
+  if (!s->annule) session_retirer(t, s, FAUX);
+  pthread_mutex_unlock(&t->verrou);
+}
+
+static void morceau_recu(struct mg_connection *c, Reception *r) {
+  Televersements *t = r->t;
+  Televersement *s = r->s;
+  size_t recus = 0, nb = s->nb_morceaux;
+  Bool annule, lu = VRAI, publier_ici = FAUX;
+
+  pthread_mutex_lock(&t->verrou);
+  s->etats[r->morceau] = MORCEAU_RECU;
+  s->nb_recus++;
+  if (r->en_direct) {
+    s->hache = r->debut + r->longueur;
+    s->hachage_pris = FAUX;
+  }
+  annule = s->annule;
+  if (!annule) lu = rattraper(t, s);
+  if (!lu) session_retirer(t, s, VRAI);
+  if (!annule && lu && !s->hachage_pris && s->hache == s->taille && !s->publication) {
+    s->publication = publier_ici = VRAI;
+    s->references++;  // gardee pendant la publication, hors verrou
+  }
+  recus = s->nb_recus;
+  session_relacher(s);
+  r->s = NULL;
+  pthread_mutex_unlock(&t->verrou);
+
+  r->fini = VRAI;
+  if (annule) {
+    mg_http_reply(c, 410, "Content-Type: application/json\r\n", "{\"error\": \"Televersement annule\"}\n");
+  } else if (!lu) {
+    mg_http_reply(c, 500, "Content-Type: application/json\r\n", "{\"error\": \"Relecture impossible\"}\n");
+  } else if (publier_ici) {
+    publier(c, r, s);
+    pthread_mutex_lock(&t->verrou);
+    session_relacher(s);
+    pthread_mutex_unlock(&t->verrou);
+  } else {
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                  "{\"morceau\": %lu, \"recus\": %lu, \"morceaux\": %lu}\n", (unsigned long) r->morceau,
+                  (unsigned long) recus, (unsigned long) nb);
+  }
+}
+
+// Ecrit ce qui revient au morceau parmi data ; renvoie les octets consommes
+static size_t recevoir(struct mg_connection *c, Reception *r, const unsigned char *data, size_t len) {
+  size_t n = r->longueur - r->recu < len ? (size_t) (r->longueur - r->recu) : len;
+  for (size_t ecrit = 0; ecrit < n;) {
+    ssize_t w = pwrite(r->s->fd, data + ecrit, n - ecrit, (off_t) (r->debut + r->recu + ecrit));
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) {
+      Bool plein = w < 0 && errno == ENOSPC;
+      pthread_mutex_lock(&r->t->verrou);
+      morceau_abandonner(r);
+      pthread_mutex_unlock(&r->t->verrou);
+      refuser(c, r, plein ? 507 : 500, "Ecriture impossible");
+      return len;
+    }
+    ecrit += (size_t) w;
+  }
+  if (r->en_direct) empreinte_ajouter(&r->s->hachage, data, n);
+  r->recu += n;
+  atomic_fetch_add(&r->t->octets, n);
+  if (r->recu == r->longueur) morceau_recu(c, r);
+  return n;
+}
+
+static void reception_rendre(struct mg_connection *c, Reception *r) {
+  if (r->s != NULL) {
+    pthread_mutex_lock(&r->t->verrou);
+    morceau_abandonner(r);  // client parti avant la fin du morceau
+    pthread_mutex_unlock(&r->t->verrou);
+  }
+  c->pfn = r->pfn;
+  c->pfn_data = r->pfn_data;
+  free(r);
+}
+
+static void reception_cb(struct mg_connection *c, int ev, void *ev_data) {
+  Reception *r = (Reception *) c->pfn_data;
+  if (ev == MG_EV_CLOSE) {
+    reception_rendre(c, r);
+    return;
+  }
+  if (ev != MG_EV_READ && ev != MG_EV_POLL) return;
+  if (r->jeter) {
+    c->recv.len = 0;
+    return;
+  }
+  size_t saute = r->a_sauter < c->recv.len ? r->a_sauter : c->recv.len;
+  size_t utile = 0;
+  r->a_sauter -= saute;
+  if (!r->fini && c->recv.len > saute) utile = recevoir(c, r, c->recv.buf + saute, c->recv.len - saute);
+  if (r->jeter) {
+    c->recv.len = 0;
+    return;
+  }
+  if (saute + utile > 0) mg_iobuf_del(&c->recv, 0, saute + utile);
+  if (!r->fini) {
+    // Lectures de socket plus grandes que MG_IO_SIZE ; ce tampon est la seule memoire du corps
+    if (c->recv.size < TELEVERSEMENT_TAMPON) mg_iobuf_resize(&c->recv, TELEVERSEMENT_TAMPON);
+  } else if (r->a_sauter == 0) {
+    reception_rendre(c, r);
+    if (c->recv.len == 0) {
+      mg_iobuf_resize(&c->recv, 0);
+    } else {
+      c->pfn(c, MG_EV_READ, NULL);  // requete suivante deja recue
+    }
+  }
+  (void) ev_data;
+}
+
+Bool televersement_intercepter(Televersements *t, struct mg_connection *c, struct mg_http_message *hm) {
+  if (mg_strcmp(hm->uri, mg_str("/api/televersement")) != 0 || mg_vcasecmp(&hm->method, "PUT") != 0 ||
+      mg_http_get_header(hm, "Content-Length") == NULL) {
+    return FAUX;  // la route repond
+  }
+  Reception *r = calloc(1, sizeof(Reception));
+  if (r == NULL) {
+    c->is_closing = 1;
+    return VRAI;
+  }
+  r->t = t;
+  r->pfn = c->pfn;
+  r->pfn_data = c->pfn_data;
+  c->pfn = reception_cb;
+  c->pfn_data = r;
+
+  char id[17] = "", no[24] = "", *fin = NULL;
+  mg_http_get_var(&hm->query, "id", id, sizeof(id));
+  mg_http_get_var(&hm->query, "morceau", no, sizeof(no));
+  unsigned long k = strtoul(no, &fin, 10);
+  int code = 0;
+  const char *erreur = NULL;
+
+  pthread_mutex_lock(&t->verrou);
+  Televersement *s = session_chercher(t, id);
+  if (s == NULL) {
+    code = 404, erreur = "Televersement inconnu";
+  } else if (no[0] == '\0' || *fin != '\0' || k >= s->nb_morceaux) {
+    code = 400, erreur = "Numero de morceau invalide";
+  } else if (s->etats[k] != MORCEAU_ABSENT) {
+    code = 409, erreur = "Morceau deja recu ou en cours";
+  } else if (hm->body.len != longueur_morceau(s, k)) {
+    code = 400, erreur = "Taille de morceau incorrecte";
+  } else {
+    s->etats[k] = MORCEAU_EN_COURS;
+    s->references++;
+    s->maj = mg_millis();
+    r->s = s;
+    r->morceau = k;
+    r->debut = debut_morceau(k);
+    r->longueur = hm->body.len;
+    if (!s->hachage_pris && s->hache == r->debut) {
+      s->hachage_pris = r->en_direct = VRAI;  // cas courant : morceaux dans l'ordre
+      r->avant = s->hachage;
+    }
+  }
+  pthread_mutex_unlock(&t->verrou);
+
+  /* Ce qui est deja arrive du corps est ecrit tout de suite ; http_cb, qui
+     continue apres nous, attend un corps qu'il ne verra jamais complet et
+     ne produira donc pas de MG_EV_HTTP_MSG. c->recv n'est pas touche ici
+     (hm pointe dedans) : les octets traites sont sautes au prochain
+     evenement. */
+  if (erreur != NULL) {
+    refuser(c, r, code, erreur);
+  } else {
+    const unsigned char *corps = (const unsigned char *) hm->body.buf;
+    size_t present = (size_t) (c->recv.buf + c->recv.len - corps);
+    r->a_sauter = hm->head.len + recevoir(c, r, corps, present);
+  }
+  hm->body.len = (size_t) -1;
+  return VRAI;
+}
+
+#else
+
+// Sans pwrite ni rename atomique : seul mg_http_upload est disponible
+void televersements_init(Televersements *t) {
+  memset(t, 0, sizeof(Televersements));
+  pthread_mutex_init(&t->verrou, NULL);
+}
+
+void televersements_free(Televersements *t) {
+  pthread_mutex_destroy(&t->verrou);
+}
+
+int televersement_ouvrir(Televersements *t, Depot *depot, const char *extension, uint64_t taille,
+                         const char *sha256, char id[17]) {
+  (void) t, (void) depot, (void) extension, (void) taille, (void) sha256, (void) id;
+  return 501;
+}
+
+char *televersement_etat_json(Televersements *t, const char *id) {
+  (void) t, (void) id;
+  return NULL;
+}
+
+Bool televersement_annuler(Televersements *t, const char *id) {
+  (void) t, (void) id;
+  return FAUX;
+}
+
+char *televersements_stats_json(Televersements *t) {
+  (void) t;
+  return mg_mprintf("{ \"sessions\": 0 }");
+}
+
+Bool televersement_intercepter(Televersements *t, struct mg_connection *c, struct mg_http_message *hm) {
+  (void) t, (void) c, (void) hm;
+  return FAUX;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+#include "empreinte.h"
+#include "depot.h"
+
+#define TELEVERSEMENT_MORCEAU (4 * 1024 * 1024)  // octets par morceau (le dernier : le reste)
+#define TELEVERSEMENT_TAMPON (256 * 1024)        // tampon de reception d'une connexion
+#define TELEVERSEMENT_LECTURE (64 * 1024)        // relecture des morceaux arrives en avance
+#define TELEVERSEMENT_SESSIONS 64
+#define TELEVERSEMENT_OUBLI_MS (10 * 60 * 1000)  // session sans nouveau morceau : abandonnee
+
+/* Un fichier en cours de reception : un fichier temporaire cache dans le
+   repertoire du depot, de la taille annoncee, rempli morceau par morceau,
+   dans n'importe quel ordre et par plusieurs connexions a la fois. Le
+   SHA-256 avance avec le plus long prefixe recu ; complet et verifie, le
+   fichier devient le blob de son empreinte (ou disparait s'il y est deja). */
+typedef struct Televersement {
+    char id[17];
+    Depot *depot;
+    char extension[DEPOT_EXTENSION + 1];
+    char temporaire[MG_PATH_MAX];
+    int fd;
+    uint64_t taille;
+    size_t nb_morceaux;
+    uint8_t *etats;             // par morceau : absent, en cours, recu
+    size_t nb_recus;
+    Empreinte hachage;          // couvre [0, hache)
+    uint64_t hache;
+    Bool hachage_pris;          // une connexion alimente hachage hors verrou
+    char attendu[65];           // SHA-256 annonce a l'ouverture, "" : aucun
+    uint64_t maj;               // mg_millis du dernier morceau commence
+    int references;             // la table + chaque morceau en reception
+    Bool publication;           // dernier morceau hache : une seule connexion publie
+    Bool annule;                // retire de la table (annulation, erreur de lecture)
+} Televersement;
+
+/* Sessions de televersement, communes a toutes les boucles. Seules les
+   metadonnees sont sous le verrou : les ecritures (pwrite) et le hachage
+   se font en dehors. */
+typedef struct Televersements {
+    pthread_mutex_t verrou;
+    Televersement *sessions[TELEVERSEMENT_SESSIONS];
+    atomic_ulong octets;        // octets de morceaux ecrits
+    atomic_ulong publies;
+    atomic_ulong rejets;        // empreinte differente de celle annoncee
+} Televersements;
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+void televersements_init(Televersements *t);
+void televersements_free(Televersements *t);
+
+/* Ouvre une session vers le depot ; le blob aura cette extension. sha256 :
+   empreinte attendue en hexadecimal, ou NULL. Ecrit l'id dans id[17] ;
+   renvoie le code HTTP d'erreur, ou 0. */
+int televersement_ouvrir(Televersements *t, Depot *depot, const char *extension, uint64_t taille,
+                         const char *sha256, char id[17]);
+char *televersement_etat_json(Televersements *t, const char *id);
+Bool televersement_annuler(Televersements *t, const char *id);
+char *televersements_stats_json(Televersements *t);
+
+/* A appeler sur MG_EV_HTTP_HDRS. Un PUT /api/televersement?id=..&morceau=k
+   avec Content-Length est pris en charge ici : le corps va du tampon de
+   reception au fichier sans jamais etre accumule, et la reponse part a la
+   fin du morceau. Renvoie VRAI si la requete a ete prise. */
+Bool televersement_intercepter(Televersements *t, struct mg_connection *c, struct mg_http_message *hm);
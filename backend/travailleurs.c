@@ -0,0 +1,578 @@
+#ifdef __linux__
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#endif
+
+#include "travailleurs.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "boucles.h"
+
+size_t pool_nb_coeurs(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t) n : 1;
+#endif
+}
+
+// --- File d'un travailleur ---
+
+static Bool file_empiler(FileTaches *f, Tache t) {
+  pthread_mutex_lock(&f->verrou);
+  if (f->nb == f->cap) {
+    size_t cap = f->cap ? f->cap * 2 : 64;
+    Tache *tmp = malloc(cap * sizeof(Tache));
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&f->verrou);
+      return FAUX;
+    }
+    for (size_t i = 0; i < f->nb; i++) tmp[i] = f->taches[(f->debut + i) % f->cap];
+    free(f->taches);
+    f->taches = tmp;
+    f->cap = cap;
+    f->debut = 0;
+  }
+  f->taches[(f->debut + f->nb) % f->cap] = t;
+  f->nb++;
+  pthread_mutex_unlock(&f->verrou);
+  return VRAI;
+}
+
+// Proprietaire : la plus recente
+static Bool file_depiler(FileTaches *f, Tache *t) {
+  Bool ok = FAUX;
+  pthread_mutex_lock(&f->verrou);
+  if (f->nb > 0) {
+    f->nb--;
+    *t = f->taches[(f->debut + f->nb) % f->cap];
+    ok = VRAI;
+  }
+  pthread_mutex_unlock(&f->verrou);
+  return ok;
+}
+
+// Voleur : la plus ancienne
+static Bool file_voler(FileTaches *f, Tache *t) {
+  Bool ok = FAUX;
+  if (pthread_mutex_trylock(&f->verrou) != 0) return FAUX;  // file occupee : essayer la suivante
+  if (f->nb > 0) {
+    *t = f->taches[f->debut];
+    f->debut = (f->debut + 1) % f->cap;
+    f->nb--;
+    ok = VRAI;
+  }
+  pthread_mutex_unlock(&f->verrou);
+  return ok;
+}
+
+// --- Travailleurs ---
+
+static Bool prendre_tache(Travailleur *w, Tache *t) {
+  PoolTravailleurs *pool = w->pool;
+  if (file_depiler(&w->file, t)) return VRAI;
+  for (size_t k = 1; k < pool->nb; k++) {
+    Travailleur *victime = &pool->travailleurs[(w->indice + k) % pool->nb];
+    if (file_voler(&victime->file, t)) {
+      atomic_fetch_add(&w->volees, 1);
+      return VRAI;
+    }
+  }
+  return FAUX;
+}
+
+static void epingler(Travailleur *w) {
+#ifdef __linux__
+  cpu_set_t ensemble;
+  CPU_ZERO(&ensemble);
+  CPU_SET(w->indice % pool_nb_coeurs(), &ensemble);
+  pthread_setaffinity_np(w->thread, sizeof(ensemble), &ensemble);
+#else
+  (void) w;
+#endif
+}
+
+static void *boucle_travailleur(void *arg) {
+  Travailleur *w = (Travailleur *) arg;
+  PoolTravailleurs *pool = w->pool;
+  for (;;) {
+    Tache t;
+    if (atomic_load(&pool->en_attente) > 0 && prendre_tache(w, &t)) {
+      atomic_fetch_sub(&pool->en_attente, 1);
+      t.fn(t.arg);
+      atomic_fetch_add(&w->executees, 1);
+      continue;
+    }
+    pthread_mutex_lock(&pool->verrou);
+    while (atomic_load(&pool->en_attente) == 0 && !pool->arret) {
+      pthread_cond_wait(&pool->reveil, &pool->verrou);
+    }
+    Bool fini = pool->arret && atomic_load(&pool->en_attente) == 0;
+    pthread_mutex_unlock(&pool->verrou);
+    if (fini) break;
+  }
+  return NULL;
+}
+
+/* nb = 0 : un travailleur par coeur. En cas d'echec le pool reste vide et
+   pool_soumettre execute les taches sur place. */
+Bool pool_init(PoolTravailleurs *pool, size_t nb) {
+  if (pool == NULL) return FAUX;
+  memset(pool, 0, sizeof(PoolTravailleurs));
+  pthread_mutex_init(&pool->verrou, NULL);
+  pthread_cond_init(&pool->reveil, NULL);
+  if (nb == 0) nb = pool_nb_coeurs();
+
+  pool->travailleurs = calloc(nb, sizeof(Travailleur));
+  if (pool->travailleurs == NULL) return FAUX;
+  for (size_t i = 0; i < nb; i++) {
+    Travailleur *w = &pool->travailleurs[i];
+    w->pool = pool;
+    w->indice = i;
+    pthread_mutex_init(&w->file.verrou, NULL);
+  }
+  for (size_t i = 0; i < nb; i++) {
+    Travailleur *w = &pool->travailleurs[i];
+    if (pthread_create(&w->thread, NULL, boucle_travailleur, w) != 0) break;
+    epingler(w);
+    pool->nb++;
+  }
+  return pool->nb == nb;
+}
+
+Bool pool_soumettre(PoolTravailleurs *pool, FonctionTache fn, void *arg) {
+  if (pool == NULL || fn == NULL) return FAUX;
+  if (pool->nb == 0 || pool->arret) {
+    fn(arg);
+    return VRAI;
+  }
+  size_t i = atomic_fetch_add(&pool->prochain, 1) % pool->nb;
+  Tache t = {fn, arg};
+  atomic_fetch_add(&pool->en_attente, 1);  // compte avant l'empilement : jamais negatif
+  if (!file_empiler(&pool->travailleurs[i].file, t)) {
+    atomic_fetch_sub(&pool->en_attente, 1);
+    return FAUX;
+  }
+  pthread_mutex_lock(&pool->verrou);
+  pthread_cond_signal(&pool->reveil);
+  pthread_mutex_unlock(&pool->verrou);
+  return VRAI;
+}
+
+// Termine les taches deja soumises puis attend les threads
+void pool_arreter(PoolTravailleurs *pool) {
+  if (pool == NULL || pool->travailleurs == NULL) return;
+  pthread_mutex_lock(&pool->verrou);
+  pool->arret = VRAI;
+  pthread_cond_broadcast(&pool->reveil);
+  pthread_mutex_unlock(&pool->verrou);
+  for (size_t i = 0; i < pool->nb; i++) pthread_join(pool->travailleurs[i].thread, NULL);
+  for (size_t i = 0; i < pool->nb; i++) {
+    free(pool->travailleurs[i].file.taches);
+    pthread_mutex_destroy(&pool->travailleurs[i].file.verrou);
+  }
+  free(pool->travailleurs);
+  pool->travailleurs = NULL;
+  pool->nb = 0;
+  pthread_cond_destroy(&pool->reveil);
+  pthread_mutex_destroy(&pool->verrou);
+}
+
+char *pool_stats_json(const PoolTravailleurs *pool) {
+  if (pool == NULL) return NULL;
+  size_t cap = (pool->nb + 1) * 96 + 64;
+  char *json = malloc(cap);
+  if (json == NULL) return NULL;
+  size_t len = 0;
+  len += snprintf(json + len, cap - len, "{ \"travailleurs\": [");
+  for (size_t i = 0; i < pool->nb; i++) {
+    Travailleur *w = &pool->travailleurs[i];
+    len += snprintf(json + len, cap - len, "%s{ \"executees\": %lu, \"volees\": %lu }",
+                    i == 0 ? "" : ", ", atomic_load(&w->executees), atomic_load(&w->volees));
+  }
+  snprintf(json + len, cap - len, "], \"en_attente\": %lu }",
+           (unsigned long) atomic_load(&pool->en_attente));
+  return json;
+}
+
+// --- Requetes identiques partagees ---
+
+void vols_init(VolsPartages *v, const atomic_ulong *generation) {
+  memset(v, 0, sizeof(VolsPartages));
+  pthread_mutex_init(&v->verrou, NULL);
+  v->generation = generation;
+}
+
+// Apres l'arret du pool : plus aucun calcul en cours
+void vols_free(VolsPartages *v) {
+  pthread_mutex_destroy(&v->verrou);
+}
+
+static uint32_t fnv1a(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static int comparer_parametres(const Parametre *a, const Parametre *b) {
+  int d = strcmp(a->cle, b->cle);
+  if (d != 0) return d;
+  size_t n = a->longueur < b->longueur ? a->longueur : b->longueur;
+  d = memcmp(a->valeur, b->valeur, n);
+  return d != 0 ? d : (a->longueur > b->longueur) - (a->longueur < b->longueur);
+}
+
+/* "chemin?a=1&b=2#generation", parametres tries : l'ordre de la query ne
+   change pas la cle. Renvoie 0 si la cle ne tient pas dans cle. */
+static size_t vol_cle(const VolsPartages *v, struct mg_str uri, const Parametres *p, char *cle) {
+  const Parametre *tries[PARAMS_MAX];
+  for (size_t i = 0; i < p->nb; i++) {
+    size_t j = i;
+    for (; j > 0 && comparer_parametres(tries[j - 1], &p->items[i]) > 0; j--) tries[j] = tries[j - 1];
+    tries[j] = &p->items[i];
+  }
+  size_t n = 0, cle_len;
+  if (uri.len >= VOL_CLE) return 0;
+  memcpy(cle, uri.buf, uri.len);
+  n = uri.len;
+  for (size_t i = 0; i < p->nb; i++) {
+    cle_len = strlen(tries[i]->cle);
+    if (n + 1 + cle_len + 1 + tries[i]->longueur >= VOL_CLE) return 0;
+    cle[n++] = i == 0 ? '?' : '&';
+    memcpy(cle + n, tries[i]->cle, cle_len);
+    n += cle_len;
+    cle[n++] = '=';
+    memcpy(cle + n, tries[i]->valeur, tries[i]->longueur);
+    n += tries[i]->longueur;
+  }
+  int ecrit = snprintf(cle + n, VOL_CLE - n, "#%lu", atomic_load(v->generation));
+  if (ecrit < 0 || n + (size_t) ecrit >= VOL_CLE) return 0;
+  return n + (size_t) ecrit;
+}
+
+/* Sur la boucle : VRAI si t a rejoint le calcul en cours de la meme requete
+   (il sera termine par vol_distribuer), FAUX s'il doit calculer lui-meme ;
+   t->vol est alors son calcul, que les suivantes rejoindront. */
+static Bool vol_rejoindre(VolsPartages *v, struct mg_str uri, Travail *t) {
+  char cle[VOL_CLE];
+  size_t longueur = vol_cle(v, uri, &t->params, cle);
+  if (longueur == 0) return FAUX;
+  uint32_t hachage = fnv1a(cle, longueur);
+  Vol **alveole = &v->alveoles[hachage & (VOLS_ALVEOLES - 1)];
+
+  pthread_mutex_lock(&v->verrou);
+  for (Vol *vol = *alveole; vol != NULL; vol = vol->suivant) {
+    if (vol->hachage != hachage || vol->longueur_cle != longueur || memcmp(vol->cle, cle, longueur) != 0) {
+      continue;
+    }
+    if (vol->nb_attente == vol->cap_attente) {
+      size_t cap = vol->cap_attente ? vol->cap_attente * 2 : 8;
+      Travail **tmp = realloc(vol->attente, cap * sizeof(Travail *));
+      if (tmp == NULL) break;  // calcul a part
+      vol->attente = tmp;
+      vol->cap_attente = cap;
+    }
+    vol->attente[vol->nb_attente++] = t;
+    pthread_mutex_unlock(&v->verrou);
+    atomic_fetch_add(&v->partages, 1);
+    return VRAI;
+  }
+  Vol *vol = calloc(1, sizeof(Vol));
+  if (vol != NULL) {
+    vol->table = v;
+    memcpy(vol->cle, cle, longueur);
+    vol->longueur_cle = longueur;
+    vol->hachage = hachage;
+    vol->suivant = *alveole;
+    *alveole = vol;
+    t->vol = vol;
+  }
+  pthread_mutex_unlock(&v->verrou);
+  atomic_fetch_add(&v->calculs, 1);
+  return FAUX;
+}
+
+/* Fin du calcul de t : le vol quitte la table (une requete qui arrive
+   maintenant recalcule) et chaque requete en attente recoit le corps de t,
+   sans copie. */
+static void vol_distribuer(Travail *t) {
+  Vol *vol = t->vol;
+  VolsPartages *v = vol->table;
+  t->vol = NULL;
+  pthread_mutex_lock(&v->verrou);
+  for (Vol **p = &v->alveoles[vol->hachage & (VOLS_ALVEOLES - 1)]; *p != NULL; p = &(*p)->suivant) {
+    if (*p == vol) {
+      *p = vol->suivant;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&v->verrou);
+
+  if (vol->nb_attente > 0) {
+    if (t->corps == NULL) travail_repondre(t, 500, "", "{\"error\": \"Reponse absente\"}\n");
+    CorpsPartage *partage = t->corps != NULL ? malloc(sizeof(CorpsPartage)) : NULL;
+    if (partage != NULL) {
+      atomic_init(&partage->references, (int) vol->nb_attente + 1);
+      partage->corps = t->corps;
+      t->partage = partage;
+    }
+    for (size_t i = 0; i < vol->nb_attente; i++) {
+      Travail *w = vol->attente[i];
+      if (partage != NULL) {
+        w->status = t->status;
+        w->entetes = t->entetes;
+        w->corps = t->corps;
+        w->longueur = t->longueur;
+        w->partage = partage;
+      }
+      travail_terminer(w);  // sans corps : 500
+    }
+    if (partage != NULL) {
+      atomic_fetch_add(&v->octets_evites, (unsigned long) (t->longueur * vol->nb_attente));
+    }
+  }
+  free(vol->attente);
+  free(vol);
+}
+
+char *vols_stats_json(VolsPartages *v) {
+  size_t en_cours = 0, en_attente = 0;
+  pthread_mutex_lock(&v->verrou);
+  for (size_t i = 0; i < VOLS_ALVEOLES; i++) {
+    for (Vol *vol = v->alveoles[i]; vol != NULL; vol = vol->suivant) {
+      en_cours++;
+      en_attente += vol->nb_attente;
+    }
+  }
+  pthread_mutex_unlock(&v->verrou);
+  unsigned long calculs = atomic_load(&v->calculs), partages = atomic_load(&v->partages);
+  return mg_mprintf("{ \"generation\": %lu, \"en_cours\": %lu, \"en_attente\": %lu, "
+                    "\"calculs\": %lu, \"partages\": %lu, \"taux_partage\": %.3f, "
+                    "\"octets_evites\": %lu }",
+                    atomic_load(v->generation), (unsigned long) en_cours, (unsigned long) en_attente,
+                    calculs, partages,
+                    calculs + partages > 0 ? (double) partages / (double) (calculs + partages) : 0.0,
+                    atomic_load(&v->octets_evites));
+}
+
+// --- Pont avec la boucle Mongoose ---
+
+void retours_init(RetoursTravaux *r, struct mg_mgr *mgr) {
+  memset(r, 0, sizeof(RetoursTravaux));
+  pthread_mutex_init(&r->verrou, NULL);
+  r->mgr = mgr;
+}
+
+static void travail_free(Travail *t);
+
+void retours_free(RetoursTravaux *r) {
+  while (r->premier != NULL) {
+    Travail *t = r->premier;
+    r->premier = t->suivant;
+    travail_free(t);
+  }
+  pthread_mutex_destroy(&r->verrou);
+}
+
+// Connexions du serveur : fn_data est leur boucle (voir boucle_compter)
+static RetoursTravaux *retours_de(struct mg_connection *c) {
+  Boucle *boucle = (Boucle *) c->fn_data;
+  return boucle != NULL ? &boucle->retours : NULL;
+}
+
+/* Le travail en cours d'une connexion est range au debut de c->data
+   (Mongoose n'utilise que la fin de ce tableau pour mg_http_serve_file). */
+static Travail *travail_de(struct mg_connection *c) {
+  Travail *t;
+  memcpy(&t, c->data, sizeof(t));
+  return t;
+}
+
+static void travail_attacher(struct mg_connection *c, Travail *t) {
+  memcpy(c->data, &t, sizeof(t));
+}
+
+static void travail_free(Travail *t) {
+  if (t->partage == NULL) {
+    free(t->corps);
+  } else if (atomic_fetch_sub(&t->partage->references, 1) == 1) {
+    free(t->partage->corps);
+    free(t->partage);
+  }
+  free(t);
+}
+
+static const char *raison(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 503: return "Service Unavailable";
+    default: return status >= 500 ? "Internal Server Error" : "OK";
+  }
+}
+
+static void travail_envoyer(struct mg_connection *c, Travail *t) {
+  mg_printf(c, "HTTP/1.1 %d %s\r\n%sContent-Length: %lu\r\n\r\n", t->status, raison(t->status),
+            t->entetes == NULL ? "" : t->entetes, (unsigned long) t->longueur);
+  if (t->longueur > 0) mg_send(c, t->corps, t->longueur);
+  c->is_resp = 0;  // Mongoose peut passer a la requete suivante
+}
+
+static void travail_executer(void *arg) {
+  Travail *t = (Travail *) arg;
+  t->executer(t);
+  if (t->vol != NULL) vol_distribuer(t);
+  travail_terminer(t);
+}
+
+void travail_differer(PoolTravailleurs *pool, VolsPartages *vols, struct mg_connection *c,
+                      struct mg_http_message *hm, TacheRoute executer) {
+  if (travail_de(c) != NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Requete precedente en cours\"}\n");
+    return;
+  }
+  Travail *t = calloc(1, sizeof(Travail));
+  if (t == NULL) {
+    mg_http_reply(c, 503, "", "{\"error\": \"Memoire insuffisante\"}\n");
+    return;
+  }
+  if (!params_decoder(&t->params, hm)) {
+    free(t);
+    mg_http_reply(c, 400, "", "{\"error\": \"Parametres invalides ou trop volumineux\"}\n");
+    return;
+  }
+  t->retours = retours_de(c);
+  t->executer = executer;
+  atomic_init(&t->etat, TRAVAIL_EN_COURS);
+
+  if (pool == NULL || pool->nb == 0 || t->retours == NULL) {
+    // Pas de pool : execution sur place, comme avant
+    t->executer(t);
+    if (t->corps == NULL) travail_repondre(t, 500, "", "{\"error\": \"Reponse absente\"}\n");
+    travail_envoyer(c, t);
+    travail_free(t);
+    return;
+  }
+  t->pool = pool;
+  travail_attacher(c, t);
+  if (vols != NULL && vol_rejoindre(vols, hm->uri, t)) return;  // reponse d'un calcul en cours
+  if (!pool_soumettre(pool, travail_executer, t)) {
+    if (t->vol != NULL) {
+      // Des requetes l'attendent peut-etre deja : reponse par le reveil, comme elles
+      travail_repondre(t, 503, "", "{\"error\": \"File de travail pleine\"}\n");
+      vol_distribuer(t);
+      travail_terminer(t);
+      return;
+    }
+    travail_attacher(c, NULL);
+    free(t);
+    mg_http_reply(c, 503, "", "{\"error\": \"File de travail pleine\"}\n");
+  }
+}
+
+/* Reponse construite hors du pool (client HTTP d'une boucle, par
+   exemple) : la connexion attend que travail_terminer la livre. NULL si une
+   requete y est deja en attente ou sans memoire. */
+Travail *travail_suspendre(struct mg_connection *c) {
+  if (travail_de(c) != NULL) return NULL;
+  RetoursTravaux *retours = retours_de(c);
+  Travail *t = retours != NULL ? calloc(1, sizeof(Travail)) : NULL;
+  if (t == NULL) return NULL;
+  t->retours = retours;
+  atomic_init(&t->etat, TRAVAIL_EN_COURS);
+  travail_attacher(c, t);
+  return t;
+}
+
+// Depuis n'importe quel thread : t n'appartient plus a l'appelant
+void travail_terminer(Travail *t) {
+  if (t->corps == NULL) travail_repondre(t, 500, "", "{\"error\": \"Reponse absente\"}\n");
+
+  int attendu = TRAVAIL_EN_COURS;
+  if (!atomic_compare_exchange_strong(&t->etat, &attendu, TRAVAIL_TERMINE)) {
+    travail_free(t);  // connexion fermee entre-temps
+    return;
+  }
+  // A partir d'ici la boucle possede t : livraison, ou liberation si la connexion est fermee
+  RetoursTravaux *r = t->retours;
+  pthread_mutex_lock(&r->verrou);
+  Bool reveil = r->premier == NULL;
+  t->suivant = r->premier;
+  r->premier = t;
+  pthread_mutex_unlock(&r->verrou);
+  if (reveil) mg_wakeup(r->mgr, r->ecoute, "", 0);  // perdu : rattrape par MG_EV_POLL
+}
+
+void travail_repondre(Travail *t, int status, const char *entetes, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  char *corps = mg_vmprintf(fmt, &ap);
+  va_end(ap);
+  travail_repondre_corps(t, status, entetes, corps, corps != NULL ? strlen(corps) : 0);
+}
+
+// Prend possession de corps (alloue avec malloc)
+void travail_repondre_corps(Travail *t, int status, const char *entetes, char *corps, size_t longueur) {
+  free(t->corps);
+  t->status = status;
+  t->entetes = entetes;
+  t->corps = corps;
+  t->longueur = corps != NULL ? longueur : 0;
+}
+
+/* Un seul parcours des connexions retrouve le destinataire de chaque
+   travail encore attache ; ceux dont la connexion est fermee ont
+   connexion = NULL (travail_abandonner) et sont seulement liberes. */
+void travail_livrer(struct mg_connection *ecoute) {
+  RetoursTravaux *r = retours_de(ecoute);
+  if (r == NULL) return;
+  pthread_mutex_lock(&r->verrou);
+  Travail *liste = r->premier;
+  r->premier = NULL;
+  pthread_mutex_unlock(&r->verrou);
+  if (liste == NULL) return;
+
+  for (struct mg_connection *c = ecoute->mgr->conns; c != NULL; c = c->next) {
+    Travail *t = travail_de(c);
+    if (t != NULL) t->connexion = c;
+  }
+  while (liste != NULL) {
+    Travail *t = liste;
+    liste = t->suivant;
+    struct mg_connection *c = t->connexion;
+    if (c != NULL) {
+      travail_attacher(c, NULL);
+      travail_envoyer(c, t);
+      if (c->recv.len > 0) c->pfn(c, MG_EV_READ, NULL);  // requete suivante deja recue
+    }
+    travail_free(t);
+  }
+}
+
+/* MG_EV_CLOSE : le travailleur libere s'il n'a pas fini ; sinon t est (ou
+   va etre) dans les retours de la boucle, qui le liberera. */
+void travail_abandonner(struct mg_connection *c) {
+  Travail *t = travail_de(c);
+  if (t == NULL) return;
+  travail_attacher(c, NULL);
+  t->connexion = NULL;
+  int attendu = TRAVAIL_EN_COURS;
+  atomic_compare_exchange_strong(&t->etat, &attendu, TRAVAIL_ABANDONNE);
+}
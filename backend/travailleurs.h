@@ -0,0 +1,153 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mongoose.h"
+#include "model.h"
+#include "parametres.h"
+
+typedef void (*FonctionTache)(void *arg);
+
+typedef struct Tache {
+    FonctionTache fn;
+    void *arg;
+} Tache;
+
+/* File propre a un travailleur (anneau protege par un mutex). Le proprietaire
+   depile par la fin (LIFO : donnees encore chaudes en cache), un travailleur
+   inactif vole par le debut (FIFO : les taches les plus anciennes). */
+typedef struct FileTaches {
+    pthread_mutex_t verrou;
+    Tache *taches;
+    size_t debut;
+    size_t nb;
+    size_t cap;
+} FileTaches;
+
+struct PoolTravailleurs;
+
+typedef struct Travailleur {
+    struct PoolTravailleurs *pool;
+    size_t indice;
+    pthread_t thread;
+    FileTaches file;
+    atomic_ulong executees;
+    atomic_ulong volees;        // taches prises dans la file d'un autre
+} Travailleur;
+
+/* Pool de taille fixe, un thread par coeur (epingle sous Linux), partage
+   par toutes les boucles. Les resultats reviennent a la boucle Mongoose de
+   la connexion (RetoursTravaux) : seul le thread de son mg_mgr_poll ecrit
+   dessus. */
+typedef struct PoolTravailleurs {
+    Travailleur *travailleurs;
+    size_t nb;
+    atomic_size_t en_attente;   // taches soumises, pas encore prises
+    atomic_size_t prochain;     // repartition en tourniquet
+    pthread_mutex_t verrou;     // sommeil des travailleurs inactifs
+    pthread_cond_t reveil;
+    Bool arret;
+} PoolTravailleurs;
+
+/* Requete confiee au pool : parametres decodes sur la boucle (hm n'est plus
+   valide ensuite), reponse construite par le travailleur puis envoyee par
+   la boucle quand elle vide ses RetoursTravaux. Une requete suspendue
+   (travail_suspendre) attend de la meme facon une reponse venue d'ailleurs,
+   donnee par travail_terminer. */
+typedef struct Travail Travail;
+typedef void (*TacheRoute)(Travail *t);
+
+/* Travaux termines en attente de leur boucle. N'importe quel thread en
+   ajoute ; la boucle est reveillee (mg_wakeup vers sa socket d'ecoute)
+   seulement quand la liste etait vide. Mongoose jette le datagramme de
+   reveil si le tube est plein : MG_EV_POLL de la socket d'ecoute vide
+   aussi la liste, un reveil perdu ne retarde donc que d'un tour. */
+typedef struct RetoursTravaux {
+    pthread_mutex_t verrou;
+    Travail *premier;           // pile, l'ordre de livraison est indifferent
+    struct mg_mgr *mgr;
+    unsigned long ecoute;       // id de la connexion qui recoit les reveils
+} RetoursTravaux;
+
+enum { TRAVAIL_EN_COURS = 0, TRAVAIL_TERMINE, TRAVAIL_ABANDONNE };
+
+#define VOLS_ALVEOLES 256                     // puissance de 2
+#define VOL_CLE 512
+
+// Corps d'une reponse partage par plusieurs travaux, libere par le dernier
+typedef struct CorpsPartage {
+    atomic_int references;
+    char *corps;
+} CorpsPartage;
+
+struct VolsPartages;
+
+/* Un calcul en cours pour une cle (chemin, parametres tries, generation du
+   catalogue) : les requetes identiques arrivees entre-temps attendent dans
+   attente et recoivent le meme corps. */
+typedef struct Vol {
+    struct VolsPartages *table;
+    char cle[VOL_CLE];
+    size_t longueur_cle;
+    uint32_t hachage;
+    Travail **attente;
+    size_t nb_attente;
+    size_t cap_attente;
+    struct Vol *suivant;
+} Vol;
+
+/* Calculs en cours des routes ROUTE_PARTAGEE. La generation fait partie de
+   la cle : une requete arrivee apres une ecriture du catalogue ne rejoint
+   pas un calcul commence avant. */
+typedef struct VolsPartages {
+    pthread_mutex_t verrou;
+    const atomic_ulong *generation;
+    Vol *alveoles[VOLS_ALVEOLES];
+    atomic_ulong calculs;       // requetes calculees par le pool
+    atomic_ulong partages;      // requetes servies par le calcul d'une autre
+    atomic_ulong octets_evites; // corps non reconstruits
+} VolsPartages;
+
+struct Travail {
+    PoolTravailleurs *pool;
+    RetoursTravaux *retours;    // boucle de la connexion
+    Travail *suivant;           // dans retours, une fois termine
+    struct mg_connection *connexion;  // boucle seulement : destinataire, NULL si fermee
+    TacheRoute executer;
+    atomic_int etat;
+    Parametres params;
+    int status;
+    const char *entetes;
+    char *corps;
+    size_t longueur;
+    Vol *vol;                   // calcul que d'autres requetes attendent, ou NULL
+    CorpsPartage *partage;      // corps commun a d'autres travaux, ou NULL
+};
+
+// --- PROTOTYPES DES FONCTIONS ---
+
+size_t pool_nb_coeurs(void);
+Bool pool_init(PoolTravailleurs *pool, size_t nb);
+Bool pool_soumettre(PoolTravailleurs *pool, FonctionTache fn, void *arg);
+void pool_arreter(PoolTravailleurs *pool);
+char *pool_stats_json(const PoolTravailleurs *pool);
+
+void vols_init(VolsPartages *v, const atomic_ulong *generation);
+void vols_free(VolsPartages *v);
+char *vols_stats_json(VolsPartages *v);
+
+void retours_init(RetoursTravaux *r, struct mg_mgr *mgr);
+// Apres l'arret du pool et la fermeture des connexions
+void retours_free(RetoursTravaux *r);
+
+// vols non NULL : une requete identique deja en cours est partagee
+void travail_differer(PoolTravailleurs *pool, VolsPartages *vols, struct mg_connection *c,
+                      struct mg_http_message *hm, TacheRoute executer);
+Travail *travail_suspendre(struct mg_connection *c);
+void travail_terminer(Travail *t);
+void travail_repondre(Travail *t, int status, const char *entetes, const char *fmt, ...);
+void travail_repondre_corps(Travail *t, int status, const char *entetes, char *corps, size_t longueur);
+// MG_EV_WAKEUP ou MG_EV_POLL de la socket d'ecoute : envoie les reponses terminees
+void travail_livrer(struct mg_connection *ecoute);
+void travail_abandonner(struct mg_connection *c);
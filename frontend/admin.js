@@ -12,6 +12,7 @@ let empruntsExternes = [];
 document.addEventListener('DOMContentLoaded', () => {
     fetch('/api/emprunts_all').then(res => res.ok ? res.json() : []).then(data => { empruntsExternes = data || []; });
     loadLivres();
+    ecouterCatalogue();
 
     // Mise ? jour visuelle du nom de fichier lors de la s?lection
     const fileInput = document.getElementById('form-fichier');
@@ -128,6 +129,7 @@ async function loadLivres() {
             
             const card = document.createElement('div');
             card.className = `admin-card${exists ? '' : ' admin-card--missing'}`;
+            card.dataset.id = l.id;
             card.style.cursor = fileName ? 'pointer' : 'default';
             
             card.innerHTML = `
@@ -176,69 +178,61 @@ async function loadLivres() {
     } catch (e) { console.error("Erreur de chargement de l'index", e); }
 }
 
+// --- MISES À JOUR EN DIRECT (/ws) ---
+// Les emprunts et retours changent seulement le badge ; le reste recharge la liste, une fois par rafale
+let rechargementPrevu = null;
+
+function ecouterCatalogue() {
+    if (!('WebSocket' in window)) return;
+    const ws = new WebSocket(`${location.protocol === 'https:' ? 'wss' : 'ws'}://${location.host}/ws`);
+    ws.onmessage = (ev) => {
+        let msg;
+        try { msg = JSON.parse(ev.data); } catch (e) { return; }
+        if (msg.type === 'bonjour') {
+            const empruntes = new Set(msg.empruntes || []);
+            document.querySelectorAll('.admin-card[data-id]').forEach(card => {
+                marquerStatut(card, empruntes.has(Number(card.dataset.id)));
+            });
+        } else if (msg.type === 'etat') {
+            const card = document.querySelector(`.admin-card[data-id="${msg.id}"]`);
+            if (card) marquerStatut(card, msg.est_emprunte);
+        } else {
+            clearTimeout(rechargementPrevu);
+            rechargementPrevu = setTimeout(loadLivres, 1000);
+        }
+    };
+    ws.onclose = () => setTimeout(ecouterCatalogue, 5000);
+}
+
+function marquerStatut(card, emprunte) {
+    const badge = card.querySelector('.admin-card-status');
+    if (!badge) return;
+    badge.classList.toggle('admin-card-status--busy', emprunte);
+    badge.textContent = emprunte ? 'Emprunte' : 'Disponible';
+}
+
 /**
  * Récupère la liste des fichiers existants sur le serveur
  */
 async function syncFilesFromServer() {
     try {
-        const res = await fetch('/api/pdfs');
-        const files = await res.json();
-        pdfSet = new Set(files.map(f => f.split(/[\/]/).pop()));
+        const noms = new Set();
+        let debut = 0;
+        while (debut != null) {
+            const res = await fetch(`/api/pdfs?debut=${debut}`);
+            const page = await res.json();
+            (page.fichiers || []).forEach(f => noms.add(f.nom));
+            debut = page.suivant;
+        }
+        pdfSet = noms;
     } catch (e) { pdfSet = new Set(); }
 }
 
 async function chargerLivresApiAdmin() {
-    const res = await fetch('https://gutendex.com/books/?mime_type=application/pdf');
+    const res = await fetch('/api/externe');
     if (!res.ok) throw new Error('API indisponible');
     const data = await res.json();
-    return (data.results || []).slice(0, 10).map(normalizeGutendexAdmin);
-}
-
-function pickFormat(formats, prefix) {
-    if (!formats) return '';
-    for (const key in formats) {
-        if (key.startsWith(prefix)) return formats[key];
-    }
-    return '';
-}
-
-function getCategorieDescriptionGutendex(b) {
-    const shelves = Array.isArray(b.bookshelves) ? b.bookshelves : [];
-    const subjects = Array.isArray(b.subjects) ? b.subjects : [];
-    const summaries = Array.isArray(b.summaries) ? b.summaries : [];
-
-    const categorie = shelves[0] || subjects[0] || 'Sans categorie';
-    const description = summaries[0] ||
-        (subjects.length ? subjects.slice(0, 3).join(', ') : 'Description indisponible');
-
-    return { categorie, description };
-}
-
-function normalizeGutendexAdmin(b) {
-    const formats = b.formats || {};
-    const cover = formats['image/jpeg'] || formats['image/png'] || '';
-    const pdf = formats['application/pdf'] || pickFormat(formats, 'application/pdf');
-    const html = pickFormat(formats, 'text/html');
-    const epub = formats['application/epub+zip'] || '';
-    const link = pdf || html || epub || '';
-    const format = pdf ? 'pdf' : (html ? 'html' : (epub ? 'epub' : ''));
-    const auteur = (b.authors && b.authors[0] && b.authors[0].name)
-        ? b.authors[0].name
-        : 'Auteur inconnu';
-    const { categorie, description } = getCategorieDescriptionGutendex(b);
-
-    return {
-        id: b.id,
-        titre: b.title || 'Sans titre',
-        auteur,
-        annee: '',
-        categorie,
-        description,
-        couverture: cover,
-        lien: link,
-        format,
-        source: 'api'
-    };
+    return (data.livres || []).filter(l => l.source === 'api');
 }
 
 
@@ -361,18 +355,59 @@ function ouvrirPleinEcran() {
     window.open(target, '_blank');
 }
 
+/**
+ * SHA-256 du fichier en hexadécimal, ou null si le navigateur ne l'offre
+ * pas (crypto.subtle n'existe qu'en contexte sécurisé).
+ */
+async function empreinteFichier(file) {
+    if (!window.crypto || !crypto.subtle) return null;
+    const brut = new Uint8Array(await crypto.subtle.digest('SHA-256', await file.arrayBuffer()));
+    return Array.from(brut, (o) => o.toString(16).padStart(2, '0')).join('');
+}
+
+/**
+ * Transfert par morceaux : ouverture de la session, morceaux envoyés en
+ * parallèle (PUT), le serveur publie le fichier à la réception du dernier.
+ * Renvoie le nom sous lequel le serveur l'a rangé (son empreinte) ; un
+ * contenu déjà présent n'est pas renvoyé.
+ */
+async function televerser(file, type) {
+    const params = new URLSearchParams({ file: file.name, taille: file.size });
+    if (type) params.append('type', type);
+    const sha256 = await empreinteFichier(file);
+    if (sha256) params.append('sha256', sha256);
+    const ouverture = await fetch(`/api/televersement?${params.toString()}`, { method: 'POST' });
+    if (!ouverture.ok) throw new Error("Transfert refusé par le serveur");
+    const session = await ouverture.json();
+    if (session.publie) return session.publie;
+
+    let suivant = 0;
+    let publie = null;
+    const envoyerMorceaux = async () => {
+        while (suivant < session.morceaux) {
+            const k = suivant++;
+            const res = await fetch(`/api/televersement?id=${session.id}&morceau=${k}`, {
+                method: 'PUT',
+                body: file.slice(k * session.morceau, (k + 1) * session.morceau)
+            });
+            if (!res.ok) throw new Error("Échec du transfert serveur");
+            const payload = await res.json();
+            if (payload.publie) publie = payload.publie;
+        }
+    };
+    await Promise.all([envoyerMorceaux(), envoyerMorceaux(), envoyerMorceaux(), envoyerMorceaux()]);
+    if (!publie) throw new Error("Fichier incomplet côté serveur");
+    return publie;
+}
+
 async function uploadCouvertureSiBesoin() {
     const coverFileInput = document.getElementById('form-couverture-file');
 
     if (coverFileInput && coverFileInput.files && coverFileInput.files.length > 0) {
         const file = coverFileInput.files[0];
-        const uploadRes = await fetch(`/api/upload_couverture?file=${encodeURIComponent(file.name)}`, {
-            method: 'POST',
-            body: await file.arrayBuffer()
-        });
-        if (!uploadRes.ok) throw new Error("Echec du transfert couverture");
+        const nom = await televerser(file, 'couverture');
 
-        return `/api/couverture?fichier=${encodeURIComponent(file.name)}`;
+        return `/api/couverture?fichier=${encodeURIComponent(nom)}`;
     }
 
     return "";
@@ -407,12 +442,7 @@ async function ajouterLivreDemo() {
 
     try {
         // 1. UPLOAD DU PDF (Binaire Pur)
-        const uploadRes = await fetch(`/api/upload?file=${encodeURIComponent(file.name)}`, {
-            method: 'POST',
-            body: await file.arrayBuffer()
-        });
-
-        if (!uploadRes.ok) throw new Error("Échec du transfert serveur");
+        const fichier = await televerser(file);
 
         const coverUrl = await uploadCouvertureSiBesoin();
 
@@ -422,7 +452,7 @@ async function ajouterLivreDemo() {
             auteur: document.getElementById('form-auteur').value,
             annee: document.getElementById('form-annee').value,
             categorie: document.getElementById('form-categorie').value,
-            fichier: file.name,
+            fichier: fichier,
             description: descriptionInput ? descriptionInput.value : ""
         });
         if (coverUrl) params.append('couverture', coverUrl);
@@ -480,12 +510,7 @@ async function modifierLivre() {
         let fichier = "";
         if (fileInput && fileInput.files && fileInput.files.length > 0) {
             const file = fileInput.files[0];
-            const uploadRes = await fetch(`/api/upload?file=${encodeURIComponent(file.name)}`, {
-                method: 'POST',
-                body: await file.arrayBuffer()
-            });
-            if (!uploadRes.ok) throw new Error("Echec du transfert serveur");
-            fichier = file.name;
+            fichier = await televerser(file);
         }
 
         const coverUrl = await uploadCouvertureSiBesoin();
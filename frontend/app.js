@@ -15,6 +15,7 @@ document.addEventListener('DOMContentLoaded', () => {
     // Ne pas charger toute la bibliothèque sur la page des emprunts
     if (!document.body.classList.contains('emprunt-page')) {
         chargerLivres();
+        ecouterCatalogue();
     }
 
     const searchInput = document.getElementById('searchInput');
@@ -96,64 +97,16 @@ async function chargerLivres(query = "", categorie = "") {
     }
 }
 
+// Livres Gutendex, deja normalises et dedoublonnes par le serveur (cache partage)
 async function chargerLivresApi(query = "") {
-    let apiUrl = "https://gutendex.com/books/?mime_type=application/pdf";
+    let apiUrl = "/api/externe";
     if (query) {
-        apiUrl += `&search=${encodeURIComponent(query)}`;
+        apiUrl += `?search=${encodeURIComponent(query)}`;
     }
     const res = await fetch(apiUrl);
     if (!res.ok) throw new Error("Erreur API Gutendex");
     const data = await res.json();
-    return (data.results || []).slice(0, 10).map(normalizeGutendex);
-}
-
-function getCategorieDescriptionGutendex(b) {
-    const shelves = Array.isArray(b.bookshelves) ? b.bookshelves : [];
-    const subjects = Array.isArray(b.subjects) ? b.subjects : [];
-    const summaries = Array.isArray(b.summaries) ? b.summaries : [];
-
-    const categorie = shelves[0] || subjects[0] || "Sans categorie";
-    const description = summaries[0] ||
-        (subjects.length ? subjects.slice(0, 3).join(", ") : "Description indisponible");
-
-    return { categorie, description };
-}
-
-
-function pickFormat(formats, prefix) {
-    if (!formats) return "";
-    for (const key in formats) {
-        if (key.startsWith(prefix)) return formats[key];
-    }
-    return "";
-}
-
-function normalizeGutendex(b) {
-    const formats = b.formats || {};
-    const cover = formats["image/jpeg"] || formats["image/png"] || "";
-    const pdf = formats["application/pdf"] || pickFormat(formats, "application/pdf");
-    const html = pickFormat(formats, "text/html");
-    const epub = formats["application/epub+zip"] || "";
-    const link = pdf || html || epub || "";
-    const format = pdf ? "pdf" : (html ? "html" : (epub ? "epub" : ""));
-    const auteur = (b.authors && b.authors[0] && b.authors[0].name)
-        ? b.authors[0].name
-        : "Auteur inconnu";
-    const { categorie, description } = getCategorieDescriptionGutendex(b);
-
-    return {
-        id: b.id,
-        titre: b.title || "Sans titre",
-        auteur,
-        annee: "",
-        categorie,
-        description,
-        couverture: cover,
-        est_emprunte: false,
-        lien: link,
-        format,
-        source: "api"
-    };
+    return (data.livres || []).filter(l => l.source === "api");
 }
 
 
@@ -161,6 +114,7 @@ function normalizeGutendex(b) {
 function creerCarteLivre(livre) {
     const div = document.createElement('div');
     div.className = "book-card";
+    if (livre.source !== 'api' && livre.id) div.dataset.id = livre.id;
     let icon = "????";
     const cat = (livre.categorie || "").toLowerCase();
     if (cat.includes("hist")) icon = "????";
@@ -296,6 +250,47 @@ function creerCarteLivre(livre) {
     return div;
 }
 }
+// --- MISES À JOUR EN DIRECT (/ws) ---
+// Le serveur pousse chaque changement du catalogue : pas besoin de recharger la page
+let rechargementPrevu = null;
+
+function ecouterCatalogue() {
+    if (!('WebSocket' in window)) return;
+    const ws = new WebSocket(`${location.protocol === 'https:' ? 'wss' : 'ws'}://${location.host}/ws`);
+    ws.onmessage = (ev) => {
+        let msg;
+        try { msg = JSON.parse(ev.data); } catch (e) { return; }
+        if (msg.type === 'bonjour') {
+            // Etat complet à la (re)connexion : les disponibilités affichées peuvent dater
+            const empruntes = new Set(msg.empruntes || []);
+            document.querySelectorAll('.book-card[data-id]').forEach(card => {
+                marquerDisponibilite(card, empruntes.has(Number(card.dataset.id)));
+            });
+        } else if (msg.type === 'etat') {
+            const card = document.querySelector(`.book-card[data-id="${msg.id}"]`);
+            if (card) marquerDisponibilite(card, msg.est_emprunte);
+        } else if (msg.type === 'suppression') {
+            const card = document.querySelector(`.book-card[data-id="${msg.id}"]`);
+            if (card) card.remove();
+        } else if (msg.type === 'modification') {
+            const card = document.querySelector(`.book-card[data-id="${msg.livre.id}"]`);
+            if (card) card.replaceWith(creerCarteLivre(msg.livre));
+        } else if (msg.type === 'ajout' || msg.type === 'import' || msg.type === 'recharge') {
+            // Les nouveaux livres dépendent de la recherche en cours : on relance, une fois par rafale
+            clearTimeout(rechargementPrevu);
+            rechargementPrevu = setTimeout(lancerRecherche, 1000);
+        }
+    };
+    ws.onclose = () => setTimeout(ecouterCatalogue, 5000);
+}
+
+function marquerDisponibilite(card, emprunte) {
+    const cover = card.querySelector('.book-cover');
+    if (cover) cover.classList.toggle('book-cover--unavailable', emprunte);
+    const btn = card.querySelector('.emprunter-btn');
+    if (btn && !document.body.classList.contains('emprunt-page')) btn.disabled = emprunte;
+}
+
 // --- LOGIQUE DES FILTRES ---
 function extraireCategories(livres) {
     const filterContainer = document.getElementById('category-filters');
@@ -3189,7 +3189,10 @@ static int skip_chunk(const char *buf, int len, int *pl, int *dl) {
   while (i < len && is_hex_digit(buf[i])) i++;
   if (i == 0) return -1;                     // Error, no length specified
   if (i > (int) sizeof(int) * 2) return -1;  // Chunk length is too big
-  if (len < i + 1 || buf[i] != '\r' || buf[i + 1] != '\n') return -1;  // Error
+  // Local patch (serveur_biblio): a partially buffered length line is not
+  // an error, wait for more data
+  if (len < i + 2) return 0;
+  if (buf[i] != '\r' || buf[i + 1] != '\n') return -1;  // Error
   n = (int) mg_unhexn(buf, (size_t) i);  // Decode chunk length
   if (n < 0) return -1;                  // Error
   if (n > len - i - 4) return 0;         // Chunk not yet fully buffered
@@ -10682,6 +10685,9 @@ long mg_tls_recv(struct mg_connection *c, void *buf, size_t len) {
     mg_tls_drop_record(c);
     return MG_IO_WAIT;
   }
+  // Local patch (serveur_biblio): the record was decrypted in place in
+  // c->rtls, which may have been reallocated since; recompute the pointer
+  tls->recv.buf = c->rtls.buf + TLS_RECHDR_SIZE + (tls->recv.size - tls->recv.len);
   minlen = len < tls->recv.len ? len : tls->recv.len;
   memmove(buf, tls->recv.buf, minlen);
   tls->recv.buf += minlen;